@@ -154,7 +154,9 @@ sub build_pgprobackup
 		"$currpath/src", 
 		'archive.c',
 		'backup.c',
+		'backup_all.c',
 		'catalog.c',
+		'catalog_sync.c',
 		'configure.c',
 		'data.c',
 		'delete.c',
@@ -179,6 +181,7 @@ sub build_pgprobackup
 		'remote.c',
 		'json.c',
 		'logger.c',
+		'pagemap.c',
 		'parray.c',
 		'pgut.c',
 		'thread.c',
@@ -197,8 +200,6 @@ sub build_pgprobackup
 		$probackup->AddFile("$pgsrc/src/bin/pg_basebackup/walmethods.c");
 	}
 
-	$probackup->AddFile("$pgsrc/src/bin/pg_rewind/datapagemap.c");
-
 	$probackup->AddFile("$pgsrc/src/interfaces/libpq/pthread-win32.c");
 	$probackup->AddFile("$pgsrc/src/timezone/strftime.c");
 
@@ -11,9 +11,69 @@
 #include "pg_probackup.h"
 
 #include <unistd.h>
+#ifndef WIN32
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "receivelog.h"
+#include "streamutil.h"
+#include "utils/thread.h"
+
+/* How long to wait before reconnecting after WAL streaming was broken */
+#define RECEIVE_RECONNECT_SLEEP	5
+
+/*
+ * Request sent by archive-push client to archive daemon. Both sides are
+ * the same binary, so the structure is sent as is.
+ */
+typedef struct
+{
+	uint32		version;		/* PROGRAM_VERSION of the client */
+	uint64		system_id;		/* system identifier of client's cluster */
+	bool		overwrite;
+	char		wal_file_path[MAXPGPATH];	/* absolute path */
+	char		wal_file_name[MAXFNAMELEN];
+} archive_daemon_request;
+
+/*
+ * Files opened by push_wal_file(). They are tracked, so archive daemon's
+ * worker can release them if the push fails with ERROR.
+ */
+typedef struct
+{
+	FILE	   *in;
+	int			out;
+#ifdef HAVE_LIBZ
+	gzFile		gz_out;
+#endif
+	/* temporary file created by the push, empty if there is none */
+	char		part_path[MAXPGPATH];
+} push_wal_state;
+
+typedef struct
+{
+	InstanceConfig *instance;
+	pthread_t	thread;
+	/* worker is running, protected by daemon_mutex */
+	bool		running;
+	/* connection of the client being served, -1 if there is none */
+	int			sock;
+	push_wal_state push;
+} archive_daemon_worker_arg;
+
+#ifndef WIN32
+/* Connections accepted by archive daemon, which wait for a free worker */
+static parray *daemon_queue = NULL;
+static bool daemon_stop = false;
+static pthread_mutex_t daemon_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t daemon_cond = PTHREAD_COND_INITIALIZER;
+#endif
 
 static void push_wal_file(const char *from_path, const char *to_path,
-						  bool is_compress, bool overwrite, int compress_level);
+						  bool is_compress, bool overwrite, int compress_level,
+						  push_wal_state *state);
 static void get_wal_file(const char *from_path, const char *to_path);
 #ifdef HAVE_LIBZ
 static const char *get_gz_error(gzFile gzf, int errnum);
@@ -24,6 +84,25 @@ static void copy_file_attributes(const char *from_path,
 								 fio_location from_location,
 								 const char *to_path, fio_location to_location,
 								 bool unlink_on_error);
+#if PG_VERSION_NUM >= 100000
+static void receive_identify_system(PGconn *conn, InstanceConfig *instance,
+									TimeLineID *tli, XLogRecPtr *xlogpos);
+static XLogRecPtr get_receive_start_lsn(InstanceConfig *instance,
+										TimeLineID tli, XLogRecPtr xlogpos);
+static bool stop_receiving(XLogRecPtr xlogpos, uint32 timeline,
+						   bool segment_finished);
+#endif
+#ifndef WIN32
+static void get_daemon_socket_path(char *path, size_t len,
+								   InstanceConfig *instance,
+								   const char *daemon_socket);
+static void check_daemon_socket(const char *path);
+static void start_daemon_worker(archive_daemon_worker_arg *arg);
+static void *archive_daemon_worker(void *arg);
+static void archive_daemon_worker_cleanup(void *arg);
+static int32 archive_daemon_serve(InstanceConfig *instance, int sock,
+								  push_wal_state *state);
+#endif
 
 /*
  * pg_probackup specific archive command for archive backups
@@ -41,6 +120,7 @@ do_archive_push(InstanceConfig *instance,
 	char		current_dir[MAXPGPATH];
 	uint64		system_id;
 	bool		is_compress = false;
+	push_wal_state state;
 
 	if (wal_file_name == NULL && wal_file_path == NULL)
 		elog(ERROR, "required parameters are not specified: --wal-file-name %%f --wal-file-path %%p");
@@ -85,7 +165,7 @@ do_archive_push(InstanceConfig *instance,
 #endif
 
 	push_wal_file(absolute_wal_file_path, backup_wal_file_path, is_compress,
-				  overwrite, instance->compress_level);
+				  overwrite, instance->compress_level, &state);
 	elog(INFO, "pg_probackup archive-push completed successfully");
 
 	return 0;
@@ -128,13 +208,333 @@ do_archive_get(InstanceConfig *instance,
 	return 0;
 }
 
+/*
+ * pg_probackup specific WAL receiver.
+ * Stream WAL from the server via replication protocol directly into
+ * arclog_path until interrupted. Segment being received is kept with
+ * .partial suffix and renamed when it is finished, so complete segments
+ * look exactly like pushed by archive-push.
+ */
+int
+do_archive_receive(InstanceConfig *instance)
+{
+#if PG_VERSION_NUM < 100000
+	elog(ERROR, "archive-receive command requires PostgreSQL 10 or newer");
+#else
+	int			compress_level = 0;
+
+	if (instance->compress_alg == PGLZ_COMPRESS)
+		elog(ERROR, "pglz compression is not supported");
+
+#ifdef HAVE_LIBZ
+	if (instance->compress_alg == ZLIB_COMPRESS)
+		compress_level = instance->compress_level;
+#endif
+
+	if (!replication_slot)
+		elog(WARNING, "Replication slot is not specified (-S, --slot), "
+			 "WAL segments may be removed by server before they are received");
+
+	/* Create 'archlog_path' directory. Do nothing if it already exists. */
+	fio_mkdir(instance->arclog_path, DIR_PERMISSION, FIO_BACKUP_HOST);
+
+	while (!interrupted)
+	{
+		PGconn	   *conn;
+		StreamCtl	ctl;
+		TimeLineID	tli;
+		XLogRecPtr	xlogpos;
+
+		conn = pgut_connect_replication(instance->conn_opt.pghost,
+										instance->conn_opt.pgport,
+										instance->conn_opt.pgdatabase,
+										instance->conn_opt.pguser);
+
+		receive_identify_system(conn, instance, &tli, &xlogpos);
+
+#if PG_VERSION_NUM >= 110000
+		if (!RetrieveWalSegSize(conn))
+			elog(ERROR, "Failed to retrieve wal_segment_size");
+#endif
+
+		MemSet(&ctl, 0, sizeof(ctl));
+
+		ctl.startpos = get_receive_start_lsn(instance, tli, xlogpos);
+		ctl.timeline = tli;
+		ctl.sysidentifier = NULL;
+		ctl.walmethod = CreateWalDirectoryMethod(instance->arclog_path,
+												 compress_level, true);
+		ctl.replication_slot = replication_slot;
+		ctl.stop_socket = PGINVALID_SOCKET;
+		ctl.stream_stop = stop_receiving;
+		ctl.standby_message_timeout = 10 * 1000;	/* 10 sec */
+		ctl.partial_suffix = ".partial";
+		ctl.synchronous = false;
+		ctl.mark_done = false;
+
+		elog(INFO, "Started receiving WAL at %X/%X (timeline %u) into \"%s\"",
+			 (uint32) (ctl.startpos >> 32), (uint32) ctl.startpos, tli,
+			 instance->arclog_path);
+
+		if (!ReceiveXlogStream(conn, &ctl))
+			elog(WARNING, "Problem in receivexlog");
+
+		if (!ctl.walmethod->finish())
+			elog(ERROR, "Could not finish writing WAL files: %s",
+				 strerror(errno));
+
+		FreeWalDirectoryMethod();
+		PQfinish(conn);
+
+		if (interrupted)
+			break;
+
+		elog(WARNING, "WAL streaming was interrupted, reconnecting in %d seconds",
+			 RECEIVE_RECONNECT_SLEEP);
+		sleep(RECEIVE_RECONNECT_SLEEP);
+	}
+
+	elog(INFO, "pg_probackup archive-receive completed successfully");
+#endif
+
+	return 0;
+}
+
+/*
+ * archive-push client of archive daemon.
+ * Pass WAL segment to the daemon, serving the instance, and wait until it
+ * is pushed into the archive. Neither instance configuration nor
+ * connection to backup host are needed here, daemon has them all.
+ */
+int
+do_archive_push_via_daemon(InstanceConfig *instance, char *wal_file_path,
+						   char *wal_file_name, bool overwrite,
+						   const char *daemon_socket)
+{
+#ifdef WIN32
+	elog(ERROR, "Archive daemon is not supported on Windows");
+#else
+	archive_daemon_request request;
+	struct sockaddr_un addr;
+	char		current_dir[MAXPGPATH];
+	int			sock;
+	int32		result;
+
+	if (wal_file_name == NULL && wal_file_path == NULL)
+		elog(ERROR, "required parameters are not specified: --wal-file-name %%f --wal-file-path %%p");
+
+	if (wal_file_name == NULL)
+		elog(ERROR, "required parameter not specified: --wal-file-name %%f");
+
+	if (wal_file_path == NULL)
+		elog(ERROR, "required parameter not specified: --wal-file-path %%p");
+
+	canonicalize_path(wal_file_path);
+
+	if (!getcwd(current_dir, sizeof(current_dir)))
+		elog(ERROR, "getcwd() error");
+
+	MemSet(&request, 0, sizeof(request));
+	request.version = parse_program_version(PROGRAM_VERSION);
+	/* Daemon verifies it against the instance */
+	request.system_id = get_system_identifier(current_dir);
+	request.overwrite = overwrite;
+	join_path_components(request.wal_file_path, current_dir, wal_file_path);
+	strlcpy(request.wal_file_name, wal_file_name, sizeof(request.wal_file_name));
+
+	MemSet(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	get_daemon_socket_path(addr.sun_path, sizeof(addr.sun_path), instance,
+						   daemon_socket);
+
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0)
+		elog(ERROR, "Cannot create socket: %s", strerror(errno));
+
+	if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+		elog(ERROR, "Cannot connect to archive daemon at \"%s\": %s",
+			 addr.sun_path, strerror(errno));
+
+	if (write(sock, &request, sizeof(request)) != sizeof(request))
+		elog(ERROR, "Cannot send request to archive daemon: %s",
+			 strerror(errno));
+
+	/* Reply is sent after the segment is safely in the archive */
+	if (read(sock, &result, sizeof(result)) != sizeof(result))
+		elog(ERROR, "Archive daemon closed connection unexpectedly");
+
+	close(sock);
+
+	if (result != 0)
+		elog(ERROR, "Archive daemon failed to push WAL segment \"%s\", "
+			 "see its log for details", wal_file_name);
+
+	elog(INFO, "pg_probackup archive-push completed successfully");
+#endif
+
+	return 0;
+}
+
+/*
+ * pg_probackup specific archive daemon.
+ * Listen on UNIX socket and push WAL segments, passed by
+ * 'archive-push --via-daemon' clients, into arclog_path. Instance
+ * configuration, SSH connection to backup host and everything else is set
+ * up once, so the cost of pushing a segment is about the cost of copying it.
+ * Segments are pushed concurrently by num_threads workers, each of them
+ * keeps its own connection to backup host. Worker, which failed to push a
+ * segment, fails the request, releases its resources and is restarted.
+ */
+int
+do_archive_daemon(InstanceConfig *instance, const char *daemon_socket)
+{
+#ifdef WIN32
+	elog(ERROR, "Archive daemon is not supported on Windows");
+#else
+	struct sockaddr_un addr;
+	int			listen_sock;
+	uint64		system_id;
+	archive_daemon_worker_arg *workers;
+	int			i;
+
+	if (instance->pgdata == NULL)
+		elog(ERROR, "required parameter not specified: PGDATA "
+			 "(-D, --pgdata)");
+
+	if (instance->compress_alg == PGLZ_COMPRESS)
+		elog(ERROR, "pglz compression is not supported");
+
+	system_id = get_system_identifier(instance->pgdata);
+	if (system_id != instance->system_identifier)
+		elog(ERROR, "Refuse to start archive daemon. Instance parameters mismatch."
+					"Instance '%s' should have SYSTEM_ID = " UINT64_FORMAT " instead of " UINT64_FORMAT,
+			 instance->name, instance->system_identifier, system_id);
+
+	/* Create 'archlog_path' directory. Do nothing if it already exists. */
+	fio_mkdir(instance->arclog_path, DIR_PERMISSION, FIO_BACKUP_HOST);
+
+	MemSet(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	get_daemon_socket_path(addr.sun_path, sizeof(addr.sun_path), instance,
+						   daemon_socket);
+
+	/* Refuse to steal the socket of running daemon */
+	check_daemon_socket(addr.sun_path);
+
+	listen_sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_sock < 0)
+		elog(ERROR, "Cannot create socket: %s", strerror(errno));
+
+	if (bind(listen_sock, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+		elog(ERROR, "Cannot bind socket \"%s\": %s", addr.sun_path,
+			 strerror(errno));
+
+	/* Only the owner of the instance is allowed to push WAL */
+	if (chmod(addr.sun_path, S_IRUSR | S_IWUSR) < 0)
+		elog(ERROR, "Cannot change mode of socket \"%s\": %s", addr.sun_path,
+			 strerror(errno));
+
+	if (listen(listen_sock, 5) < 0)
+		elog(ERROR, "Cannot listen on socket \"%s\": %s", addr.sun_path,
+			 strerror(errno));
+
+	daemon_queue = parray_new();
+
+	workers = (archive_daemon_worker_arg *)
+		palloc(sizeof(archive_daemon_worker_arg) * num_threads);
+	for (i = 0; i < num_threads; i++)
+	{
+		workers[i].instance = instance;
+		workers[i].running = false;
+		workers[i].sock = -1;
+		start_daemon_worker(&workers[i]);
+	}
+
+	elog(INFO, "pg_probackup archive-daemon is listening on \"%s\"",
+		 addr.sun_path);
+
+	while (!interrupted)
+	{
+		struct timeval timeout;
+		fd_set		rset;
+		int			sock;
+		int			rc;
+
+		/* Wake up every second to check for interrupt */
+		FD_ZERO(&rset);
+		FD_SET(listen_sock, &rset);
+		timeout.tv_sec = 1;
+		timeout.tv_usec = 0;
+
+		rc = select(listen_sock + 1, &rset, NULL, NULL, &timeout);
+		if (rc < 0 && errno != EINTR)
+			elog(ERROR, "select() failed: %s", strerror(errno));
+
+		/* Restart workers, which exited with ERROR */
+		for (i = 0; i < num_threads; i++)
+		{
+			bool		running;
+
+			pthread_mutex_lock(&daemon_mutex);
+			running = workers[i].running;
+			pthread_mutex_unlock(&daemon_mutex);
+
+			if (running)
+				continue;
+
+			pthread_join(workers[i].thread, NULL);
+			/* Error in the worker should not affect the following requests */
+			thread_interrupted = false;
+			start_daemon_worker(&workers[i]);
+		}
+
+		if (rc <= 0)
+			continue;
+
+		sock = accept(listen_sock, NULL, NULL);
+		if (sock < 0)
+		{
+			elog(WARNING, "Cannot accept connection: %s", strerror(errno));
+			continue;
+		}
+
+		pthread_mutex_lock(&daemon_mutex);
+		parray_append(daemon_queue, (void *) (intptr_t) sock);
+		pthread_cond_signal(&daemon_cond);
+		pthread_mutex_unlock(&daemon_mutex);
+	}
+
+	close(listen_sock);
+	unlink(addr.sun_path);
+
+	/* Let workers finish the requests being served */
+	pthread_mutex_lock(&daemon_mutex);
+	daemon_stop = true;
+	pthread_cond_broadcast(&daemon_cond);
+	pthread_mutex_unlock(&daemon_mutex);
+
+	for (i = 0; i < num_threads; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	/* Clients, which were not served, get an error and retry */
+	for (i = 0; i < parray_num(daemon_queue); i++)
+		close((int) (intptr_t) parray_get(daemon_queue, i));
+	parray_free(daemon_queue);
+	pfree(workers);
+
+	elog(INFO, "pg_probackup archive-daemon completed successfully");
+#endif
+
+	return 0;
+}
+
 /* ------------- INTERNAL FUNCTIONS ---------- */
 /*
  * Copy WAL segment from pgdata to archive catalog with possible compression.
  */
 void
 push_wal_file(const char *from_path, const char *to_path, bool is_compress,
-			  bool overwrite, int compress_level)
+			  bool overwrite, int compress_level, push_wal_state *state)
 {
 	FILE	   *in = NULL;
 	int			out = -1;
@@ -161,18 +561,30 @@ push_wal_file(const char *from_path, const char *to_path, bool is_compress,
 #endif
 		to_path_p = to_path;
 
+	state->in = NULL;
+	state->out = -1;
+#ifdef HAVE_LIBZ
+	state->gz_out = NULL;
+#endif
+	state->part_path[0] = '\0';
+
 	/* open file for read */
 	in = fio_fopen(from_path, PG_BINARY_R, FIO_DB_HOST);
 	if (in == NULL)
 		elog(ERROR, "Cannot open source WAL file \"%s\": %s", from_path,
 			 strerror(errno));
+	state->in = in;
 
 	/* Check if possible to skip copying */
 	if (fileExists(to_path_p, FIO_BACKUP_HOST))
 	{
+		/* Do not copy and do not rise error. Just quit as normal. */
 		if (fileEqualCRC(from_path, to_path_p, is_compress))
+		{
+			fio_fclose(in);
+			state->in = NULL;
 			return;
-			/* Do not copy and do not rise error. Just quit as normal. */
+		}
 		else if (!overwrite)
 			elog(ERROR, "WAL segment \"%s\" already exists.", to_path_p);
 	}
@@ -190,6 +602,11 @@ push_wal_file(const char *from_path, const char *to_path, bool is_compress,
 			elog(WARNING, "Cannot open destination temporary WAL file \"%s\": %s",
 				 to_path_temp, strerror(errno));
 		}
+		else
+		{
+			state->gz_out = gz_out;
+			strlcpy(state->part_path, to_path_temp, sizeof(state->part_path));
+		}
 	}
 	else
 #endif
@@ -203,6 +620,11 @@ push_wal_file(const char *from_path, const char *to_path, bool is_compress,
 			elog(WARNING, "Cannot open destination temporary WAL file \"%s\": %s",
 				 to_path_temp, strerror(errno));
 		}
+		else
+		{
+			state->out = out;
+			strlcpy(state->part_path, to_path_temp, sizeof(state->part_path));
+		}
 	}
 
 	/* Partial file is already exists, it could have happened due to failed archive-push,
@@ -250,6 +672,7 @@ push_wal_file(const char *from_path, const char *to_path, bool is_compress,
 			if (gz_out == NULL)
 				elog(ERROR, "Cannot open destination temporary WAL file \"%s\": %s",
 					to_path_temp, strerror(errno));
+			state->gz_out = gz_out;
 		}
 		else
 #endif
@@ -258,7 +681,9 @@ push_wal_file(const char *from_path, const char *to_path, bool is_compress,
 			if (out < 0)
 				elog(ERROR, "Cannot open destination temporary WAL file \"%s\": %s",
 					to_path_temp, strerror(errno));
+			state->out = out;
 		}
+		strlcpy(state->part_path, to_path_temp, sizeof(state->part_path));
 	}
 
 	/* copy content */
@@ -310,6 +735,7 @@ push_wal_file(const char *from_path, const char *to_path, bool is_compress,
 #ifdef HAVE_LIBZ
 	if (is_compress)
 	{
+		state->gz_out = NULL;
 		if (fio_gzclose(gz_out) != 0)
 		{
 			errno_temp = errno;
@@ -321,7 +747,9 @@ push_wal_file(const char *from_path, const char *to_path, bool is_compress,
 	else
 #endif
 	{
-		if (fio_flush(out) != 0 || fio_close(out) != 0)
+		/* File is synced by fio_durable_rename() */
+		state->out = -1;
+		if (fio_close(out) != 0)
 		{
 			errno_temp = errno;
 			fio_unlink(to_path_temp, FIO_BACKUP_HOST);
@@ -330,6 +758,7 @@ push_wal_file(const char *from_path, const char *to_path, bool is_compress,
 		}
 	}
 
+	state->in = NULL;
 	if (fio_fclose(in))
 	{
 		errno_temp = errno;
@@ -341,13 +770,18 @@ push_wal_file(const char *from_path, const char *to_path, bool is_compress,
 	/* update file permission. */
 	copy_file_attributes(from_path, FIO_DB_HOST, to_path_temp, FIO_BACKUP_HOST, true);
 
-	if (fio_rename(to_path_temp, to_path_p, FIO_BACKUP_HOST) < 0)
+	/*
+	 * PostgreSQL removes the segment as soon as archive_command succeeds,
+	 * so it must survive a crash of the backup host after that.
+	 */
+	if (fio_durable_rename(to_path_temp, to_path_p, FIO_BACKUP_HOST) < 0)
 	{
 		errno_temp = errno;
 		fio_unlink(to_path_temp, FIO_BACKUP_HOST);
 		elog(ERROR, "Cannot rename WAL file \"%s\" to \"%s\": %s",
 			 to_path_temp, to_path_p, strerror(errno_temp));
 	}
+	state->part_path[0] = '\0';
 
 #ifdef HAVE_LIBZ
 	if (is_compress)
@@ -627,3 +1061,372 @@ copy_file_attributes(const char *from_path, fio_location from_location,
 			 to_path, strerror(errno));
 	}
 }
+
+#if PG_VERSION_NUM >= 100000
+/*
+ * Run IDENTIFY_SYSTEM through replication connection, check that it
+ * belongs to the instance and get current timeline and WAL position.
+ */
+static void
+receive_identify_system(PGconn *conn, InstanceConfig *instance,
+						TimeLineID *tli, XLogRecPtr *xlogpos)
+{
+	PGresult   *res;
+	uint64		system_id;
+	uint32		hi,
+				lo;
+
+	if (!CheckServerVersionForStreaming(conn))
+	{
+		PQfinish(conn);
+		elog(ERROR, "Cannot receive WAL because stream connect has failed.");
+	}
+
+	res = pgut_execute(conn, "IDENTIFY_SYSTEM", 0, NULL);
+
+	if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) != 1)
+		elog(ERROR, "Could not send replication command \"%s\": %s",
+			 "IDENTIFY_SYSTEM", PQerrorMessage(conn));
+
+	if (!parse_uint64(PQgetvalue(res, 0, 0), &system_id, 0))
+		elog(ERROR, "%s is not system_identifier", PQgetvalue(res, 0, 0));
+
+	if (system_id != instance->system_identifier)
+		elog(ERROR, "Refuse to receive WAL into archive. Instance parameters mismatch."
+					"Instance '%s' should have SYSTEM_ID = " UINT64_FORMAT " instead of " UINT64_FORMAT,
+			 instance->name, instance->system_identifier, system_id);
+
+	*tli = atoi(PQgetvalue(res, 0, 1));
+
+	if (sscanf(PQgetvalue(res, 0, 2), "%X/%X", &hi, &lo) != 2)
+		elog(ERROR, "Could not parse write-ahead log location \"%s\"",
+			 PQgetvalue(res, 0, 2));
+	*xlogpos = ((uint64) hi) << 32 | lo;
+
+	PQclear(res);
+}
+
+/*
+ * Find position to start streaming from: the beginning of the segment,
+ * following the last complete segment of the timeline in the archive.
+ * If the archive has no segments of this timeline, start from the segment
+ * containing current server position.
+ * Leftovers of previous partially received segment are removed, because it
+ * is received again from its beginning.
+ */
+static XLogRecPtr
+get_receive_start_lsn(InstanceConfig *instance, TimeLineID tli,
+					  XLogRecPtr xlogpos)
+{
+	DIR		   *dir;
+	struct dirent *de;
+	XLogSegNo	start_segno;
+	bool		found = false;
+	XLogRecPtr	startpos;
+	char		wal_name[MAXFNAMELEN];
+	int			i;
+
+	GetXLogSegNo(xlogpos, start_segno, instance->xlog_seg_size);
+
+	dir = fio_opendir(instance->arclog_path, FIO_BACKUP_HOST);
+	if (dir == NULL)
+		elog(ERROR, "Cannot open directory \"%s\": %s",
+			 instance->arclog_path, strerror(errno));
+
+	while ((de = fio_readdir(dir)) != NULL)
+	{
+		TimeLineID	seg_tli;
+		XLogSegNo	segno;
+
+		/* Consider only complete segments, either compressed or not */
+		if (!IsXLogFileName(de->d_name) && !IsCompressedXLogFileName(de->d_name))
+			continue;
+
+		strlcpy(wal_name, de->d_name, XLOG_FNAME_LEN + 1);
+		GetXLogFromFileName(wal_name, &seg_tli, &segno, instance->xlog_seg_size);
+
+		if (seg_tli != tli)
+			continue;
+
+		if (!found || segno + 1 > start_segno)
+			start_segno = segno + 1;
+		found = true;
+	}
+	fio_closedir(dir);
+
+	GetXLogFileName(wal_name, tli, start_segno, instance->xlog_seg_size);
+
+	for (i = 0; i < 2; i++)
+	{
+		char		partial_path[MAXPGPATH];
+
+		snprintf(partial_path, sizeof(partial_path), "%s/%s%s.partial",
+				 instance->arclog_path, wal_name, i == 0 ? "" : ".gz");
+
+		if (fio_access(partial_path, F_OK, FIO_BACKUP_HOST) == 0)
+		{
+			elog(LOG, "Removing partial WAL file \"%s\"", partial_path);
+			fio_unlink(partial_path, FIO_BACKUP_HOST);
+		}
+	}
+
+	GetXLogRecPtr(start_segno, 0, instance->xlog_seg_size, startpos);
+
+	return startpos;
+}
+
+/*
+ * WAL is received until interrupted.
+ */
+static bool
+stop_receiving(XLogRecPtr xlogpos, uint32 timeline, bool segment_finished)
+{
+	if (segment_finished)
+		elog(VERBOSE, "Finished segment at %X/%X (timeline %u)",
+			 (uint32) (xlogpos >> 32), (uint32) xlogpos, timeline);
+
+	return interrupted;
+}
+#endif
+
+#ifndef WIN32
+/*
+ * Get path to the socket of archive daemon, serving the instance.
+ * It is placed in /tmp by default, like PostgreSQL sockets are.
+ */
+static void
+get_daemon_socket_path(char *path, size_t len, InstanceConfig *instance,
+					   const char *daemon_socket)
+{
+	if (daemon_socket)
+	{
+		if (!is_absolute_path(daemon_socket))
+			elog(ERROR, "--daemon-socket must be an absolute path");
+		if (strlen(daemon_socket) >= len)
+			elog(ERROR, "Socket path \"%s\" is too long", daemon_socket);
+		strlcpy(path, daemon_socket, len);
+	}
+	else if (snprintf(path, len, "/tmp/.s.pg_probackup.%s",
+					  instance->name) >= (int) len)
+		elog(ERROR, "Instance name '%s' is too long for socket path, "
+			 "use --daemon-socket option", instance->name);
+}
+
+/*
+ * Check that socket of archive daemon is not used by another daemon.
+ * Socket file left by a daemon, which was not stopped properly, is removed.
+ */
+static void
+check_daemon_socket(const char *path)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	int			sock;
+
+	if (lstat(path, &st) < 0)
+	{
+		if (errno == ENOENT)
+			return;
+		elog(ERROR, "Cannot stat socket \"%s\": %s", path, strerror(errno));
+	}
+
+	if (!S_ISSOCK(st.st_mode))
+		elog(ERROR, "File \"%s\" already exists and it is not a socket", path);
+
+	MemSet(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0)
+		elog(ERROR, "Cannot create socket: %s", strerror(errno));
+
+	if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) == 0)
+	{
+		close(sock);
+		elog(ERROR, "Archive daemon is already running on socket \"%s\"",
+			 path);
+	}
+	if (errno != ECONNREFUSED && errno != ENOENT)
+		elog(ERROR, "Cannot connect to socket \"%s\": %s", path,
+			 strerror(errno));
+	close(sock);
+
+	elog(WARNING, "Removing stale socket \"%s\"", path);
+	if (unlink(path) < 0 && errno != ENOENT)
+		elog(ERROR, "Cannot remove socket \"%s\": %s", path, strerror(errno));
+}
+
+static void
+start_daemon_worker(archive_daemon_worker_arg *arg)
+{
+	arg->push.in = NULL;
+	arg->push.out = -1;
+#ifdef HAVE_LIBZ
+	arg->push.gz_out = NULL;
+#endif
+	arg->push.part_path[0] = '\0';
+
+	pthread_mutex_lock(&daemon_mutex);
+	arg->running = true;
+	pthread_mutex_unlock(&daemon_mutex);
+
+	if (pthread_create(&arg->thread, NULL, archive_daemon_worker, arg) != 0)
+		elog(ERROR, "Cannot create thread: %s", strerror(errno));
+}
+
+/*
+ * Worker of archive daemon. It serves clients one by one, using the same
+ * connection to backup host, until the daemon is stopped.
+ */
+static void *
+archive_daemon_worker(void *arg)
+{
+	archive_daemon_worker_arg *worker_arg = (archive_daemon_worker_arg *) arg;
+
+	/* Release resources if the worker exits with ERROR */
+	pthread_cleanup_push(archive_daemon_worker_cleanup, worker_arg);
+
+	for (;;)
+	{
+		int32		result;
+
+		pthread_mutex_lock(&daemon_mutex);
+		while (parray_num(daemon_queue) == 0 && !daemon_stop)
+			pthread_cond_wait(&daemon_cond, &daemon_mutex);
+		if (daemon_stop)
+		{
+			pthread_mutex_unlock(&daemon_mutex);
+			break;
+		}
+		worker_arg->sock = (int) (intptr_t) parray_remove(daemon_queue, 0);
+		pthread_mutex_unlock(&daemon_mutex);
+
+		result = archive_daemon_serve(worker_arg->instance, worker_arg->sock,
+									  &worker_arg->push);
+
+		if (write(worker_arg->sock, &result, sizeof(result)) != sizeof(result))
+			elog(WARNING, "Cannot send reply to archive-push client: %s",
+				 strerror(errno));
+		close(worker_arg->sock);
+		worker_arg->sock = -1;
+	}
+
+	/* Daemon is stopped, release the connection */
+	pthread_cleanup_pop(1);
+
+	return NULL;
+}
+
+/*
+ * Called when archive daemon's worker exits, either because the daemon is
+ * stopped or because of ERROR. Only local resources are released here,
+ * as connection to backup host may be broken.
+ */
+static void
+archive_daemon_worker_cleanup(void *arg)
+{
+	archive_daemon_worker_arg *worker_arg = (archive_daemon_worker_arg *) arg;
+	push_wal_state *state = &worker_arg->push;
+
+	/* Source WAL file is always local to the daemon */
+	if (state->in)
+		fio_fclose(state->in);
+
+	/*
+	 * Remote temporary file is left behind, it is considered stale and
+	 * reused when the segment is pushed again.
+	 */
+	if (!IsSshProtocol())
+	{
+#ifdef HAVE_LIBZ
+		if (state->gz_out)
+			fio_gzclose(state->gz_out);
+#endif
+		if (state->out >= 0)
+			fio_close(state->out);
+		if (state->part_path[0] != '\0')
+			fio_unlink(state->part_path, FIO_BACKUP_HOST);
+	}
+
+	/* Client of the failed push gets the error */
+	if (worker_arg->sock >= 0)
+	{
+		int32		result = 1;
+
+		if (write(worker_arg->sock, &result, sizeof(result)) != sizeof(result))
+			elog(WARNING, "Cannot send reply to archive-push client: %s",
+				 strerror(errno));
+		close(worker_arg->sock);
+		worker_arg->sock = -1;
+	}
+
+	fio_disconnect();
+
+	pthread_mutex_lock(&daemon_mutex);
+	worker_arg->running = false;
+	pthread_mutex_unlock(&daemon_mutex);
+}
+
+/*
+ * Read request of archive-push client and push WAL segment on its behalf.
+ * Returns 0 if the segment is pushed, 1 otherwise.
+ */
+static int32
+archive_daemon_serve(InstanceConfig *instance, int sock, push_wal_state *state)
+{
+	archive_daemon_request request;
+	char		backup_wal_file_path[MAXPGPATH];
+	bool		is_compress = false;
+
+	if (read(sock, &request, sizeof(request)) != sizeof(request))
+	{
+		elog(WARNING, "Cannot read request from archive-push client");
+		return 1;
+	}
+
+	/* Make sure strings are terminated whatever client has sent */
+	request.wal_file_path[MAXPGPATH - 1] = '\0';
+	request.wal_file_name[MAXFNAMELEN - 1] = '\0';
+
+	if (request.version != parse_program_version(PROGRAM_VERSION))
+	{
+		elog(WARNING, "Refuse to push WAL segment %s, archive-push client "
+			 "version differs from %s", request.wal_file_name,
+			 PROGRAM_VERSION);
+		return 1;
+	}
+	if (request.system_id != instance->system_identifier)
+	{
+		elog(WARNING, "Refuse to push WAL segment %s into archive. Instance parameters mismatch."
+					"Instance '%s' should have SYSTEM_ID = " UINT64_FORMAT " instead of " UINT64_FORMAT,
+			 request.wal_file_name, instance->name,
+			 instance->system_identifier, request.system_id);
+		return 1;
+	}
+	if (!is_absolute_path(request.wal_file_path) ||
+		first_dir_separator(request.wal_file_name) != NULL)
+	{
+		elog(WARNING, "Refuse to push WAL segment, invalid request");
+		return 1;
+	}
+
+	join_path_components(backup_wal_file_path, instance->arclog_path,
+						 request.wal_file_name);
+
+	elog(INFO, "pg_probackup archive-push from %s to %s",
+		 request.wal_file_path, backup_wal_file_path);
+
+#ifdef HAVE_LIBZ
+	if (instance->compress_alg == ZLIB_COMPRESS)
+		is_compress = IsXLogFileName(request.wal_file_name);
+#endif
+
+	push_wal_file(request.wal_file_path, backup_wal_file_path, is_compress,
+				  request.overwrite, instance->compress_level, state);
+
+	elog(INFO, "pg_probackup archive-push completed successfully");
+
+	return 0;
+}
+#endif
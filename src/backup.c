@@ -25,6 +25,18 @@
 #include "utils/thread.h"
 #include "utils/file.h"
 
+#include "storage/fsm_internals.h"
+
+#ifdef WIN32
+#define __thread __declspec(thread)
+#endif
+
+/* Depth of free space map tree, as freespace.c defines it */
+#define FSM_TREE_DEPTH	((SlotsPerFSMPage >= 1626) ? 3 : 4)
+
+/* Number of bytes of visibility map page used for the map itself */
+#define VM_MAPSIZE		(BLCKSZ - MAXALIGN(SizeOfPageHeaderData))
+
 static int	standby_message_timeout = 10 * 1000;	/* 10 sec = default */
 static XLogRecPtr stop_backup_lsn = InvalidXLogRecPtr;
 static XLogRecPtr stop_stream_lsn = InvalidXLogRecPtr;
@@ -42,9 +54,54 @@ const char *progname = "pg_probackup";
 /* list of files contained in backup */
 static parray *backup_files_list = NULL;
 
-/* We need critical section for datapagemap_add() in case of using threads */
+/* We need critical section for pagemap_add() in case of using threads */
 static pthread_mutex_t backup_pagemap_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Pagemaps of files changed in already archived WAL. PAGE backup reads this
+ * WAL while pg_start_backup() waits for checkpoint, when the list of files
+ * is not known yet. Sorted by path.
+ */
+static parray *pending_pagemaps = NULL;
+/* Pagemap is built from WAL up to this LSN before list of files is known */
+static XLogRecPtr pending_pagemaps_lsn = InvalidXLogRecPtr;
+
+/*
+ * Number of main fork blocks covered by a page of visibility map. The map
+ * keeps two bits per block since 9.6 and one bit before.
+ */
+static BlockNumber vm_blocks_per_page = VM_MAPSIZE * 4;
+
+/*
+ * Pages of visibility map and free space map marked for the last changed
+ * block of the main fork. Blocks changed one after another are usually
+ * covered by the same pages, so there is no need to look for them again.
+ */
+static __thread RelFileNode last_rnode;
+static __thread BlockNumber last_vm_block = InvalidBlockNumber;
+static __thread BlockNumber last_fsm_block = InvalidBlockNumber;
+
+/*
+ * Database directories of the backup on stripe paths. Data files are placed
+ * round-robin into the backup directory and these ones, and are linked from
+ * the backup directory.
+ */
+static parray *stripe_dirs = NULL;
+static pg_atomic_uint32 stripe_counter;
+
+/*
+ * Standbys to read data files from along with the source. Each of them must
+ * replay WAL up to START LSN before its files are read.
+ */
+typedef struct
+{
+	char	   *host;
+	char	   *port;
+	PGconn	   *conn;
+} StandbySource;
+
+static parray *standby_sources = NULL;
+
 /*
  * We need to wait end of WAL streaming before execute pg_stop_backup().
  */
@@ -70,6 +127,8 @@ bool exclusive_backup = false;
 
 /* Is pg_start_backup() was executed */
 static bool backup_in_progress = false;
+/* Is pg_start_backup() was sent, but its result is not received yet */
+static bool pg_start_backup_is_sent = false;
 /* Is pg_stop_backup() was sent */
 static bool pg_stop_backup_is_sent = false;
 
@@ -81,9 +140,22 @@ static void backup_cleanup(bool fatal, void *userdata);
 static void *backup_files(void *arg);
 
 static void do_backup_instance(PGconn *backup_conn, PGNodeInfo *nodeInfo);
+static void choose_backup_mode(PGconn *backup_conn, PGNodeInfo *nodeInfo);
+static XLogRecPtr get_current_lsn(PGconn *conn, bool in_recovery);
+static void connect_standby_sources(PGNodeInfo *nodeInfo);
+static void disconnect_standby_sources(void);
+static void wait_lsn_reached(PGconn *conn, bool in_recovery, XLogRecPtr lsn,
+							 const char *host);
 
 static void pg_start_backup(const char *label, bool smooth, pgBackup *backup,
-							PGNodeInfo *nodeInfo, PGconn *backup_conn, PGconn *master_conn);
+							PGNodeInfo *nodeInfo, PGconn *backup_conn, PGconn *master_conn,
+							XLogRecPtr prev_backup_start_lsn);
+static XLogRecPtr extract_archived_pagemap(XLogRecPtr prev_backup_start_lsn,
+										   TimeLineID tli);
+static void apply_pending_pagemaps(void);
+static void add_block_change(ForkNumber forknum, RelFileNode rnode,
+							 BlockNumber blkno);
+static BlockNumber fsm_block_of(BlockNumber blkno, int level);
 static void pg_switch_wal(PGconn *conn);
 static void pg_stop_backup(pgBackup *backup, PGconn *pg_startbackup_conn, PGNodeInfo *nodeInfo);
 static int checkpoint_timeout(PGconn *backup_conn);
@@ -110,6 +182,21 @@ static void check_server_version(PGconn *conn, PGNodeInfo *nodeInfo);
 static void confirm_block_size(PGconn *conn, const char *name, int blcksz);
 static void set_cfs_datafiles(parray *files, const char *root, char *relative, size_t i);
 
+/*
+ * Cancel pg_start_backup() if we failed while waiting for its result.
+ */
+static void
+backup_startbackup_callback(bool fatal, void *userdata)
+{
+	PGconn *pg_startbackup_conn = (PGconn *) userdata;
+
+	if (pg_start_backup_is_sent)
+	{
+		elog(WARNING, "pg_start_backup() is in progress, cancel it");
+		pgut_cancel(pg_startbackup_conn);
+	}
+}
+
 static void
 backup_stopbackup_callback(bool fatal, void *userdata)
 {
@@ -147,6 +234,7 @@ do_backup_instance(PGconn *backup_conn, PGNodeInfo *nodeInfo)
 	parray	   *prev_backup_filelist = NULL;
 	parray	   *backup_list = NULL;
 	parray	   *external_dirs = NULL;
+	parray	   *stripe_paths = NULL;
 	parray	   *database_map = NULL;
 
 	pgFile	   *pg_control = NULL;
@@ -158,6 +246,10 @@ do_backup_instance(PGconn *backup_conn, PGNodeInfo *nodeInfo)
 	char		pretty_bytes[20];
 
 	elog(LOG, "Database backup start");
+
+	if (nodeInfo->server_version < 90600)
+		vm_blocks_per_page = VM_MAPSIZE * 8;
+
 	if(current.external_dir_str)
 	{
 		external_dirs = make_external_directory_list(current.external_dir_str,
@@ -165,6 +257,26 @@ do_backup_instance(PGconn *backup_conn, PGNodeInfo *nodeInfo)
 		check_external_for_tablespaces(external_dirs, backup_conn);
 	}
 
+	stripe_paths = make_stripe_path_list(instance_config.stripe_paths_str);
+	if (stripe_paths)
+	{
+		stripe_dirs = parray_new();
+		for (i = 0; i < parray_num(stripe_paths); i++)
+		{
+			char		stripe_dir[MAXPGPATH];
+
+			snprintf(stripe_dir, MAXPGPATH, "%s/%s/%s/%s",
+					 (char *) parray_get(stripe_paths, i), instance_name,
+					 base36enc(current.start_time), DATABASE_DIR);
+			parray_append(stripe_dirs, pgut_strdup(stripe_dir));
+		}
+		free_dir_list(stripe_paths);
+		pg_atomic_init_u32(&stripe_counter, 0);
+	}
+
+	if (standby_hosts)
+		connect_standby_sources(nodeInfo);
+
 	/* Obtain current timeline */
 #if PG_VERSION_NUM >= 90600
 	current.tli = get_current_timeline(backup_conn);
@@ -242,7 +354,8 @@ do_backup_instance(PGconn *backup_conn, PGNodeInfo *nodeInfo)
 	else
 		pg_startbackup_conn = backup_conn;
 
-	pg_start_backup(label, smooth_checkpoint, &current, nodeInfo, backup_conn, pg_startbackup_conn);
+	pg_start_backup(label, smooth_checkpoint, &current, nodeInfo, backup_conn,
+					pg_startbackup_conn, prev_backup_start_lsn);
 
 	/* For incremental backup check that start_lsn is not from the past
 	 * Though it will not save us if PostgreSQL instance is actually
@@ -299,9 +412,13 @@ do_backup_instance(PGconn *backup_conn, PGNodeInfo *nodeInfo)
 	/* initialize backup list */
 	backup_files_list = parray_new();
 
-	/* list files with the logical path. omit $PGDATA */
-	dir_list_file(backup_files_list, instance_config.pgdata,
-				  true, true, false, 0, FIO_DB_HOST);
+	/*
+	 * list files with the logical path. omit $PGDATA.
+	 * Names of files are parsed into OIDs, forks and segment numbers during
+	 * the walk.
+	 */
+	dir_list_file_parallel(backup_files_list, instance_config.pgdata,
+						   true, true, false, 0, FIO_DB_HOST);
 
 	/*
 	 * Get database_map (name to oid) for use in partial restore feature.
@@ -317,8 +434,8 @@ do_backup_instance(PGconn *backup_conn, PGNodeInfo *nodeInfo)
 		for (i = 0; i < parray_num(external_dirs); i++)
 			/* External dirs numeration starts with 1.
 			 * 0 value is not external dir */
-			dir_list_file(backup_files_list, parray_get(external_dirs, i),
-						  false, true, false, i+1, FIO_DB_HOST);
+			dir_list_file_parallel(backup_files_list, parray_get(external_dirs, i),
+								   false, true, false, i+1, FIO_DB_HOST);
 
 	/* close ssh session in main thread */
 	fio_disconnect();
@@ -356,7 +473,7 @@ do_backup_instance(PGconn *backup_conn, PGNodeInfo *nodeInfo)
 	 * Sorted array is used at least in parse_filelist_filenames(),
 	 * extractPageMap(), make_pagemap_from_ptrack().
 	 */
-	parray_qsort(backup_files_list, pgFileComparePath);
+	parray_qsort_parallel(backup_files_list, pgFileComparePath, num_threads);
 
 	/* Extract information about files in backup_list parsing their names:*/
 	parse_filelist_filenames(backup_files_list, instance_config.pgdata);
@@ -382,13 +499,23 @@ do_backup_instance(PGconn *backup_conn, PGNodeInfo *nodeInfo)
 
 		if (current.backup_mode == BACKUP_MODE_DIFF_PAGE)
 		{
+			XLogRecPtr	startpoint = prev_backup->start_lsn;
+
+			/* Pagemap could be partially built during pg_start_backup() */
+			if (pending_pagemaps != NULL)
+			{
+				apply_pending_pagemaps();
+				startpoint = pending_pagemaps_lsn;
+			}
+
 			/*
 			 * Build the page map. Obtain information about changed pages
 			 * reading WAL segments present in archives up to the point
 			 * where this backup has started.
 			 */
-			extractPageMap(arclog_path, current.tli, instance_config.xlog_seg_size,
-						   prev_backup->start_lsn, current.start_lsn);
+			if (startpoint < current.start_lsn)
+				extractPageMap(arclog_path, current.tli, instance_config.xlog_seg_size,
+							   startpoint, current.start_lsn);
 		}
 		else if (current.backup_mode == BACKUP_MODE_DIFF_PTRACK)
 		{
@@ -442,6 +569,19 @@ do_backup_instance(PGconn *backup_conn, PGNodeInfo *nodeInfo)
 			else
 				join_path_components(dirpath, database_path, dir_name);
 			fio_mkdir(dirpath, DIR_PERMISSION, FIO_BACKUP_HOST);
+
+			/* Data files can be placed on stripe paths too */
+			if (stripe_dirs && !file->external_dir_num)
+			{
+				int			j;
+
+				for (j = 0; j < parray_num(stripe_dirs); j++)
+				{
+					join_path_components(dirpath, parray_get(stripe_dirs, j),
+										 dir_name);
+					fio_mkdir(dirpath, DIR_PERMISSION, FIO_BACKUP_HOST);
+				}
+			}
 		}
 
 		/* setup threads */
@@ -459,6 +599,17 @@ do_backup_instance(PGconn *backup_conn, PGNodeInfo *nodeInfo)
 						  instance_config.pgdata, external_dirs);
 	write_backup(&current);
 
+	/*
+	 * Pages read from a standby, which has not replayed WAL up to START LSN
+	 * yet, could be older than WAL of the backup.
+	 */
+	for (i = 0; standby_sources && i < parray_num(standby_sources); i++)
+	{
+		StandbySource *source = (StandbySource *) parray_get(standby_sources, i);
+
+		wait_lsn_reached(source->conn, true, current.start_lsn, source->host);
+	}
+
 	/* init thread args with own file lists */
 	threads = (pthread_t *) palloc(sizeof(pthread_t) * num_threads);
 	threads_args = (backup_files_arg *) palloc(sizeof(backup_files_arg)*num_threads);
@@ -478,6 +629,14 @@ do_backup_instance(PGconn *backup_conn, PGNodeInfo *nodeInfo)
 		arg->conn_arg.conn = NULL;
 		arg->conn_arg.cancel_conn = NULL;
 		arg->thread_num = i+1;
+		/*
+		 * Threads are bound to sources round-robin, the first one always
+		 * reads from the source.
+		 */
+		arg->standby_host = NULL;
+		if (standby_sources && i % (parray_num(standby_sources) + 1) > 0)
+			arg->standby_host = ((StandbySource *) parray_get(standby_sources,
+									i % (parray_num(standby_sources) + 1) - 1))->host;
 		/* By default there are some error */
 		arg->ret = 1;
 	}
@@ -525,6 +684,26 @@ do_backup_instance(PGconn *backup_conn, PGNodeInfo *nodeInfo)
 		parray_free(prev_backup_filelist);
 	}
 
+	/*
+	 * Standbys could be ahead of the source, so STOP LSN must not be less
+	 * than LSN of any page read from them. Wait for the source to reach
+	 * the replay position of every standby before stopping the backup.
+	 */
+	if (standby_sources)
+	{
+		XLogRecPtr	standby_lsn = InvalidXLogRecPtr;
+
+		for (i = 0; i < parray_num(standby_sources); i++)
+		{
+			StandbySource *source = (StandbySource *) parray_get(standby_sources, i);
+
+			standby_lsn = Max(standby_lsn, get_current_lsn(source->conn, true));
+		}
+		wait_lsn_reached(backup_conn, current.from_replica, standby_lsn,
+						 instance_config.conn_opt.pghost);
+		disconnect_standby_sources();
+	}
+
 	/* Notify end of backup */
 	pg_stop_backup(&current, pg_startbackup_conn, nodeInfo);
 
@@ -607,6 +786,24 @@ do_backup_instance(PGconn *backup_conn, PGNodeInfo *nodeInfo)
 		parray_free(database_map);
 	}
 
+	/*
+	 * Backup files were written without waiting for the disk. Sync them all
+	 * at once before the list of files makes the backup complete.
+	 */
+	pgBackupGetPath(&current, dst_backup_path, lengthof(dst_backup_path), NULL);
+	if (fio_sync_tree(dst_backup_path, FIO_BACKUP_HOST) != 0)
+		elog(ERROR, "Cannot sync backup directory \"%s\": %s",
+			 dst_backup_path, strerror(errno));
+
+	for (i = 0; stripe_dirs && i < parray_num(stripe_dirs); i++)
+	{
+		char	   *stripe_dir = (char *) parray_get(stripe_dirs, i);
+
+		if (fio_sync_tree(stripe_dir, FIO_BACKUP_HOST) != 0)
+			elog(ERROR, "Cannot sync directory \"%s\": %s",
+				 stripe_dir, strerror(errno));
+	}
+
 	/* Print the list of files to backup catalog */
 	write_backup_filelist(&current, backup_files_list, instance_config.pgdata,
 						  external_dirs);
@@ -617,6 +814,12 @@ do_backup_instance(PGconn *backup_conn, PGNodeInfo *nodeInfo)
 	if (external_dirs)
 		free_dir_list(external_dirs);
 
+	if (stripe_dirs)
+	{
+		free_dir_list(stripe_dirs);
+		stripe_dirs = NULL;
+	}
+
 	/* Cleanup */
 	if (backup_list)
 	{
@@ -725,7 +928,8 @@ do_backup(time_t start_time, bool no_validate,
 
 	elog(INFO, "Backup start, pg_probackup version: %s, instance: %s, backup ID: %s, backup mode: %s, "
 			"wal mode: %s, remote: %s, compress-algorithm: %s, compress-level: %i",
-			PROGRAM_VERSION, instance_name, base36enc(start_time), pgBackupGetBackupMode(&current),
+			PROGRAM_VERSION, instance_name, base36enc(start_time),
+			backup_mode_auto ? "AUTO" : pgBackupGetBackupMode(&current),
 			current.stream ? "STREAM" : "ARCHIVE", IsSshProtocol()  ? "true" : "false",
 			deparse_compress_alg(current.compress_alg), current.compress_level);
 
@@ -778,6 +982,9 @@ do_backup(time_t start_time, bool no_validate,
 			nodeInfo.is_ptrack_enable = pg_ptrack_enable(backup_conn);
 	}
 
+	if (backup_mode_auto)
+		choose_backup_mode(backup_conn, &nodeInfo);
+
 	if (current.backup_mode == BACKUP_MODE_DIFF_PTRACK)
 	{
 		if (nodeInfo.ptrack_version_num == 0)
@@ -830,7 +1037,17 @@ do_backup(time_t start_time, bool no_validate,
 			elog(ERROR, "Failed to pin the backup %s", base36enc(current.backup_id));
 	}
 
-	if (!no_validate)
+	/*
+	 * Pages and files were already checked as they were written, there is
+	 * no need to read the backup again.
+	 */
+	if (inline_validate)
+	{
+		write_backup_status(&current, BACKUP_STATUS_OK, instance_name);
+		elog(INFO, "Backup %s data files are validated during backup",
+			 base36enc(current.start_time));
+	}
+	else if (!no_validate)
 		pgBackupValidate(&current, NULL);
 
 	/* Notify user about backup size */
@@ -932,6 +1149,338 @@ check_server_version(PGconn *conn, PGNodeInfo *nodeInfo)
 	exclusive_backup = nodeInfo->server_version < 90600;
 }
 
+/*
+ * Limits used by --backup-mode=auto. If the estimated fraction of changed
+ * blocks reaches AUTO_FULL_CHANGED_FRACTION, an incremental backup would read
+ * and store almost as much as a FULL one, while making restore chain longer.
+ * Chains longer than AUTO_MAX_CHAIN_LENGTH incremental backups are cut
+ * by a FULL backup to keep restore and merge time bounded.
+ */
+#define AUTO_FULL_CHANGED_FRACTION	0.5
+#define AUTO_MAX_CHAIN_LENGTH		10
+
+/*
+ * Choose backup mode for --backup-mode=auto.
+ *
+ * The fraction of blocks changed since the previous backup is estimated
+ * without reading data files: by ptrack map if ptrack 2.x is enabled,
+ * otherwise by volume of WAL generated since previous backup, which is
+ * the upper bound of changed data. Then the cheapest mode is chosen:
+ * PTRACK reads only changed blocks, PAGE reads WAL and changed blocks,
+ * DELTA reads all data files. The reasoning is saved in backup.control.
+ */
+static void
+choose_backup_mode(PGconn *backup_conn, PGNodeInfo *nodeInfo)
+{
+	parray	   *backup_list;
+	pgBackup   *prev_backup;
+	XLogRecPtr	current_lsn;
+	XLogRecPtr	wal_start_lsn;
+	XLogRecPtr	ptrack_lsn;
+	XLogSegNo	stop_segno;
+	int64		pgdata_bytes;
+	int64		wal_bytes = 0;
+	int64		changed_bytes;
+	double		changed_fraction;
+	int			chain_length;
+	bool		ptrack_is_usable = false;
+	bool		page_is_usable = false;
+	const char *estimated_by;
+	char		estimate[512];
+	char		reason[1024];
+	char		pretty_changed[20];
+	char		pretty_pgdata[20];
+
+#if PG_VERSION_NUM >= 90600
+	current.tli = get_current_timeline(backup_conn);
+#else
+	current.tli = get_current_timeline_from_control(false);
+#endif
+
+	backup_list = catalog_get_backup_list(instance_name, INVALID_BACKUP_ID);
+	prev_backup = catalog_get_last_data_backup(backup_list, current.tli, current.start_time);
+
+	if (prev_backup == NULL)
+	{
+		current.backup_mode = BACKUP_MODE_FULL;
+		snprintf(reason, sizeof(reason),
+				 "there is no valid backup on current timeline %X", current.tli);
+		goto chosen;
+	}
+
+	chain_length = prev_backup->depth + 1;
+
+	/* Size of PGDATA is known since the previous backup */
+	pgdata_bytes = prev_backup->pgdata_bytes;
+	if (pgdata_bytes <= 0 && prev_backup->root_backup)
+		pgdata_bytes = prev_backup->root_backup->uncompressed_bytes;
+
+	/*
+	 * pg_stop_backup() of previous backup switched WAL segment, the rest of
+	 * the segment of STOP LSN is not filled with changes.
+	 */
+	current_lsn = get_current_lsn(backup_conn, current.from_replica);
+	GetXLogSegNo(prev_backup->stop_lsn, stop_segno, instance_config.xlog_seg_size);
+	GetXLogRecPtr(stop_segno + 1, 0, instance_config.xlog_seg_size, wal_start_lsn);
+	if (current_lsn > wal_start_lsn)
+		wal_bytes = current_lsn - wal_start_lsn;
+	else if (current_lsn > prev_backup->stop_lsn)
+		wal_bytes = current_lsn - prev_backup->stop_lsn;
+
+	/* PTRACK backup is possible if ptrack tracked all changes since previous backup */
+	if (nodeInfo->is_ptrack_enable)
+	{
+		ptrack_lsn = get_last_ptrack_lsn(backup_conn, nodeInfo);
+		ptrack_is_usable = ptrack_lsn != InvalidXLogRecPtr &&
+			ptrack_lsn <= prev_backup->stop_lsn;
+	}
+
+	/* PAGE backup is possible if WAL since previous backup is archived */
+	{
+		char		wal_segment[MAXFNAMELEN];
+		char		wal_segment_path[MAXPGPATH];
+		XLogSegNo	segno;
+
+		GetXLogSegNo(prev_backup->start_lsn, segno, instance_config.xlog_seg_size);
+		GetXLogFileName(wal_segment, current.tli, segno, instance_config.xlog_seg_size);
+		join_path_components(wal_segment_path, arclog_path, wal_segment);
+		page_is_usable = fileExists(wal_segment_path, FIO_BACKUP_HOST);
+#ifdef HAVE_LIBZ
+		if (!page_is_usable)
+		{
+			char		gz_wal_segment_path[MAXPGPATH];
+
+			snprintf(gz_wal_segment_path, sizeof(gz_wal_segment_path), "%s.gz",
+					 wal_segment_path);
+			page_is_usable = fileExists(gz_wal_segment_path, FIO_BACKUP_HOST);
+		}
+#endif
+	}
+
+	if (ptrack_is_usable && nodeInfo->ptrack_version_num >= 20)
+	{
+		changed_bytes = pg_ptrack_count_changed_blocks(backup_conn,
+													   nodeInfo->ptrack_schema,
+													   prev_backup->start_lsn) * BLCKSZ;
+		estimated_by = "ptrack map";
+	}
+	else
+	{
+		changed_bytes = wal_bytes;
+		estimated_by = "WAL volume";
+	}
+
+	if (pgdata_bytes <= 0)
+	{
+		/* Nothing to compare with, DELTA backup is correct in any case */
+		current.backup_mode = BACKUP_MODE_DIFF_DELTA;
+		snprintf(reason, sizeof(reason),
+				 "size of PGDATA is unknown for previous backup %s",
+				 base36enc(prev_backup->start_time));
+		goto chosen;
+	}
+
+	changed_fraction = (double) changed_bytes / pgdata_bytes;
+	if (changed_fraction > 1)
+		changed_fraction = 1;
+
+	pretty_size(changed_bytes, pretty_changed, lengthof(pretty_changed));
+	pretty_size(pgdata_bytes, pretty_pgdata, lengthof(pretty_pgdata));
+	snprintf(estimate, sizeof(estimate),
+			 "%.1f%% of data is changed since backup %s, estimated by %s: %s of %s",
+			 changed_fraction * 100, base36enc(prev_backup->start_time),
+			 estimated_by, pretty_changed, pretty_pgdata);
+
+	if (chain_length > AUTO_MAX_CHAIN_LENGTH)
+	{
+		current.backup_mode = BACKUP_MODE_FULL;
+		snprintf(reason, sizeof(reason),
+				 "%s; backup chain would exceed %d incremental backups",
+				 estimate, AUTO_MAX_CHAIN_LENGTH);
+	}
+	else if (changed_fraction >= AUTO_FULL_CHANGED_FRACTION)
+	{
+		current.backup_mode = BACKUP_MODE_FULL;
+		snprintf(reason, sizeof(reason),
+				 "%s; incremental backup would cost as much as FULL", estimate);
+	}
+	else if (ptrack_is_usable)
+	{
+		current.backup_mode = BACKUP_MODE_DIFF_PTRACK;
+		snprintf(reason, sizeof(reason),
+				 "%s; ptrack tracks all changes", estimate);
+	}
+	else if (page_is_usable && wal_bytes + changed_bytes < pgdata_bytes)
+	{
+		current.backup_mode = BACKUP_MODE_DIFF_PAGE;
+		snprintf(reason, sizeof(reason),
+				 "%s; archived WAL is smaller than data files", estimate);
+	}
+	else
+	{
+		current.backup_mode = BACKUP_MODE_DIFF_DELTA;
+		snprintf(reason, sizeof(reason),
+				 "%s; %s", estimate, page_is_usable ?
+				 "archived WAL is larger than data files" :
+				 "WAL since previous backup is not archived");
+	}
+
+chosen:
+	current.mode_reason = pgut_strdup(reason);
+	elog(INFO, "Backup mode %s is chosen, because %s",
+		 pgBackupGetBackupMode(&current), reason);
+
+	/* Save the chosen mode right away */
+	write_backup(&current);
+
+	parray_walk(backup_list, pgBackupFree);
+	parray_free(backup_list);
+}
+
+/*
+ * Get current WAL insert location, or replay location on standby.
+ */
+static XLogRecPtr
+get_current_lsn(PGconn *conn, bool in_recovery)
+{
+	PGresult   *res;
+	uint32		lsn_hi;
+	uint32		lsn_lo;
+	XLogRecPtr	lsn;
+	const char *query;
+
+#if PG_VERSION_NUM >= 100000
+	if (in_recovery)
+		query = "SELECT pg_catalog.pg_last_wal_replay_lsn()";
+	else
+		query = "SELECT pg_catalog.pg_current_wal_lsn()";
+#else
+	if (in_recovery)
+		query = "SELECT pg_catalog.pg_last_xlog_replay_location()";
+	else
+		query = "SELECT pg_catalog.pg_current_xlog_location()";
+#endif
+
+	res = pgut_execute(conn, query, 0, NULL);
+	XLogDataFromLSN(PQgetvalue(res, 0, 0), &lsn_hi, &lsn_lo);
+	lsn = ((uint64) lsn_hi) << 32 | lsn_lo;
+
+	PQclear(res);
+	return lsn;
+}
+
+/*
+ * Connect to standbys listed in --standby-hosts and check that they are
+ * standbys of the same cluster, which can be read by remote agents.
+ * Each entry is "host[:port]", port of the source is used by default.
+ */
+static void
+connect_standby_sources(PGNodeInfo *nodeInfo)
+{
+	char	   *hosts = pgut_strdup(standby_hosts);
+	char	   *entry;
+
+	if (!IsSshProtocol())
+		elog(ERROR, "--standby-hosts can be used only in remote mode, "
+			 "specify --remote-host");
+
+	standby_sources = parray_new();
+
+	for (entry = strtok(hosts, ","); entry; entry = strtok(NULL, ","))
+	{
+		StandbySource *source = pgut_new(StandbySource);
+		char	   *port = strchr(entry, ':');
+
+		if (port)
+			*port++ = '\0';
+		if (entry[0] == '\0')
+			elog(ERROR, "Invalid value of --standby-hosts: \"%s\"", standby_hosts);
+
+		source->host = pgut_strdup(entry);
+		source->port = pgut_strdup(port ? port : instance_config.conn_opt.pgport);
+		source->conn = pgut_connect(source->host, source->port,
+									instance_config.conn_opt.pgdatabase,
+									instance_config.conn_opt.pguser);
+
+		if (!pg_is_in_recovery(source->conn))
+			elog(ERROR, "Host \"%s\" is not a standby", source->host);
+
+		if (PQserverVersion(source->conn) != nodeInfo->server_version)
+			elog(ERROR, "Server version of standby \"%s\" is %d, %d expected",
+				 source->host, PQserverVersion(source->conn),
+				 nodeInfo->server_version);
+
+		if (get_remote_system_identifier(source->conn) !=
+			instance_config.system_identifier)
+			elog(ERROR, "Standby \"%s\" has system id " UINT64_FORMAT ", "
+				 "but backup data directory was initialized for system id " UINT64_FORMAT,
+				 source->host, get_remote_system_identifier(source->conn),
+				 instance_config.system_identifier);
+
+		confirm_block_size(source->conn, "block_size", BLCKSZ);
+
+		elog(INFO, "Data files will be read from standby \"%s\" too",
+			 source->host);
+		parray_append(standby_sources, source);
+	}
+	pg_free(hosts);
+
+	if (num_threads < parray_num(standby_sources) + 1)
+		elog(WARNING, "Not all standbys are used, number of threads %d "
+			 "is less than number of sources %d", num_threads,
+			 (int) parray_num(standby_sources) + 1);
+}
+
+static void
+disconnect_standby_sources(void)
+{
+	int			i;
+
+	for (i = 0; i < parray_num(standby_sources); i++)
+	{
+		StandbySource *source = (StandbySource *) parray_get(standby_sources, i);
+
+		pgut_disconnect(source->conn);
+		pg_free(source->host);
+		pg_free(source->port);
+		pg_free(source);
+	}
+	parray_free(standby_sources);
+	standby_sources = NULL;
+}
+
+/*
+ * Wait until the server reaches the LSN, i.e. replays WAL up to it if
+ * the server is in recovery. Wait at most archive_timeout seconds.
+ */
+static void
+wait_lsn_reached(PGconn *conn, bool in_recovery, XLogRecPtr lsn,
+				 const char *host)
+{
+	uint32		try_count = 0;
+	XLogRecPtr	cur_lsn;
+
+	while ((cur_lsn = get_current_lsn(conn, in_recovery)) < lsn)
+	{
+		if (interrupted)
+			elog(ERROR, "Interrupted during waiting for LSN");
+
+		if (try_count == 0)
+			elog(INFO, "Wait for server \"%s\" to reach LSN %X/%X, current LSN %X/%X",
+				 host ? host : "localhost", (uint32) (lsn >> 32), (uint32) lsn,
+				 (uint32) (cur_lsn >> 32), (uint32) cur_lsn);
+
+		if (++try_count > instance_config.archive_timeout)
+			elog(ERROR, "Server \"%s\" has not reached LSN %X/%X in %u seconds, "
+				 "current LSN %X/%X", host ? host : "localhost",
+				 (uint32) (lsn >> 32), (uint32) lsn,
+				 instance_config.archive_timeout,
+				 (uint32) (cur_lsn >> 32), (uint32) cur_lsn);
+
+		sleep(1);
+	}
+}
+
 /*
  * Ensure that backup directory was initialized for the same PostgreSQL
  * instance we opened connection to. And that target backup database PGDATA
@@ -999,10 +1548,13 @@ confirm_block_size(PGconn *conn, const char *name, int blcksz)
  */
 static void
 pg_start_backup(const char *label, bool smooth, pgBackup *backup,
-				PGNodeInfo *nodeInfo, PGconn *backup_conn, PGconn *pg_startbackup_conn)
+				PGNodeInfo *nodeInfo, PGconn *backup_conn, PGconn *pg_startbackup_conn,
+				XLogRecPtr prev_backup_start_lsn)
 {
 	PGresult   *res;
+	PGresult   *next_res;
 	const char *params[2];
+	const char *query;
 	uint32		lsn_hi;
 	uint32		lsn_lo;
 	PGconn	   *conn;
@@ -1015,15 +1567,46 @@ pg_start_backup(const char *label, bool smooth, pgBackup *backup,
 	/* 2nd argument is 'fast'*/
 	params[1] = smooth ? "false" : "true";
 	if (!exclusive_backup)
-		res = pgut_execute(conn,
-						   "SELECT pg_catalog.pg_start_backup($1, $2, false)",
-						   2,
-						   params);
+		query = "SELECT pg_catalog.pg_start_backup($1, $2, false)";
 	else
-		res = pgut_execute(conn,
-						   "SELECT pg_catalog.pg_start_backup($1, $2)",
-						   2,
-						   params);
+		query = "SELECT pg_catalog.pg_start_backup($1, $2)";
+
+	/*
+	 * pg_start_backup() may wait for checkpoint for a long time. Send it
+	 * asynchronously and read already archived WAL meanwhile.
+	 */
+	pgut_send(conn, query, 2, params, ERROR);
+	pg_start_backup_is_sent = true;
+	pgut_atexit_push(backup_startbackup_callback, pg_startbackup_conn);
+
+	if (current.backup_mode == BACKUP_MODE_DIFF_PAGE)
+		pending_pagemaps_lsn = extract_archived_pagemap(prev_backup_start_lsn,
+														backup->tli);
+
+	/* Wait for the result of pg_start_backup() */
+	if (!PQconsumeInput(conn))
+		elog(ERROR, "pg_start_backup() failed: %s", PQerrorMessage(conn));
+	while (PQisBusy(conn))
+	{
+		if (pgut_wait(1, &conn, NULL) < 0)
+		{
+			if (interrupted)
+				elog(ERROR, "interrupted during waiting for pg_start_backup");
+			elog(ERROR, "pg_start_backup() failed: %s", PQerrorMessage(conn));
+		}
+	}
+
+	res = PQgetResult(conn);
+	if (PQresultStatus(res) != PGRES_TUPLES_OK)
+		elog(ERROR, "query failed: %squery was: %s",
+			 PQerrorMessage(conn), query);
+
+	/* Connection is ready for the next query only after NULL result */
+	while ((next_res = PQgetResult(conn)) != NULL)
+		PQclear(next_res);
+
+	pg_start_backup_is_sent = false;
+	pgut_atexit_pop(backup_startbackup_callback, pg_startbackup_conn);
 
 	/*
 	 * Set flag that pg_start_backup() was called. If an error will happen it
@@ -1064,6 +1647,101 @@ pg_start_backup(const char *label, bool smooth, pgBackup *backup,
 		wait_wal_lsn(backup->start_lsn, true, backup->tli, true, true, ERROR, false);
 }
 
+/*
+ * Build pagemap from WAL, which is already archived, while pg_start_backup()
+ * waits for checkpoint. The list of files is not known yet, so changed
+ * blocks are collected into pending_pagemaps.
+ *
+ * Returns LSN up to which pagemap is built, or prev_backup_start_lsn if
+ * there is nothing to read yet.
+ */
+static XLogRecPtr
+extract_archived_pagemap(XLogRecPtr prev_backup_start_lsn, TimeLineID tli)
+{
+	XLogSegNo	start_segno;
+	XLogSegNo	segno;
+	XLogRecPtr	endpoint;
+	time_t		start_time,
+				end_time;
+
+	GetXLogSegNo(prev_backup_start_lsn, start_segno,
+				 instance_config.xlog_seg_size);
+
+	/* Find the end of continuous sequence of archived segments */
+	for (segno = start_segno;; segno++)
+	{
+		char		wal_segment[MAXFNAMELEN];
+		char		wal_segment_path[MAXPGPATH];
+#ifdef HAVE_LIBZ
+		char		gz_wal_segment_path[MAXPGPATH];
+#endif
+
+		GetXLogFileName(wal_segment, tli, segno, instance_config.xlog_seg_size);
+		join_path_components(wal_segment_path, arclog_path, wal_segment);
+		if (fileExists(wal_segment_path, FIO_BACKUP_HOST))
+			continue;
+#ifdef HAVE_LIBZ
+		snprintf(gz_wal_segment_path, sizeof(gz_wal_segment_path), "%s.gz",
+				 wal_segment_path);
+		if (fileExists(gz_wal_segment_path, FIO_BACKUP_HOST))
+			continue;
+#endif
+		break;
+	}
+
+	/*
+	 * Records of the last segment read may continue in the next one, and it
+	 * must be archived too. So we need at least two segments after the
+	 * segment of the previous backup.
+	 */
+	if (segno < start_segno + 3)
+		return prev_backup_start_lsn;
+
+	/* Stop at the first record of the last but one archived segment */
+	GetXLogRecPtr(segno - 2, SizeOfXLogLongPHD, instance_config.xlog_seg_size,
+				  endpoint);
+
+	elog(INFO, "Compiling pagemap of changed blocks from archived WAL up to %X/%X",
+		 (uint32) (endpoint >> 32), (uint32) (endpoint));
+	time(&start_time);
+
+	pending_pagemaps = parray_new();
+	extractPageMap(arclog_path, tli, instance_config.xlog_seg_size,
+				   prev_backup_start_lsn, endpoint);
+
+	time(&end_time);
+	elog(INFO, "Pagemap of archived WAL compiled, time elapsed %.0f sec",
+		 difftime(end_time, start_time));
+
+	return endpoint;
+}
+
+/*
+ * Move pagemaps collected by extract_archived_pagemap() into backup_files_list.
+ * Files, which are not in the list, are ignored the same way
+ * process_block_change() does.
+ */
+static void
+apply_pending_pagemaps(void)
+{
+	int			i;
+
+	for (i = 0; i < parray_num(pending_pagemaps); i++)
+	{
+		pgFile	   *pending = (pgFile *) parray_get(pending_pagemaps, i);
+		pgFile	  **file_item;
+
+		file_item = (pgFile **) parray_bsearch(backup_files_list, pending,
+											   pgFileComparePath);
+		if (file_item)
+			pagemap_union(&(*file_item)->pagemap, &pending->pagemap);
+	}
+
+	parray_walk(pending_pagemaps, pgFileFree);
+	parray_free(pending_pagemaps);
+	pending_pagemaps = NULL;
+}
+
 /*
  * Switch to a new WAL segment. It should be called only for master.
  * For PG 9.5 it should be called only if pguser is superuser.
@@ -1934,6 +2612,10 @@ backup_files(void *arg)
 
 	prev_time = current.start_time;
 
+	/* Agent of this thread runs on the standby */
+	if (arguments->standby_host)
+		set_agent_host(arguments->standby_host);
+
 	/* backup a file */
 	for (i = 0; i < n_backup_files_list; i++)
 	{
@@ -1941,6 +2623,14 @@ backup_files(void *arg)
 		struct stat	buf;
 		pgFile	   *file = (pgFile *) parray_get(arguments->files_list, i);
 
+		/*
+		 * Only data files are the same on all standbys, other files are left
+		 * for threads reading from the source.
+		 */
+		if (arguments->standby_host &&
+			(!file->is_datafile || file->is_cfs || file->external_dir_num))
+			continue;
+
 		if (arguments->thread_num == 1)
 		{
 			/* update backup_content.control every 10 seconds */
@@ -2016,20 +2706,46 @@ backup_files(void *arg)
 				prev_file = (pgFile **) parray_bsearch(arguments->prev_filelist,
 											&key, pgFileComparePathWithExternal);
 				if (prev_file)
+				{
 					/* File exists in previous backup */
 					file->exists_in_prev = true;
+
+					/*
+					 * Forks of relations were copied as a whole by older
+					 * versions, changed blocks cannot be applied to such copy.
+					 */
+					if (file->is_datafile && !(*prev_file)->is_datafile)
+						file->pagemap_isabsent = true;
+				}
 			}
 
 			/* copy the file into backup */
 			if (file->is_datafile && !file->is_cfs)
 			{
 				char		to_path[MAXPGPATH];
+				char		stripe_path[MAXPGPATH];
+				const char *data_path = to_path;
+				const char *rel_path = file->path + strlen(arguments->from_root) + 1;
 
-				join_path_components(to_path, arguments->to_root,
-									 file->path + strlen(arguments->from_root) + 1);
+				join_path_components(to_path, arguments->to_root, rel_path);
+
+				/* Stripe 0 is the backup directory itself */
+				if (stripe_dirs)
+				{
+					uint32		stripe = pg_atomic_fetch_add_u32(&stripe_counter, 1) %
+						(parray_num(stripe_dirs) + 1);
+
+					if (stripe > 0)
+					{
+						join_path_components(stripe_path,
+											 parray_get(stripe_dirs, stripe - 1),
+											 rel_path);
+						data_path = stripe_path;
+					}
+				}
 
 				/* backup block by block if datafile AND not compressed by cfs*/
-				if (!backup_data_file(arguments, to_path, file,
+				if (!backup_data_file(arguments, data_path, file,
 									  arguments->prev_start_lsn,
 									  current.backup_mode,
 									  instance_config.compress_alg,
@@ -2045,6 +2761,14 @@ backup_files(void *arg)
 					elog(VERBOSE, "File \"%s\" was not copied to backup", file->path);
 					continue;
 				}
+
+				if (data_path != to_path &&
+					fio_symlink(data_path, to_path, FIO_BACKUP_HOST) < 0)
+					elog(ERROR, "Cannot create symlink \"%s\" to \"%s\": %s",
+						 to_path, data_path, strerror(errno));
+
+				if (read_back)
+					read_back_file(data_path, file);
 			}
 			else if (!file->external_dir_num &&
 					 strcmp(file->name, "pg_control") == 0)
@@ -2057,16 +2781,38 @@ backup_files(void *arg)
 				bool		skip = false;
 				char		external_dst[MAXPGPATH];
 
+				/*
+				 * Remember the state of the file before reading it, so
+				 * a concurrent change would be noticed by the next backup.
+				 */
+				file->size = buf.st_size;
+				file->mtime = buf.st_mtime;
+
 				/* If non-data file has not changed since last backup... */
 				if (prev_file && file->exists_in_prev &&
 					buf.st_mtime < current.parent_backup)
 				{
-					file->crc = pgFileGetCRC(file->path, true, false,
-											 &file->read_size, FIO_DB_HOST);
-					file->write_size = file->read_size;
-					/* ...and checksum is the same... */
-					if (EQ_TRADITIONAL_CRC32(file->crc, (*prev_file)->crc))
-						skip = true; /* ...skip copying file. */
+					/*
+					 * ...and has the same size and mtime, there is no need
+					 * to read it, unless user asked us to be paranoid.
+					 */
+					if (!paranoid_crc && (*prev_file)->mtime > 0 &&
+						(*prev_file)->mtime == buf.st_mtime &&
+						(*prev_file)->size == (size_t) buf.st_size)
+					{
+						file->crc = (*prev_file)->crc;
+						file->read_size = buf.st_size;
+						skip = true;
+					}
+					else
+					{
+						file->crc = pgFileGetCRC(file->path, true, false,
+												 &file->read_size, FIO_DB_HOST);
+						file->write_size = file->read_size;
+						/* ...and checksum is the same... */
+						if (EQ_TRADITIONAL_CRC32(file->crc, (*prev_file)->crc))
+							skip = true; /* ...skip copying file. */
+					}
 				}
 				/* Set file paths */
 				if (file->external_dir_num)
@@ -2088,6 +2834,14 @@ backup_files(void *arg)
 						 file->path);
 					continue;
 				}
+
+				if (read_back)
+				{
+					char		written_path[MAXPGPATH];
+
+					join_path_components(written_path, dst, file->rel_path);
+					read_back_file(written_path, file);
+				}
 			}
 
 			elog(VERBOSE, "File \"%s\". Copied "INT64_FORMAT " bytes",
@@ -2099,6 +2853,7 @@ backup_files(void *arg)
 
 	/* ssh connection to longer needed */
 	fio_disconnect();
+	set_agent_host(NULL);
 
 	/* Close connection */
 	if (arguments->conn_arg.conn)
@@ -2247,11 +3002,128 @@ set_cfs_datafiles(parray *files, const char *root, char *relative, size_t i)
 }
 
 /*
- * Find pgfile by given rnode in the backup_files_list
- * and add given blkno to its pagemap.
+ * Add block of the file to pending_pagemaps, which are kept sorted by path.
+ */
+static void
+add_pending_block(const char *path, BlockNumber blkno)
+{
+	pgFile	   *file;
+	size_t		lo = 0,
+				hi;
+
+	/* We need critical section only we use more than one threads */
+	if (num_threads > 1)
+		pthread_lock(&backup_pagemap_mutex);
+
+	/* Find the first file, which path is not less than the path */
+	hi = parray_num(pending_pagemaps);
+	while (lo < hi)
+	{
+		size_t		mid = (lo + hi) / 2;
+
+		file = (pgFile *) parray_get(pending_pagemaps, mid);
+		if (strcmp(file->path, path) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < parray_num(pending_pagemaps) &&
+		strcmp(((pgFile *) parray_get(pending_pagemaps, lo))->path, path) == 0)
+		file = (pgFile *) parray_get(pending_pagemaps, lo);
+	else
+	{
+		file = pgFileInit(path, "");
+		parray_insert(pending_pagemaps, lo, file);
+	}
+
+	pagemap_add(&file->pagemap, blkno);
+
+	if (num_threads > 1)
+		pthread_mutex_unlock(&backup_pagemap_mutex);
+}
+
+/*
+ * Remember the change of the block found in WAL record.
  */
 void
 process_block_change(ForkNumber forknum, RelFileNode rnode, BlockNumber blkno)
+{
+	BlockNumber vm_block;
+	BlockNumber fsm_block;
+	int			level;
+
+	add_block_change(forknum, rnode, blkno);
+
+	if (forknum != MAIN_FORKNUM)
+		return;
+
+	/*
+	 * Change of the block may clear its bits in visibility map and update
+	 * free space map, neither of them is referenced by WAL record. Mark the
+	 * page of visibility map and pages of free space map from the leaf up to
+	 * the root, which cover the block.
+	 */
+	vm_block = blkno / vm_blocks_per_page;
+	fsm_block = fsm_block_of(blkno, 0);
+
+	if (!RelFileNodeEquals(rnode, last_rnode))
+	{
+		last_rnode = rnode;
+		last_vm_block = InvalidBlockNumber;
+		last_fsm_block = InvalidBlockNumber;
+	}
+
+	if (vm_block != last_vm_block)
+	{
+		add_block_change(VISIBILITYMAP_FORKNUM, rnode, vm_block);
+		last_vm_block = vm_block;
+	}
+
+	if (fsm_block != last_fsm_block)
+	{
+		for (level = 0; level < FSM_TREE_DEPTH; level++)
+			add_block_change(FSM_FORKNUM, rnode, fsm_block_of(blkno, level));
+		last_fsm_block = fsm_block;
+	}
+}
+
+/*
+ * Physical block number of free space map page of the given level, which
+ * covers the main fork block. Level 0 is the leaf level. This is what
+ * fsm_logical_to_physical() of the server computes.
+ */
+static BlockNumber
+fsm_block_of(BlockNumber blkno, int level)
+{
+	BlockNumber	leafno;
+	BlockNumber	pages = 0;
+	int			l;
+
+	/* The first leaf page under the page of the given level */
+	leafno = blkno / SlotsPerFSMPage;
+	for (l = 0; l < level; l++)
+		leafno /= SlotsPerFSMPage;
+	for (l = 0; l < level; l++)
+		leafno *= SlotsPerFSMPage;
+
+	/* Count pages of all levels up to this one, in depth-first order */
+	for (l = 0; l < FSM_TREE_DEPTH; l++)
+	{
+		pages += leafno + 1;
+		leafno /= SlotsPerFSMPage;
+	}
+	pages -= level;
+
+	return pages - 1;
+}
+
+/*
+ * Find pgfile by given rnode and fork in the backup_files_list and add given
+ * blkno to its pagemap.
+ */
+static void
+add_block_change(ForkNumber forknum, RelFileNode rnode, BlockNumber blkno)
 {
 	char	   *path;
 	char	   *rel_path;
@@ -2272,6 +3144,15 @@ process_block_change(ForkNumber forknum, RelFileNode rnode, BlockNumber blkno)
 	pg_free(rel_path);
 
 	f.path = path;
+
+	/* List of files is not known yet, remember the block for later */
+	if (pending_pagemaps != NULL)
+	{
+		add_pending_block(path, blkno_inseg);
+		pg_free(path);
+		return;
+	}
+
 	/* backup_files_list should be sorted before */
 	file_item = (pgFile **) parray_bsearch(backup_files_list, &f,
 										   pgFileComparePath);
@@ -2288,7 +3169,7 @@ process_block_change(ForkNumber forknum, RelFileNode rnode, BlockNumber blkno)
 		if (num_threads > 1)
 			pthread_lock(&backup_pagemap_mutex);
 
-		datapagemap_add(&(*file_item)->pagemap, blkno_inseg);
+		pagemap_add(&(*file_item)->pagemap, blkno_inseg);
 
 		if (num_threads > 1)
 			pthread_mutex_unlock(&backup_pagemap_mutex);
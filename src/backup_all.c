@@ -0,0 +1,427 @@
+/*-------------------------------------------------------------------------
+ *
+ * backup_all.c: take backups of several instances concurrently.
+ *
+ * State of a backup is kept in global variables, so each backup is taken by
+ * a child pg_probackup process. The number of threads given by -j is shared
+ * by all backups running at the same time: backups are started in the order
+ * of the schedule as long as there are enough free threads for them.
+ *
+ * Portions Copyright (c) 2019, Postgres Professional
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "pg_probackup.h"
+
+#include <dirent.h>
+#include <signal.h>
+#include <unistd.h>
+#ifndef WIN32
+#include <sys/wait.h>
+#endif
+
+/* How often running backups are checked for completion */
+#define BACKUP_ALL_POLL_INTERVAL	100000L		/* 100 ms */
+
+typedef struct
+{
+	char	   *instance;
+	char	   *mode;			/* backup mode as passed to -b */
+	int			threads;
+
+	pid_t		pid;			/* 0 if the backup is not started yet */
+	bool		done;
+	bool		signalled;		/* SIGINT is sent to the backup */
+	int			exit_status;	/* status from waitpid() */
+	time_t		start_time;
+	time_t		end_time;
+} backup_job;
+
+static parray *read_schedule(const char *schedule_path,
+							 const char *default_mode);
+static parray *list_instances(const char *default_mode);
+static backup_job *new_job(const char *instance, const char *mode,
+						   int threads);
+static void start_job(backup_job *job, parray *backup_args);
+static void print_report(parray *jobs);
+static void backup_job_free(void *job);
+
+/*
+ * Entry point of pg_probackup BACKUP-ALL subcommand.
+ *
+ * Backups of instances listed in the schedule file are taken, or of all
+ * instances of the catalog if there is no schedule. backup_args are passed
+ * to each backup command as is.
+ */
+int
+do_backup_all(const char *schedule_path, const char *default_mode,
+			  parray *backup_args)
+{
+#ifdef WIN32
+	elog(ERROR, "backup-all command is not supported on Windows");
+	return 1;
+#else
+	parray	   *jobs;
+	int			free_threads = num_threads;
+	int			running = 0;
+	int			failed = 0;
+	int			not_started = 0;
+	size_t		next = 0;
+	size_t		i;
+
+	if (PROGRAM_FULL_PATH == NULL)
+		elog(ERROR, "Cannot find a full path to %s executable", PROGRAM_NAME);
+
+	if (schedule_path)
+		jobs = read_schedule(schedule_path, default_mode);
+	else
+		jobs = list_instances(default_mode);
+
+	if (parray_num(jobs) == 0)
+		elog(ERROR, "There are no instances to backup");
+
+	elog(INFO, "Backing up %lu instances using %d threads",
+		 (unsigned long) parray_num(jobs), num_threads);
+
+	while (next < parray_num(jobs) || running > 0)
+	{
+		backup_job *job = NULL;
+		int			status;
+		pid_t		pid;
+
+		/*
+		 * Start backups in the order of the schedule. A backup, which needs
+		 * more threads than there are free, waits until they are released,
+		 * and the following ones wait too, so the order is kept.
+		 */
+		while (next < parray_num(jobs) && !interrupted)
+		{
+			job = (backup_job *) parray_get(jobs, next);
+
+			if (job->threads > free_threads)
+				break;
+
+			start_job(job, backup_args);
+			free_threads -= job->threads;
+			running++;
+			next++;
+		}
+
+		/* Let running backups stop, do not start new ones */
+		if (interrupted)
+		{
+			for (i = 0; i < next; i++)
+			{
+				job = (backup_job *) parray_get(jobs, i);
+				if (!job->done && !job->signalled)
+				{
+					kill(job->pid, SIGINT);
+					job->signalled = true;
+				}
+			}
+			not_started = parray_num(jobs) - next;
+			next = parray_num(jobs);
+		}
+
+		pid = waitpid(-1, &status, WNOHANG);
+		if (pid == 0 || (pid < 0 && errno == EINTR))
+		{
+			pg_usleep(BACKUP_ALL_POLL_INTERVAL);
+			continue;
+		}
+		if (pid < 0)
+			elog(ERROR, "Cannot wait for backup process: %s", strerror(errno));
+
+		for (i = 0; i < next; i++)
+		{
+			job = (backup_job *) parray_get(jobs, i);
+			if (job->pid == pid && !job->done)
+				break;
+			job = NULL;
+		}
+
+		/* Not a backup process, nothing to do */
+		if (job == NULL)
+			continue;
+
+		job->done = true;
+		job->exit_status = status;
+		job->end_time = time(NULL);
+		free_threads += job->threads;
+		running--;
+
+		if (status == 0)
+			elog(INFO, "Backup of instance '%s' completed, time elapsed: %.0f sec",
+				 job->instance, difftime(job->end_time, job->start_time));
+		else
+		{
+			char	   *reason = wait_result_to_str(status);
+
+			elog(WARNING, "Backup of instance '%s' failed: %s",
+				 job->instance, reason);
+			pfree(reason);
+			failed++;
+		}
+	}
+
+	print_report(jobs);
+
+	parray_walk(jobs, backup_job_free);
+	parray_free(jobs);
+
+	if (interrupted)
+		elog(ERROR, "interrupted during backup-all, %d backups are not started",
+			 not_started);
+
+	if (failed > 0)
+		elog(ERROR, "%d backups failed", failed);
+
+	elog(INFO, "All backups completed");
+
+	return 0;
+#endif
+}
+
+/*
+ * Read the schedule. Each line is "instance_name [backup_mode [num_threads]]",
+ * empty lines and lines starting with '#' are ignored. Backups are started
+ * in the order of lines.
+ */
+static parray *
+read_schedule(const char *schedule_path, const char *default_mode)
+{
+	parray	   *jobs = parray_new();
+	char		buf[MAXPGPATH * 2];
+	FILE	   *fp;
+	int			lineno = 0;
+
+	fp = fopen(schedule_path, "rt");
+	if (fp == NULL)
+		elog(ERROR, "Cannot open schedule file \"%s\": %s", schedule_path,
+			 strerror(errno));
+
+	while (fgets(buf, lengthof(buf), fp))
+	{
+		char	   *instance;
+		char	   *mode;
+		char	   *threads;
+		char	   *extra;
+		int			nthreads = 1;
+
+		lineno++;
+
+		instance = strtok(buf, " \t\r\n");
+		if (instance == NULL || instance[0] == '#')
+			continue;
+
+		mode = strtok(NULL, " \t\r\n");
+		threads = strtok(NULL, " \t\r\n");
+		extra = strtok(NULL, " \t\r\n");
+
+		if (extra != NULL)
+			elog(ERROR, "Syntax error in \"%s\" at line %d: \"%s\"",
+				 schedule_path, lineno, extra);
+
+		if (mode == NULL)
+			mode = (char *) default_mode;
+		if (mode == NULL)
+			elog(ERROR, "Backup mode is not specified for instance '%s' in \"%s\", "
+				 "use -b option to set the default one", instance, schedule_path);
+
+		if (threads != NULL &&
+			(!parse_int32(threads, &nthreads, 0) || nthreads < 1))
+			elog(ERROR, "Invalid number of threads \"%s\" in \"%s\" at line %d",
+				 threads, schedule_path, lineno);
+
+		parray_append(jobs, new_job(instance, mode, nthreads));
+	}
+
+	if (ferror(fp))
+		elog(ERROR, "Cannot read schedule file \"%s\": %s", schedule_path,
+			 strerror(errno));
+	fclose(fp);
+
+	return jobs;
+}
+
+/*
+ * Backup all instances of the catalog in the order of their names.
+ */
+static parray *
+list_instances(const char *default_mode)
+{
+	parray	   *names = parray_new();
+	parray	   *jobs = parray_new();
+	char		path[MAXPGPATH];
+	DIR		   *dir;
+	struct dirent *dent;
+	size_t		i;
+
+	if (default_mode == NULL)
+		elog(ERROR, "required parameter not specified: BACKUP_MODE "
+			 "(-b, --backup-mode) or --schedule");
+
+	join_path_components(path, backup_path, BACKUPS_DIR);
+	dir = opendir(path);
+	if (dir == NULL)
+		elog(ERROR, "Cannot open directory \"%s\": %s", path, strerror(errno));
+
+	while ((dent = readdir(dir)) != NULL)
+	{
+		char		child[MAXPGPATH];
+		struct stat	st;
+
+		if (strcmp(dent->d_name, ".") == 0 || strcmp(dent->d_name, "..") == 0)
+			continue;
+
+		join_path_components(child, path, dent->d_name);
+		if (lstat(child, &st) == -1)
+			elog(ERROR, "Cannot stat file \"%s\": %s", child, strerror(errno));
+
+		if (S_ISDIR(st.st_mode))
+			parray_append(names, pgut_strdup(dent->d_name));
+	}
+	closedir(dir);
+
+	parray_qsort(names, pgCompareString);
+
+	for (i = 0; i < parray_num(names); i++)
+		parray_append(jobs, new_job(parray_get(names, i), default_mode, 1));
+
+	free_dir_list(names);
+
+	return jobs;
+}
+
+static backup_job *
+new_job(const char *instance, const char *mode, int threads)
+{
+	backup_job *job = pgut_new(backup_job);
+
+	/* Check the mode now rather than in each backup */
+	if (pg_strcasecmp(mode, "auto") != 0)
+		parse_backup_mode(mode);
+
+	job->instance = pgut_strdup(instance);
+	job->mode = pgut_strdup(mode);
+	/* Backup cannot wait for more threads than there are */
+	job->threads = Min(threads, num_threads);
+	job->pid = 0;
+	job->done = false;
+	job->signalled = false;
+	job->exit_status = 0;
+	job->start_time = 0;
+	job->end_time = 0;
+
+	return job;
+}
+
+/*
+ * Run backup command for the job in a child process.
+ */
+static void
+start_job(backup_job *job, parray *backup_args)
+{
+	char	  **argv;
+	char		instance_opt[MAXPGPATH];
+	char		threads_opt[32];
+	int			argc = 0;
+	size_t		i;
+	pid_t		pid;
+
+	snprintf(instance_opt, sizeof(instance_opt), "--instance=%s", job->instance);
+	snprintf(threads_opt, sizeof(threads_opt), "%d", job->threads);
+
+	argv = (char **) palloc((10 + parray_num(backup_args)) * sizeof(char *));
+	argv[argc++] = (char *) PROGRAM_FULL_PATH;
+	argv[argc++] = "backup";
+	argv[argc++] = "-B";
+	argv[argc++] = backup_path;
+	argv[argc++] = instance_opt;
+	argv[argc++] = "-b";
+	argv[argc++] = job->mode;
+	argv[argc++] = "-j";
+	argv[argc++] = threads_opt;
+	for (i = 0; i < parray_num(backup_args); i++)
+		argv[argc++] = (char *) parray_get(backup_args, i);
+	argv[argc] = NULL;
+
+	elog(INFO, "Start %s backup of instance '%s' using %d threads",
+		 job->mode, job->instance, job->threads);
+
+	/* Output of the child must not be mixed with our buffered one */
+	fflush(stdout);
+	fflush(stderr);
+
+	pid = fork();
+	if (pid < 0)
+		elog(ERROR, "Cannot start backup of instance '%s': %s",
+			 job->instance, strerror(errno));
+
+	if (pid == 0)
+	{
+		execv(PROGRAM_FULL_PATH, argv);
+		fprintf(stderr, "Cannot execute \"%s\": %s\n", PROGRAM_FULL_PATH,
+				strerror(errno));
+		_exit(1);
+	}
+
+	job->pid = pid;
+	job->start_time = time(NULL);
+
+	pfree(argv);
+}
+
+/*
+ * Print status of all backups as a table.
+ */
+static void
+print_report(parray *jobs)
+{
+	int			width = strlen("Instance");
+	size_t		i;
+
+	for (i = 0; i < parray_num(jobs); i++)
+	{
+		backup_job *job = (backup_job *) parray_get(jobs, i);
+
+		width = Max(width, (int) strlen(job->instance));
+	}
+
+	printf("\n %-*s  %-6s  %7s  %-12s  %s\n", width, "Instance", "Mode",
+		   "Threads", "Status", "Time");
+
+	for (i = 0; i < parray_num(jobs); i++)
+	{
+		backup_job *job = (backup_job *) parray_get(jobs, i);
+		char		time_str[20] = "----";
+		const char *status;
+
+		if (job->pid == 0)
+			status = "NOT STARTED";
+		else if (job->exit_status == 0)
+			status = "OK";
+		else
+			status = "FAILED";
+
+		if (job->pid != 0)
+			snprintf(time_str, sizeof(time_str), "%.0fs",
+					 difftime(job->end_time, job->start_time));
+
+		printf(" %-*s  %-6s  %7d  %-12s  %s\n", width, job->instance,
+			   job->mode, job->threads, status, time_str);
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+static void
+backup_job_free(void *job)
+{
+	backup_job *j = (backup_job *) job;
+
+	pg_free(j->instance);
+	pg_free(j->mode);
+	pg_free(j);
+}
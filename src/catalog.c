@@ -489,6 +489,8 @@ catalog_get_backup_list(const char *instance_name, time_t requested_backup_id)
 			curr->parent_backup_link = *ancestor;
 	}
 
+	catalog_build_backup_graph(backups);
+
 	return backups;
 
 err_proc:
@@ -503,6 +505,75 @@ err_proc:
 	return NULL;
 }
 
+/*
+ * Visit the backup and its descendants in depth-first order.
+ */
+static void
+backup_graph_visit(pgBackup *backup, pgBackup *root, int depth, int *counter)
+{
+	int			i;
+
+	backup->root_backup = root;
+	backup->depth = depth;
+	backup->dag_enter = (*counter)++;
+
+	if (backup->children)
+		for (i = 0; i < parray_num(backup->children); i++)
+			backup_graph_visit((pgBackup *) parray_get(backup->children, i),
+							   root, depth + 1, counter);
+
+	/* All descendants are visited right after the backup */
+	backup->dag_leave = *counter - 1;
+}
+
+/*
+ * Compute positions of backups in the graph formed by parent_backup_link:
+ * the root of the chain, depth and children of every backup. Every backup
+ * is numbered in depth-first order, so descendants of the backup have
+ * numbers from dag_enter + 1 up to dag_leave, and queries about the chain
+ * don't need to walk it.
+ */
+void
+catalog_build_backup_graph(parray *backups)
+{
+	int			counter = 0;
+	int			i;
+
+	for (i = 0; i < parray_num(backups); i++)
+	{
+		pgBackup   *backup = (pgBackup *) parray_get(backups, i);
+
+		if (backup->children)
+			parray_free(backup->children);
+		backup->children = NULL;
+		backup->root_backup = NULL;
+		backup->depth = 0;
+		backup->dag_enter = -1;
+		backup->dag_leave = -1;
+	}
+
+	for (i = 0; i < parray_num(backups); i++)
+	{
+		pgBackup   *backup = (pgBackup *) parray_get(backups, i);
+		pgBackup   *parent = backup->parent_backup_link;
+
+		if (parent == NULL)
+			continue;
+
+		if (parent->children == NULL)
+			parent->children = parray_new();
+		parray_append(parent->children, backup);
+	}
+
+	for (i = 0; i < parray_num(backups); i++)
+	{
+		pgBackup   *backup = (pgBackup *) parray_get(backups, i);
+
+		if (backup->parent_backup_link == NULL)
+			backup_graph_visit(backup, backup, 0, &counter);
+	}
+}
+
 /*
  * Create list of backup datafiles.
  * If 'requested_backup_id' is INVALID_BACKUP_ID, exit with error.
@@ -617,7 +688,7 @@ catalog_get_last_data_backup(parray *backup_list, TimeLineID tli, time_t current
 					 * but this way we have an opportunity to detect and report all possible
 					 * anomalies.
 					 */
-					if (is_parent(full_backup->start_time, backup, true))
+					if (is_ancestor(full_backup, backup, true))
 					{
 						elog(INFO, "Parent backup: %s",
 							base36enc(backup->start_time));
@@ -1517,6 +1588,10 @@ pgBackupWriteControl(FILE *out, pgBackup *backup)
 	/* print external directories list */
 	if (backup->external_dir_str)
 		fio_fprintf(out, "external-dirs = '%s'\n", backup->external_dir_str);
+
+	/* print the reason of automatic choice of backup mode */
+	if (backup->mode_reason)
+		fio_fprintf(out, "backup-mode-reason = '%s'\n", backup->mode_reason);
 }
 
 /*
@@ -1548,7 +1623,7 @@ write_backup(pgBackup *backup)
 			 path_temp, strerror(errno_temp));
 	}
 
-	if (fio_rename(path_temp, path, FIO_BACKUP_HOST) < 0)
+	if (fio_durable_rename(path_temp, path, FIO_BACKUP_HOST) < 0)
 	{
 		errno_temp = errno;
 		fio_unlink(path_temp, FIO_BACKUP_HOST);
@@ -1648,6 +1723,15 @@ write_backup_filelist(pgBackup *backup, parray *files, const char *root,
 		if (file->n_blocks != BLOCKNUM_INVALID)
 			len += sprintf(line+len, ",\"n_blocks\":\"%i\"", file->n_blocks);
 
+		/*
+		 * Size and mtime of non-data files allow the next incremental backup
+		 * to skip unchanged files without reading them.
+		 */
+		if (S_ISREG(file->mode) && !file->is_datafile && file->mtime > 0)
+			len += sprintf(line+len, ",\"mtime\":\"" INT64_FORMAT "\","
+						   "\"full_size\":\"" INT64_FORMAT "\"",
+						   (int64) file->mtime, (int64) file->size);
+
 		len += sprintf(line+len, "}\n");
 
 		if (write_len + len >= BUFFERSZ)
@@ -1686,7 +1770,7 @@ write_backup_filelist(pgBackup *backup, parray *files, const char *root,
 			 path_temp, strerror(errno));
 	}
 
-	if (fio_rename(path_temp, path, FIO_BACKUP_HOST) < 0)
+	if (fio_durable_rename(path_temp, path, FIO_BACKUP_HOST) < 0)
 	{
 		errno_temp = errno;
 		fio_unlink(path_temp, FIO_BACKUP_HOST);
@@ -1750,6 +1834,7 @@ readBackupControlFile(const char *path)
 		{'b', 0, "from-replica",		&backup->from_replica, SOURCE_FILE_STRICT},
 		{'s', 0, "primary-conninfo",	&backup->primary_conninfo, SOURCE_FILE_STRICT},
 		{'s', 0, "external-dirs",		&backup->external_dir_str, SOURCE_FILE_STRICT},
+		{'s', 0, "backup-mode-reason",	&backup->mode_reason, SOURCE_FILE_STRICT},
 		{0}
 	};
 
@@ -1945,6 +2030,47 @@ deparse_compress_alg(int alg)
 	return NULL;
 }
 
+CompressLocation
+parse_compress_location(const char *arg)
+{
+	size_t		len;
+
+	/* Skip all spaces detected */
+	while (isspace((unsigned char)*arg))
+		arg++;
+	len = strlen(arg);
+
+	if (len == 0)
+		elog(ERROR, "compress location is empty");
+
+	if (pg_strncasecmp("source", arg, len) == 0)
+		return COMPRESS_LOCATION_SOURCE;
+	else if (pg_strncasecmp("target", arg, len) == 0)
+		return COMPRESS_LOCATION_TARGET;
+	else if (pg_strncasecmp("auto", arg, len) == 0)
+		return COMPRESS_LOCATION_AUTO;
+	else
+		elog(ERROR, "invalid compress location value \"%s\"", arg);
+
+	return COMPRESS_LOCATION_DEFAULT;
+}
+
+const char*
+deparse_compress_location(CompressLocation location)
+{
+	switch (location)
+	{
+		case COMPRESS_LOCATION_SOURCE:
+			return "source";
+		case COMPRESS_LOCATION_TARGET:
+			return "target";
+		case COMPRESS_LOCATION_AUTO:
+			return "auto";
+	}
+
+	return NULL;
+}
+
 /*
  * Fill PGNodeInfo struct with default values.
  */
@@ -2001,10 +2127,16 @@ pgBackupInit(pgBackup *backup)
 	backup->from_replica = false;
 	backup->parent_backup = INVALID_BACKUP_ID;
 	backup->parent_backup_link = NULL;
+	backup->root_backup = NULL;
+	backup->children = NULL;
+	backup->depth = 0;
+	backup->dag_enter = -1;
+	backup->dag_leave = -1;
 	backup->primary_conninfo = NULL;
 	backup->program_version[0] = '\0';
 	backup->server_version[0] = '\0';
 	backup->external_dir_str = NULL;
+	backup->mode_reason = NULL;
 }
 
 /* free pgBackup object */
@@ -2013,8 +2145,11 @@ pgBackupFree(void *backup)
 {
 	pgBackup *b = (pgBackup *) backup;
 
+	if (b->children)
+		parray_free(b->children);
 	pfree(b->primary_conninfo);
 	pfree(b->external_dir_str);
+	pfree(b->mode_reason);
 	pfree(backup);
 }
 
@@ -2107,6 +2242,14 @@ is_prolific(parray *backup_list, pgBackup *target_backup)
 	int i;
 	int child_counter = 0;
 
+	/* Children are known if the graph of backups is built */
+	if (target_backup->dag_enter >= 0)
+	{
+		if (target_backup->children == NULL)
+			return false;
+		backup_list = target_backup->children;
+	}
+
 	for (i = 0; i < parray_num(backup_list); i++)
 	{
 		pgBackup   *tmp_backup = (pgBackup *) parray_get(backup_list, i);
@@ -2138,9 +2281,14 @@ find_parent_full_backup(pgBackup *current_backup)
 	if (!current_backup)
 		elog(ERROR, "Target backup cannot be NULL");
 
-	while (base_full_backup->parent_backup_link != NULL)
+	if (current_backup->root_backup)
+		base_full_backup = current_backup->root_backup;
+	else
 	{
-		base_full_backup = base_full_backup->parent_backup_link;
+		while (base_full_backup->parent_backup_link != NULL)
+		{
+			base_full_backup = base_full_backup->parent_backup_link;
+		}
 	}
 
 	if (base_full_backup->backup_mode != BACKUP_MODE_FULL)
@@ -2247,6 +2395,28 @@ is_parent(time_t parent_backup_time, pgBackup *child_backup, bool inclusive)
 	return false;
 }
 
+/*
+ * The same as is_parent(), but for the backup, which is present in the list.
+ * Determine if descendant descend from ancestor using their positions in the
+ * graph of backups, so it takes constant time.
+ */
+bool
+is_ancestor(pgBackup *ancestor, pgBackup *descendant, bool inclusive)
+{
+	if (!ancestor || !descendant)
+		elog(ERROR, "Target backup cannot be NULL");
+
+	if (ancestor == descendant)
+		return inclusive;
+
+	/* Graph is not built, e.g. for backups not read from the catalog */
+	if (ancestor->dag_enter < 0 || descendant->dag_enter < 0)
+		return is_parent(ancestor->start_time, descendant, inclusive);
+
+	return ancestor->dag_enter < descendant->dag_enter &&
+		   descendant->dag_enter <= ancestor->dag_leave;
+}
+
 /*
  * Return backup index number.
  * Note: this index number holds true until new sorting of backup list
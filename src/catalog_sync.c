@@ -0,0 +1,952 @@
+/*-------------------------------------------------------------------------
+ *
+ * catalog_sync.c: copy backups and WAL of the instance to another catalog.
+ *
+ * Only backups and WAL segments missing in the destination catalog are
+ * transferred. Files are copied in parallel, each of them is verified by
+ * CRC at the destination side, and backup.control is copied last, so
+ * a backup appears in the destination catalog only when it is complete.
+ *
+ * Destination can also be an object storage, e.g. S3-compatible one. Then
+ * each file is uploaded by the user-supplied command under the key equal to
+ * its path relative to the catalog root, so the bucket mirrors the layout of
+ * the catalog. Objects are never listed, uploaded files are recorded in the
+ * manifest file kept in the instance directory of the source catalog and
+ * uploaded as well.
+ *
+ * The object storage only receives a copy of backups, which are completed
+ * in the local catalog. It is not a storage backend of the catalog: backup
+ * does not write into it, restore and validate do not read from it.
+ *
+ * Portions Copyright (c) 2019, Postgres Professional
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "pg_probackup.h"
+
+#include <unistd.h>
+
+#include "utils/thread.h"
+
+/*
+ * Destination catalog is either local or located at the remote host,
+ * accessed via remote agent.
+ */
+#define FIO_DST_HOST	FIO_REMOTE_HOST
+
+#define SYNC_BUFSIZE	(BLCKSZ * 8)
+
+#define DST_COMMAND_ATTEMPTS	5
+
+/* Object uploaded by --dst-command */
+typedef struct
+{
+	char	   *key;			/* path relative to the catalog root */
+	pg_crc32	crc;
+	int64		size;
+} manifest_entry;
+
+typedef struct
+{
+	parray	   *files;
+	const char *from_root;
+	const char *to_root;
+	bool		use_crc32c;		/* algorithm of CRC in backup_content.control */
+	bool		check_crc;		/* compare CRC with one of pgFile */
+
+	/* Number of files and bytes actually sent */
+	int			files_sent;
+	int64		bytes_sent;
+
+	/*
+	 * Return value from the thread.
+	 * 0 means there is no error, 1 - there is an error.
+	 */
+	int			ret;
+} catalog_sync_files_arg;
+
+static char dst_instance_path[MAXPGPATH];
+static char dst_arclog_path[MAXPGPATH];
+
+static const char *dst_command = NULL;
+
+/*
+ * Objects known to be uploaded, sorted by key. Files uploaded by threads
+ * are collected in manifest_pending and merged into the manifest after
+ * each backup.
+ */
+static parray *manifest = NULL;
+static parray *manifest_pending = NULL;
+static pthread_mutex_t manifest_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static bool sync_backup(pgBackup *backup);
+static int sync_wal(void);
+static void sync_files(parray *files, const char *from_root,
+					   const char *to_root, bool use_crc32c, bool check_crc,
+					   int *files_sent, int64 *bytes_sent);
+static void *sync_files_worker(void *arg);
+static bool sync_file(const char *from_path, const char *to_path,
+					  int64 size, pg_crc32 expected_crc, bool use_crc32c,
+					  bool check_crc, int64 *bytes_sent);
+static bool upload_file(const char *from_path, const char *key,
+						int64 size, pg_crc32 expected_crc, bool use_crc32c,
+						bool check_crc, int64 *bytes_sent);
+static void run_dst_command(const char *from_path, const char *key);
+static bool dst_file_exists(const char *to_path);
+static manifest_entry *manifest_find(const char *key);
+static void manifest_read(void);
+static void manifest_flush(void);
+static void manifest_entry_free(void *entry);
+static int manifest_entry_compare(const void *a, const void *b);
+static bool is_temp_wal_file(const char *name);
+static int compare_names(const void *a, const void *b);
+
+/*
+ * Entry point of pg_probackup CATALOG-SYNC subcommand.
+ */
+int
+do_catalog_sync(const char *dst_backup_path, const char *dst_cmd)
+{
+	parray	   *backup_list;
+	char		from_path[MAXPGPATH];
+	char		to_path[MAXPGPATH];
+	int			backups_synced = 0;
+	int			backups_failed = 0;
+	int			wal_synced;
+	int			i;
+
+	if (dst_backup_path == NULL && dst_cmd == NULL)
+		elog(ERROR, "required parameter not specified: --dst-backup-path or --dst-command");
+
+	if (dst_backup_path && dst_cmd)
+		elog(ERROR, "--dst-backup-path and --dst-command cannot be used together");
+
+	if (dst_cmd)
+	{
+		dst_command = dst_cmd;
+
+		/* Destination paths are object keys relative to the catalog root */
+		snprintf(dst_instance_path, MAXPGPATH, "%s/%s",
+				 BACKUPS_DIR, instance_name);
+		snprintf(dst_arclog_path, MAXPGPATH, "%s/%s", "wal", instance_name);
+
+		elog(INFO, "Syncing instance '%s' using --dst-command", instance_name);
+
+		manifest_read();
+	}
+	else
+	{
+		if (!is_absolute_path(dst_backup_path))
+			elog(ERROR, "--dst-backup-path must be an absolute path");
+
+		if (strcmp(dst_backup_path, backup_path) == 0)
+			elog(ERROR, "Source and destination backup catalogs are the same");
+
+		snprintf(dst_instance_path, MAXPGPATH, "%s/%s/%s",
+				 dst_backup_path, BACKUPS_DIR, instance_name);
+		snprintf(dst_arclog_path, MAXPGPATH, "%s/%s/%s",
+				 dst_backup_path, "wal", instance_name);
+
+		elog(INFO, "Syncing instance '%s' to backup catalog \"%s\"",
+			 instance_name, dst_backup_path);
+
+		/* Create instance directories in the destination catalog, if needed */
+		fio_mkdir(dst_instance_path, DIR_PERMISSION, FIO_DST_HOST);
+		fio_mkdir(dst_arclog_path, DIR_PERMISSION, FIO_DST_HOST);
+	}
+
+	/* Instance config is needed to use the destination catalog */
+	join_path_components(from_path, backup_instance_path,
+						 BACKUP_CATALOG_CONF_FILE);
+	join_path_components(to_path, dst_instance_path, BACKUP_CATALOG_CONF_FILE);
+	if (!dst_file_exists(to_path))
+		sync_file(from_path, to_path, 0, 0, true, false, NULL);
+
+	backup_list = catalog_get_backup_list(instance_name, INVALID_BACKUP_ID);
+
+	/* Go from the oldest backup, so parents are synced before children */
+	for (i = parray_num(backup_list) - 1; i >= 0; i--)
+	{
+		pgBackup   *backup = (pgBackup *) parray_get(backup_list, i);
+
+		if (interrupted)
+			elog(ERROR, "interrupted during catalog sync");
+
+		/* Only complete and consistent backups are synced */
+		if (backup->status != BACKUP_STATUS_OK &&
+			backup->status != BACKUP_STATUS_DONE)
+		{
+			elog(INFO, "Skip backup %s with status %s",
+				 base36enc(backup->start_time), status2str(backup->status));
+			continue;
+		}
+
+		/* Incremental backup is useless without its parent */
+		if (backup->backup_mode != BACKUP_MODE_FULL)
+		{
+			char		parent_control[MAXPGPATH];
+
+			snprintf(parent_control, MAXPGPATH, "%s/%s/%s", dst_instance_path,
+					 base36enc(backup->parent_backup), BACKUP_CONTROL_FILE);
+
+			if (!dst_file_exists(parent_control))
+			{
+				char	   *parent_id = base36enc_dup(backup->parent_backup);
+
+				elog(WARNING, "Skip backup %s, its parent %s is missing in "
+					 "the destination catalog", base36enc(backup->start_time),
+					 parent_id);
+				pg_free(parent_id);
+				continue;
+			}
+		}
+
+		/* Prevent the backup from being deleted or merged meanwhile */
+		if (!lock_backup(backup))
+		{
+			elog(WARNING, "Skip backup %s, it is used by another process",
+				 base36enc(backup->start_time));
+			continue;
+		}
+
+		if (sync_backup(backup))
+			backups_synced++;
+		else
+			backups_failed++;
+	}
+
+	wal_synced = sync_wal();
+
+	parray_walk(backup_list, pgBackupFree);
+	parray_free(backup_list);
+
+	if (manifest)
+	{
+		parray_walk(manifest, manifest_entry_free);
+		parray_free(manifest);
+		parray_free(manifest_pending);
+	}
+
+	elog(INFO, "Backups synced: %d, WAL files synced: %d",
+		 backups_synced, wal_synced);
+
+	if (backups_failed > 0)
+		elog(ERROR, "Failed to sync %d backups", backups_failed);
+
+	elog(INFO, "Catalog sync completed");
+
+	return 0;
+}
+
+/*
+ * Copy the backup to the destination catalog. Files already present in
+ * the destination, e.g. after interrupted sync, are not sent again if their
+ * CRC is valid. Return false, if some of the files cannot be synced.
+ */
+static bool
+sync_backup(pgBackup *backup)
+{
+	char	   *backup_id = base36enc_dup(backup->start_time);
+	char		from_root[MAXPGPATH];
+	char		to_root[MAXPGPATH];
+	char		from_path[MAXPGPATH];
+	char		to_path[MAXPGPATH];
+	char		base_path[MAXPGPATH];
+	char		external_prefix[MAXPGPATH];
+	parray	   *files;
+	uint32		backup_version = parse_program_version(backup->program_version);
+	bool		use_crc32c;
+	int			files_sent = 0;
+	int64		bytes_sent = 0;
+	time_t		start_time = time(NULL);
+	int			i;
+
+	pgBackupGetPath(backup, from_root, lengthof(from_root), NULL);
+	join_path_components(to_root, dst_instance_path, backup_id);
+
+	/*
+	 * Backup is already synced, if its backup.control is there and is the
+	 * same. It can differ, e.g. if the backup was pinned after previous sync,
+	 * then files are checked by CRC and backup.control is replaced.
+	 */
+	join_path_components(from_path, from_root, BACKUP_CONTROL_FILE);
+	join_path_components(to_path, to_root, BACKUP_CONTROL_FILE);
+	if (dst_command)
+	{
+		manifest_entry *entry = manifest_find(to_path);
+
+		/* Object cannot be unpromoted, it is just overwritten at the end */
+		if (entry &&
+			pgFileGetCRC(from_path, true, true, NULL, FIO_BACKUP_HOST) == entry->crc)
+		{
+			elog(LOG, "Backup %s is already synced", backup_id);
+			pg_free(backup_id);
+			return true;
+		}
+	}
+	else if (fio_access(to_path, F_OK, FIO_DST_HOST) == 0)
+	{
+		if (pgFileGetCRC(from_path, true, true, NULL, FIO_BACKUP_HOST) ==
+			fio_get_crc32(to_path, true, FIO_DST_HOST))
+		{
+			elog(LOG, "Backup %s is already synced", backup_id);
+			pg_free(backup_id);
+			return true;
+		}
+
+		/* Unpromote the backup until all its files are verified */
+		fio_unlink(to_path, FIO_DST_HOST);
+	}
+
+	elog(INFO, "Syncing backup %s", backup_id);
+
+	pgBackupGetPath(backup, base_path, lengthof(base_path), DATABASE_DIR);
+	pgBackupGetPath(backup, external_prefix, lengthof(external_prefix), EXTERNAL_DIR);
+	pgBackupGetPath(backup, from_path, lengthof(from_path), DATABASE_FILE_LIST);
+	files = dir_read_file_list(base_path, external_prefix, from_path,
+							   FIO_BACKUP_HOST);
+
+	/* The same rule to choose CRC algorithm is used by validation */
+	use_crc32c = backup_version <= 20021 || backup_version >= 20025;
+
+	/* Create directories first, they are sorted, so parents go first */
+	parray_qsort(files, pgFileComparePath);
+	if (!dst_command)
+		fio_mkdir(to_root, DIR_PERMISSION, FIO_DST_HOST);
+	for (i = 0; i < parray_num(files) && !dst_command; i++)
+	{
+		pgFile	   *file = (pgFile *) parray_get(files, i);
+
+		if (S_ISDIR(file->mode))
+		{
+			join_path_components(to_path, to_root,
+								 file->path + strlen(from_root) + 1);
+			fio_mkdir(to_path, DIR_PERMISSION, FIO_DST_HOST);
+		}
+	}
+
+	sync_files(files, from_root, to_root, use_crc32c, true,
+			   &files_sent, &bytes_sent);
+
+	parray_walk(files, pgFileFree);
+	parray_free(files);
+
+	if (interrupted)
+		elog(ERROR, "interrupted during catalog sync");
+
+	if (thread_interrupted)
+	{
+		thread_interrupted = false;
+		/* Keep track of uploaded files to resume the sync later */
+		if (dst_command)
+			manifest_flush();
+		elog(WARNING, "Backup %s is not synced", backup_id);
+		pg_free(backup_id);
+		return false;
+	}
+
+	/* Catalog files of the backup, backup.control goes last */
+	join_path_components(from_path, from_root, DATABASE_MAP);
+	if (fileExists(from_path, FIO_BACKUP_HOST))
+	{
+		join_path_components(to_path, to_root, DATABASE_MAP);
+		sync_file(from_path, to_path, 0, 0, true, false, &bytes_sent);
+	}
+
+	join_path_components(from_path, from_root, DATABASE_FILE_LIST);
+	join_path_components(to_path, to_root, DATABASE_FILE_LIST);
+	sync_file(from_path, to_path, 0, 0, true, false, &bytes_sent);
+
+	/*
+	 * The backup must be complete on disk of the destination host, before
+	 * backup.control promotes it, including directories created above.
+	 */
+	if (!dst_command && fio_sync_tree(to_root, FIO_DST_HOST) < 0)
+		elog(ERROR, "Cannot sync backup directory \"%s\": %s", to_root,
+			 strerror(errno));
+
+	join_path_components(from_path, from_root, BACKUP_CONTROL_FILE);
+	join_path_components(to_path, to_root, BACKUP_CONTROL_FILE);
+	sync_file(from_path, to_path, 0, 0, true, false, &bytes_sent);
+
+	if (dst_command)
+		manifest_flush();
+
+	elog(INFO, "Backup %s is synced, files sent: %d, bytes sent: " INT64_FORMAT
+		 ", time elapsed: %.0f sec", backup_id, files_sent, bytes_sent,
+		 difftime(time(NULL), start_time));
+
+	pg_free(backup_id);
+	return true;
+}
+
+/*
+ * Copy WAL files missing in the destination archive. Files are renamed into
+ * place only when they are complete, so presence of a file means that it is
+ * already synced. Return number of files sent.
+ */
+static int
+sync_wal(void)
+{
+	parray	   *src_files = parray_new();
+	parray	   *dst_names = parray_new();
+	parray	   *files = parray_new();
+	DIR		   *dir;
+	struct dirent *de;
+	int			files_sent = 0;
+	int64		bytes_sent = 0;
+	int			i;
+
+	dir_list_file(src_files, arclog_path, false, false, false, 0,
+				  FIO_BACKUP_HOST);
+
+	/* Only names are needed to find out, what is missing */
+	if (!dst_command)
+	{
+		dir = fio_opendir(dst_arclog_path, FIO_DST_HOST);
+		if (dir == NULL)
+			elog(ERROR, "Cannot open directory \"%s\": %s",
+				 dst_arclog_path, strerror(errno));
+
+		while ((de = fio_readdir(dir)) != NULL)
+			parray_append(dst_names, pgut_strdup(de->d_name));
+		fio_closedir(dir);
+
+		parray_qsort(dst_names, compare_names);
+	}
+
+	for (i = 0; i < parray_num(src_files); i++)
+	{
+		pgFile	   *file = (pgFile *) parray_get(src_files, i);
+
+		/* Skip files, which are being written right now */
+		if (!S_ISREG(file->mode) || is_temp_wal_file(file->name))
+			continue;
+
+		if (dst_command)
+		{
+			char		key[MAXPGPATH];
+
+			join_path_components(key, dst_arclog_path, file->name);
+			if (manifest_find(key) != NULL)
+				continue;
+		}
+		else if (parray_bsearch(dst_names, file->name, compare_names) != NULL)
+			continue;
+
+		parray_append(files, file);
+	}
+
+	elog(INFO, "Syncing %lu WAL files", (unsigned long) parray_num(files));
+
+	sync_files(files, arclog_path, dst_arclog_path, true, false,
+			   &files_sent, &bytes_sent);
+
+	if (dst_command)
+		manifest_flush();
+
+	parray_free(files);
+	parray_walk(src_files, pgFileFree);
+	parray_free(src_files);
+	parray_walk(dst_names, pfree);
+	parray_free(dst_names);
+
+	if (interrupted)
+		elog(ERROR, "interrupted during catalog sync");
+
+	if (thread_interrupted)
+		elog(ERROR, "WAL files sync failed");
+
+	return files_sent;
+}
+
+/*
+ * Copy files from from_root to to_root in num_threads threads.
+ * Errors are reported by thread_interrupted flag.
+ */
+static void
+sync_files(parray *files, const char *from_root, const char *to_root,
+		   bool use_crc32c, bool check_crc, int *files_sent,
+		   int64 *bytes_sent)
+{
+	pthread_t  *threads;
+	catalog_sync_files_arg *threads_args;
+	bool		sync_isok = true;
+	int			i;
+
+	for (i = 0; i < parray_num(files); i++)
+	{
+		pgFile	   *file = (pgFile *) parray_get(files, i);
+
+		pg_atomic_clear_flag(&file->lock);
+	}
+
+	threads = (pthread_t *) palloc(sizeof(pthread_t) * num_threads);
+	threads_args = (catalog_sync_files_arg *)
+		palloc(sizeof(catalog_sync_files_arg) * num_threads);
+
+	thread_interrupted = false;
+	for (i = 0; i < num_threads; i++)
+	{
+		catalog_sync_files_arg *arg = &(threads_args[i]);
+
+		arg->files = files;
+		arg->from_root = from_root;
+		arg->to_root = to_root;
+		arg->use_crc32c = use_crc32c;
+		arg->check_crc = check_crc;
+		arg->files_sent = 0;
+		arg->bytes_sent = 0;
+		/* By default there are some error */
+		arg->ret = 1;
+
+		pthread_create(&threads[i], NULL, sync_files_worker, arg);
+	}
+
+	/* Wait threads */
+	for (i = 0; i < num_threads; i++)
+	{
+		catalog_sync_files_arg *arg = &(threads_args[i]);
+
+		pthread_join(threads[i], NULL);
+		if (arg->ret == 1)
+			sync_isok = false;
+		*files_sent += arg->files_sent;
+		*bytes_sent += arg->bytes_sent;
+	}
+
+	/* Let the caller know about the error in any thread */
+	if (!sync_isok)
+		thread_interrupted = true;
+
+	pfree(threads);
+	pfree(threads_args);
+}
+
+static void *
+sync_files_worker(void *arg)
+{
+	catalog_sync_files_arg *arguments = (catalog_sync_files_arg *) arg;
+	size_t		from_root_len = strlen(arguments->from_root);
+	int			n_files = parray_num(arguments->files);
+	int			i;
+
+	for (i = 0; i < n_files; i++)
+	{
+		pgFile	   *file = (pgFile *) parray_get(arguments->files, i);
+		char		to_path[MAXPGPATH];
+		bool		check_crc = arguments->check_crc;
+
+		if (!pg_atomic_test_set_flag(&file->lock))
+			continue;
+
+		if (interrupted || thread_interrupted)
+			elog(ERROR, "interrupted during catalog sync");
+
+		/* Directories are already created */
+		if (!S_ISREG(file->mode))
+			continue;
+
+		/* File was not modified since previous backup, so it is not there */
+		if (arguments->check_crc && file->write_size == BYTES_INVALID)
+			continue;
+
+		/* Since 2.0.25 CRC of pg_control is the one of its content */
+		if (check_crc && strcmp(file->name, "pg_control") == 0 &&
+			!file->external_dir_num)
+			check_crc = false;
+
+		elog(VERBOSE, "Syncing file \"%s\"", file->path);
+
+		join_path_components(to_path, arguments->to_root,
+							 file->path + from_root_len + 1);
+
+		if (sync_file(file->path, to_path, file->write_size, file->crc,
+					  arguments->use_crc32c, check_crc,
+					  &arguments->bytes_sent))
+			arguments->files_sent++;
+	}
+
+	/* Close connection to the remote agent */
+	fio_disconnect();
+
+	/* Files transferring is successful */
+	arguments->ret = 0;
+
+	return NULL;
+}
+
+/*
+ * Copy the file to the destination catalog through a temporary file, which
+ * is renamed into place only after its CRC at the destination is checked.
+ * If the file is already there with the same size (size of backup file
+ * according to backup_content.control) and valid CRC, it is not sent again.
+ * If check_crc is true, the file must have expected_crc,
+ * otherwise its copy must be the same as the source.
+ * Return true if the file was sent.
+ */
+static bool
+sync_file(const char *from_path, const char *to_path, int64 size,
+		  pg_crc32 expected_crc, bool use_crc32c, bool check_crc,
+		  int64 *bytes_sent)
+{
+	char		to_path_temp[MAXPGPATH];
+	char		buf[SYNC_BUFSIZE];
+	struct stat	st;
+	FILE	   *in;
+	int			out;
+	pg_crc32	crc;
+	ssize_t		read_len;
+	int64		sent = 0;
+
+	if (dst_command)
+		return upload_file(from_path, to_path, size, expected_crc, use_crc32c,
+						   check_crc, bytes_sent);
+
+	if (check_crc &&
+		fio_stat(to_path, &st, true, FIO_DST_HOST) == 0 &&
+		st.st_size == size &&
+		fio_get_crc32(to_path, use_crc32c, FIO_DST_HOST) == expected_crc)
+	{
+		elog(VERBOSE, "File \"%s\" is already synced", to_path);
+		return false;
+	}
+
+	snprintf(to_path_temp, MAXPGPATH, "%s.part", to_path);
+
+	in = fio_fopen(from_path, PG_BINARY_R, FIO_BACKUP_HOST);
+	if (in == NULL)
+		elog(ERROR, "Cannot open source file \"%s\": %s", from_path,
+			 strerror(errno));
+
+	out = fio_open(to_path_temp, O_RDWR | O_CREAT | O_TRUNC | PG_BINARY,
+				   FIO_DST_HOST);
+	if (out < 0)
+		elog(ERROR, "Cannot open destination file \"%s\": %s", to_path_temp,
+			 strerror(errno));
+
+	INIT_FILE_CRC32(use_crc32c, crc);
+
+	while ((read_len = fio_fread(in, buf, sizeof(buf))) > 0)
+	{
+		COMP_FILE_CRC32(use_crc32c, crc, buf, read_len);
+
+		if (fio_write(out, buf, read_len) != read_len)
+			elog(ERROR, "Cannot write to file \"%s\": %s", to_path_temp,
+				 strerror(errno));
+		sent += read_len;
+	}
+
+	FIN_FILE_CRC32(use_crc32c, crc);
+
+	if (fio_flush(out) != 0 || fio_close(out) != 0)
+		elog(ERROR, "Cannot write file \"%s\": %s", to_path_temp,
+			 strerror(errno));
+	fio_fclose(in);
+
+	/* Source file must not be corrupted */
+	if (check_crc && crc != expected_crc)
+		elog(ERROR, "Invalid CRC of backup file \"%s\" : %X. Expected %X",
+			 from_path, crc, expected_crc);
+
+	/* Copy must reach the destination intact */
+	if (fio_get_crc32(to_path_temp, use_crc32c, FIO_DST_HOST) != crc)
+		elog(ERROR, "Invalid CRC of synced file \"%s\"", to_path_temp);
+
+	/* Synced file must survive a crash of the destination host */
+	if (fio_durable_rename(to_path_temp, to_path, FIO_DST_HOST) < 0)
+		elog(ERROR, "Cannot rename file \"%s\" to \"%s\": %s",
+			 to_path_temp, to_path, strerror(errno));
+
+	if (bytes_sent)
+		*bytes_sent += sent;
+
+	return true;
+}
+
+/*
+ * Upload the file by --dst-command under the key. Just like sync_file(), the
+ * file is checked against expected_crc before it is sent, if check_crc is
+ * true, and it is not sent again, if the manifest has the same object.
+ * Return true if the file was sent.
+ */
+static bool
+upload_file(const char *from_path, const char *key, int64 size,
+			pg_crc32 expected_crc, bool use_crc32c, bool check_crc,
+			int64 *bytes_sent)
+{
+	manifest_entry *entry;
+	struct stat	st;
+	pg_crc32	crc;
+
+	if (check_crc)
+	{
+		entry = manifest_find(key);
+		if (entry && entry->size == size && entry->crc == expected_crc)
+		{
+			elog(VERBOSE, "File \"%s\" is already synced", key);
+			return false;
+		}
+	}
+
+	if (fio_stat(from_path, &st, true, FIO_BACKUP_HOST) < 0)
+		elog(ERROR, "Cannot stat source file \"%s\": %s", from_path,
+			 strerror(errno));
+
+	/* Source file must not be corrupted */
+	crc = pgFileGetCRC(from_path, use_crc32c, true, NULL, FIO_BACKUP_HOST);
+	if (check_crc && crc != expected_crc)
+		elog(ERROR, "Invalid CRC of backup file \"%s\" : %X. Expected %X",
+			 from_path, crc, expected_crc);
+
+	run_dst_command(from_path, key);
+
+	entry = pgut_new(manifest_entry);
+	entry->key = pgut_strdup(key);
+	entry->crc = crc;
+	entry->size = st.st_size;
+
+	pthread_lock(&manifest_mutex);
+	parray_append(manifest_pending, entry);
+	pthread_mutex_unlock(&manifest_mutex);
+
+	if (bytes_sent)
+		*bytes_sent += st.st_size;
+
+	return true;
+}
+
+/*
+ * Run --dst-command for the file, replacing %p with its path and %f with
+ * the key. Failed command is retried with exponential backoff, as object
+ * storages tend to fail requests under load.
+ */
+static void
+run_dst_command(const char *from_path, const char *key)
+{
+	PQExpBufferData cmd;
+	const char *sp;
+	int			delay = 1;
+	int			attempt;
+	int			rc;
+
+	initPQExpBuffer(&cmd);
+	for (sp = dst_command; *sp; sp++)
+	{
+		if (*sp == '%' && sp[1] == 'p')
+		{
+			appendPQExpBufferStr(&cmd, from_path);
+			sp++;
+		}
+		else if (*sp == '%' && sp[1] == 'f')
+		{
+			appendPQExpBufferStr(&cmd, key);
+			sp++;
+		}
+		else if (*sp == '%' && sp[1] == '%')
+		{
+			appendPQExpBufferChar(&cmd, '%');
+			sp++;
+		}
+		else
+			appendPQExpBufferChar(&cmd, *sp);
+	}
+
+	for (attempt = 1;; attempt++)
+	{
+		char	   *reason;
+
+		elog(VERBOSE, "Executing command \"%s\"", cmd.data);
+
+		rc = system(cmd.data);
+		if (rc == 0)
+			break;
+
+		if (interrupted || thread_interrupted)
+			elog(ERROR, "interrupted during catalog sync");
+
+		reason = wait_result_to_str(rc);
+		if (attempt >= DST_COMMAND_ATTEMPTS)
+			elog(ERROR, "Command \"%s\" failed: %s", cmd.data, reason);
+
+		elog(WARNING, "Command \"%s\" failed: %s, retry in %d sec",
+			 cmd.data, reason, delay);
+		pfree(reason);
+
+		sleep(delay);
+		delay *= 2;
+	}
+
+	termPQExpBuffer(&cmd);
+}
+
+/*
+ * Check if the file is present in the destination catalog, or in the
+ * manifest if --dst-command is used.
+ */
+static bool
+dst_file_exists(const char *to_path)
+{
+	if (dst_command)
+		return manifest_find(to_path) != NULL;
+
+	return fio_access(to_path, F_OK, FIO_DST_HOST) == 0;
+}
+
+static manifest_entry *
+manifest_find(const char *key)
+{
+	manifest_entry	key_entry;
+	void	   *res;
+
+	key_entry.key = (char *) key;
+	res = parray_bsearch(manifest, &key_entry, manifest_entry_compare);
+
+	return res ? *(manifest_entry **) res : NULL;
+}
+
+/*
+ * Read the manifest of uploaded objects from the instance directory.
+ * Each line is "crc size key".
+ */
+static void
+manifest_read(void)
+{
+	char		path[MAXPGPATH];
+	char		buf[MAXPGPATH * 2];
+	FILE	   *fp;
+
+	manifest = parray_new();
+	manifest_pending = parray_new();
+
+	join_path_components(path, backup_instance_path, SYNC_MANIFEST_FILE);
+	if (!fileExists(path, FIO_BACKUP_HOST))
+		return;
+
+	fp = fio_open_stream(path, FIO_BACKUP_HOST);
+	if (fp == NULL)
+		elog(ERROR, "Cannot open \"%s\": %s", path, strerror(errno));
+
+	while (fgets(buf, lengthof(buf), fp))
+	{
+		manifest_entry *entry;
+		uint32		crc;
+		int64		size;
+		int			key_pos;
+
+		if (sscanf(buf, "%u " INT64_FORMAT " %n", &crc, &size, &key_pos) != 2)
+			elog(ERROR, "Invalid line in \"%s\": %s", path, buf);
+
+		buf[strcspn(buf, "\n")] = '\0';
+
+		entry = pgut_new(manifest_entry);
+		entry->key = pgut_strdup(buf + key_pos);
+		entry->crc = crc;
+		entry->size = size;
+		parray_append(manifest, entry);
+	}
+	fio_close_stream(fp);
+
+	parray_qsort(manifest, manifest_entry_compare);
+}
+
+/*
+ * Merge objects uploaded since previous call into the manifest, write it
+ * into the instance directory and upload it.
+ */
+static void
+manifest_flush(void)
+{
+	char		path[MAXPGPATH];
+	char		path_temp[MAXPGPATH];
+	char		key[MAXPGPATH];
+	parray	   *new_entries = parray_new();
+	FILE	   *out;
+	int			i;
+
+	for (i = 0; i < parray_num(manifest_pending); i++)
+	{
+		manifest_entry *pending = (manifest_entry *) parray_get(manifest_pending, i);
+		manifest_entry *entry = manifest_find(pending->key);
+
+		/* Object was uploaded again, e.g. backup.control */
+		if (entry)
+		{
+			entry->crc = pending->crc;
+			entry->size = pending->size;
+			manifest_entry_free(pending);
+		}
+		else
+			parray_append(new_entries, pending);
+	}
+	parray_concat(manifest, new_entries);
+	parray_free(new_entries);
+	parray_qsort(manifest, manifest_entry_compare);
+
+	/* All pending entries are either merged or freed */
+	parray_free(manifest_pending);
+	manifest_pending = parray_new();
+
+	join_path_components(path, backup_instance_path, SYNC_MANIFEST_FILE);
+	snprintf(path_temp, sizeof(path_temp), "%s.tmp", path);
+
+	out = fio_fopen(path_temp, PG_BINARY_W, FIO_BACKUP_HOST);
+	if (out == NULL)
+		elog(ERROR, "Cannot open file \"%s\": %s", path_temp,
+			 strerror(errno));
+
+	for (i = 0; i < parray_num(manifest); i++)
+	{
+		manifest_entry *entry = (manifest_entry *) parray_get(manifest, i);
+
+		fio_fprintf(out, "%u " INT64_FORMAT " %s\n",
+					entry->crc, entry->size, entry->key);
+	}
+
+	if (fio_fflush(out) || fio_fclose(out))
+		elog(ERROR, "Cannot write file \"%s\": %s", path_temp,
+			 strerror(errno));
+
+	if (fio_durable_rename(path_temp, path, FIO_BACKUP_HOST) < 0)
+		elog(ERROR, "Cannot rename file \"%s\" to \"%s\": %s",
+			 path_temp, path, strerror(errno));
+
+	/* Readers of the bucket can find backups and WAL without listing it */
+	join_path_components(key, dst_instance_path, SYNC_MANIFEST_FILE);
+	run_dst_command(path, key);
+}
+
+static void
+manifest_entry_free(void *entry)
+{
+	pg_free(((manifest_entry *) entry)->key);
+	pg_free(entry);
+}
+
+static int
+manifest_entry_compare(const void *a, const void *b)
+{
+	return strcmp((*(manifest_entry * const *) a)->key,
+				  (*(manifest_entry * const *) b)->key);
+}
+
+/*
+ * Temporary files of archive-push and archive-receive are not synced.
+ */
+static bool
+is_temp_wal_file(const char *name)
+{
+	size_t		len = strlen(name);
+
+	return (len > strlen(".part") &&
+			strcmp(name + len - strlen(".part"), ".part") == 0) ||
+		   (len > strlen(".partial") &&
+			strcmp(name + len - strlen(".partial"), ".partial") == 0);
+}
+
+static int
+compare_names(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
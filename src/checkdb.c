@@ -155,7 +155,7 @@ check_files(void *arg)
 				 i + 1, n_files_list, file->path);
 
 		/* stat file to check its current state */
-		ret = stat(file->path, &buf);
+		ret = fio_stat(file->path, &buf, true, FIO_DB_HOST);
 		if (ret == -1)
 		{
 			if (errno == ENOENT)
@@ -198,6 +198,9 @@ check_files(void *arg)
 			elog(WARNING, "unexpected file type %d", buf.st_mode);
 	}
 
+	/* Close connection to the remote agent */
+	fio_disconnect();
+
 	/* Ret values:
 	 * 0 everything is ok
 	 * 1 thread errored during execution, e.g. interruption (default value)
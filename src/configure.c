@@ -18,10 +18,12 @@
 static void assign_log_level_console(ConfigOption *opt, const char *arg);
 static void assign_log_level_file(ConfigOption *opt, const char *arg);
 static void assign_compress_alg(ConfigOption *opt, const char *arg);
+static void assign_compress_location(ConfigOption *opt, const char *arg);
 
 static char *get_log_level_console(ConfigOption *opt);
 static char *get_log_level_file(ConfigOption *opt);
 static char *get_compress_alg(ConfigOption *opt);
+static char *get_compress_location(ConfigOption *opt);
 
 static void show_configure_start(void);
 static void show_configure_end(void);
@@ -69,6 +71,11 @@ ConfigOption instance_options[] =
 		&instance_config.external_dir_str, SOURCE_CMD, 0,
 		OPTION_INSTANCE_GROUP, 0, option_get_value
 	},
+	{
+		's', 239, "stripe-paths",
+		&instance_config.stripe_paths_str, SOURCE_CMD, 0,
+		OPTION_INSTANCE_GROUP, 0, option_get_value
+	},
 	/* Connection options */
 	{
 		's', 'd', "pgdatabase",
@@ -205,6 +212,11 @@ ConfigOption instance_options[] =
 		&instance_config.compress_level, SOURCE_CMD, 0,
 		OPTION_COMPRESS_GROUP, 0, option_get_value
 	},
+	{
+		'f', 232, "compress-location",
+		assign_compress_location, SOURCE_CMD, 0,
+		OPTION_COMPRESS_GROUP, 0, get_compress_location
+	},
 	/* Remote backup options */
 	{
 		's', 224, "remote-proto",
@@ -366,6 +378,7 @@ init_config(InstanceConfig *config, const char *instance_name)
 
 	config->compress_alg = COMPRESS_ALG_DEFAULT;
 	config->compress_level = COMPRESS_LEVEL_DEFAULT;
+	config->compress_location = COMPRESS_LOCATION_DEFAULT;
 
 	config->remote.proto = (char*)"ssh";
 }
@@ -381,6 +394,7 @@ readInstanceConfigFile(const char *instance_name)
 	char	   *log_level_console = NULL;
 	char	   *log_level_file = NULL;
 	char	   *compress_alg = NULL;
+	char	   *compress_location = NULL;
 	int			parsed_options;
 
 	ConfigOption instance_options[] =
@@ -408,6 +422,11 @@ readInstanceConfigFile(const char *instance_name)
 			&instance->external_dir_str, SOURCE_CMD, 0,
 			OPTION_INSTANCE_GROUP, 0, option_get_value
 		},
+		{
+			's', 239, "stripe-paths",
+			&instance->stripe_paths_str, SOURCE_CMD, 0,
+			OPTION_INSTANCE_GROUP, 0, option_get_value
+		},
 		/* Connection options */
 		{
 			's', 'd', "pgdatabase",
@@ -552,6 +571,11 @@ readInstanceConfigFile(const char *instance_name)
 			&instance->compress_level, SOURCE_CMD, 0,
 			OPTION_COMPRESS_GROUP, 0, option_get_value
 		},
+		{
+			's', 232, "compress-location",
+			&compress_location, SOURCE_CMD, 0,
+			OPTION_COMPRESS_GROUP, 0, option_get_value
+		},
 		/* Remote backup options */
 		{
 			's', 224, "remote-proto",
@@ -630,6 +654,9 @@ readInstanceConfigFile(const char *instance_name)
 	if (compress_alg)
 		instance->compress_alg = parse_compress_alg(compress_alg);
 
+	if (compress_location)
+		instance->compress_location = parse_compress_location(compress_location);
+
 #if PG_VERSION_NUM >= 110000
 	/* If for some reason xlog-seg-size is missing, then set it to 16MB */
 	if (!instance->xlog_seg_size)
@@ -658,6 +685,12 @@ assign_compress_alg(ConfigOption *opt, const char *arg)
 	instance_config.compress_alg = parse_compress_alg(arg);
 }
 
+static void
+assign_compress_location(ConfigOption *opt, const char *arg)
+{
+	instance_config.compress_location = parse_compress_location(arg);
+}
+
 static char *
 get_log_level_console(ConfigOption *opt)
 {
@@ -676,6 +709,12 @@ get_compress_alg(ConfigOption *opt)
 	return pstrdup(deparse_compress_alg(instance_config.compress_alg));
 }
 
+static char *
+get_compress_location(ConfigOption *opt)
+{
+	return pstrdup(deparse_compress_location(instance_config.compress_location));
+}
+
 /*
  * Initialize configure visualization.
  */
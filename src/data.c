@@ -15,8 +15,16 @@
 #include <common/pg_lzcompress.h>
 #include "utils/file.h"
 
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
 
 #ifdef HAVE_LIBZ
 #include <zlib.h>
@@ -24,6 +32,10 @@
 
 #include "utils/thread.h"
 
+/* Buffer to read backup files back with O_DIRECT, and its alignment */
+#define READ_BACK_BUFSIZE	(1024 * 1024)
+#define READ_BACK_ALIGN		4096
+
 /* Union to ease operations on relation pages */
 typedef union DataPage
 {
@@ -32,26 +44,149 @@ typedef union DataPage
 } DataPage;
 
 #ifdef HAVE_LIBZ
-/* Implementation of zlib compression method */
+/*
+ * zlib streams of the thread. Pages are compressed one by one, and
+ * deflateInit()/inflateInit() allocate and initialize hundreds of kilobytes
+ * of state, which costs more than compression of a page itself. So streams
+ * are created once per thread and only reset between pages.
+ */
+typedef struct zlib_context
+{
+	z_stream	deflate_stream;
+	int			deflate_level;	/* -1 if deflate_stream is not initialized */
+	z_stream	inflate_stream;
+	bool		inflate_inited;
+} zlib_context;
+
+#ifndef WIN32
+static pthread_key_t zlib_context_key;
+static pthread_once_t zlib_context_key_once = PTHREAD_ONCE_INIT;
+
+/* Release streams when the thread exits */
+static void
+zlib_context_free(void *arg)
+{
+	zlib_context *ctx = (zlib_context *) arg;
+
+	if (ctx->deflate_level >= 0)
+		deflateEnd(&ctx->deflate_stream);
+	if (ctx->inflate_inited)
+		inflateEnd(&ctx->inflate_stream);
+	pg_free(ctx);
+}
+
+static void
+zlib_context_key_init(void)
+{
+	pthread_key_create(&zlib_context_key, zlib_context_free);
+}
+#else
+static __declspec(thread) zlib_context *zlib_thread_context = NULL;
+#endif
+
+static zlib_context *
+get_zlib_context(void)
+{
+	zlib_context *ctx;
+
+#ifndef WIN32
+	pthread_once(&zlib_context_key_once, zlib_context_key_init);
+	ctx = (zlib_context *) pthread_getspecific(zlib_context_key);
+#else
+	ctx = zlib_thread_context;
+#endif
+
+	if (ctx == NULL)
+	{
+		ctx = pgut_new(zlib_context);
+		MemSet(ctx, 0, sizeof(zlib_context));
+		ctx->deflate_level = -1;
+#ifndef WIN32
+		pthread_setspecific(zlib_context_key, ctx);
+#else
+		zlib_thread_context = ctx;
+#endif
+	}
+
+	return ctx;
+}
+
+/*
+ * Implementation of zlib compression method.
+ * Produces the same output as compress2() does.
+ */
 static int32
 zlib_compress(void *dst, size_t dst_size, void const *src, size_t src_size,
 			  int level)
 {
-	uLongf		compressed_size = dst_size;
-	int			rc = compress2(dst, &compressed_size, src, src_size,
-							   level);
+	zlib_context *ctx = get_zlib_context();
+	z_stream   *zs = &ctx->deflate_stream;
+	int			rc;
+
+	/* Stream is initialized with compression level, so it must be the same */
+	if (ctx->deflate_level != level)
+	{
+		if (ctx->deflate_level >= 0)
+			deflateEnd(zs);
+		ctx->deflate_level = -1;
+
+		MemSet(zs, 0, sizeof(z_stream));
+		rc = deflateInit(zs, level);
+		if (rc != Z_OK)
+			return rc;
+		ctx->deflate_level = level;
+	}
+	else if ((rc = deflateReset(zs)) != Z_OK)
+		return rc;
 
-	return rc == Z_OK ? compressed_size : rc;
+	zs->next_in = (Bytef *) src;
+	zs->avail_in = src_size;
+	zs->next_out = (Bytef *) dst;
+	zs->avail_out = dst_size;
+
+	rc = deflate(zs, Z_FINISH);
+	if (rc == Z_STREAM_END)
+		return zs->total_out;
+
+	/* Destination buffer is too small */
+	return rc == Z_OK ? Z_BUF_ERROR : rc;
 }
 
-/* Implementation of zlib compression method */
+/*
+ * Implementation of zlib decompression method.
+ * Reports errors the same way as uncompress() does.
+ */
 static int32
 zlib_decompress(void *dst, size_t dst_size, void const *src, size_t src_size)
 {
-	uLongf		dest_len = dst_size;
-	int			rc = uncompress(dst, &dest_len, src, src_size);
+	zlib_context *ctx = get_zlib_context();
+	z_stream   *zs = &ctx->inflate_stream;
+	int			rc;
 
-	return rc == Z_OK ? dest_len : rc;
+	if (!ctx->inflate_inited)
+	{
+		MemSet(zs, 0, sizeof(z_stream));
+		rc = inflateInit(zs);
+		if (rc != Z_OK)
+			return rc;
+		ctx->inflate_inited = true;
+	}
+	else if ((rc = inflateReset(zs)) != Z_OK)
+		return rc;
+
+	zs->next_in = (Bytef *) src;
+	zs->avail_in = src_size;
+	zs->next_out = (Bytef *) dst;
+	zs->avail_out = dst_size;
+
+	rc = inflate(zs, Z_FINISH);
+	if (rc == Z_STREAM_END)
+		return zs->total_out;
+
+	/* Input is truncated or destination buffer is too small */
+	if (rc == Z_NEED_DICT || (rc == Z_BUF_ERROR && zs->avail_in == 0))
+		return Z_DATA_ERROR;
+	return rc == Z_OK ? Z_BUF_ERROR : rc;
 }
 #endif
 
@@ -293,6 +428,8 @@ read_page_from_file(pgFile *file, BlockNumber blknum,
  *         SkipCurrentPage(-3) if we need to skip this page
  *         PageIsTruncated(-2) if the page was truncated
  *         PageIsCorrupted(-4) if the page check mismatch
+ *         PageIsDeferred(-5) if the page is not valid after given number
+ *         of read attempts and defer_invalid is true
  */
 static int32
 prepare_page(ConnectionArgs *arguments,
@@ -301,16 +438,23 @@ prepare_page(ConnectionArgs *arguments,
 			 FILE *in, BlockNumber *n_skipped,
 			 BackupMode backup_mode,
 			 Page page, bool strict,
+			 int attempts, bool defer_invalid,
 			 uint32 checksum_version,
 			 int ptrack_version_num,
 			 const char *ptrack_schema)
 {
 	XLogRecPtr	page_lsn = 0;
-	int			try_again = 100;
+	int			try_again = attempts;
 	bool		page_is_valid = false;
 	bool		page_is_truncated = false;
 	BlockNumber absolute_blknum = file->segno * RELSEG_SIZE + blknum;
 
+	/*
+	 * ptrack gives pages of the main fork only, pages of other forks are
+	 * always read from the file.
+	 */
+	if (IsNotMainFork(file))
+		ptrack_version_num = 0;
 	/* check for interrupt */
 	if (interrupted || thread_interrupted)
 		elog(ERROR, "Interrupted during page reading");
@@ -320,7 +464,8 @@ prepare_page(ConnectionArgs *arguments,
 	 * Under high write load it's possible that we've read partly
 	 * flushed page, so try several times before throwing an error.
 	 */
-	if (backup_mode != BACKUP_MODE_DIFF_PTRACK || ptrack_version_num >= 20)
+	if (backup_mode != BACKUP_MODE_DIFF_PTRACK || ptrack_version_num == 0 ||
+		ptrack_version_num >= 20)
 	{
 		while(!page_is_valid && try_again)
 		{
@@ -346,13 +491,29 @@ prepare_page(ConnectionArgs *arguments,
 			 */
 			//elog(WARNING, "Checksum_Version: %i", checksum_version ? 1 : 0);
 
-			if (result == -1 && strict && ptrack_version_num > 0)
+			if (result == -1 && strict && ptrack_version_num > 0 &&
+				!defer_invalid)
 			{
 				elog(WARNING, "File \"%s\", block %u, try to fetch via shared buffer",
 					file->path, blknum);
 				break;
 			}
 		}
+		/* Caller will reread the page later */
+		if (!page_is_valid && defer_invalid)
+			return PageIsDeferred;
+
+		/*
+		 * Free space map and visibility map are rebuilt by PostgreSQL, so an
+		 * invalid page of these forks does not cancel backup.
+		 */
+		if (!page_is_valid && strict && IsNotMainFork(file))
+		{
+			elog(WARNING, "Invalid page in file \"%s\", block %u, it is copied as is",
+				 file->path, blknum);
+			return 0;
+		}
+
 		/*
 		 * If page is not valid after 100 attempts to read it
 		 * throw an error.
@@ -442,19 +603,23 @@ prepare_page(ConnectionArgs *arguments,
 	return 0;
 }
 
-static void
-compress_and_backup_page(pgFile *file, BlockNumber blknum,
-						FILE *in, FILE *out, pg_crc32 *crc,
-						int page_state, Page page,
-						CompressAlg calg, int clevel)
+/*
+ * Compress the page, prepared by prepare_page(), and put it together with
+ * its header into write_buffer, which must have room for BLCKSZ bytes and
+ * the header. Return the number of bytes to write to backup.
+ */
+static size_t
+compress_page(pgFile *file, BlockNumber blknum,
+			  int page_state, Page page,
+			  CompressAlg calg, int clevel,
+			  char *write_buffer)
 {
 	BackupPageHeader header;
 	size_t		write_buffer_size = sizeof(header);
-	char		write_buffer[BLCKSZ+sizeof(header)];
 	char		compressed_page[BLCKSZ*2]; /* compressed page may require more space than uncompressed */
 
 	if (page_state == SkipCurrentPage)
-		return;
+		return 0;
 
 	header.block = blknum;
 	header.compressed_size = page_state;
@@ -504,6 +669,23 @@ compress_and_backup_page(pgFile *file, BlockNumber blknum,
 	/* elog(VERBOSE, "backup blkno %u, compressed_size %d write_buffer_size %ld",
 				  blknum, header.compressed_size, write_buffer_size); */
 
+	return write_buffer_size;
+}
+
+/*
+ * Write the page, compressed by compress_page(), to backup.
+ */
+static void
+write_page(pgFile *file, BlockNumber blknum,
+		   FILE *in, FILE *out, pg_crc32 *crc,
+		   const char *write_buffer, size_t write_buffer_size)
+{
+	if (write_buffer_size == 0)
+		return;
+
+	if (inline_validate)
+		check_written_page(file, write_buffer, current.checksum_version);
+
 	/* Update CRC */
 	COMP_FILE_CRC32(true, *crc, write_buffer, write_buffer_size);
 
@@ -522,6 +704,282 @@ compress_and_backup_page(pgFile *file, BlockNumber blknum,
 	file->uncompressed_size += BLCKSZ;
 }
 
+static void
+compress_and_backup_page(pgFile *file, BlockNumber blknum,
+						FILE *in, FILE *out, pg_crc32 *crc,
+						int page_state, Page page,
+						CompressAlg calg, int clevel)
+{
+	char		write_buffer[BLCKSZ+sizeof(BackupPageHeader)];
+	size_t		write_buffer_size;
+
+	write_buffer_size = compress_page(file, blknum, page_state, page,
+									  calg, clevel, write_buffer);
+	write_page(file, blknum, in, out, crc, write_buffer, write_buffer_size);
+}
+
+/*
+ * Return true if the queue of deferred pages is full and the oldest deferred
+ * page must be reread to make room for the next page.
+ */
+bool
+deferred_page_queue_full(DeferredPageQueue *queue)
+{
+	if (queue->npages < DEFERRED_PAGES_MAX)
+		return false;
+
+	if (queue->first == 0)
+		return true;
+
+	/* Move the pages not written yet to the beginning */
+	queue->npages -= queue->first;
+	memmove(queue->pages, queue->pages + queue->first,
+			queue->npages * sizeof(DeferredPage));
+	queue->first = 0;
+
+	return false;
+}
+
+/*
+ * Append the page to the queue of deferred pages. The queue must not be full.
+ */
+DeferredPage *
+deferred_page_queue_add(DeferredPageQueue *queue, BlockNumber blknum)
+{
+	DeferredPage *dpage;
+
+	Assert(queue->npages < DEFERRED_PAGES_MAX);
+
+	if (queue->pages == NULL)
+		queue->pages = pgut_malloc(DEFERRED_PAGES_MAX * sizeof(DeferredPage));
+
+	dpage = &queue->pages[queue->npages++];
+	dpage->blknum = blknum;
+	dpage->deferred = false;
+	dpage->page_state = 0;
+	dpage->attempts = PAGE_READ_ATTEMPTS - 1;
+	dpage->size = 0;
+
+	return dpage;
+}
+
+/*
+ * Remove the page from the beginning of the queue, if it is not deferred.
+ * Returned page is valid until the next page is added.
+ */
+DeferredPage *
+deferred_page_queue_pop(DeferredPageQueue *queue)
+{
+	DeferredPage *dpage;
+
+	if (queue->first == queue->npages || queue->pages[queue->first].deferred)
+		return NULL;
+
+	dpage = &queue->pages[queue->first++];
+
+	if (queue->first == queue->npages)
+		queue->first = queue->npages = queue->nread = 0;
+
+	return dpage;
+}
+
+/*
+ * Count the page read and return the oldest deferred page, if it is time
+ * to reread it.
+ */
+DeferredPage *
+deferred_page_queue_retry(DeferredPageQueue *queue)
+{
+	if (queue->npages == 0 || !queue->pages[queue->first].deferred)
+		return NULL;
+
+	if (++queue->nread < DEFERRED_PAGE_RETRY_INTERVAL)
+		return NULL;
+
+	queue->nread = 0;
+	return &queue->pages[queue->first];
+}
+
+void
+deferred_page_queue_free(DeferredPageQueue *queue)
+{
+	pg_free(queue->pages);
+	memset(queue, 0, sizeof(DeferredPageQueue));
+}
+
+/*
+ * A page, which fails header or checksum verification on the first read, is
+ * most likely being written by PostgreSQL right now. Instead of rereading it
+ * in place, backup_data_file() defers the page and goes on with the following
+ * pages, which wait for it in the queue. When the deferred page runs out of
+ * read attempts, there is no room for more pages or the file is read to the
+ * end, the page is handled by prepare_page() as before: it is reread for the
+ * remaining attempts and then fetched via ptrack, if it is available.
+ */
+typedef struct deferred_pages
+{
+	/* What is needed to reread and write pages of the file */
+	ConnectionArgs *conn_arg;
+	pgFile	   *file;
+	FILE	   *in;
+	FILE	   *out;
+	BlockNumber	nblocks;
+	BlockNumber *n_skipped;
+	XLogRecPtr	prev_backup_start_lsn;
+	BackupMode	backup_mode;
+	CompressAlg	calg;
+	int			clevel;
+	uint32		checksum_version;
+	int			ptrack_version_num;
+	const char *ptrack_schema;
+
+	DeferredPageQueue queue;
+	bool		truncated;		/* a deferred page is found truncated */
+	BlockNumber	ndiscarded;		/* pages read after the truncated page */
+} deferred_pages;
+
+/*
+ * Write pages from the beginning of the queue up to the first deferred one.
+ */
+static void
+deferred_pages_flush(deferred_pages *deferred)
+{
+	DeferredPageQueue *queue = &deferred->queue;
+	DeferredPage *dpage;
+
+	while ((dpage = deferred_page_queue_pop(queue)) != NULL)
+	{
+		write_page(deferred->file, dpage->blknum, deferred->in, deferred->out,
+				   &deferred->file->crc, dpage->data, dpage->size);
+
+		/*
+		 * The file was truncated after the following pages were read, forget
+		 * them as if they were never read.
+		 */
+		if (dpage->page_state == PageIsTruncated)
+		{
+			int			i;
+
+			deferred->truncated = true;
+
+			for (i = queue->first; i < queue->npages; i++)
+			{
+				if (queue->pages[i].page_state == SkipCurrentPage)
+					(*deferred->n_skipped)--;
+				deferred->ndiscarded++;
+			}
+			queue->first = queue->npages = queue->nread = 0;
+		}
+	}
+}
+
+/*
+ * Reread the oldest deferred page. If force is true, the page is handled as
+ * if it was never deferred: it is reread for all remaining attempts and then
+ * fetched via ptrack or backup fails.
+ */
+static void
+deferred_page_reread(deferred_pages *deferred, bool force)
+{
+	DeferredPage *dpage = &deferred->queue.pages[deferred->queue.first];
+	char		page[BLCKSZ];
+	int32		page_state;
+
+	Assert(dpage->deferred);
+
+	page_state = prepare_page(deferred->conn_arg, deferred->file,
+							  deferred->prev_backup_start_lsn,
+							  dpage->blknum, deferred->nblocks,
+							  deferred->in, deferred->n_skipped,
+							  deferred->backup_mode, page, true,
+							  force ? Max(dpage->attempts, 1) : 1, !force,
+							  deferred->checksum_version,
+							  deferred->ptrack_version_num,
+							  deferred->ptrack_schema);
+
+	if (page_state == PageIsDeferred)
+	{
+		dpage->attempts--;
+		return;
+	}
+
+	elog(VERBOSE, "File: \"%s\" blknum %u, deferred page is reread",
+		 deferred->file->path, dpage->blknum);
+
+	dpage->deferred = false;
+	dpage->page_state = page_state;
+	dpage->size = compress_page(deferred->file, dpage->blknum, page_state,
+								page, deferred->calg, deferred->clevel,
+								dpage->data);
+	deferred_pages_flush(deferred);
+}
+
+/*
+ * Add the page, prepared by prepare_page(), to the queue of pages waiting
+ * for the oldest deferred page, and reread that page if it is time to.
+ */
+static void
+deferred_pages_add(deferred_pages *deferred, BlockNumber blknum,
+				   int32 page_state, Page page)
+{
+	DeferredPage *dpage;
+
+	/* Make room for the page */
+	while (deferred_page_queue_full(&deferred->queue))
+		deferred_page_reread(deferred, true);
+
+	/* The page was read after the truncated one, forget it */
+	if (deferred->truncated)
+	{
+		if (page_state == SkipCurrentPage)
+			(*deferred->n_skipped)--;
+		deferred->ndiscarded++;
+		return;
+	}
+
+	/* Deferred pages could have been written to make room */
+	if (deferred->queue.npages == 0 && page_state != PageIsDeferred)
+	{
+		compress_and_backup_page(deferred->file, blknum, deferred->in,
+								 deferred->out, &deferred->file->crc,
+								 page_state, page, deferred->calg,
+								 deferred->clevel);
+		return;
+	}
+
+	dpage = deferred_page_queue_add(&deferred->queue, blknum);
+	dpage->page_state = page_state;
+	if (page_state == PageIsDeferred)
+	{
+		elog(LOG, "File: \"%s\" blknum %u, page is deferred", deferred->file->path,
+			 blknum);
+		dpage->deferred = true;
+	}
+	else
+		dpage->size = compress_page(deferred->file, blknum, page_state, page,
+									deferred->calg, deferred->clevel,
+									dpage->data);
+
+	dpage = deferred_page_queue_retry(&deferred->queue);
+	if (dpage != NULL)
+		deferred_page_reread(deferred, dpage->attempts <= 1);
+}
+
+/*
+ * Reread all deferred pages and write the remaining pages. Return the number
+ * of pages discarded, because the file was truncated before them.
+ */
+static BlockNumber
+deferred_pages_finish(deferred_pages *deferred)
+{
+	while (deferred->queue.npages > 0)
+		deferred_page_reread(deferred, true);
+
+	deferred_page_queue_free(&deferred->queue);
+
+	return deferred->ndiscarded;
+}
+
 /*
  * Backup data file in the from_root directory to the to_root directory with
  * same relative path. If prev_backup_start_lsn is not NULL, only pages with
@@ -545,6 +1003,15 @@ backup_data_file(backup_files_arg* arguments,
 	BlockNumber	n_blocks_read = 0;
 	int			page_state;
 	char		curr_page[BLCKSZ];
+	deferred_pages deferred;
+
+	/*
+	 * Free space map is not WAL-logged and visibility map bits are cleared
+	 * without updating LSN of the map page, so DELTA backup cannot rely on
+	 * page LSN and copies all pages of these forks.
+	 */
+	if (IsNotMainFork(file))
+		prev_backup_start_lsn = InvalidXLogRecPtr;
 
 	/*
 	 * Skip unchanged file only if it exists in previous backup.
@@ -553,7 +1020,7 @@ backup_data_file(backup_files_arg* arguments,
 	 */
 	if ((backup_mode == BACKUP_MODE_DIFF_PAGE ||
 		backup_mode == BACKUP_MODE_DIFF_PTRACK) &&
-		file->pagemap.bitmapsize == PageBitmapIsEmpty &&
+		pagemap_is_empty(&file->pagemap) &&
 		file->exists_in_prev && !file->pagemap_isabsent)
 	{
 		/*
@@ -616,6 +1083,22 @@ backup_data_file(backup_files_arg* arguments,
 			 to_path, strerror(errno_tmp));
 	}
 
+	/* Pages, which are not valid on the first read, are reread later */
+	memset(&deferred, 0, sizeof(deferred));
+	deferred.conn_arg = &(arguments->conn_arg);
+	deferred.file = file;
+	deferred.in = in;
+	deferred.out = out;
+	deferred.nblocks = nblocks;
+	deferred.n_skipped = &n_blocks_skipped;
+	deferred.prev_backup_start_lsn = prev_backup_start_lsn;
+	deferred.backup_mode = backup_mode;
+	deferred.calg = calg;
+	deferred.clevel = clevel;
+	deferred.checksum_version = checksum_version;
+	deferred.ptrack_version_num = ptrack_version_num;
+	deferred.ptrack_schema = ptrack_schema;
+
 	/*
 	 * Read each page, verify checksum and write it to backup.
 	 * If page map is empty or file is not present in previous backup
@@ -623,7 +1106,7 @@ backup_data_file(backup_files_arg* arguments,
 	 *
 	 * We will enter here if backup_mode is FULL or DELTA.
 	 */
-	if (file->pagemap.bitmapsize == PageBitmapIsEmpty ||
+	if (pagemap_is_empty(&file->pagemap) ||
 		file->pagemap_isabsent || !file->exists_in_prev)
 	{
 		/* TODO: take into account PTRACK 2.0 */
@@ -647,21 +1130,25 @@ backup_data_file(backup_files_arg* arguments,
 		else
 		{
 		  RetryUsingPtrack:
-			for (blknum = 0; blknum < nblocks; blknum++)
+			for (blknum = 0; blknum < nblocks && !deferred.truncated; blknum++)
 			{
 				page_state = prepare_page(&(arguments->conn_arg), file, prev_backup_start_lsn,
 										  blknum, nblocks, in, &n_blocks_skipped,
-										  backup_mode, curr_page, true,
+										  backup_mode, curr_page, true, 1, true,
 										  checksum_version, ptrack_version_num,
 										  ptrack_schema);
-				compress_and_backup_page(file, blknum, in, out, &(file->crc),
-										  page_state, curr_page, calg, clevel);
+				if (page_state == PageIsDeferred || deferred.queue.npages > 0)
+					deferred_pages_add(&deferred, blknum, page_state, curr_page);
+				else
+					compress_and_backup_page(file, blknum, in, out, &(file->crc),
+											 page_state, curr_page, calg, clevel);
 				n_blocks_read++;
 				if (page_state == PageIsTruncated)
 					break;
 
 				file->read_size += BLCKSZ;
 			}
+			n_blocks_read -= deferred_pages_finish(&deferred);
 		}
 		if (backup_mode == BACKUP_MODE_DIFF_DELTA)
 			file->n_blocks = n_blocks_read;
@@ -673,23 +1160,27 @@ backup_data_file(backup_files_arg* arguments,
 	 */
 	else
 	{
-		datapagemap_iterator_t *iter;
-		iter = datapagemap_iterate(&file->pagemap);
-		while (datapagemap_next(iter, &blknum))
+		pagemap_iterator_t *iter;
+		iter = pagemap_iterate(&file->pagemap);
+		while (!deferred.truncated && pagemap_next(iter, &blknum))
 		{
 			page_state = prepare_page(&(arguments->conn_arg), file, prev_backup_start_lsn,
 									  blknum, nblocks, in, &n_blocks_skipped,
-									  backup_mode, curr_page, true,
+									  backup_mode, curr_page, true, 1, true,
 									  checksum_version, ptrack_version_num,
 									  ptrack_schema);
-			compress_and_backup_page(file, blknum, in, out, &(file->crc),
-									  page_state, curr_page, calg, clevel);
+			if (page_state == PageIsDeferred || deferred.queue.npages > 0)
+				deferred_pages_add(&deferred, blknum, page_state, curr_page);
+			else
+				compress_and_backup_page(file, blknum, in, out, &(file->crc),
+										 page_state, curr_page, calg, clevel);
 			n_blocks_read++;
 			if (page_state == PageIsTruncated)
 				break;
 		}
+		n_blocks_read -= deferred_pages_finish(&deferred);
 
-		pg_free(file->pagemap.bitmap);
+		pagemap_free(&file->pagemap);
 		pg_free(iter);
 	}
 
@@ -703,7 +1194,8 @@ backup_data_file(backup_files_arg* arguments,
 			 strerror(errno_tmp));
 	}
 
-	if (fio_fflush(out) != 0 ||
+	/* The whole backup is synced at once after all files are copied */
+	if (fio_fflush_async(out) != 0 ||
 		fio_fclose(out))
 		elog(ERROR, "cannot write backup file \"%s\": %s",
 			 to_path, strerror(errno));
@@ -727,60 +1219,299 @@ backup_data_file(backup_files_arg* arguments,
 }
 
 /*
- * Restore files in the from_root directory to the to_root directory with
- * same relative path.
- *
- * If write_header is true then we add header to each restored block, currently
- * it is used for MERGE command.
+ * Pages of a data file are restored in batches: the restore thread reads
+ * a batch of pages, decompresses them, possibly sharing this work with the
+ * decompression workers, and then writes pages in the order they were read.
  */
-void
-restore_data_file(const char *to_path, pgFile *file, bool allow_truncate,
-				  bool write_header, uint32 backup_version)
+#define RESTORE_BATCH_PAGES	64
+
+typedef struct restore_page
 {
-	FILE	   *in = NULL;
-	FILE	   *out = NULL;
 	BackupPageHeader header;
-	BlockNumber	blknum = 0,
-				truncate_from = 0;
-	bool		need_truncate = false;
+	DataPage	compressed_page; /* used as read buffer */
+	DataPage	page;
+	bool		need_decompress;
+	int32		uncompressed_size;
+	const char *errormsg;
+	off_t		data_offset;	/* offset of page data in the backup file,
+								 * if the page is cloned, otherwise -1 */
+} restore_page;
+
+typedef struct restore_batch
+{
+	CompressAlg	compress_alg;
+	int			maxpages;
+	int			npages;
+	/*
+	 * Uncompressed pages are cloned from the backup file clone_fd instead of
+	 * being read, while clone_pages is set.
+	 */
+	bool		clone_pages;
+	int			clone_fd;
+	/* Protected by restore_pool_mutex while the batch is queued */
+	int			next_page;		/* next page to decompress */
+	int			done_pages;		/* number of decompressed pages */
+	struct restore_batch *next;
+	int			nrefs;			/* writers of fan-out restore, which have not
+								 * written the batch yet */
+	restore_page pages[FLEXIBLE_ARRAY_MEMBER];
+} restore_batch;
+
+#ifndef WIN32
+/*
+ * Pool of decompression workers, shared by all restore threads. Workers
+ * never report errors themselves, errors are reported by the restore thread.
+ */
+static pthread_mutex_t restore_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t restore_pool_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t restore_batch_done_cond = PTHREAD_COND_INITIALIZER;
+static restore_batch *restore_pool_queue = NULL;
+static bool restore_pool_stop = false;
+static pthread_t *restore_pool_threads = NULL;
+static int	restore_pool_size = 0;
+#endif
 
-	/* BYTES_INVALID allowed only in case of restoring file from DELTA backup */
-	if (file->write_size != BYTES_INVALID)
+/*
+ * Allocate a batch for pages of the file. Small files need no more pages
+ * than they can contain.
+ */
+static restore_batch *
+restore_batch_new(pgFile *file)
+{
+	restore_batch *batch;
+	int			maxpages = RESTORE_BATCH_PAGES;
+
+	if (file->write_size / (sizeof(BackupPageHeader) + MAXIMUM_ALIGNOF) + 1 < maxpages)
+		maxpages = file->write_size / (sizeof(BackupPageHeader) + MAXIMUM_ALIGNOF) + 1;
+
+	batch = (restore_batch *) pgut_malloc(offsetof(restore_batch, pages) +
+										  maxpages * sizeof(restore_page));
+	batch->compress_alg = file->compress_alg;
+	batch->maxpages = maxpages;
+	batch->npages = 0;
+	batch->clone_pages = false;
+	batch->clone_fd = -1;
+	batch->next = NULL;
+
+	return batch;
+}
+
+/*
+ * Copy len bytes from from_fd at from_offset to to_fd at to_offset without
+ * passing them through user space. File systems, which support reflinks,
+ * share the data instead of copying it. Return false if the file system
+ * cannot do that, the caller should read and write the data then.
+ */
+static bool
+copy_file_data(int from_fd, off_t from_offset, int to_fd, off_t to_offset,
+			   size_t len)
+{
+#if defined(__linux__) && defined(SYS_copy_file_range)
+	int64		from_pos = from_offset;
+	int64		to_pos = to_offset;
+
+	while (len > 0)
 	{
-		/* open backup mode file for read */
-		in = fopen(file->path, PG_BINARY_R);
-		if (in == NULL)
-		{
-			elog(ERROR, "Cannot open backup file \"%s\": %s", file->path,
-				 strerror(errno));
-		}
+		ssize_t		rc;
+
+		rc = syscall(SYS_copy_file_range, from_fd, &from_pos, to_fd, &to_pos,
+					 len, 0);
+		if (rc <= 0)
+			return false;
+		len -= rc;
 	}
+	return true;
+#else
+	return false;
+#endif
+}
 
-	/*
-	 * Open backup file for write. 	We use "r+" at first to overwrite only
-	 * modified pages for differential restore. If the file does not exist,
-	 * re-open it with "w" to create an empty file.
-	 */
-	out = fio_fopen(to_path, PG_BINARY_R "+", FIO_DB_HOST);
-	if (out == NULL)
+static void
+restore_page_decompress(restore_batch *batch, restore_page *rpage)
+{
+	rpage->uncompressed_size = do_decompress(rpage->page.data, BLCKSZ,
+											 rpage->compressed_page.data,
+											 rpage->header.compressed_size,
+											 batch->compress_alg,
+											 &rpage->errormsg);
+}
+
+#ifndef WIN32
+/*
+ * Claim the next page of the batch which needs decompression.
+ * restore_pool_mutex must be held.
+ */
+static restore_page *
+restore_batch_claim_page(restore_batch *batch)
+{
+	while (batch->next_page < batch->npages)
 	{
-		int errno_tmp = errno;
-		fclose(in);
-		elog(ERROR, "Cannot open restore target file \"%s\": %s",
-			 to_path, strerror(errno_tmp));
+		restore_page *rpage = &batch->pages[batch->next_page++];
+
+		if (rpage->need_decompress)
+			return rpage;
+		batch->done_pages++;
 	}
 
-	while (true)
-	{
-		off_t		write_pos;
-		size_t		read_len;
-		DataPage	compressed_page; /* used as read buffer */
-		DataPage	page;
-		int32		uncompressed_size = 0;
+	return NULL;
+}
 
-		/* File didn`t changed. Nothing to copy */
-		if (file->write_size == BYTES_INVALID)
+static void *
+restore_decompress_worker(void *arg)
+{
+	pthread_mutex_lock(&restore_pool_mutex);
+	while (!restore_pool_stop)
+	{
+		restore_batch *batch = restore_pool_queue;
+		restore_page *rpage = NULL;
+
+		/* Find a queued batch with pages left to decompress */
+		while (batch != NULL &&
+			   (rpage = restore_batch_claim_page(batch)) == NULL)
+			batch = batch->next;
+
+		if (rpage == NULL)
+		{
+			pthread_cond_wait(&restore_pool_cond, &restore_pool_mutex);
+			continue;
+		}
+
+		pthread_mutex_unlock(&restore_pool_mutex);
+		restore_page_decompress(batch, rpage);
+		pthread_mutex_lock(&restore_pool_mutex);
+
+		if (++batch->done_pages == batch->npages)
+			pthread_cond_broadcast(&restore_batch_done_cond);
+	}
+	pthread_mutex_unlock(&restore_pool_mutex);
+
+	return NULL;
+}
+
+/*
+ * Start nworkers decompression workers, which help restore threads to
+ * decompress pages.
+ */
+void
+restore_decompress_pool_start(int nworkers)
+{
+	int			i;
+
+	Assert(restore_pool_size == 0);
+
+	restore_pool_stop = false;
+	restore_pool_threads = (pthread_t *) palloc(sizeof(pthread_t) * nworkers);
+	for (i = 0; i < nworkers; i++)
+	{
+		if (pthread_create(&restore_pool_threads[i], NULL,
+						   restore_decompress_worker, NULL) != 0)
 			break;
+		restore_pool_size++;
+	}
+
+	elog(VERBOSE, "Started %d decompression workers", restore_pool_size);
+}
+
+void
+restore_decompress_pool_stop(void)
+{
+	int			i;
+
+	if (restore_pool_size == 0)
+		return;
+
+	pthread_mutex_lock(&restore_pool_mutex);
+	restore_pool_stop = true;
+	pthread_cond_broadcast(&restore_pool_cond);
+	pthread_mutex_unlock(&restore_pool_mutex);
+
+	for (i = 0; i < restore_pool_size; i++)
+		pthread_join(restore_pool_threads[i], NULL);
+
+	pfree(restore_pool_threads);
+	restore_pool_threads = NULL;
+	restore_pool_size = 0;
+}
+#else
+/* Restore threads decompress their pages themselves */
+void
+restore_decompress_pool_start(int nworkers)
+{
+}
+
+void
+restore_decompress_pool_stop(void)
+{
+}
+#endif
+
+/*
+ * Decompress pages of the batch, which need it. If decompression workers
+ * are running, the batch is queued for them and the restore thread
+ * decompresses pages of the batch together with workers.
+ */
+static void
+restore_batch_decompress(restore_batch *batch)
+{
+	int			i;
+
+#ifndef WIN32
+	if (restore_pool_size > 0 && batch->npages > 1)
+	{
+		restore_page *rpage;
+		restore_batch **prev;
+
+		pthread_mutex_lock(&restore_pool_mutex);
+		batch->next_page = 0;
+		batch->done_pages = 0;
+		batch->next = restore_pool_queue;
+		restore_pool_queue = batch;
+		pthread_cond_broadcast(&restore_pool_cond);
+
+		while ((rpage = restore_batch_claim_page(batch)) != NULL)
+		{
+			pthread_mutex_unlock(&restore_pool_mutex);
+			restore_page_decompress(batch, rpage);
+			pthread_mutex_lock(&restore_pool_mutex);
+			batch->done_pages++;
+		}
+
+		/* All pages are claimed, so workers don't need the batch anymore */
+		for (prev = &restore_pool_queue; *prev != batch; prev = &(*prev)->next)
+			;
+		*prev = batch->next;
+		batch->next = NULL;
+
+		/* Wait for pages being decompressed by workers */
+		while (batch->done_pages < batch->npages)
+			pthread_cond_wait(&restore_batch_done_cond, &restore_pool_mutex);
+		pthread_mutex_unlock(&restore_pool_mutex);
+		return;
+	}
+#endif
+
+	for (i = 0; i < batch->npages; i++)
+	{
+		if (batch->pages[i].need_decompress)
+			restore_page_decompress(batch, &batch->pages[i]);
+	}
+}
+
+/*
+ * Read the next batch of pages of the data file from backup. Set *eof if
+ * the end of file is reached, and *need_truncate if the restored file must
+ * be truncated at *truncate_from block.
+ */
+static void
+restore_batch_read(FILE *in, pgFile *file, restore_batch *batch,
+				   uint32 backup_version, BlockNumber *blknum, bool *eof,
+				   bool *need_truncate, BlockNumber *truncate_from)
+{
+	batch->npages = 0;
+	while (batch->npages < batch->maxpages)
+	{
+		restore_page *rpage = &batch->pages[batch->npages];
+		size_t		read_len;
 
 		/*
 		 * We need to truncate result file if data file in an incremental backup
@@ -790,60 +1521,83 @@ restore_data_file(const char *to_path, pgFile *file, bool allow_truncate,
 		 * file.
 		 */
 		if (file->n_blocks != BLOCKNUM_INVALID &&
-			(blknum + 1) > file->n_blocks)
+			(*blknum + 1) > file->n_blocks)
 		{
-			truncate_from = blknum;
-			need_truncate = true;
+			*truncate_from = *blknum;
+			*need_truncate = true;
 			break;
 		}
 
 		/* read BackupPageHeader */
-		read_len = fread(&header, 1, sizeof(header), in);
-		if (read_len != sizeof(header))
+		read_len = fread(&rpage->header, 1, sizeof(rpage->header), in);
+		if (read_len != sizeof(rpage->header))
 		{
 			int errno_tmp = errno;
 			if (read_len == 0 && feof(in))
+			{
+				*eof = true;
 				break;		/* EOF found */
+			}
 			else if (read_len != 0 && feof(in))
 				elog(ERROR,
 					 "Odd size page found at block %u of \"%s\"",
-					 blknum, file->path);
+					 *blknum, file->path);
 			else
 				elog(ERROR, "Cannot read header of block %u of \"%s\": %s",
-					 blknum, file->path, strerror(errno_tmp));
+					 *blknum, file->path, strerror(errno_tmp));
 		}
 
-		if (header.block == 0 && header.compressed_size == 0)
+		if (rpage->header.block == 0 && rpage->header.compressed_size == 0)
 		{
 			elog(VERBOSE, "Skip empty block of \"%s\"", file->path);
 			continue;
 		}
 
-		if (header.block < blknum)
+		if (rpage->header.block < *blknum)
 			elog(ERROR, "Backup is broken at block %u of \"%s\"",
-				 blknum, file->path);
+				 *blknum, file->path);
 
-		blknum = header.block;
+		*blknum = rpage->header.block;
 
-		if (header.compressed_size == PageIsTruncated)
+		if (rpage->header.compressed_size == PageIsTruncated)
 		{
 			/*
 			 * Backup contains information that this block was truncated.
 			 * We need to truncate file to this length.
 			 */
-			truncate_from = blknum;
-			need_truncate = true;
+			*truncate_from = *blknum;
+			*need_truncate = true;
 			break;
 		}
 
-		Assert(header.compressed_size <= BLCKSZ);
+		Assert(rpage->header.compressed_size <= BLCKSZ);
+
+		/*
+		 * Data of uncompressed page is copied from the backup file by the
+		 * kernel, only its offset is needed.
+		 */
+		if (batch->clone_pages && rpage->header.compressed_size == BLCKSZ)
+		{
+			rpage->data_offset = ftell(in);
+			if (rpage->data_offset < 0 || fseek(in, BLCKSZ, SEEK_CUR) != 0)
+				elog(ERROR, "Cannot seek block %u of \"%s\": %s",
+					 *blknum, file->path, strerror(errno));
+
+			rpage->need_decompress = false;
+			rpage->uncompressed_size = 0;
+			rpage->errormsg = NULL;
+
+			batch->npages++;
+			continue;
+		}
+		rpage->data_offset = -1;
 
 		/* read a page from file */
-		read_len = fread(compressed_page.data, 1,
-			MAXALIGN(header.compressed_size), in);
-		if (read_len != MAXALIGN(header.compressed_size))
+		read_len = fread(rpage->compressed_page.data, 1,
+			MAXALIGN(rpage->header.compressed_size), in);
+		if (read_len != MAXALIGN(rpage->header.compressed_size))
 			elog(ERROR, "Cannot read block %u of \"%s\" read %zu of %d",
-				blknum, file->path, read_len, header.compressed_size);
+				*blknum, file->path, read_len, rpage->header.compressed_size);
 
 		/*
 		 * if page size is smaller than BLCKSZ, decompress the page.
@@ -851,62 +1605,146 @@ restore_data_file(const char *to_path, pgFile *file, bool allow_truncate,
 		 * we have to check, whether it is compressed or not using
 		 * page_may_be_compressed() function.
 		 */
-		if (header.compressed_size != BLCKSZ
-			|| page_may_be_compressed(compressed_page.data, file->compress_alg,
-									  backup_version))
-		{
-			const char *errormsg = NULL;
+		rpage->need_decompress =
+			rpage->header.compressed_size != BLCKSZ ||
+			page_may_be_compressed(rpage->compressed_page.data,
+								   file->compress_alg, backup_version);
+		rpage->uncompressed_size = 0;
+		rpage->errormsg = NULL;
+
+		batch->npages++;
+	}
+}
 
-			uncompressed_size = do_decompress(page.data, BLCKSZ,
-											  compressed_page.data,
-											  header.compressed_size,
-											  file->compress_alg, &errormsg);
-			if (uncompressed_size < 0 && errormsg != NULL)
-				elog(WARNING, "An error occured during decompressing block %u of file \"%s\": %s",
-					 blknum, file->path, errormsg);
+/*
+ * Report pages of the batch, which failed to decompress.
+ */
+static void
+restore_batch_check(restore_batch *batch, pgFile *file)
+{
+	int			i;
 
-			if (uncompressed_size != BLCKSZ)
-				elog(ERROR, "Page of file \"%s\" uncompressed to %d bytes. != BLCKSZ",
-					 file->path, uncompressed_size);
-		}
+	for (i = 0; i < batch->npages; i++)
+	{
+		restore_page *rpage = &batch->pages[i];
+
+		if (!rpage->need_decompress)
+			continue;
+
+		if (rpage->uncompressed_size < 0 && rpage->errormsg != NULL)
+			elog(WARNING, "An error occured during decompressing block %u of file \"%s\": %s",
+				 rpage->header.block, file->path, rpage->errormsg);
+
+		if (rpage->uncompressed_size != BLCKSZ)
+			elog(ERROR, "Page of file \"%s\" uncompressed to %d bytes. != BLCKSZ",
+				 file->path, rpage->uncompressed_size);
+	}
+}
+
+/*
+ * Clone data of an uncompressed page from the backup file into the restored
+ * file at write_pos. If the file system cannot do that, page data is read
+ * into the page buffer and false is returned, so the page is written as
+ * usual. The rest of the file is not cloned then.
+ */
+static bool
+restore_page_clone(restore_batch *batch, restore_page *rpage, FILE *out,
+				   off_t write_pos, pgFile *file)
+{
+	if (batch->clone_pages)
+	{
+		/* Pages written before must reach the file first */
+		if (fflush(out) != 0)
+			elog(ERROR, "Cannot write \"%s\": %s", file->path, strerror(errno));
+
+		if (copy_file_data(batch->clone_fd, rpage->data_offset, fileno(out),
+						   write_pos, BLCKSZ))
+			return true;
+
+		elog(VERBOSE, "Cannot clone block %u of \"%s\", copy the file",
+			 rpage->header.block, file->path);
+		batch->clone_pages = false;
+	}
+
+	errno = 0;
+	if (pread(batch->clone_fd, rpage->compressed_page.data, BLCKSZ,
+			  rpage->data_offset) != BLCKSZ)
+		elog(ERROR, "Cannot read block %u of \"%s\": %s",
+			 rpage->header.block, file->path,
+			 errno ? strerror(errno) : "unexpected end of file");
+
+	return false;
+}
+
+/*
+ * Write decompressed pages of the batch in order.
+ */
+static void
+restore_batch_write(restore_batch *batch, FILE *out, const char *to_path,
+					pgFile *file, bool write_header)
+{
+	int			i;
+
+	for (i = 0; i < batch->npages; i++)
+	{
+		restore_page *rpage = &batch->pages[i];
+		BlockNumber	blkno = rpage->header.block;
+		BackupPageHeader header;
+		off_t		write_pos;
 
-		write_pos = (write_header) ? blknum * (BLCKSZ + sizeof(header)) :
-									 blknum * BLCKSZ;
+		write_pos = (write_header) ? blkno * (BLCKSZ + sizeof(header)) :
+									 blkno * BLCKSZ;
 
 		/*
 		 * Seek and write the restored page.
 		 */
 		if (fio_fseek(out, write_pos) < 0)
 			elog(ERROR, "Cannot seek block %u of \"%s\": %s",
-				 blknum, to_path, strerror(errno));
+				 blkno, to_path, strerror(errno));
 
 		if (write_header)
 		{
 			/* We uncompressed the page, so its size is BLCKSZ */
+			header = rpage->header;
 			header.compressed_size = BLCKSZ;
 			if (fio_fwrite(out, &header, sizeof(header)) != sizeof(header))
 				elog(ERROR, "Cannot write header of block %u of \"%s\": %s",
-					 blknum, file->path, strerror(errno));
+					 blkno, file->path, strerror(errno));
+			write_pos += sizeof(header);
 		}
 
+		if (rpage->data_offset >= 0 &&
+			restore_page_clone(batch, rpage, out, write_pos, file))
+			continue;
+
 		/* if we uncompressed the page - write page.data,
 		 * if page wasn't compressed -
 		 * write what we've read - compressed_page.data
 		 */
-		if (uncompressed_size == BLCKSZ)
+		if (rpage->uncompressed_size == BLCKSZ)
 		{
-			if (fio_fwrite(out, page.data, BLCKSZ) != BLCKSZ)
+			if (fio_fwrite(out, rpage->page.data, BLCKSZ) != BLCKSZ)
 				elog(ERROR, "Cannot write block %u of \"%s\": %s",
-					 blknum, file->path, strerror(errno));
+					 blkno, file->path, strerror(errno));
 		}
 		else
 		{
-			if (fio_fwrite(out, compressed_page.data, BLCKSZ) != BLCKSZ)
+			if (fio_fwrite(out, rpage->compressed_page.data, BLCKSZ) != BLCKSZ)
 				elog(ERROR, "Cannot write block %u of \"%s\": %s",
-					 blknum, file->path, strerror(errno));
+					 blkno, file->path, strerror(errno));
 		}
 	}
+}
 
+/*
+ * Truncate the restored data file if needed, set its permissions and
+ * close it.
+ */
+static void
+restore_data_file_finish(FILE *out, const char *to_path, pgFile *file,
+						 bool allow_truncate, bool write_header,
+						 bool need_truncate, BlockNumber truncate_from)
+{
 	/*
 	 * DELTA backup have no knowledge about truncated blocks as PAGE or PTRACK do
 	 * But during DELTA backup we read every file in PGDATA and thus DELTA backup
@@ -928,7 +1766,7 @@ restore_data_file(const char *to_path, pgFile *file, bool allow_truncate,
 	{
 		off_t		write_pos;
 
-		write_pos = (write_header) ? truncate_from * (BLCKSZ + sizeof(header)) :
+		write_pos = (write_header) ? truncate_from * (BLCKSZ + sizeof(BackupPageHeader)) :
 									 truncate_from * BLCKSZ;
 
 		/*
@@ -946,8 +1784,6 @@ restore_data_file(const char *to_path, pgFile *file, bool allow_truncate,
 	{
 		int errno_tmp = errno;
 
-		if (in)
-			fclose(in);
 		fio_fclose(out);
 		elog(ERROR, "Cannot change mode of \"%s\": %s", to_path,
 			 strerror(errno_tmp));
@@ -956,11 +1792,541 @@ restore_data_file(const char *to_path, pgFile *file, bool allow_truncate,
 	if (fio_fflush(out) != 0 ||
 		fio_fclose(out))
 		elog(ERROR, "Cannot write \"%s\": %s", to_path, strerror(errno));
+}
+
+/*
+ * Restore files in the from_root directory to the to_root directory with
+ * same relative path.
+ *
+ * If write_header is true then we add header to each restored block, currently
+ * it is used for MERGE command.
+ *
+ * If clone_pages is true, the backup catalog and the restored file are on
+ * the same local file system, and uncompressed pages are cloned.
+ */
+void
+restore_data_file(const char *to_path, pgFile *file, bool allow_truncate,
+				  bool write_header, uint32 backup_version, bool clone_pages)
+{
+	FILE	   *in = NULL;
+	FILE	   *out = NULL;
+	BlockNumber	blknum = 0,
+				truncate_from = 0;
+	bool		need_truncate = false;
+	bool		eof = false;
+	restore_batch *batch = NULL;
+
+	/* BYTES_INVALID allowed only in case of restoring file from DELTA backup */
+	if (file->write_size != BYTES_INVALID)
+	{
+		/* open backup mode file for read */
+		in = fopen(file->path, PG_BINARY_R);
+		if (in == NULL)
+		{
+			elog(ERROR, "Cannot open backup file \"%s\": %s", file->path,
+				 strerror(errno));
+		}
+	}
+
+	/*
+	 * Open backup file for write. 	We use "r+" at first to overwrite only
+	 * modified pages for differential restore. If the file does not exist,
+	 * re-open it with "w" to create an empty file.
+	 */
+	out = fio_fopen(to_path, PG_BINARY_R "+", FIO_DB_HOST);
+	if (out == NULL)
+	{
+		int errno_tmp = errno;
+		fclose(in);
+		elog(ERROR, "Cannot open restore target file \"%s\": %s",
+			 to_path, strerror(errno_tmp));
+	}
+
+	if (file->write_size != BYTES_INVALID)
+	{
+		batch = restore_batch_new(file);
+
+		/*
+		 * Only headers of cloned pages are read, so the backup file is not
+		 * buffered to avoid reading their data.
+		 */
+		if (clone_pages && !fio_is_remote_file(out) &&
+			(file->compress_alg == NONE_COMPRESS ||
+			 file->compress_alg == NOT_DEFINED_COMPRESS))
+		{
+			setvbuf(in, NULL, _IONBF, 0);
+			batch->clone_pages = true;
+			batch->clone_fd = fileno(in);
+		}
+	}
+
+	while (!eof && !need_truncate)
+	{
+		/* File didn`t changed. Nothing to copy */
+		if (file->write_size == BYTES_INVALID)
+			break;
+
+		restore_batch_read(in, file, batch, backup_version, &blknum,
+						   &eof, &need_truncate, &truncate_from);
+
+		/* Decompress pages of the batch, using decompression workers if any */
+		restore_batch_decompress(batch);
+		restore_batch_check(batch, file);
+
+		restore_batch_write(batch, out, to_path, file, write_header);
+	}
+
+	if (batch)
+		pg_free(batch);
 
 	if (in)
 		fclose(in);
+
+	restore_data_file_finish(out, to_path, file, allow_truncate, write_header,
+							 need_truncate, truncate_from);
 }
 
+#ifndef WIN32
+/*
+ * Fan-out restore writes every data file into several data directories.
+ * Restore threads read and decompress pages once, and every data directory
+ * has its own writer thread, which writes the pages. Each writer has a queue
+ * of at most RESTORE_FANOUT_QUEUE_JOBS batches, so a slow writer lets the
+ * others go ahead by this number of batches only. Writers also copy non-data
+ * files, so that all files of a data directory are written over the agent
+ * connection of its writer, which may run at its own host.
+ */
+#define RESTORE_FANOUT_QUEUE_JOBS	16
+
+/* Data file being restored, shared by writers */
+typedef struct fanout_file
+{
+	pgFile	   *file;
+	bool		allow_truncate;
+	/* Set before the last job of the file is queued */
+	bool		need_truncate;
+	BlockNumber	truncate_from;
+	FILE	  **outs;			/* opened by each writer */
+	int			nrefs;			/* writers, which have not finished the file */
+} fanout_file;
+
+/* Non-data file, copied by every writer */
+typedef struct fanout_copy
+{
+	pgFile	   *file;
+	char	   *from_root;
+	bool		create_empty;	/* excluded by partial restore */
+	int			nrefs;			/* writers, which have not copied the file */
+} fanout_copy;
+
+typedef struct fanout_job
+{
+	fanout_file *ffile;			/* NULL for a copy job */
+	restore_batch *batch;		/* NULL for the last job of the file */
+	fanout_copy *copy;
+	struct fanout_job *next;
+} fanout_job;
+
+typedef struct fanout_writer
+{
+	restore_fanout *fanout;
+	int			num;
+	pgRestoreTarget *target;
+	pthread_t	thread;
+	pthread_cond_t	job_cond;	/* a job is queued or writers are stopped */
+	fanout_job *head;
+	fanout_job *tail;
+	int			njobs;
+
+	/*
+	 * Return value from the thread.
+	 * 0 means there is no error, 1 - there is an error.
+	 */
+	int			ret;
+} fanout_writer;
+
+struct restore_fanout
+{
+	pthread_mutex_t mutex;		/* protects everything below and in writers */
+	pthread_cond_t	progress_cond;	/* a job is taken or done */
+	int			npending;		/* jobs queued or being written */
+	bool		stop;
+	int			nwriters;
+	fanout_writer *writers;
+};
+
+/*
+ * Wait on the condition variable of fan-out restore, checking for
+ * interrupts. Mutex is released on error.
+ */
+static void
+restore_fanout_wait_cond(restore_fanout *fanout, pthread_cond_t *cond)
+{
+	struct timespec	timeout;
+
+	if (interrupted || thread_interrupted)
+	{
+		pthread_mutex_unlock(&fanout->mutex);
+		elog(ERROR, "Interrupted during restore database");
+	}
+
+	clock_gettime(CLOCK_REALTIME, &timeout);
+	timeout.tv_nsec += 100 * 1000 * 1000;
+	if (timeout.tv_nsec >= 1000 * 1000 * 1000)
+	{
+		timeout.tv_sec++;
+		timeout.tv_nsec -= 1000 * 1000 * 1000;
+	}
+	pthread_cond_timedwait(cond, &fanout->mutex, &timeout);
+}
+
+/*
+ * Copy the non-data file into the data directory of the writer. Sizes and
+ * CRC are set by every writer, so they are set in a copy of pgFile.
+ */
+static void
+fanout_writer_copy(fanout_writer *writer, fanout_copy *copy)
+{
+	pgFile		file = *copy->file;
+	const char *pgdata = writer->target->pgdata;
+
+	if (copy->create_empty)
+		create_empty_file(FIO_BACKUP_HOST, pgdata, FIO_DB_HOST, &file);
+	else if (strcmp(file.name, "pg_control") == 0)
+		copy_pgcontrol_file(copy->from_root, FIO_BACKUP_HOST, pgdata,
+							FIO_DB_HOST, &file);
+	else
+		copy_file(FIO_BACKUP_HOST, pgdata, FIO_DB_HOST, &file, false);
+}
+
+static void
+fanout_writer_do_job(fanout_writer *writer, fanout_job *job)
+{
+	fanout_file *ffile = job->ffile;
+	FILE	   *out;
+	char		to_path[MAXPGPATH];
+
+	if (ffile == NULL)
+	{
+		fanout_writer_copy(writer, job->copy);
+		return;
+	}
+
+	out = ffile->outs[writer->num];
+	join_path_components(to_path, writer->target->pgdata,
+						 ffile->file->rel_path);
+
+	if (out == NULL)
+	{
+		out = fio_fopen(to_path, PG_BINARY_R "+", FIO_DB_HOST);
+		if (out == NULL)
+			elog(ERROR, "Cannot open restore target file \"%s\": %s",
+				 to_path, strerror(errno));
+		ffile->outs[writer->num] = out;
+	}
+
+	if (job->batch)
+		restore_batch_write(job->batch, out, to_path, ffile->file, false);
+	else
+	{
+		ffile->outs[writer->num] = NULL;
+		restore_data_file_finish(out, to_path, ffile->file,
+								 ffile->allow_truncate, false,
+								 ffile->need_truncate, ffile->truncate_from);
+	}
+}
+
+static void *
+fanout_writer_main(void *arg)
+{
+	fanout_writer *writer = (fanout_writer *) arg;
+	restore_fanout *fanout = writer->fanout;
+
+	/* Agent of this writer runs at the host of its data directory */
+	if (writer->target->host)
+		set_agent_host(writer->target->host);
+
+	for (;;)
+	{
+		fanout_job *job;
+
+		pthread_mutex_lock(&fanout->mutex);
+		while (writer->head == NULL && !fanout->stop)
+			pthread_cond_wait(&writer->job_cond, &fanout->mutex);
+
+		job = writer->head;
+		if (job == NULL)
+		{
+			pthread_mutex_unlock(&fanout->mutex);
+			break;
+		}
+		writer->head = job->next;
+		if (writer->head == NULL)
+			writer->tail = NULL;
+		writer->njobs--;
+		pthread_cond_broadcast(&fanout->progress_cond);
+		pthread_mutex_unlock(&fanout->mutex);
+
+		if (interrupted || thread_interrupted)
+			elog(ERROR, "Interrupted during restore database");
+
+		fanout_writer_do_job(writer, job);
+
+		pthread_mutex_lock(&fanout->mutex);
+		if (job->copy && --job->copy->nrefs == 0)
+		{
+			pg_free(job->copy->from_root);
+			pg_free(job->copy);
+		}
+		else if (job->batch && --job->batch->nrefs == 0)
+			pg_free(job->batch);
+		else if (job->ffile && job->batch == NULL && --job->ffile->nrefs == 0)
+		{
+			pg_free(job->ffile->outs);
+			pg_free(job->ffile);
+		}
+		fanout->npending--;
+		pthread_cond_broadcast(&fanout->progress_cond);
+		pthread_mutex_unlock(&fanout->mutex);
+
+		pg_free(job);
+	}
+
+	fio_disconnect();
+	set_agent_host(NULL);
+
+	writer->ret = 0;
+	return NULL;
+}
+
+/*
+ * Queue the batch of pages of the file, or the last job of the file if batch
+ * is NULL, or the copy of non-data file if ffile is NULL, for every writer.
+ */
+static void
+restore_fanout_push(restore_fanout *fanout, fanout_file *ffile,
+					restore_batch *batch, fanout_copy *copy)
+{
+	int			i;
+
+	pthread_mutex_lock(&fanout->mutex);
+	if (batch)
+		batch->nrefs = fanout->nwriters;
+
+	for (i = 0; i < fanout->nwriters; i++)
+	{
+		fanout_writer *writer = &fanout->writers[i];
+		fanout_job *job;
+
+		while (writer->njobs >= RESTORE_FANOUT_QUEUE_JOBS)
+			restore_fanout_wait_cond(fanout, &fanout->progress_cond);
+
+		job = pgut_new(fanout_job);
+		job->ffile = ffile;
+		job->batch = batch;
+		job->copy = copy;
+		job->next = NULL;
+		if (writer->tail)
+			writer->tail->next = job;
+		else
+			writer->head = job;
+		writer->tail = job;
+		writer->njobs++;
+		fanout->npending++;
+		pthread_cond_signal(&writer->job_cond);
+	}
+	pthread_mutex_unlock(&fanout->mutex);
+}
+
+/*
+ * Start writers for the given list of data directories, pgRestoreTarget.
+ */
+restore_fanout *
+restore_fanout_start(parray *target_list)
+{
+	restore_fanout *fanout = pgut_new(restore_fanout);
+	int			i;
+
+	pthread_mutex_init(&fanout->mutex, NULL);
+	pthread_cond_init(&fanout->progress_cond, NULL);
+	fanout->npending = 0;
+	fanout->stop = false;
+	fanout->nwriters = parray_num(target_list);
+	fanout->writers = palloc0(sizeof(fanout_writer) * fanout->nwriters);
+
+	for (i = 0; i < fanout->nwriters; i++)
+	{
+		fanout_writer *writer = &fanout->writers[i];
+
+		writer->fanout = fanout;
+		writer->num = i;
+		writer->target = (pgRestoreTarget *) parray_get(target_list, i);
+		pthread_cond_init(&writer->job_cond, NULL);
+		/* By default there are some error */
+		writer->ret = 1;
+
+		pthread_create(&writer->thread, NULL, fanout_writer_main, writer);
+	}
+
+	elog(LOG, "Started %d writers for fan-out restore", fanout->nwriters);
+
+	return fanout;
+}
+
+/*
+ * Wait until writers have written everything queued so far.
+ */
+void
+restore_fanout_wait(restore_fanout *fanout)
+{
+	pthread_mutex_lock(&fanout->mutex);
+	while (fanout->npending > 0)
+		restore_fanout_wait_cond(fanout, &fanout->progress_cond);
+	pthread_mutex_unlock(&fanout->mutex);
+}
+
+/*
+ * Stop writers. Throw an error if any of them failed.
+ */
+void
+restore_fanout_stop(restore_fanout *fanout)
+{
+	bool		isok = true;
+	int			i;
+
+	pthread_mutex_lock(&fanout->mutex);
+	fanout->stop = true;
+	for (i = 0; i < fanout->nwriters; i++)
+		pthread_cond_signal(&fanout->writers[i].job_cond);
+	pthread_mutex_unlock(&fanout->mutex);
+
+	for (i = 0; i < fanout->nwriters; i++)
+	{
+		pthread_join(fanout->writers[i].thread, NULL);
+		if (fanout->writers[i].ret == 1)
+			isok = false;
+	}
+
+	if (!isok)
+		elog(ERROR, "Data files restoring failed");
+
+	pfree(fanout->writers);
+	pfree(fanout);
+}
+
+/*
+ * Restore the data file into all data directories of fan-out restore.
+ * Pages are read and decompressed once and then written by writers.
+ */
+void
+restore_data_file_fanout(restore_fanout *fanout, pgFile *file,
+						 bool allow_truncate, uint32 backup_version)
+{
+	FILE	   *in = NULL;
+	fanout_file *ffile;
+	BlockNumber	blknum = 0,
+				truncate_from = 0;
+	bool		need_truncate = false;
+	bool		eof = false;
+
+	/* BYTES_INVALID allowed only in case of restoring file from DELTA backup */
+	if (file->write_size != BYTES_INVALID)
+	{
+		/* open backup mode file for read */
+		in = fopen(file->path, PG_BINARY_R);
+		if (in == NULL)
+		{
+			elog(ERROR, "Cannot open backup file \"%s\": %s", file->path,
+				 strerror(errno));
+		}
+	}
+
+	ffile = pgut_new(fanout_file);
+	ffile->file = file;
+	ffile->allow_truncate = allow_truncate;
+	ffile->need_truncate = false;
+	ffile->truncate_from = 0;
+	ffile->outs = palloc0(sizeof(FILE *) * fanout->nwriters);
+	ffile->nrefs = fanout->nwriters;
+
+	/* File didn`t changed. Nothing to copy */
+	while (file->write_size != BYTES_INVALID && !eof && !need_truncate)
+	{
+		restore_batch *batch = restore_batch_new(file);
+
+		restore_batch_read(in, file, batch, backup_version, &blknum,
+						   &eof, &need_truncate, &truncate_from);
+		if (batch->npages == 0)
+		{
+			pg_free(batch);
+			continue;
+		}
+
+		restore_batch_decompress(batch);
+		restore_batch_check(batch, file);
+
+		/* Writers free the batch */
+		restore_fanout_push(fanout, ffile, batch, NULL);
+	}
+
+	if (in)
+		fclose(in);
+
+	ffile->need_truncate = need_truncate;
+	ffile->truncate_from = truncate_from;
+	restore_fanout_push(fanout, ffile, NULL, NULL);
+}
+
+/*
+ * Copy the non-data file into all data directories of fan-out restore, or
+ * create it empty, if it is excluded by partial restore. The file is read
+ * by every writer. from_root is used to read pg_control.
+ */
+void
+restore_file_fanout(restore_fanout *fanout, pgFile *file,
+					const char *from_root, bool create_empty)
+{
+	fanout_copy *copy = pgut_new(fanout_copy);
+
+	copy->file = file;
+	copy->from_root = pgut_strdup(from_root);
+	copy->create_empty = create_empty;
+	copy->nrefs = fanout->nwriters;
+
+	/* Writers free the copy */
+	restore_fanout_push(fanout, NULL, NULL, copy);
+}
+#else
+restore_fanout *
+restore_fanout_start(parray *target_list)
+{
+	elog(ERROR, "Restore into several data directories is not supported on this platform");
+	return NULL;				/* keep compiler quiet */
+}
+
+void
+restore_fanout_wait(restore_fanout *fanout)
+{
+}
+
+void
+restore_fanout_stop(restore_fanout *fanout)
+{
+}
+
+void
+restore_data_file_fanout(restore_fanout *fanout, pgFile *file,
+						 bool allow_truncate, uint32 backup_version)
+{
+}
+
+void
+restore_file_fanout(restore_fanout *fanout, pgFile *file,
+					const char *from_root, bool create_empty)
+{
+}
+#endif
+
 /*
  * Copy file to backup.
  * We do not apply compression to these files, because
@@ -1088,7 +2454,11 @@ copy_file(fio_location from_location, const char *to_root,
 			 strerror(errno_tmp));
 	}
 
-	if (fio_fflush(out) != 0 ||
+	/*
+	 * Files copied into the backup catalog are synced at once by the caller,
+	 * files restored into PGDATA are synced right away.
+	 */
+	if ((to_location == FIO_DB_HOST ? fio_fflush(out) : fio_fflush_async(out)) != 0 ||
 		fio_fclose(out))
 		elog(ERROR, "cannot write \"%s\": %s", to_path, strerror(errno));
 	fio_fclose(in);
@@ -1129,6 +2499,80 @@ create_empty_file(fio_location from_location, const char *to_root,
 	return true;
 }
 
+/*
+ * Restore a non-data file by cloning it, used if the backup catalog and the
+ * target directory are on the same local file system. Return false if the
+ * file system can neither clone nor copy the file by itself, copy_file()
+ * should be used then.
+ */
+bool
+clone_file(const char *to_root, pgFile *file)
+{
+#ifdef __linux__
+	char		to_path[MAXPGPATH];
+	struct stat	st;
+	int			in;
+	int			out;
+	bool		success = false;
+
+	in = open(file->path, O_RDONLY | PG_BINARY, 0);
+	if (in < 0)
+		elog(ERROR, "cannot open source file \"%s\": %s", file->path,
+			 strerror(errno));
+
+	if (fstat(in, &st) == -1)
+	{
+		int			errno_tmp = errno;
+
+		close(in);
+		elog(ERROR, "cannot stat file \"%s\": %s", file->path,
+			 strerror(errno_tmp));
+	}
+
+	join_path_components(to_path, to_root, file->rel_path);
+	out = open(to_path, O_WRONLY | O_CREAT | O_TRUNC | PG_BINARY,
+			   FILE_PERMISSION);
+	if (out < 0)
+	{
+		int			errno_tmp = errno;
+
+		close(in);
+		elog(ERROR, "cannot open destination file \"%s\": %s",
+			 to_path, strerror(errno_tmp));
+	}
+
+#ifdef FICLONE
+	success = ioctl(out, FICLONE, in) == 0;
+#endif
+	if (!success)
+		success = copy_file_data(in, 0, out, 0, st.st_size);
+
+	close(in);
+	if (close(out) != 0)
+		elog(ERROR, "cannot write \"%s\": %s", to_path, strerror(errno));
+
+	/* copy_file() truncates the file and copies it again */
+	if (!success)
+	{
+		elog(VERBOSE, "Cannot clone file \"%s\", copy it", file->path);
+		return false;
+	}
+
+	/* update file permission */
+	if (fio_chmod(to_path, file->mode, FIO_DB_HOST) == -1)
+		elog(ERROR, "cannot change mode of \"%s\": %s", to_path,
+			 strerror(errno));
+
+	file->read_size = st.st_size;
+	file->write_size = st.st_size;
+	file->uncompressed_size = st.st_size;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
 /*
  * Validate given page.
  *
@@ -1251,7 +2695,7 @@ check_data_file(ConnectionArgs *arguments,
 	char		curr_page[BLCKSZ];
 	bool 		is_valid = true;
 
-	in = fopen(file->path, PG_BINARY_R);
+	in = fio_fopen(file->path, PG_BINARY_R, FIO_DB_HOST);
 	if (in == NULL)
 	{
 		/*
@@ -1272,6 +2716,24 @@ check_data_file(ConnectionArgs *arguments,
 	if (file->size % BLCKSZ != 0)
 		elog(WARNING, "File: \"%s\", invalid file size %zu", file->path, file->size);
 
+	/*
+	 * Pages of the remote file are checked by the agent,
+	 * which sends back only numbers of corrupted blocks.
+	 */
+	if (fio_is_remote_file(in))
+	{
+		int rc = fio_check_pages(in, file, checksum_version);
+
+		fio_fclose(in);
+		if (rc < 0)
+		{
+			elog(WARNING, "Failed to read file \"%s\": %s",
+				 file->path, strerror(-rc));
+			return false;
+		}
+		return rc == 0;
+	}
+
 	/*
 	 * Compute expected number of blocks in the file.
 	 * NOTE This is a normal situation, if the file size has changed
@@ -1283,7 +2745,8 @@ check_data_file(ConnectionArgs *arguments,
 	{
 		page_state = prepare_page(arguments, file, InvalidXLogRecPtr,
 									blknum, nblocks, in, &n_blocks_skipped,
-									BACKUP_MODE_FULL, curr_page, false, checksum_version,
+									BACKUP_MODE_FULL, curr_page, false,
+									PAGE_READ_ATTEMPTS, false, checksum_version,
 									0, NULL);
 
 		if (page_state == PageIsTruncated)
@@ -1312,7 +2775,7 @@ check_data_file(ConnectionArgs *arguments,
 		}
 	}
 
-	fclose(in);
+	fio_fclose(in);
 	return is_valid;
 }
 
@@ -1438,14 +2901,17 @@ check_file_pages(pgFile *file, XLogRecPtr stop_lsn, uint32 checksum_version,
 				return false;
 			}
 
+			/* Invalid page of auxiliary fork is copied as is, see prepare_page() */
 			if (validate_one_page(page.data, file, blknum,
-								  stop_lsn, checksum_version) == PAGE_IS_FOUND_AND_NOT_VALID)
+								  stop_lsn, checksum_version) == PAGE_IS_FOUND_AND_NOT_VALID &&
+				!IsNotMainFork(file))
 				is_valid = false;
 		}
 		else
 		{
 			if (validate_one_page(compressed_page.data, file, blknum,
-				stop_lsn, checksum_version) == PAGE_IS_FOUND_AND_NOT_VALID)
+				stop_lsn, checksum_version) == PAGE_IS_FOUND_AND_NOT_VALID &&
+				!IsNotMainFork(file))
 				is_valid = false;
 		}
 	}
@@ -1462,3 +2928,100 @@ check_file_pages(pgFile *file, XLogRecPtr stop_lsn, uint32 checksum_version,
 
 	return is_valid;
 }
+
+/*
+ * Check the page being written to backup the same way validation does it,
+ * so that the backup need not be validated after it is taken. write_buffer
+ * contains BackupPageHeader followed by the page, compressed or not.
+ */
+void
+check_written_page(pgFile *file, const char *write_buffer,
+				   uint32 checksum_version)
+{
+	BackupPageHeader *header = (BackupPageHeader *) write_buffer;
+	DataPage	page;
+
+	if (header->compressed_size == PageIsTruncated)
+		return;
+
+	if (header->compressed_size != BLCKSZ)
+	{
+		int32		uncompressed_size;
+		const char *errormsg = NULL;
+
+		uncompressed_size = do_decompress(page.data, BLCKSZ,
+										  write_buffer + sizeof(BackupPageHeader),
+										  header->compressed_size,
+										  file->compress_alg, &errormsg);
+		if (uncompressed_size != BLCKSZ)
+			elog(ERROR, "Block %u of file \"%s\" cannot be decompressed: %s",
+				 header->block, file->path,
+				 errormsg ? errormsg : "invalid size of uncompressed page");
+	}
+	else
+		memcpy(page.data, write_buffer + sizeof(BackupPageHeader), BLCKSZ);
+
+	/* Invalid page of auxiliary fork is copied as is, see prepare_page() */
+	if (validate_one_page(page.data, file, header->block, InvalidXLogRecPtr,
+						  checksum_version) == PAGE_IS_FOUND_AND_NOT_VALID &&
+		!IsNotMainFork(file))
+		elog(ERROR, "Block %u of file \"%s\" is not valid in backup",
+			 header->block, file->path);
+}
+
+/*
+ * Read the file just written to backup and compare its CRC with the one
+ * computed while writing. The file is opened with O_DIRECT if possible,
+ * so the data is read from the storage rather than from OS cache.
+ */
+void
+read_back_file(const char *path, pgFile *file)
+{
+	char	   *buf_raw;
+	char	   *buf;
+	int			fd = -1;
+	ssize_t		rc;
+	pg_crc32	crc;
+	bool		direct = false;
+
+	buf_raw = pgut_malloc(READ_BACK_BUFSIZE + READ_BACK_ALIGN);
+	buf = (char *) TYPEALIGN(READ_BACK_ALIGN, buf_raw);
+
+#ifdef O_DIRECT
+	fd = open(path, O_RDONLY | PG_BINARY | O_DIRECT);
+	direct = (fd >= 0);
+#endif
+
+retry:
+	/* File system may not support O_DIRECT */
+	if (fd < 0)
+		fd = open(path, O_RDONLY | PG_BINARY);
+	if (fd < 0)
+		elog(ERROR, "Cannot open backup file \"%s\": %s", path,
+			 strerror(errno));
+
+	INIT_FILE_CRC32(true, crc);
+	while ((rc = read(fd, buf, READ_BACK_BUFSIZE)) > 0)
+		COMP_FILE_CRC32(true, crc, buf, rc);
+
+	if (rc < 0)
+	{
+		if (direct && errno == EINVAL)
+		{
+			close(fd);
+			fd = -1;
+			direct = false;
+			goto retry;
+		}
+		elog(ERROR, "Cannot read backup file \"%s\": %s", path,
+			 strerror(errno));
+	}
+	FIN_FILE_CRC32(true, crc);
+
+	close(fd);
+	pg_free(buf_raw);
+
+	if (crc != file->crc)
+		elog(ERROR, "Backup file \"%s\" is read back with CRC %X, but %X was written",
+			 path, crc, file->crc);
+}
@@ -65,7 +65,7 @@ do_delete(time_t backup_id)
 		pgBackup   *backup = (pgBackup *) parray_get(backup_list, i);
 
 		/* check if backup is descendant of delete target */
-		if (is_parent(target_backup->start_time, backup, true))
+		if (is_ancestor(target_backup, backup, true))
 		{
 			parray_append(delete_list, backup);
 
@@ -549,6 +549,9 @@ do_retention_merge(parray *backup_list, parray *to_keep_list, parray *to_purge_l
 			merge_backups(full_backup, from_backup);
 			backup_merged = true;
 
+			/* Merge changed links between backups */
+			catalog_build_backup_graph(backup_list);
+
 			/* Try to remove merged incremental backup from both keep and purge lists */
 			parray_rm(to_purge_list, from_backup, pgBackupCompareId);
 			parray_set(to_keep_list, i, NULL);
@@ -562,12 +565,23 @@ do_retention_merge(parray *backup_list, parray *to_keep_list, parray *to_purge_l
 
 }
 
+/* Compare two pgBackup with their position in the graph of backups */
+static int
+pgBackupCompareDagEnter(const void *l, const void *r)
+{
+	pgBackup   *lp = *(pgBackup **) l;
+	pgBackup   *rp = *(pgBackup **) r;
+
+	return lp->dag_enter - rp->dag_enter;
+}
+
 /* Purge expired backups */
 static void
 do_retention_purge(parray *to_keep_list, parray *to_purge_list)
 {
 	int i;
 	int j;
+	parray	   *keep_descendants = parray_new();
 
 	/* Remove backups by retention policy. Retention policy is configured by
 	 * retention_redundancy and retention_window
@@ -577,40 +591,61 @@ do_retention_purge(parray *to_keep_list, parray *to_purge_list)
 	 * but parent isn`t. Maybe something bad happened with time on server?
 	 */
 
+	/*
+	 * Descendants of the backup are numbered right after it in the graph of
+	 * backups, so sort incremental backups from keep list by their numbers,
+	 * then the first of them after the backup marked for purge tells us if
+	 * the backup has a descendant guarded by retention.
+	 */
+	for (i = 0; i < parray_num(to_keep_list); i++)
+	{
+		pgBackup   *keep_backup = (pgBackup *) parray_get(to_keep_list, i);
+
+		/* item could have been nullified in merge */
+		if (!keep_backup)
+			continue;
+
+		/* Full backup cannot be a descendant */
+		if (keep_backup->backup_mode == BACKUP_MODE_FULL)
+			continue;
+
+		parray_append(keep_descendants, keep_backup);
+	}
+	parray_qsort(keep_descendants, pgBackupCompareDagEnter);
+
 	for (j = 0; j < parray_num(to_purge_list); j++)
 	{
 		bool purge = true;
-
 		pgBackup   *delete_backup = (pgBackup *) parray_get(to_purge_list, j);
+		size_t		lo = 0,
+					hi = parray_num(keep_descendants);
 
 		elog(LOG, "Consider backup %s for purge",
 						base36enc(delete_backup->start_time));
 
-		/* Evaluate marked for delete backup against every backup in keep list.
+		/* Find the first backup from keep list not preceding delete_backup */
+		while (lo < hi)
+		{
+			size_t		mid = (lo + hi) / 2;
+			pgBackup   *keep_backup = (pgBackup *) parray_get(keep_descendants, mid);
+
+			if (keep_backup->dag_enter < delete_backup->dag_enter)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		/* Evaluate marked for delete backup against backups in keep list.
 		 * If marked for delete backup is recognized as parent of one of those,
 		 * then this backup should not be deleted.
 		 */
-		for (i = 0; i < parray_num(to_keep_list); i++)
+		if (lo < parray_num(keep_descendants))
 		{
-			char		*keeped_backup_id;
-
-			pgBackup   *keep_backup = (pgBackup *) parray_get(to_keep_list, i);
-
-			/* item could have been nullified in merge */
-			if (!keep_backup)
-				continue;
+			pgBackup   *keep_backup = (pgBackup *) parray_get(keep_descendants, lo);
 
-			/* Full backup cannot be a descendant */
-			if (keep_backup->backup_mode == BACKUP_MODE_FULL)
-				continue;
-
-			keeped_backup_id = base36enc_dup(keep_backup->start_time);
-
-			elog(LOG, "Check if backup %s is parent of backup %s",
-						base36enc(delete_backup->start_time), keeped_backup_id);
-
-			if (is_parent(delete_backup->start_time, keep_backup, true))
+			if (is_ancestor(delete_backup, keep_backup, true))
 			{
+				char	   *keeped_backup_id = base36enc_dup(keep_backup->start_time);
 
 				/* We must not delete this backup, evict it from purge list */
 				elog(LOG, "Retain backup %s because his "
@@ -619,9 +654,7 @@ do_retention_purge(parray *to_keep_list, parray *to_purge_list)
 
 				purge = false;
 				pg_free(keeped_backup_id);
-				break;
 			}
-			pg_free(keeped_backup_id);
 		}
 
 		/* Retain backup */
@@ -642,6 +675,8 @@ do_retention_purge(parray *to_keep_list, parray *to_purge_list)
 		backup_deleted = true;
 
 	}
+
+	parray_free(keep_descendants);
 }
 
 /*
@@ -658,6 +693,10 @@ do_retention_wal(bool dry_run)
 
 	tli_list = catalog_get_timelines(&instance_config);
 
+	/* WAL validated earlier may be removed */
+	if (!dry_run)
+		forget_validated_wal();
+
 	for (i = 0; i < parray_num(tli_list); i++)
 	{
 		timelineInfo  *tlinfo = (timelineInfo  *) parray_get(tli_list, i);
@@ -727,6 +766,8 @@ delete_backup_files(pgBackup *backup)
 	char		path[MAXPGPATH];
 	char		timestamp[100];
 	parray	   *files;
+	parray	   *stripe_paths;
+	parray	   *stripe_roots = parray_new();
 	size_t		num_files;
 
 	/*
@@ -769,11 +810,48 @@ delete_backup_files(pgBackup *backup)
 		if (interrupted)
 			elog(ERROR, "interrupted during delete backup");
 
-		pgFileDelete(file);
+		pgBackupFileDelete(file, path, stripe_roots);
 	}
 
 	parray_walk(files, pgFileFree);
 	parray_free(files);
+
+	/*
+	 * Remove directories of the backup on stripe paths. Data files of merged
+	 * backup can be located in the directory named after the FULL backup, it
+	 * is found by links, the current name is checked on each stripe path.
+	 */
+	stripe_paths = make_stripe_path_list(instance_config.stripe_paths_str);
+	for (i = 0; stripe_paths && i < parray_num(stripe_paths); i++)
+	{
+		snprintf(path, MAXPGPATH, "%s/%s/%s",
+				 (char *) parray_get(stripe_paths, i), instance_name,
+				 base36enc(backup->start_time));
+		parray_append(stripe_roots, pgut_strdup(path));
+	}
+	if (stripe_paths)
+		free_dir_list(stripe_paths);
+
+	for (i = 0; i < parray_num(stripe_roots); i++)
+	{
+		char	   *stripe_root = (char *) parray_get(stripe_roots, i);
+		size_t		j;
+
+		if (fio_access(stripe_root, F_OK, FIO_BACKUP_HOST) != 0)
+			continue;
+
+		files = parray_new();
+		dir_list_file(files, stripe_root, false, false, true, 0,
+					  FIO_BACKUP_HOST);
+		parray_qsort(files, pgFileComparePathDesc);
+		for (j = 0; j < parray_num(files); j++)
+			pgFileDelete((pgFile *) parray_get(files, j));
+
+		parray_walk(files, pgFileFree);
+		parray_free(files);
+	}
+	free_dir_list(stripe_roots);
+
 	backup->status = BACKUP_STATUS_DELETED;
 
 	return;
@@ -964,6 +1042,7 @@ do_delete_instance(void)
 	int 		i;
 	int 		rc;
 	char		instance_config_path[MAXPGPATH];
+	char		path[MAXPGPATH];
 
 
 	/* Delete all backups. */
@@ -1009,6 +1088,16 @@ do_delete_instance(void)
 			strerror(errno));
 	}
 
+	/* Delete manifest of objects uploaded by catalog-sync, if any */
+	join_path_components(path, backup_instance_path, SYNC_MANIFEST_FILE);
+	if (remove(path) && errno != ENOENT)
+		elog(ERROR, "Can't remove \"%s\": %s", path, strerror(errno));
+
+	/* Delete cache of validate --wal, if any */
+	join_path_components(path, backup_instance_path, WAL_VALIDATION_CACHE_FILE);
+	if (remove(path) && errno != ENOENT)
+		elog(ERROR, "Can't remove \"%s\": %s", path, strerror(errno));
+
 	/* Delete instance root directories */
 	if (rmdir(backup_instance_path) != 0)
 		elog(ERROR, "Can't remove \"%s\": %s", backup_instance_path,
@@ -22,6 +22,7 @@
 #include <dirent.h>
 
 #include "utils/configuration.h"
+#include "utils/thread.h"
 
 /*
  * The contents of these directories are removed or recreated during server
@@ -102,11 +103,11 @@ typedef struct TablespaceListCell
 	char		new_dir[MAXPGPATH];
 } TablespaceListCell;
 
-typedef struct TablespaceList
+struct TablespaceList
 {
 	TablespaceListCell *head;
 	TablespaceListCell *tail;
-} TablespaceList;
+};
 
 typedef struct TablespaceCreatedListCell
 {
@@ -126,7 +127,36 @@ static int pgCompareString(const void *str1, const void *str2);
 static char dir_check_file(pgFile *file);
 static void dir_list_file_internal(parray *files, pgFile *parent, bool exclude,
 								   bool follow_symlink,
-								   int external_dir_num, fio_location location);
+								   int external_dir_num, fio_location location,
+								   parray *subdirs);
+
+/*
+ * Parallel directory walk. Directories to read are queued, each thread takes
+ * a directory from the queue, lists its content into its own list of files
+ * and queues found subdirectories.
+ */
+typedef struct
+{
+	parray	   *files;			/* files found by the thread */
+	bool		exclude;
+	bool		follow_symlink;
+	int			external_dir_num;
+	fio_location location;
+
+	/*
+	 * Return value from the thread.
+	 * 0 means there is no error, 1 - there is an error.
+	 */
+	int			ret;
+} dir_list_arg;
+
+static pthread_mutex_t dir_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Directories waiting to be read */
+static parray *dir_list_queue = NULL;
+/* Number of directories being read at the moment */
+static int	dir_list_active = 0;
+
+static void *dir_list_file_worker(void *arg);
 static void opt_path_map(ConfigOption *opt, const char *arg,
 						 TablespaceList *list, const char *type);
 
@@ -181,6 +211,7 @@ pgFileNew(const char *path, const char *rel_path, bool follow_symlink,
 	file = pgFileInit(path, rel_path);
 	file->size = st.st_size;
 	file->mode = st.st_mode;
+	file->mtime = st.st_mtime;
 	file->external_dir_num = external_dir_num;
 
 	return file;
@@ -328,6 +359,8 @@ pgFileFree(void *file)
 	if (file_ptr->forkName)
 		free(file_ptr->forkName);
 
+	pagemap_free(&file_ptr->pagemap);
+
 	pfree(file_ptr->path);
 	pfree(file_ptr->rel_path);
 	pfree(file);
@@ -529,12 +562,162 @@ dir_list_file(parray *files, const char *root, bool exclude, bool follow_symlink
 		parray_append(files, file);
 
 	dir_list_file_internal(files, file, exclude, follow_symlink,
-						   external_dir_num, location);
+						   external_dir_num, location, NULL);
 
 	if (!add_root)
 		pgFileFree(file);
 }
 
+/*
+ * The same as dir_list_file(), but directories are read by num_threads
+ * threads. Order of files in the list is undefined.
+ */
+void
+dir_list_file_parallel(parray *files, const char *root, bool exclude,
+					   bool follow_symlink, bool add_root, int external_dir_num,
+					   fio_location location)
+{
+	pgFile	   *file;
+	pthread_t  *threads;
+	dir_list_arg *threads_args;
+	bool		list_isok = true;
+	int			i;
+
+	if (num_threads <= 1)
+	{
+		dir_list_file(files, root, exclude, follow_symlink, add_root,
+					  external_dir_num, location);
+		return;
+	}
+
+	file = pgFileNew(root, "", follow_symlink, external_dir_num, location);
+	if (file == NULL)
+	{
+		/* For external directory this is not ok */
+		if (external_dir_num > 0)
+			elog(ERROR, "External directory is not found: \"%s\"", root);
+		else
+			return;
+	}
+
+	if (!S_ISDIR(file->mode))
+	{
+		if (external_dir_num > 0)
+			elog(ERROR, " --external-dirs option \"%s\": directory or symbolic link expected",
+				 file->path);
+		else
+			elog(WARNING, "Skip \"%s\": unexpected file format", file->path);
+		return;
+	}
+
+	dir_list_queue = parray_new();
+	parray_append(dir_list_queue, file);
+	dir_list_active = 0;
+
+	threads = (pthread_t *) palloc(sizeof(pthread_t) * num_threads);
+	threads_args = (dir_list_arg *) palloc(sizeof(dir_list_arg) * num_threads);
+
+	thread_interrupted = false;
+	for (i = 0; i < num_threads; i++)
+	{
+		dir_list_arg *arg = &(threads_args[i]);
+
+		arg->files = parray_new();
+		arg->exclude = exclude;
+		arg->follow_symlink = follow_symlink;
+		arg->external_dir_num = external_dir_num;
+		arg->location = location;
+		/* By default there are some error */
+		arg->ret = 1;
+
+		pthread_create(&threads[i], NULL, dir_list_file_worker, arg);
+	}
+
+	if (add_root)
+		parray_append(files, file);
+
+	for (i = 0; i < num_threads; i++)
+	{
+		pthread_join(threads[i], NULL);
+		if (threads_args[i].ret == 1)
+			list_isok = false;
+
+		parray_concat(files, threads_args[i].files);
+		parray_free(threads_args[i].files);
+	}
+
+	parray_free(dir_list_queue);
+	dir_list_queue = NULL;
+
+	pfree(threads);
+	pfree(threads_args);
+
+	if (!list_isok)
+		elog(ERROR, "Failed to list directory \"%s\"", root);
+
+	if (!add_root)
+		pgFileFree(file);
+}
+
+static void *
+dir_list_file_worker(void *arg)
+{
+	dir_list_arg *arguments = (dir_list_arg *) arg;
+	parray	   *subdirs = parray_new();
+
+	while (true)
+	{
+		pgFile	   *dir = NULL;
+
+		pthread_lock(&dir_list_mutex);
+		if (parray_num(dir_list_queue) > 0)
+		{
+			dir = (pgFile *) parray_remove(dir_list_queue,
+										   parray_num(dir_list_queue) - 1);
+			dir_list_active++;
+		}
+		else if (dir_list_active == 0)
+		{
+			/* Nothing to read and nobody can queue more directories */
+			pthread_mutex_unlock(&dir_list_mutex);
+			break;
+		}
+		pthread_mutex_unlock(&dir_list_mutex);
+
+		if (interrupted || thread_interrupted)
+			elog(ERROR, "interrupted during directory listing");
+
+		if (dir == NULL)
+		{
+			/* Other threads are still reading, they may queue directories */
+			pg_usleep(1000L);
+			continue;
+		}
+
+		dir_list_file_internal(arguments->files, dir, arguments->exclude,
+							   arguments->follow_symlink,
+							   arguments->external_dir_num,
+							   arguments->location, subdirs);
+
+		pthread_lock(&dir_list_mutex);
+		while (parray_num(subdirs) > 0)
+			parray_append(dir_list_queue,
+						  parray_remove(subdirs, parray_num(subdirs) - 1));
+		dir_list_active--;
+		pthread_mutex_unlock(&dir_list_mutex);
+	}
+
+	parray_free(subdirs);
+
+	/* close ssh connection */
+	fio_disconnect();
+
+	/* Listing is successful */
+	arguments->ret = 0;
+
+	return NULL;
+}
+
 #define CHECK_FALSE				0
 #define CHECK_TRUE				1
 #define CHECK_EXCLUDE_FALSE		2
@@ -707,11 +890,20 @@ dir_check_file(pgFile *file)
 			if (fork_name)
 			{
 				/* Auxiliary fork of the relfile */
-				sscanf(file->name, "%u_%s", &(file->relOid), file->forkName);
+				sscanf(file->name, "%u_%[a-z].%d", &(file->relOid),
+					   file->forkName, &(file->segno));
 
 				/* Do not backup ptrack files */
 				if (strcmp(file->forkName, "ptrack") == 0)
 					return CHECK_FALSE;
+
+				/*
+				 * Free space map and visibility map consist of regular pages,
+				 * so they are backed up block by block as the main fork.
+				 */
+				if (strcmp(file->forkName, "fsm") == 0 ||
+					strcmp(file->forkName, "vm") == 0)
+					file->is_datafile = true;
 			}
 			else
 			{
@@ -749,7 +941,8 @@ dir_check_file(pgFile *file)
 static void
 dir_list_file_internal(parray *files, pgFile *parent, bool exclude,
 					   bool follow_symlink,
-					   int external_dir_num, fio_location location)
+					   int external_dir_num, fio_location location,
+					   parray *subdirs)
 {
 	DIR			  *dir;
 	struct dirent *dent;
@@ -826,11 +1019,17 @@ dir_list_file_internal(parray *files, pgFile *parent, bool exclude,
 
 		/*
 		 * If the entry is a directory call dir_list_file_internal()
-		 * recursively.
+		 * recursively, or leave it for caller, if caller collects
+		 * subdirectories.
 		 */
 		if (S_ISDIR(file->mode))
-			dir_list_file_internal(files, file, exclude, follow_symlink,
-								   external_dir_num, location);
+		{
+			if (subdirs)
+				parray_append(subdirs, file);
+			else
+				dir_list_file_internal(files, file, exclude, follow_symlink,
+									   external_dir_num, location, NULL);
+		}
 	}
 
 	if (errno && errno != ENOENT)
@@ -845,16 +1044,20 @@ dir_list_file_internal(parray *files, pgFile *parent, bool exclude,
 
 /*
  * Retrieve tablespace path, either relocated or original depending on whether
- * -T was passed or not.
+ * -T was passed or not. If tablespace_map is not NULL, it is used instead of
+ * -T, e.g. for a data directory given by --extra-pgdata.
  *
  * Copy of function get_tablespace_mapping() from pg_basebackup.c.
  */
-static const char *
-get_tablespace_mapping(const char *dir)
+const char *
+get_tablespace_mapping(TablespaceList *tablespace_map, const char *dir)
 {
 	TablespaceListCell *cell;
 
-	for (cell = tablespace_dirs.head; cell; cell = cell->next)
+	if (tablespace_map == NULL)
+		tablespace_map = &tablespace_dirs;
+
+	for (cell = tablespace_map->head; cell; cell = cell->next)
 		if (strcmp(dir, cell->old_dir) == 0)
 			return cell->new_dir;
 
@@ -937,12 +1140,62 @@ opt_externaldir_map(ConfigOption *opt, const char *arg)
 	opt_path_map(opt, arg, &external_remap_list, "external directory");
 }
 
+/*
+ * Parse data directory to restore into, given as [HOST:]DIR[,OLDDIR=NEWDIR]...
+ * The data directory is an absolute path, so everything before the colon
+ * is a host name. Tablespace mapping applies to this data directory only.
+ */
+pgRestoreTarget *
+parse_restore_target(const char *arg)
+{
+	pgRestoreTarget *target = pgut_new(pgRestoreTarget);
+	char	   *pgdata = pgut_strdup(arg);
+	char	   *colon;
+	char	   *mapping;
+
+	target->host = NULL;
+	target->tablespace_map = pgut_new(TablespaceList);
+	target->tablespace_map->head = NULL;
+	target->tablespace_map->tail = NULL;
+
+	if (!is_absolute_path(pgdata) && (colon = strchr(pgdata, ':')) != NULL)
+	{
+		*colon = '\0';
+		if (*pgdata == '\0')
+			elog(ERROR, "empty host name in --extra-pgdata: \"%s\"", arg);
+		target->host = pgdata;
+		pgdata = colon + 1;
+	}
+
+	mapping = strchr(pgdata, ',');
+	if (mapping)
+		*mapping++ = '\0';
+
+	canonicalize_path(pgdata);
+	if (!is_absolute_path(pgdata))
+		elog(ERROR, "--extra-pgdata must be an absolute path");
+	target->pgdata = pgdata;
+
+	while (mapping)
+	{
+		char	   *next = strchr(mapping, ',');
+
+		if (next)
+			*next++ = '\0';
+		opt_path_map(NULL, mapping, target->tablespace_map, "tablespace");
+		mapping = next;
+	}
+
+	return target;
+}
+
 /*
  * Create directories from **dest_files** in **data_dir**.
  *
  * If **extract_tablespaces** is true then try to extract tablespace data
  * directories into their initial path using tablespace_map file.
- * Use **backup_dir** for tablespace_map extracting.
+ * Use **backup_dir** for tablespace_map extracting. Tablespaces are
+ * relocated by **tablespace_map** or by -T, if it is NULL.
  *
  * Enforce permissions from backup_content.control. The only
  * problem now is with PGDATA itself.
@@ -954,7 +1207,8 @@ opt_externaldir_map(ConfigOption *opt, const char *arg)
  */
 void
 create_data_directories(parray *dest_files, const char *data_dir, const char *backup_dir,
-						bool extract_tablespaces, fio_location location)
+						bool extract_tablespaces, TablespaceList *tablespace_map,
+						fio_location location)
 {
 	int			i;
 	parray		*links = NULL;
@@ -1044,7 +1298,8 @@ create_data_directories(parray *dest_files, const char *data_dir, const char *ba
 				/* got match */
 				if (link)
 				{
-					const char *linked_path = get_tablespace_mapping((*link)->linked);
+					const char *linked_path = get_tablespace_mapping(tablespace_map,
+																	 (*link)->linked);
 
 					if (!is_absolute_path(linked_path))
 							elog(ERROR, "Tablespace directory is not an absolute path: %s\n",
@@ -1145,10 +1400,11 @@ read_tablespace_map(parray *files, const char *backup_dir)
  * paths. Linked directories must be empty or do not exist.
  *
  * If tablespace-mapping option is supplied, all OLDDIR entries must have
- * entries in tablespace_map file.
+ * entries in tablespace_map file. The same is checked for **tablespace_map**
+ * of --extra-pgdata, which is used instead of -T, if it is not NULL.
  */
 void
-check_tablespace_mapping(pgBackup *backup)
+check_tablespace_mapping(pgBackup *backup, TablespaceList *tablespace_map)
 {
 	char		this_backup_path[MAXPGPATH];
 	parray	   *links;
@@ -1167,13 +1423,15 @@ check_tablespace_mapping(pgBackup *backup)
 			base36enc(backup->start_time));
 
 	/* 1 - each OLDDIR must have an entry in tablespace_map file (links) */
-	for (cell = tablespace_dirs.head; cell; cell = cell->next)
+	for (cell = (tablespace_map ? tablespace_map : &tablespace_dirs)->head;
+		 cell; cell = cell->next)
 	{
 		tmp_file->linked = cell->old_dir;
 
 		if (parray_bsearch(links, tmp_file, pgFileCompareLinked) == NULL)
-			elog(ERROR, "--tablespace-mapping option's old directory "
+			elog(ERROR, "%s option's old directory "
 				 "doesn't have an entry in tablespace_map file: \"%s\"",
+				 tablespace_map ? "--extra-pgdata" : "--tablespace-mapping",
 				 cell->old_dir);
 	}
 
@@ -1181,15 +1439,8 @@ check_tablespace_mapping(pgBackup *backup)
 	for (i = 0; i < parray_num(links); i++)
 	{
 		pgFile	   *link = (pgFile *) parray_get(links, i);
-		const char *linked_path = link->linked;
-		TablespaceListCell *cell;
-
-		for (cell = tablespace_dirs.head; cell; cell = cell->next)
-			if (strcmp(link->linked, cell->old_dir) == 0)
-			{
-				linked_path = cell->new_dir;
-				break;
-			}
+		const char *linked_path = get_tablespace_mapping(tablespace_map,
+														 link->linked);
 
 		if (!is_absolute_path(linked_path))
 			elog(ERROR, "tablespace directory is not an absolute path: %s\n",
@@ -1457,6 +1708,8 @@ dir_read_file_list(const char *root, const char *external_prefix,
 					crc,
 					segno,
 					n_blocks,
+					mtime,
+					full_size,
 					dbOid;		/* used for partial restore */
 		pgFile	   *file;
 
@@ -1509,6 +1762,16 @@ dir_read_file_list(const char *root, const char *external_prefix,
 		if (get_control_value(buf, "n_blocks", NULL, &n_blocks, false))
 			file->n_blocks = (int) n_blocks;
 
+		if (get_control_value(buf, "mtime", NULL, &mtime, false))
+			file->mtime = (time_t) mtime;
+
+		if (get_control_value(buf, "full_size", NULL, &full_size, false))
+			file->size = (size_t) full_size;
+
+		/* Fork of the relation is not stored, it is known from the name */
+		if (file->is_datafile)
+			sscanf(file->name, "%*u_%[a-z]", file->forkName);
+
 		parray_append(files, file);
 	}
 
@@ -1633,6 +1896,122 @@ make_external_directory_list(const char *colon_separated_dirs, bool remap)
 	return list;
 }
 
+/*
+ * Parse stripe-paths option. Return NULL if there are no stripe paths.
+ */
+parray *
+make_stripe_path_list(const char *colon_separated_paths)
+{
+	char	   *p;
+	parray	   *list;
+	char	   *tmp;
+
+	if (colon_separated_paths == NULL ||
+		pg_strcasecmp(colon_separated_paths, "none") == 0)
+		return NULL;
+
+#ifdef WIN32
+	elog(ERROR, "Stripe paths are not supported on Windows");
+#endif
+
+	list = parray_new();
+	tmp = pg_strdup(colon_separated_paths);
+
+	p = strtok(tmp, EXTERNAL_DIRECTORY_DELIMITER);
+	while (p != NULL)
+	{
+		char	   *stripe_path = pg_strdup(p);
+
+		canonicalize_path(stripe_path);
+		if (!is_absolute_path(stripe_path))
+			elog(ERROR, "Stripe path \"%s\" is not an absolute path",
+				 stripe_path);
+		parray_append(list, stripe_path);
+
+		p = strtok(NULL, EXTERNAL_DIRECTORY_DELIMITER);
+	}
+	pfree(tmp);
+
+	if (parray_num(list) == 0)
+	{
+		parray_free(list);
+		return NULL;
+	}
+	return list;
+}
+
+/*
+ * Data file of the backup placed on a stripe path is represented by a symbolic
+ * link in the backup directory. If the file at path is such a link, put the
+ * path of the data file to target and return true.
+ */
+bool
+get_stripe_target(const char *path, char *target)
+{
+#ifndef WIN32
+	struct stat	st;
+	ssize_t		len;
+
+	if (lstat(path, &st) == -1 || !S_ISLNK(st.st_mode))
+		return false;
+
+	len = readlink(path, target, MAXPGPATH - 1);
+	if (len < 0)
+		elog(ERROR, "cannot read link \"%s\": %s", path, strerror(errno));
+	target[len] = '\0';
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Delete file of the backup located at backup_root. Data file placed on
+ * a stripe path is deleted as well as the link to it.
+ *
+ * If stripe_roots is NULL, directories on the stripe path left empty are
+ * removed. Otherwise the whole backup is being deleted, and the directory
+ * of the backup on the stripe path is added to stripe_roots, so the caller
+ * can remove it at once.
+ */
+void
+pgBackupFileDelete(pgFile *file, const char *backup_root, parray *stripe_roots)
+{
+	char		target[MAXPGPATH];
+
+	if (!S_ISDIR(file->mode) && get_stripe_target(file->path, target))
+	{
+		const char *rel_path = file->path + strlen(backup_root) + 1;
+		const char *p;
+
+		if (remove(target) == -1 && errno != ENOENT)
+			elog(ERROR, "cannot remove file \"%s\": %s", target,
+				 strerror(errno));
+
+		/*
+		 * Layout of the stripe path is the same as the one of the backup
+		 * directory, so go up as many levels as rel_path has, the last one
+		 * is the directory of the backup itself.
+		 */
+		for (p = rel_path; p != NULL; p = first_dir_separator(p + 1))
+		{
+			get_parent_directory(target);
+			if (stripe_roots == NULL && rmdir(target) == -1)
+				break;
+		}
+
+		if (stripe_roots &&
+			parray_bsearch(stripe_roots, target, pgCompareString) == NULL)
+		{
+			parray_append(stripe_roots, pgut_strdup(target));
+			parray_qsort(stripe_roots, pgCompareString);
+		}
+	}
+
+	pgFileDelete(file);
+}
+
 /* Free memory of parray containing strings */
 void
 free_dir_list(parray *list)
@@ -23,6 +23,10 @@ static void help_add_instance(void);
 static void help_del_instance(void);
 static void help_archive_push(void);
 static void help_archive_get(void);
+static void help_archive_receive(void);
+static void help_archive_daemon(void);
+static void help_catalog_sync(void);
+static void help_backup_all(void);
 static void help_checkdb(void);
 
 void
@@ -56,6 +60,14 @@ help_command(char *command)
 		help_archive_push();
 	else if (strcmp(command, "archive-get") == 0)
 		help_archive_get();
+	else if (strcmp(command, "archive-receive") == 0)
+		help_archive_receive();
+	else if (strcmp(command, "archive-daemon") == 0)
+		help_archive_daemon();
+	else if (strcmp(command, "catalog-sync") == 0)
+		help_catalog_sync();
+	else if (strcmp(command, "backup-all") == 0)
+		help_backup_all();
 	else if (strcmp(command, "checkdb") == 0)
 		help_checkdb();
 	else if (strcmp(command, "--help") == 0
@@ -84,6 +96,7 @@ help_pg_probackup(void)
 	printf(_("\n  %s set-config -B backup-path --instance=instance_name\n"), PROGRAM_NAME);
 	printf(_("                 [-D pgdata-path]\n"));
 	printf(_("                 [--external-dirs=external-directories-paths]\n"));
+	printf(_("                 [--stripe-paths=stripe-paths]\n"));
 	printf(_("                 [--log-level-console=log-level-console]\n"));
 	printf(_("                 [--log-level-file=log-level-file]\n"));
 	printf(_("                 [--log-filename=log-filename]\n"));
@@ -96,6 +109,7 @@ help_pg_probackup(void)
 	printf(_("                 [--wal-depth=wal-depth]\n"));
 	printf(_("                 [--compress-algorithm=compress-algorithm]\n"));
 	printf(_("                 [--compress-level=compress-level]\n"));
+	printf(_("                 [--compress-location=compress-location]\n"));
 	printf(_("                 [--archive-timeout=timeout]\n"));
 	printf(_("                 [-d dbname] [-h host] [-p port] [-U username]\n"));
 	printf(_("                 [--remote-proto] [--remote-host]\n"));
@@ -118,6 +132,8 @@ help_pg_probackup(void)
 	printf(_("                 [--stream [-S slot-name]] [--temp-slot]\n"));
 	printf(_("                 [--backup-pg-log] [-j num-threads] [--progress]\n"));
 	printf(_("                 [--no-validate] [--skip-block-validation]\n"));
+	printf(_("                 [--paranoid] [--standby-hosts=host[:port],...]\n"));
+	printf(_("                 [--inline-validate] [--read-back]\n"));
 	printf(_("                 [--external-dirs=external-directories-paths]\n"));
 	printf(_("                 [--log-level-console=log-level-console]\n"));
 	printf(_("                 [--log-level-file=log-level-file]\n"));
@@ -133,6 +149,7 @@ help_pg_probackup(void)
 	printf(_("                 [--compress]\n"));
 	printf(_("                 [--compress-algorithm=compress-algorithm]\n"));
 	printf(_("                 [--compress-level=compress-level]\n"));
+	printf(_("                 [--compress-location=compress-location]\n"));
 	printf(_("                 [--archive-timeout=archive-timeout]\n"));
 	printf(_("                 [-d dbname] [-h host] [-p port] [-U username]\n"));
 	printf(_("                 [-w --no-password] [-W --password]\n"));
@@ -157,6 +174,7 @@ help_pg_probackup(void)
 	printf(_("                 [--external-mapping=OLDDIR=NEWDIR]\n"));
 	printf(_("                 [--skip-external-dirs] [--restore-command=cmdline]\n"));
 	printf(_("                 [--db-include | --db-exclude]\n"));
+	printf(_("                 [--extra-pgdata=[host:]pgdata-path[,OLDDIR=NEWDIR]]\n"));
 	printf(_("                 [--remote-proto] [--remote-host]\n"));
 	printf(_("                 [--remote-port] [--remote-path] [--remote-user]\n"));
 	printf(_("                 [--ssh-options]\n"));
@@ -170,13 +188,16 @@ help_pg_probackup(void)
 	printf(_("                  |--recovery-target-lsn=lsn [--recovery-target-inclusive=boolean]]\n"));
 	printf(_("                 [--recovery-target-timeline=timeline]\n"));
 	printf(_("                 [--recovery-target-name=target-name]\n"));
-	printf(_("                 [--skip-block-validation]\n"));
+	printf(_("                 [--skip-block-validation] [--wal]\n"));
 	printf(_("                 [--help]\n"));
 
 	printf(_("\n  %s checkdb [-B backup-path] [--instance=instance_name]\n"), PROGRAM_NAME);
 	printf(_("                 [-D pgdata-path] [--progress] [-j num-threads]\n"));
 	printf(_("                 [--amcheck] [--skip-block-validation]\n"));
 	printf(_("                 [--heapallindexed]\n"));
+	printf(_("                 [--remote-proto] [--remote-host]\n"));
+	printf(_("                 [--remote-port] [--remote-path] [--remote-user]\n"));
+	printf(_("                 [--ssh-options]\n"));
 	printf(_("                 [--help]\n"));
 
 	printf(_("\n  %s show -B backup-path\n"), PROGRAM_NAME);
@@ -213,6 +234,7 @@ help_pg_probackup(void)
 	printf(_("                 --wal-file-path=wal-file-path\n"));
 	printf(_("                 --wal-file-name=wal-file-name\n"));
 	printf(_("                 [--overwrite]\n"));
+	printf(_("                 [--via-daemon] [--daemon-socket=path]\n"));
 	printf(_("                 [--compress]\n"));
 	printf(_("                 [--compress-algorithm=compress-algorithm]\n"));
 	printf(_("                 [--compress-level=compress-level]\n"));
@@ -229,6 +251,40 @@ help_pg_probackup(void)
 	printf(_("                 [--ssh-options]\n"));
 	printf(_("                 [--help]\n"));
 
+	printf(_("\n  %s archive-receive -B backup-path --instance=instance_name\n"), PROGRAM_NAME);
+	printf(_("                 [-S slot-name]\n"));
+	printf(_("                 [--compress]\n"));
+	printf(_("                 [--compress-algorithm=compress-algorithm]\n"));
+	printf(_("                 [--compress-level=compress-level]\n"));
+	printf(_("                 [-d dbname] [-h host] [-p port] [-U username]\n"));
+	printf(_("                 [-w --no-password] [-W --password]\n"));
+	printf(_("                 [--help]\n"));
+
+	printf(_("\n  %s archive-daemon -B backup-path --instance=instance_name\n"), PROGRAM_NAME);
+	printf(_("                 [-j num-threads] [--daemon-socket=path]\n"));
+	printf(_("                 [--compress]\n"));
+	printf(_("                 [--compress-algorithm=compress-algorithm]\n"));
+	printf(_("                 [--compress-level=compress-level]\n"));
+	printf(_("                 [--remote-proto] [--remote-host]\n"));
+	printf(_("                 [--remote-port] [--remote-path] [--remote-user]\n"));
+	printf(_("                 [--ssh-options]\n"));
+	printf(_("                 [--help]\n"));
+
+	printf(_("\n  %s catalog-sync -B backup-path --instance=instance_name\n"), PROGRAM_NAME);
+	printf(_("                 --dst-backup-path=backup-path | --dst-command=command\n"));
+	printf(_("                 [-j num-threads]\n"));
+	printf(_("                 [--remote-proto] [--remote-host]\n"));
+	printf(_("                 [--remote-port] [--remote-path] [--remote-user]\n"));
+	printf(_("                 [--ssh-options]\n"));
+	printf(_("                 [--help]\n"));
+
+	printf(_("\n  %s backup-all -B backup-path [-b backup-mode]\n"), PROGRAM_NAME);
+	printf(_("                 [--schedule=schedule-file] [-j num-threads]\n"));
+	printf(_("                 [--stream [--temp-slot]] [-C] [--no-validate]\n"));
+	printf(_("                 [--delete-expired] [--merge-expired] [--delete-wal]\n"));
+	printf(_("                 [backup options]\n"));
+	printf(_("                 [--help]\n"));
+
 	if ((PROGRAM_URL || PROGRAM_EMAIL))
 	{
 		printf("\n");
@@ -255,6 +311,8 @@ help_backup(void)
 	printf(_("                 [--stream [-S slot-name] [--temp-slot]\n"));
 	printf(_("                 [--backup-pg-log] [-j num-threads] [--progress]\n"));
 	printf(_("                 [--no-validate] [--skip-block-validation]\n"));
+	printf(_("                 [--paranoid] [--standby-hosts=host[:port],...]\n"));
+	printf(_("                 [--inline-validate] [--read-back]\n"));
 	printf(_("                 [-E external-directories-paths]\n"));
 	printf(_("                 [--log-level-console=log-level-console]\n"));
 	printf(_("                 [--log-level-file=log-level-file]\n"));
@@ -270,6 +328,7 @@ help_backup(void)
 	printf(_("                 [--compress]\n"));
 	printf(_("                 [--compress-algorithm=compress-algorithm]\n"));
 	printf(_("                 [--compress-level=compress-level]\n"));
+	printf(_("                 [--compress-location=compress-location]\n"));
 	printf(_("                 [--archive-timeout=archive-timeout]\n"));
 	printf(_("                 [-d dbname] [-h host] [-p port] [-U username]\n"));
 	printf(_("                 [-w --no-password] [-W --password]\n"));
@@ -279,7 +338,7 @@ help_backup(void)
 	printf(_("                 [--ttl] [--expire-time]\n\n"));
 
 	printf(_("  -B, --backup-path=backup-path    location of the backup storage area\n"));
-	printf(_("  -b, --backup-mode=backup-mode    backup mode=FULL|PAGE|DELTA|PTRACK\n"));
+	printf(_("  -b, --backup-mode=backup-mode    backup mode=FULL|PAGE|DELTA|PTRACK|AUTO\n"));
 	printf(_("      --instance=instance_name     name of the instance\n"));
 	printf(_("  -D, --pgdata=pgdata-path         location of the database storage area\n"));
 	printf(_("  -C, --smooth-checkpoint          do smooth checkpoint before backup\n"));
@@ -290,7 +349,16 @@ help_backup(void)
 	printf(_("  -j, --threads=NUM                number of parallel threads\n"));
 	printf(_("      --progress                   show progress\n"));
 	printf(_("      --no-validate                disable validation after backup\n"));
+	printf(_("      --inline-validate            validate pages as they are written instead\n"));
+	printf(_("                                   of validation after backup\n"));
+	printf(_("      --read-back                  read each written file back bypassing OS cache\n"));
+	printf(_("                                   to check its checksum, implies --inline-validate\n"));
 	printf(_("      --skip-block-validation      set to validate only file-level checksum\n"));
+	printf(_("      --paranoid                   compare checksums of non-data files even if\n"));
+	printf(_("                                   their size and mtime are unchanged\n"));
+	printf(_("      --standby-hosts=host[:port],...\n"));
+	printf(_("                                   read data files from these standbys too\n"));
+	printf(_("                                   (requires remote mode)\n"));
 	printf(_("  -E  --external-dirs=external-directories-paths\n"));
 	printf(_("                                   backup some directories not from pgdata \n"));
 	printf(_("                                   (example: --external-dirs=/tmp/dir1:/tmp/dir2)\n"));
@@ -342,6 +410,9 @@ help_backup(void)
 	printf(_("                                   available options: 'zlib', 'pglz', 'none' (default: none)\n"));
 	printf(_("      --compress-level=compress-level\n"));
 	printf(_("                                   level of compression [0-9] (default: 1)\n"));
+	printf(_("      --compress-location=compress-location\n"));
+	printf(_("                                   host to compress pages of remote backup on\n"));
+	printf(_("                                   available options: 'source', 'target', 'auto' (default: source)\n"));
 
 	printf(_("\n  Archive options:\n"));
 	printf(_("      --archive-timeout=timeout    wait timeout for WAL segment archiving (default: 5min)\n"));
@@ -391,6 +462,7 @@ help_restore(void)
 	printf(_("                 [--skip-external-dirs]\n"));
 	printf(_("                 [--restore-command=cmdline]\n"));
 	printf(_("                 [--db-include dbname | --db-exclude dbname]\n"));
+	printf(_("                 [--extra-pgdata=[host:]pgdata-path[,OLDDIR=NEWDIR]]\n"));
 	printf(_("                 [--remote-proto] [--remote-host]\n"));
 	printf(_("                 [--remote-port] [--remote-path] [--remote-user]\n"));
 	printf(_("                 [--ssh-options]\n"));
@@ -401,6 +473,10 @@ help_restore(void)
 	printf(_("      --instance=instance_name     name of the instance\n"));
 
 	printf(_("  -D, --pgdata=pgdata-path         location of the database storage area\n"));
+	printf(_("      --extra-pgdata=[host:]pgdata-path[,OLDDIR=NEWDIR]\n"));
+	printf(_("                                   one more location to restore into at the same time,\n"));
+	printf(_("                                   optionally at another remote host and with its own\n"));
+	printf(_("                                   tablespace mapping, can be specified multiple times\n"));
 	printf(_("  -i, --backup-id=backup-id        backup to restore\n"));
 	printf(_("  -j, --threads=NUM                number of parallel threads\n"));
 
@@ -484,7 +560,7 @@ help_validate(void)
 	printf(_("                  |--recovery-target-lsn=lsn [--recovery-target-inclusive=boolean]]\n"));
 	printf(_("                 [--recovery-target-timeline=timeline]\n"));
 	printf(_("                 [--recovery-target-name=target-name]\n"));
-	printf(_("                 [--skip-block-validation]\n\n"));
+	printf(_("                 [--skip-block-validation] [--wal]\n\n"));
 
 	printf(_("  -B, --backup-path=backup-path    location of the backup storage area\n"));
 	printf(_("      --instance=instance_name     name of the instance\n"));
@@ -502,6 +578,8 @@ help_validate(void)
 	printf(_("      --recovery-target-name=target-name\n"));
 	printf(_("                                   the named restore point to which recovery will proceed\n"));
 	printf(_("      --skip-block-validation      set to validate only file-level checksum\n"));
+	printf(_("      --wal                        validate only WAL archive, skipping segments\n"));
+	printf(_("                                   validated earlier\n"));
 
 	printf(_("\n  Logging options:\n"));
 	printf(_("      --log-level-console=log-level-console\n"));
@@ -531,7 +609,10 @@ help_checkdb(void)
 	printf(_("\n%s checkdb [-B backup-path] [--instance=instance_name]\n"), PROGRAM_NAME);
 	printf(_("                 [-D pgdata-path] [-j num-threads] [--progress]\n"));
 	printf(_("                 [--amcheck] [--skip-block-validation]\n"));
-	printf(_("                 [--heapallindexed]\n\n"));
+	printf(_("                 [--heapallindexed]\n"));
+	printf(_("                 [--remote-proto] [--remote-host]\n"));
+	printf(_("                 [--remote-port] [--remote-path] [--remote-user]\n"));
+	printf(_("                 [--ssh-options]\n\n"));
 
 	printf(_("  -B, --backup-path=backup-path    location of the backup storage area\n"));
 	printf(_("      --instance=instance_name     name of the instance\n"));
@@ -574,7 +655,18 @@ help_checkdb(void)
 	printf(_("  -h, --pghost=HOSTNAME            database server host or socket directory(default: 'local socket')\n"));
 	printf(_("  -p, --pgport=PORT                database server port (default: 5432)\n"));
 	printf(_("  -w, --no-password                never prompt for password\n"));
-	printf(_("  -W, --password                   force password prompt\n\n"));
+	printf(_("  -W, --password                   force password prompt\n"));
+
+	printf(_("\n  Remote options:\n"));
+	printf(_("      --remote-proto=protocol      remote protocol to use\n"));
+	printf(_("                                   available options: 'ssh', 'none' (default: ssh)\n"));
+	printf(_("      --remote-host=destination    remote host address or hostname\n"));
+	printf(_("      --remote-port=port           remote host port (default: 22)\n"));
+	printf(_("      --remote-path=path           path to directory with pg_probackup binary on remote host\n"));
+	printf(_("                                   (default: current binary path)\n"));
+	printf(_("      --remote-user=username       user name for ssh connection (default: current user)\n"));
+	printf(_("      --ssh-options=ssh_options    additional ssh options (default: none)\n"));
+	printf(_("                                   (example: --ssh-options='-c cipher_spec -F configfile')\n\n"));
 }
 
 static void
@@ -704,6 +796,7 @@ help_set_config(void)
 	printf(_("\n%s set-config -B backup-path --instance=instance_name\n"), PROGRAM_NAME);
 	printf(_("                 [-D pgdata-path]\n"));
 	printf(_("                 [-E external-directories-paths]\n"));
+	printf(_("                 [--stripe-paths=stripe-paths]\n"));
 	printf(_("                 [--restore-command=cmdline]\n"));
 	printf(_("                 [--log-level-console=log-level-console]\n"));
 	printf(_("                 [--log-level-file=log-level-file]\n"));
@@ -717,6 +810,7 @@ help_set_config(void)
 	printf(_("                 [--wal-depth=wal-depth]\n"));
 	printf(_("                 [--compress-algorithm=compress-algorithm]\n"));
 	printf(_("                 [--compress-level=compress-level]\n"));
+	printf(_("                 [--compress-location=compress-location]\n"));
 	printf(_("                 [--archive-timeout=timeout]\n"));
 	printf(_("                 [-d dbname] [-h host] [-p port] [-U username]\n"));
 	printf(_("                 [--remote-proto] [--remote-host]\n"));
@@ -729,6 +823,8 @@ help_set_config(void)
 	printf(_("  -E  --external-dirs=external-directories-paths\n"));
 	printf(_("                                   backup some directories not from pgdata \n"));
 	printf(_("                                   (example: --external-dirs=/tmp/dir1:/tmp/dir2)\n"));
+	printf(_("      --stripe-paths=stripe-paths  additional directories to place data files of backups in\n"));
+	printf(_("                                   (example: --stripe-paths=/mnt/vol1:/mnt/vol2)\n"));
 	printf(_("      --restore-command=cmdline    command to use as 'restore_command' in recovery.conf; 'none' disables\n"));
 
 	printf(_("\n  Logging options:\n"));
@@ -766,6 +862,9 @@ help_set_config(void)
 	printf(_("                                   available options: 'zlib','pglz','none' (default: 'none')\n"));
 	printf(_("      --compress-level=compress-level\n"));
 	printf(_("                                   level of compression [0-9] (default: 1)\n"));
+	printf(_("      --compress-location=compress-location\n"));
+	printf(_("                                   host to compress pages of remote backup on\n"));
+	printf(_("                                   available options: 'source', 'target', 'auto' (default: source)\n"));
 
 	printf(_("\n  Archive options:\n"));
 	printf(_("      --archive-timeout=timeout    wait timeout for WAL segment archiving (default: 5min)\n"));
@@ -856,6 +955,7 @@ help_archive_push(void)
 	printf(_("                 --wal-file-path=wal-file-path\n"));
 	printf(_("                 --wal-file-name=wal-file-name\n"));
 	printf(_("                 [--overwrite]\n"));
+	printf(_("                 [--via-daemon] [--daemon-socket=path]\n"));
 	printf(_("                 [--compress]\n"));
 	printf(_("                 [--compress-algorithm=compress-algorithm]\n"));
 	printf(_("                 [--compress-level=compress-level]\n"));
@@ -870,6 +970,9 @@ help_archive_push(void)
 	printf(_("      --wal-file-name=wal-file-name\n"));
 	printf(_("                                   name of the WAL file to retrieve from the server\n"));
 	printf(_("      --overwrite                  overwrite archived WAL file\n"));
+	printf(_("      --via-daemon                 pass WAL file to archive-daemon instead of pushing it\n"));
+	printf(_("      --daemon-socket=path         socket of archive-daemon\n"));
+	printf(_("                                   (default: /tmp/.s.pg_probackup.instance_name)\n"));
 
 	printf(_("\n  Compression options:\n"));
 	printf(_("      --compress                   alias for --compress-algorithm='zlib' and --compress-level=1\n"));
@@ -918,3 +1021,130 @@ help_archive_get(void)
 	printf(_("      --ssh-options=ssh_options    additional ssh options (default: none)\n"));
 	printf(_("                                   (example: --ssh-options='-c cipher_spec -F configfile')\n\n"));
 }
+
+static void
+help_archive_receive(void)
+{
+	printf(_("\n%s archive-receive -B backup-path --instance=instance_name\n"), PROGRAM_NAME);
+	printf(_("                 [-S slot-name]\n"));
+	printf(_("                 [--compress]\n"));
+	printf(_("                 [--compress-algorithm=compress-algorithm]\n"));
+	printf(_("                 [--compress-level=compress-level]\n"));
+	printf(_("                 [-d dbname] [-h host] [-p port] [-U username]\n"));
+	printf(_("                 [-w --no-password] [-W --password]\n\n"));
+
+	printf(_("  -B, --backup-path=backup-path    location of the backup storage area\n"));
+	printf(_("      --instance=instance_name     name of the instance\n"));
+	printf(_("  -S, --slot=SLOTNAME              replication slot to use\n"));
+
+	printf(_("\n  Compression options:\n"));
+	printf(_("      --compress                   alias for --compress-algorithm='zlib' and --compress-level=1\n"));
+	printf(_("      --compress-algorithm=compress-algorithm\n"));
+	printf(_("                                   available options: 'zlib', 'none' (default: 'none')\n"));
+	printf(_("      --compress-level=compress-level\n"));
+	printf(_("                                   level of compression [0-9] (default: 1)\n"));
+
+	printf(_("\n  Connection options:\n"));
+	printf(_("  -U, --pguser=USERNAME            user name to connect as (default: current local user)\n"));
+	printf(_("  -d, --pgdatabase=DBNAME          database to connect (default: username)\n"));
+	printf(_("  -h, --pghost=HOSTNAME            database server host or socket directory(default: 'local socket')\n"));
+	printf(_("  -p, --pgport=PORT                database server port (default: 5432)\n"));
+	printf(_("  -w, --no-password                never prompt for password\n"));
+	printf(_("  -W, --password                   force password prompt\n\n"));
+}
+
+static void
+help_archive_daemon(void)
+{
+	printf(_("\n%s archive-daemon -B backup-path --instance=instance_name\n"), PROGRAM_NAME);
+	printf(_("                 [-j num-threads] [--daemon-socket=path]\n"));
+	printf(_("                 [--compress]\n"));
+	printf(_("                 [--compress-algorithm=compress-algorithm]\n"));
+	printf(_("                 [--compress-level=compress-level]\n"));
+	printf(_("                 [--remote-proto] [--remote-host]\n"));
+	printf(_("                 [--remote-port] [--remote-path] [--remote-user]\n"));
+	printf(_("                 [--ssh-options]\n\n"));
+
+	printf(_("  -B, --backup-path=backup-path    location of the backup storage area\n"));
+	printf(_("      --instance=instance_name     name of the instance\n"));
+	printf(_("  -j, --threads=NUM                number of parallel threads\n"));
+	printf(_("      --daemon-socket=path         socket to listen for archive-push requests on\n"));
+	printf(_("                                   (default: /tmp/.s.pg_probackup.instance_name)\n"));
+
+	printf(_("\n  Compression options:\n"));
+	printf(_("      --compress                   alias for --compress-algorithm='zlib' and --compress-level=1\n"));
+	printf(_("      --compress-algorithm=compress-algorithm\n"));
+	printf(_("                                   available options: 'zlib', 'none' (default: 'none')\n"));
+	printf(_("      --compress-level=compress-level\n"));
+	printf(_("                                   level of compression [0-9] (default: 1)\n"));
+
+	printf(_("\n  Remote options:\n"));
+	printf(_("      --remote-proto=protocol      remote protocol to use\n"));
+	printf(_("                                   available options: 'ssh', 'none' (default: ssh)\n"));
+	printf(_("      --remote-host=hostname       remote host address or hostname\n"));
+	printf(_("      --remote-port=port           remote host port (default: 22)\n"));
+	printf(_("      --remote-path=path           path to directory with pg_probackup binary on remote host\n"));
+	printf(_("                                   (default: current binary path)\n"));
+	printf(_("      --remote-user=username       user name for ssh connection (default: current user)\n"));
+	printf(_("      --ssh-options=ssh_options    additional ssh options (default: none)\n"));
+	printf(_("                                   (example: --ssh-options='-c cipher_spec -F configfile')\n\n"));
+}
+
+static void
+help_catalog_sync(void)
+{
+	printf(_("\n%s catalog-sync -B backup-path --instance=instance_name\n"), PROGRAM_NAME);
+	printf(_("                 --dst-backup-path=backup-path | --dst-command=command\n"));
+	printf(_("                 [-j num-threads]\n"));
+	printf(_("                 [--remote-proto] [--remote-host]\n"));
+	printf(_("                 [--remote-port] [--remote-path] [--remote-user]\n"));
+	printf(_("                 [--ssh-options]\n\n"));
+
+	printf(_("  -B, --backup-path=backup-path    location of the backup storage area\n"));
+	printf(_("      --instance=instance_name     name of the instance\n"));
+	printf(_("      --dst-backup-path=backup-path\n"));
+	printf(_("                                   location of the backup catalog to copy backups and WAL to\n"));
+	printf(_("      --dst-command=command        command to upload files to object storage\n"));
+	printf(_("                                   (example: --dst-command='aws s3 cp %%p s3://bucket/%%f')\n"));
+	printf(_("  -j, --threads=NUM                number of parallel threads\n"));
+
+	printf(_("\n  Remote options:\n"));
+	printf(_("      --remote-proto=protocol      remote protocol to use\n"));
+	printf(_("                                   available options: 'ssh', 'none' (default: ssh)\n"));
+	printf(_("      --remote-host=hostname       remote host address or hostname\n"));
+	printf(_("      --remote-port=port           remote host port (default: 22)\n"));
+	printf(_("      --remote-path=path           path to directory with pg_probackup binary on remote host\n"));
+	printf(_("                                   (default: current binary path)\n"));
+	printf(_("      --remote-user=username       user name for ssh connection (default: current user)\n"));
+	printf(_("      --ssh-options=ssh_options    additional ssh options (default: none)\n"));
+	printf(_("                                   (example: --ssh-options='-c cipher_spec -F configfile')\n\n"));
+}
+
+static void
+help_backup_all(void)
+{
+	printf(_("\n%s backup-all -B backup-path [-b backup-mode]\n"), PROGRAM_NAME);
+	printf(_("                 [--schedule=schedule-file] [-j num-threads]\n"));
+	printf(_("                 [--stream [--temp-slot]] [-C] [--no-validate]\n"));
+	printf(_("                 [--delete-expired] [--merge-expired] [--delete-wal]\n"));
+	printf(_("                 [backup options]\n\n"));
+
+	printf(_("  Other options of backup command are passed to backup of each instance\n\n"));
+
+	printf(_("  -B, --backup-path=backup-path    location of the backup storage area\n"));
+	printf(_("  -b, --backup-mode=backup-mode    default backup mode=FULL|PAGE|DELTA|PTRACK|AUTO\n"));
+	printf(_("      --schedule=schedule-file     file with lines 'instance_name [backup-mode [num-threads]]'\n"));
+	printf(_("                                   (default: all instances of the catalog)\n"));
+	printf(_("  -j, --threads=NUM                number of threads shared by all backups\n"));
+	printf(_("      --stream                     stream the transaction log and include it in the backup\n"));
+	printf(_("      --temp-slot                  use temporary replication slot\n"));
+	printf(_("  -C, --smooth-checkpoint          do smooth checkpoint before backup\n"));
+	printf(_("      --no-validate                disable validation after backup\n"));
+
+	printf(_("\n  Retention options:\n"));
+	printf(_("      --delete-expired             delete backups expired according to current\n"));
+	printf(_("                                   retention policy after successful backup completion\n"));
+	printf(_("      --merge-expired              merge backups expired according to current\n"));
+	printf(_("                                   retention policy after successful backup completion\n"));
+	printf(_("      --delete-wal                 remove redundant files in WAL archive\n\n"));
+}
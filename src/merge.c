@@ -181,6 +181,7 @@ merge_backups(pgBackup *to_backup, pgBackup *from_backup)
 			   *to_files;
 	parray	   *to_external = NULL,
 			   *from_external = NULL;
+	parray	   *stripe_paths;
 	pthread_t  *threads = NULL;
 	merge_files_arg *threads_args = NULL;
 	int			i;
@@ -259,7 +260,8 @@ merge_backups(pgBackup *to_backup, pgBackup *from_backup)
 	write_backup_status(to_backup, BACKUP_STATUS_MERGING, instance_name);
 	write_backup_status(from_backup, BACKUP_STATUS_MERGING, instance_name);
 
-	create_data_directories(files, to_database_path, from_backup_path, false, FIO_BACKUP_HOST);
+	create_data_directories(files, to_database_path, from_backup_path, false,
+							NULL, FIO_BACKUP_HOST);
 
 	threads = (pthread_t *) palloc(sizeof(pthread_t) * num_threads);
 	threads_args = (merge_files_arg *) palloc(sizeof(merge_files_arg) * num_threads);
@@ -330,6 +332,27 @@ merge_backups(pgBackup *to_backup, pgBackup *from_backup)
 	if (!merge_isok)
 		elog(ERROR, "Data files merging failed");
 
+	/* Merged files must be on disk before the source backup is deleted */
+	if (fio_sync_tree(to_backup_path, FIO_LOCAL_HOST) != 0)
+		elog(ERROR, "Cannot sync backup directory \"%s\": %s",
+			 to_backup_path, strerror(errno));
+
+	/* Data files on stripe paths are merged in place */
+	stripe_paths = make_stripe_path_list(instance_config.stripe_paths_str);
+	for (i = 0; stripe_paths && i < parray_num(stripe_paths); i++)
+	{
+		char		stripe_path[MAXPGPATH];
+
+		join_path_components(stripe_path, parray_get(stripe_paths, i),
+							 instance_name);
+		if (fio_access(stripe_path, F_OK, FIO_LOCAL_HOST) == 0 &&
+			fio_sync_tree(stripe_path, FIO_LOCAL_HOST) != 0)
+			elog(ERROR, "Cannot sync directory \"%s\": %s",
+				 stripe_path, strerror(errno));
+	}
+	if (stripe_paths)
+		free_dir_list(stripe_paths);
+
 	/*
 	 * Update to_backup metadata.
 	 * We cannot set backup status to OK just yet,
@@ -391,7 +414,7 @@ delete_source_backup:
 			prev_path = file->path;
 			file->path = to_file_path;
 
-			pgFileDelete(file);
+			pgBackupFileDelete(file, to_backup_path, NULL);
 			elog(VERBOSE, "Deleted \"%s\"", file->path);
 
 			file->path = prev_path;
@@ -405,6 +428,9 @@ delete_source_backup:
 	if (rename(to_backup_path, from_backup_path) == -1)
 		elog(ERROR, "Could not rename directory \"%s\" to \"%s\": %s",
 			 to_backup_path, from_backup_path, strerror(errno));
+	if (fio_sync(backup_instance_path, FIO_LOCAL_HOST) != 0)
+		elog(ERROR, "Cannot sync directory \"%s\": %s",
+			 backup_instance_path, strerror(errno));
 
 	/*
 	 * Merging finished, now we can safely update ID of the destination backup.
@@ -417,6 +443,17 @@ delete_source_backup:
 	to_backup->start_time = from_backup->start_time;
 	write_backup(to_backup);
 
+	/* Descendants of the merged backup now descend from the destination one */
+	if (from_backup->children)
+	{
+		for (i = 0; i < parray_num(from_backup->children); i++)
+		{
+			pgBackup   *child = (pgBackup *) parray_get(from_backup->children, i);
+
+			child->parent_backup_link = to_backup;
+		}
+	}
+
 	/* Cleanup */
 	if (threads)
 	{
@@ -476,6 +513,15 @@ merge_files(void *arg)
 
 		join_path_components(to_file_path, argument->to_root, file->path);
 
+		/* Merge data file placed on a stripe path right there */
+		if (to_file && file->is_datafile)
+		{
+			char		target[MAXPGPATH];
+
+			if (get_stripe_target(to_file_path, target))
+				strcpy(to_file_path, target);
+		}
+
 		/*
 		 * Skip files which haven't changed since previous backup. But in case
 		 * of DELTA backup we must truncate the target file to n_blocks.
@@ -542,6 +588,20 @@ merge_files(void *arg)
 		elog(VERBOSE, "Merging file \"%s\", is_datafile %d, is_cfs %d",
 			 file->path, file->is_database, file->is_cfs);
 
+		/*
+		 * Forks of relations were copied as a whole by older versions. Such
+		 * copy is replaced by the file from incremental backup, which is
+		 * complete in this case.
+		 */
+		if (to_file && file->is_datafile && !file->is_cfs &&
+			!to_file->is_datafile)
+		{
+			if (unlink(to_file_path) == -1 && errno != ENOENT)
+				elog(ERROR, "Could not remove file \"%s\": %s",
+					 to_file_path, strerror(errno));
+			to_file = NULL;
+		}
+
 		if (file->is_datafile && !file->is_cfs)
 		{
 			/*
@@ -587,7 +647,8 @@ merge_files(void *arg)
 					to_file->path = to_file_path;
 					/* Decompress target file into temporary one */
 					restore_data_file(merge_to_file_path, to_file, false, false,
-									  parse_program_version(to_backup->program_version));
+									  parse_program_version(to_backup->program_version),
+									  false);
 					to_file->path = prev_path;
 				}
 				else
@@ -600,7 +661,8 @@ merge_files(void *arg)
 				restore_data_file(merge_to_file_path, file,
 								  from_backup->backup_mode == BACKUP_MODE_DIFF_DELTA,
 								  false,
-								  parse_program_version(from_backup->program_version));
+								  parse_program_version(from_backup->program_version),
+								  false);
 
 				elog(VERBOSE, "Compress file and save it into the directory \"%s\"",
 					 argument->to_root);
@@ -641,7 +703,8 @@ merge_files(void *arg)
 				restore_data_file(to_file_path, file,
 								  from_backup->backup_mode == BACKUP_MODE_DIFF_DELTA,
 								  true,
-								  parse_program_version(from_backup->program_version));
+								  parse_program_version(from_backup->program_version),
+								  false);
 
 				/*
 				 * We need to calculate write_size, restore_data_file() doesn't
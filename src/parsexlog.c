@@ -224,6 +224,30 @@ static time_t			wal_target_time = 0;
 static TransactionId	wal_target_xid = InvalidTransactionId;
 static XLogRecPtr		wal_target_lsn = InvalidXLogRecPtr;
 
+/*
+ * Ranges of archived WAL, which are already validated during this run.
+ * Backups of the instance often share WAL segments, so the range of a backup
+ * is read only from the end of the validated range it begins in. Ranges are
+ * bounded by START and STOP LSN of backups, which are always record
+ * boundaries, so overlapping ranges are merged.
+ */
+typedef struct
+{
+	TimeLineID	tli;
+	XLogRecPtr	start_lsn;
+	XLogRecPtr	end_lsn;
+} ValidatedWalRange;
+
+static parray		   *validated_wal_ranges = NULL;
+/* Archive directory the ranges belong to */
+static char				validated_wal_archivedir[MAXPGPATH];
+
+static ValidatedWalRange *find_validated_wal_range(const char *archivedir,
+												   TimeLineID tli,
+												   XLogRecPtr lsn);
+static void add_validated_wal_range(const char *archivedir, TimeLineID tli,
+									XLogRecPtr start_lsn, XLogRecPtr end_lsn);
+
 /*
  * Read WAL from the archive directory, from 'startpoint' to 'endpoint' on the
  * given timeline. Collect data blocks touched by the WAL records into a page map.
@@ -255,15 +279,38 @@ extractPageMap(const char *archivedir, TimeLineID tli, uint32 wal_seg_size,
 static void
 validate_backup_wal_from_start_to_stop(pgBackup *backup,
 									   const char *archivedir, TimeLineID tli,
-									   uint32 xlog_seg_size)
+									   uint32 xlog_seg_size, bool use_cache)
 {
 	bool		got_endpoint;
+	XLogRecPtr	startpoint = backup->start_lsn;
+
+	if (use_cache)
+	{
+		ValidatedWalRange *range = find_validated_wal_range(archivedir, tli,
+															backup->start_lsn);
+
+		if (range && range->end_lsn >= backup->stop_lsn)
+		{
+			elog(VERBOSE, "WAL of backup %s from %X/%X to %X/%X is already validated",
+				 base36enc(backup->start_time),
+				 (uint32) (backup->start_lsn >> 32), (uint32) (backup->start_lsn),
+				 (uint32) (backup->stop_lsn >> 32), (uint32) (backup->stop_lsn));
+			return;
+		}
+		/* Read only the part of WAL, which is not validated yet */
+		if (range)
+			startpoint = range->end_lsn;
+	}
 
 	got_endpoint = RunXLogThreads(archivedir, 0, InvalidTransactionId,
 								  InvalidXLogRecPtr, tli, xlog_seg_size,
-								  backup->start_lsn, backup->stop_lsn,
+								  startpoint, backup->stop_lsn,
 								  false, NULL, NULL);
 
+	if (got_endpoint && use_cache)
+		add_validated_wal_range(archivedir, tli, backup->start_lsn,
+								backup->stop_lsn);
+
 	if (!got_endpoint)
 	{
 		/*
@@ -322,11 +369,11 @@ validate_wal(pgBackup *backup, const char *archivedir,
 						 DATABASE_DIR, PG_XLOG_DIR);
 
 		validate_backup_wal_from_start_to_stop(backup, backup_xlog_path, tli,
-											   wal_seg_size);
+											   wal_seg_size, false);
 	}
 	else
 		validate_backup_wal_from_start_to_stop(backup, (char *) archivedir, tli,
-											   wal_seg_size);
+											   wal_seg_size, true);
 
 	if (backup->status == BACKUP_STATUS_CORRUPT)
 	{
@@ -407,6 +454,156 @@ validate_wal(pgBackup *backup, const char *archivedir,
 	}
 }
 
+/*
+ * Check that all records beginning in the WAL segment can be read, i.e. the
+ * segment can be decompressed, and its page headers and record CRCs are
+ * valid. The record crossing the end of the segment is read from the next
+ * one, if it exists, otherwise *complete is set to false.
+ */
+bool
+validate_wal_segment(const char *archivedir, TimeLineID tli, XLogSegNo segno,
+					 uint32 seg_size, int thread_num, bool *complete)
+{
+	XLogReaderState *xlogreader;
+	XLogReaderData reader_data;
+	XLogRecPtr	startpoint;
+	XLogRecPtr	endpoint;
+	XLogRecPtr	found;
+	char	   *errormsg = NULL;
+	bool		read_ok;
+	bool		result = true;
+
+	*complete = true;
+
+	xlogreader = InitXLogPageRead(&reader_data, archivedir, tli, seg_size,
+								  false, false, true);
+	reader_data.thread_num = thread_num;
+	reader_data.xlogsegno = segno;
+
+	GetXLogRecPtr(segno, 0, seg_size, startpoint);
+	GetXLogRecPtr(segno + 1, 0, seg_size, endpoint);
+
+	/* Skip over the page header and contrecord if any */
+	found = XLogFindNextRecord(xlogreader, startpoint);
+	read_ok = !XLogRecPtrIsInvalid(found);
+
+	while (read_ok)
+	{
+		if (interrupted || thread_interrupted)
+			elog(ERROR, "Thread [%d]: Interrupted during WAL reading", thread_num);
+
+		if (XLogReadRecord(xlogreader, found, &errormsg) == NULL)
+			read_ok = false;
+		/* Continue reading at the next record */
+		found = InvalidXLogRecPtr;
+
+		if (xlogreader->EndRecPtr >= endpoint)
+			break;
+	}
+
+	if (!read_ok)
+	{
+		/* The last record continues in the next segment, which is absent */
+		if (reader_data.xlogsegno > segno && !reader_data.xlogexists)
+			*complete = false;
+		else
+		{
+			if (errormsg)
+				elog(WARNING, "Thread [%d]: Could not read WAL record at %X/%X: %s",
+					 thread_num, (uint32) (xlogreader->EndRecPtr >> 32),
+					 (uint32) (xlogreader->EndRecPtr), errormsg);
+			PrintXLogCorruptionMsg(&reader_data, WARNING);
+			result = false;
+		}
+	}
+
+	CleanupXLogPageRead(xlogreader);
+	XLogReaderFree(xlogreader);
+
+	return result;
+}
+
+/*
+ * Find validated range of WAL in the archive directory containing the LSN.
+ */
+static ValidatedWalRange *
+find_validated_wal_range(const char *archivedir, TimeLineID tli, XLogRecPtr lsn)
+{
+	int			i;
+
+	if (validated_wal_ranges == NULL ||
+		strcmp(validated_wal_archivedir, archivedir) != 0)
+		return NULL;
+
+	for (i = 0; i < parray_num(validated_wal_ranges); i++)
+	{
+		ValidatedWalRange *range = (ValidatedWalRange *) parray_get(validated_wal_ranges, i);
+
+		if (range->tli == tli && range->start_lsn <= lsn && lsn <= range->end_lsn)
+			return range;
+	}
+	return NULL;
+}
+
+/*
+ * Remember that WAL from start_lsn to end_lsn is valid, merging the range
+ * with overlapping ones.
+ */
+static void
+add_validated_wal_range(const char *archivedir, TimeLineID tli,
+						XLogRecPtr start_lsn, XLogRecPtr end_lsn)
+{
+	ValidatedWalRange *new_range;
+	int			i;
+
+	/* Validation of another instance has started */
+	if (validated_wal_ranges != NULL &&
+		strcmp(validated_wal_archivedir, archivedir) != 0)
+		forget_validated_wal();
+
+	if (validated_wal_ranges == NULL)
+	{
+		validated_wal_ranges = parray_new();
+		strncpy(validated_wal_archivedir, archivedir, MAXPGPATH);
+	}
+
+	for (i = 0; i < parray_num(validated_wal_ranges); i++)
+	{
+		ValidatedWalRange *range = (ValidatedWalRange *) parray_get(validated_wal_ranges, i);
+
+		if (range->tli != tli || range->end_lsn < start_lsn ||
+			end_lsn < range->start_lsn)
+			continue;
+
+		start_lsn = Min(start_lsn, range->start_lsn);
+		end_lsn = Max(end_lsn, range->end_lsn);
+
+		pg_free(range);
+		parray_remove(validated_wal_ranges, i);
+		i--;
+	}
+
+	new_range = pgut_new(ValidatedWalRange);
+	new_range->tli = tli;
+	new_range->start_lsn = start_lsn;
+	new_range->end_lsn = end_lsn;
+	parray_append(validated_wal_ranges, new_range);
+}
+
+/*
+ * Forget validated ranges of WAL, e.g. after WAL files are removed.
+ */
+void
+forget_validated_wal(void)
+{
+	if (validated_wal_ranges == NULL)
+		return;
+
+	parray_walk(validated_wal_ranges, pg_free);
+	parray_free(validated_wal_ranges);
+	validated_wal_ranges = NULL;
+}
+
 /*
  * Read from archived WAL segments latest recovery time and xid. All necessary
  * segments present at archive folder. We waited **stop_lsn** in
@@ -1518,8 +1715,12 @@ extractPageInfo(XLogReaderState *record, XLogReaderData *reader_data,
 		if (!XLogRecGetBlockTag(record, block_id, &rnode, &forknum, &blkno))
 			continue;
 
-		/* We only care about the main fork; others are copied as is */
-		if (forknum != MAIN_FORKNUM)
+		/*
+		 * Visibility map block is referenced when its bits are set. Free
+		 * space map is not WAL-logged, its changes as well as cleared bits
+		 * of visibility map are derived from the change of the main fork.
+		 */
+		if (forknum != MAIN_FORKNUM && forknum != VISIBILITYMAP_FORKNUM)
 			continue;
 
 		process_block_change(forknum, rnode, blkno);
@@ -35,6 +35,8 @@ typedef enum ProbackupSubcmd
 	DELETE_INSTANCE_CMD,
 	ARCHIVE_PUSH_CMD,
 	ARCHIVE_GET_CMD,
+	ARCHIVE_RECEIVE_CMD,
+	ARCHIVE_DAEMON_CMD,
 	BACKUP_CMD,
 	RESTORE_CMD,
 	VALIDATE_CMD,
@@ -44,7 +46,9 @@ typedef enum ProbackupSubcmd
 	SET_CONFIG_CMD,
 	SET_BACKUP_CMD,
 	SHOW_CONFIG_CMD,
-	CHECKDB_CMD
+	CHECKDB_CMD,
+	CATALOG_SYNC_CMD,
+	BACKUP_ALL_CMD
 } ProbackupSubcmd;
 
 
@@ -76,6 +80,11 @@ bool		temp_slot = false;
 /* backup options */
 bool		backup_logs = false;
 bool		smooth_checkpoint;
+bool		paranoid_crc = false;
+bool		backup_mode_auto = false;
+char	   *standby_hosts = NULL;
+bool		inline_validate = false;
+bool		read_back = false;
 char       *remote_agent;
 
 /* restore options */
@@ -103,6 +112,9 @@ bool skip_external_dirs = false;
 static parray *datname_exclude_list = NULL;
 static parray *datname_include_list = NULL;
 
+/* array for more data directories to restore into, provided via extra-pgdata */
+static parray *extra_pgdata_list = NULL;
+
 /* checkdb options */
 bool need_amcheck = false;
 bool heapallindexed = false;
@@ -125,6 +137,15 @@ char	   *instance_name;
 static char *wal_file_path;
 static char *wal_file_name;
 static bool	file_overwrite = false;
+static bool	via_daemon = false;
+static char *daemon_socket = NULL;
+
+/* catalog-sync options */
+static char *dst_backup_path = NULL;
+static char *dst_command = NULL;
+
+/* backup-all options */
+static char *schedule_path = NULL;
 
 /* show options */
 ShowFormat show_format = SHOW_PLAIN;
@@ -145,9 +166,11 @@ static void opt_backup_mode(ConfigOption *opt, const char *arg);
 static void opt_show_format(ConfigOption *opt, const char *arg);
 
 static void compress_init(void);
+static void backup_all_options(parray *backup_args, ConfigOption options[]);
 
 static void opt_datname_exclude_list(ConfigOption *opt, const char *arg);
 static void opt_datname_include_list(ConfigOption *opt, const char *arg);
+static void opt_extra_pgdata_list(ConfigOption *opt, const char *arg);
 
 /*
  * Short name should be non-printable ASCII character.
@@ -172,6 +195,10 @@ static ConfigOption cmd_options[] =
 	{ 'b', 135, "delete-expired",	&delete_expired,	SOURCE_CMD_STRICT },
 	{ 'b', 235, "merge-expired",	&merge_expired,		SOURCE_CMD_STRICT },
 	{ 'b', 237, "dry-run",			&dry_run,			SOURCE_CMD_STRICT },
+	{ 'b', 162, "paranoid",			&paranoid_crc,		SOURCE_CMD_STRICT },
+	{ 's', 168, "standby-hosts",	&standby_hosts,		SOURCE_CMD_STRICT },
+	{ 'b', 169, "inline-validate",	&inline_validate,	SOURCE_CMD_STRICT },
+	{ 'b', 231, "read-back",		&read_back,			SOURCE_CMD_STRICT },
 	/* restore options */
 	{ 's', 136, "recovery-target-time",	&target_time,	SOURCE_CMD_STRICT },
 	{ 's', 137, "recovery-target-xid",	&target_xid,	SOURCE_CMD_STRICT },
@@ -189,6 +216,7 @@ static ConfigOption cmd_options[] =
 	{ 'b', 156, "skip-external-dirs", &skip_external_dirs,	SOURCE_CMD_STRICT },
 	{ 'f', 158, "db-include", 		opt_datname_include_list, SOURCE_CMD_STRICT },
 	{ 'f', 159, "db-exclude", 		opt_datname_exclude_list, SOURCE_CMD_STRICT },
+	{ 'f', 238, "extra-pgdata",		opt_extra_pgdata_list, SOURCE_CMD_STRICT },
 	/* checkdb options */
 	{ 'b', 195, "amcheck",			&need_amcheck,		SOURCE_CMD_STRICT },
 	{ 'b', 196, "heapallindexed",	&heapallindexed,	SOURCE_CMD_STRICT },
@@ -209,6 +237,13 @@ static ConfigOption cmd_options[] =
 	{ 's', 150, "wal-file-path",	&wal_file_path,		SOURCE_CMD_STRICT },
 	{ 's', 151, "wal-file-name",	&wal_file_name,		SOURCE_CMD_STRICT },
 	{ 'b', 152, "overwrite",		&file_overwrite,	SOURCE_CMD_STRICT },
+	{ 'b', 163, "via-daemon",		&via_daemon,		SOURCE_CMD_STRICT },
+	{ 's', 164, "daemon-socket",	&daemon_socket,		SOURCE_CMD_STRICT },
+	/* catalog-sync options */
+	{ 's', 165, "dst-backup-path",	&dst_backup_path,	SOURCE_CMD_STRICT },
+	{ 's', 166, "dst-command",		&dst_command,		SOURCE_CMD_STRICT },
+	/* backup-all options */
+	{ 's', 167, "schedule",			&schedule_path,		SOURCE_CMD_STRICT },
 	/* show options */
 	{ 'f', 153, "format",			opt_show_format,	SOURCE_CMD_STRICT },
 	{ 'b', 161, "archive",			&show_archive,		SOURCE_CMD_STRICT },
@@ -237,9 +272,12 @@ setMyLocation(void)
 #endif
 
 	MyLocation = IsSshProtocol()
-		? (backup_subcmd == ARCHIVE_PUSH_CMD || backup_subcmd == ARCHIVE_GET_CMD)
+		? (backup_subcmd == ARCHIVE_PUSH_CMD || backup_subcmd == ARCHIVE_GET_CMD ||
+		   backup_subcmd == ARCHIVE_DAEMON_CMD)
 		   ? FIO_DB_HOST
-		   : (backup_subcmd == BACKUP_CMD || backup_subcmd == RESTORE_CMD || backup_subcmd == ADD_INSTANCE_CMD)
+		   : (backup_subcmd == BACKUP_CMD || backup_subcmd == RESTORE_CMD ||
+			  backup_subcmd == ADD_INSTANCE_CMD || backup_subcmd == CATALOG_SYNC_CMD ||
+			   backup_subcmd == CHECKDB_CMD)
 		      ? FIO_BACKUP_HOST
 		      : FIO_LOCAL_HOST
 		: FIO_LOCAL_HOST;
@@ -293,6 +331,10 @@ main(int argc, char *argv[])
 			backup_subcmd = ARCHIVE_PUSH_CMD;
 		else if (strcmp(argv[1], "archive-get") == 0)
 			backup_subcmd = ARCHIVE_GET_CMD;
+		else if (strcmp(argv[1], "archive-receive") == 0)
+			backup_subcmd = ARCHIVE_RECEIVE_CMD;
+		else if (strcmp(argv[1], "archive-daemon") == 0)
+			backup_subcmd = ARCHIVE_DAEMON_CMD;
 		else if (strcmp(argv[1], "add-instance") == 0)
 			backup_subcmd = ADD_INSTANCE_CMD;
 		else if (strcmp(argv[1], "del-instance") == 0)
@@ -319,6 +361,10 @@ main(int argc, char *argv[])
 			backup_subcmd = SHOW_CONFIG_CMD;
 		else if (strcmp(argv[1], "checkdb") == 0)
 			backup_subcmd = CHECKDB_CMD;
+		else if (strcmp(argv[1], "catalog-sync") == 0)
+			backup_subcmd = CATALOG_SYNC_CMD;
+		else if (strcmp(argv[1], "backup-all") == 0)
+			backup_subcmd = BACKUP_ALL_CMD;
 #ifdef WIN32
 		else if (strcmp(argv[1], "ssh") == 0)
 		    launch_ssh(argv);
@@ -454,7 +500,8 @@ main(int argc, char *argv[])
 	if (instance_name == NULL)
 	{
 		if (backup_subcmd != INIT_CMD && backup_subcmd != SHOW_CMD &&
-			backup_subcmd != VALIDATE_CMD && backup_subcmd != CHECKDB_CMD)
+			backup_subcmd != VALIDATE_CMD && backup_subcmd != CHECKDB_CMD &&
+			backup_subcmd != BACKUP_ALL_CMD)
 			elog(ERROR, "required parameter not specified: --instance");
 	}
 	else
@@ -489,6 +536,18 @@ main(int argc, char *argv[])
 				backup_path, "wal", instance_name);
 		canonicalize_path(instance_config.arclog_path);
 
+		/*
+		 * archive-push client of archive daemon needs neither instance
+		 * configuration nor access to backup catalog, daemon has them all.
+		 */
+		if (backup_subcmd == ARCHIVE_PUSH_CMD && via_daemon)
+		{
+			setMyLocation();
+			return do_archive_push_via_daemon(&instance_config, wal_file_path,
+											  wal_file_name, file_overwrite,
+											  daemon_socket);
+		}
+
 		/*
 		 * Ensure that requested backup instance exists.
 		 * for all commands except init, which doesn't take this parameter
@@ -660,6 +719,10 @@ main(int argc, char *argv[])
 			elog(ERROR, "You cannot specify \"--force\" flag with the \"%s\" command",
 				command_name);
 
+		if (extra_pgdata_list && backup_subcmd != RESTORE_CMD)
+			elog(ERROR, "You cannot specify \"--extra-pgdata\" option with the \"%s\" command",
+				command_name);
+
 		if (force)
 			no_validate = true;
 
@@ -673,6 +736,7 @@ main(int argc, char *argv[])
 		restore_params->skip_external_dirs = skip_external_dirs;
 		restore_params->partial_db_list = NULL;
 		restore_params->partial_restore_type = NONE;
+		restore_params->extra_pgdata_list = extra_pgdata_list;
 
 		/* handle partial restore parameters */
 		if (datname_exclude_list && datname_include_list)
@@ -735,6 +799,10 @@ main(int argc, char *argv[])
 		case ARCHIVE_GET_CMD:
 			return do_archive_get(&instance_config,
 								  wal_file_path, wal_file_name);
+		case ARCHIVE_RECEIVE_CMD:
+			return do_archive_receive(&instance_config);
+		case ARCHIVE_DAEMON_CMD:
+			return do_archive_daemon(&instance_config, daemon_socket);
 		case ADD_INSTANCE_CMD:
 			return do_add_instance(&instance_config);
 		case DELETE_INSTANCE_CMD:
@@ -752,6 +820,14 @@ main(int argc, char *argv[])
 					elog(ERROR, "required parameter not specified: BACKUP_MODE "
 						 "(-b, --backup-mode)");
 
+				/* Reading written files back is a part of inline validation */
+				if (read_back)
+					inline_validate = true;
+
+				if (no_validate && inline_validate)
+					elog(ERROR, "You cannot specify --inline-validate or --read-back "
+						 "together with --no-validate");
+
 				return do_backup(start_time, no_validate, set_backup_params);
 			}
 		case RESTORE_CMD:
@@ -759,13 +835,22 @@ main(int argc, char *argv[])
 							  recovery_target_options,
 							 restore_params);
 		case VALIDATE_CMD:
+			/* --wal option is shared with delete command */
+			if (delete_wal)
+			{
+				if (current.backup_id != 0 || target_time != 0 ||
+					target_xid != 0 || target_lsn)
+					elog(ERROR, "You cannot specify --wal with backup ID or recovery target");
+
+				return do_validate_all(true);
+			}
 			if (current.backup_id == 0 && target_time == 0 && target_xid == 0 && !target_lsn)
 			{
 				/* sanity */
 				if (datname_exclude_list || datname_include_list)
 					elog(ERROR, "You must specify parameter (-i, --backup-id) for partial validation");
 
-				return do_validate_all();
+				return do_validate_all(false);
 			}
 			else
 				/* PITR validation and, optionally, partial validation */
@@ -805,6 +890,31 @@ main(int argc, char *argv[])
 			do_checkdb(need_amcheck,
 					   instance_config.conn_opt, instance_config.pgdata);
 			break;
+		case CATALOG_SYNC_CMD:
+			return do_catalog_sync(dst_backup_path, dst_command);
+		case BACKUP_ALL_CMD:
+			{
+				parray	   *backup_args = parray_new();
+				const char *default_mode = NULL;
+
+				if (instance_name)
+					elog(ERROR, "You cannot specify --instance with the \"%s\" command, "
+						 "use --schedule to choose instances", command_name);
+
+				if (backup_mode_auto)
+					default_mode = "auto";
+				else if (current.backup_mode != BACKUP_MODE_INVALID)
+					default_mode = deparse_backup_mode(current.backup_mode);
+
+				/* Options passed to backup of each instance */
+				backup_all_options(backup_args, cmd_options);
+				backup_all_options(backup_args, instance_options);
+
+				rc = do_backup_all(schedule_path, default_mode, backup_args);
+				parray_walk(backup_args, pfree);
+				parray_free(backup_args);
+				return rc;
+			}
 		case NO_CMD:
 			/* Should not happen */
 			elog(ERROR, "Unknown subcommand");
@@ -813,9 +923,68 @@ main(int argc, char *argv[])
 	return 0;
 }
 
+/*
+ * Deparse options given in command line, so they are passed to backup of
+ * each instance, except the ones handled by backup-all itself.
+ */
+static void
+backup_all_options(parray *backup_args, ConfigOption options[])
+{
+	ConfigOption *opt;
+
+	for (opt = options; opt->type; opt++)
+	{
+		char	   *value;
+
+		if (opt->source != SOURCE_CMD)
+			continue;
+
+		if (strcmp(opt->lname, "help") == 0 ||
+			strcmp(opt->lname, "backup-path") == 0 ||
+			strcmp(opt->lname, "threads") == 0 ||
+			strcmp(opt->lname, "backup-mode") == 0 ||
+			strcmp(opt->lname, "instance") == 0 ||
+			strcmp(opt->lname, "schedule") == 0)
+			continue;
+
+		/* Boolean option is given without value */
+		if (opt->type == 'b' || opt->type == 'B')
+		{
+			parray_append(backup_args, psprintf("--%s", opt->lname));
+			continue;
+		}
+
+		if (opt->get_value)
+			value = opt->get_value(opt);
+		else if (opt->type != 'f')
+			value = option_get_value(opt);
+		else
+			elog(ERROR, "Option --%s is not supported by \"backup-all\" command",
+				 opt->lname);
+
+		if (value == NULL)
+			continue;
+
+		parray_append(backup_args, psprintf("--%s=%s", opt->lname, value));
+		pfree(value);
+	}
+}
+
 static void
 opt_backup_mode(ConfigOption *opt, const char *arg)
 {
+	/*
+	 * Actual mode is chosen by do_backup() after connecting to the instance.
+	 * Until then the backup is shown as FULL.
+	 */
+	if (pg_strcasecmp(arg, "auto") == 0)
+	{
+		backup_mode_auto = true;
+		current.backup_mode = BACKUP_MODE_FULL;
+		return;
+	}
+
+	backup_mode_auto = false;
 	current.backup_mode = parse_backup_mode(arg);
 }
 
@@ -866,7 +1035,9 @@ compress_init(void)
 	if (instance_config.compress_alg == ZLIB_COMPRESS && instance_config.compress_level == 0)
 		elog(WARNING, "Compression level 0 will lead to data bloat!");
 
-	if (backup_subcmd == BACKUP_CMD || backup_subcmd == ARCHIVE_PUSH_CMD)
+	if (backup_subcmd == BACKUP_CMD || backup_subcmd == ARCHIVE_PUSH_CMD ||
+		backup_subcmd == ARCHIVE_RECEIVE_CMD ||
+		backup_subcmd == ARCHIVE_DAEMON_CMD)
 	{
 #ifndef HAVE_LIBZ
 		if (instance_config.compress_alg == ZLIB_COMPRESS)
@@ -914,3 +1085,13 @@ opt_datname_include_list(ConfigOption *opt, const char *arg)
 
 	parray_append(datname_include_list, dbname);
 }
+
+/* Construct array of data directories, provided by user via extra-pgdata option */
+void
+opt_extra_pgdata_list(ConfigOption *opt, const char *arg)
+{
+	if (!extra_pgdata_list)
+		extra_pgdata_list = parray_new();
+
+	parray_append(extra_pgdata_list, parse_restore_target(arg));
+}
@@ -35,8 +35,7 @@
 #include "utils/parray.h"
 #include "utils/pgut.h"
 #include "utils/file.h"
-
-#include "datapagemap.h"
+#include "utils/pagemap.h"
 
 /* pgut client variables and full path */
 extern const char  *PROGRAM_NAME;
@@ -65,6 +64,9 @@ extern const char  *PROGRAM_EMAIL;
 #define PG_TABLESPACE_MAP_FILE "tablespace_map"
 #define EXTERNAL_DIR			"external_directories/externaldir"
 #define DATABASE_MAP			"database_map"
+#define SYNC_MANIFEST_FILE		"catalog_sync.manifest"
+/* Valid WAL segments are remembered here, so they are not read again */
+#define WAL_VALIDATION_CACHE_FILE	"wal_validation.cache"
 
 /* Timeout defaults */
 #define PARTIAL_WAL_TIMER			60
@@ -110,6 +112,14 @@ typedef enum CompressAlg
 	ZLIB_COMPRESS,
 } CompressAlg;
 
+/* Host, where data pages of remote backup are compressed */
+typedef enum CompressLocation
+{
+	COMPRESS_LOCATION_SOURCE = 0,	/* database host */
+	COMPRESS_LOCATION_TARGET,		/* backup host */
+	COMPRESS_LOCATION_AUTO,			/* chosen by measured speeds */
+} CompressLocation;
+
 #define INIT_FILE_CRC32(use_crc32c, crc) \
 do { \
 	if (use_crc32c) \
@@ -139,6 +149,7 @@ typedef struct pgFile
 	char   *name;			/* file or directory name */
 	mode_t	mode;			/* protection (file type and permission) */
 	size_t	size;			/* size of the file */
+	time_t	mtime;			/* file st_mtime attribute */
 	size_t	read_size;		/* size of the portion read (if only some pages are
 							   backed up, it's different from size) */
 	int64	write_size;		/* size of the backed-up file. BYTES_INVALID means
@@ -165,11 +176,15 @@ typedef struct pgFile
 	bool	exists_in_prev;		/* Mark files, both data and regular, that exists in previous backup */
 	CompressAlg		compress_alg;		/* compression algorithm applied to the file */
 	volatile 		pg_atomic_flag lock;/* lock for synchronization of parallel threads  */
-	datapagemap_t	pagemap;			/* bitmap of pages updated since previous backup */
+	pagemap_t		pagemap;			/* set of pages updated since previous backup */
 	bool			pagemap_isabsent;	/* Used to mark files with unknown state of pagemap,
 										 * i.e. datafiles without _ptrack */
 } pgFile;
 
+/* True for files of relation forks other than the main one, e.g. "_fsm" */
+#define IsNotMainFork(file) \
+	((file)->forkName != NULL && (file)->forkName[0] != '\0')
+
 typedef struct page_map_entry
 {
 	const char	*path;		/* file or directory name */
@@ -177,9 +192,6 @@ typedef struct page_map_entry
 	size_t		 pagemapsize;
 } page_map_entry;
 
-/* Special values of datapagemap_t bitmapsize */
-#define PageBitmapIsEmpty 0		/* Used to mark unchanged datafiles */
-
 /* Current state of backup */
 typedef enum BackupStatus
 {
@@ -257,6 +269,7 @@ typedef struct InstanceConfig
 
 	char	   *pgdata;
 	char	   *external_dir_str;
+	char	   *stripe_paths_str;
 
 	ConnectionOptions conn_opt;
 	ConnectionOptions master_conn_opt;
@@ -282,6 +295,7 @@ typedef struct InstanceConfig
 
 	CompressAlg	compress_alg;
 	int			compress_level;
+	CompressLocation compress_location;
 
 	/* Archive description */
 	ArchiveOptions archive;
@@ -368,10 +382,25 @@ struct pgBackup
 									 * Which is basic backup for this
 									 * incremental backup. */
 	pgBackup		*parent_backup_link;
+
+	/*
+	 * Position of the backup in the graph of backups linked by
+	 * parent_backup_link, computed by catalog_get_backup_list().
+	 */
+	pgBackup		*root_backup;	/* oldest backup of the chain, FULL backup
+									 * if the chain is not broken */
+	parray			*children;		/* backups, linked to this one as to
+									 * parent, NULL if there are none */
+	int				depth;			/* number of links up to root_backup */
+	int				dag_enter;		/* order of the backup in depth-first walk */
+	int				dag_leave;		/* the largest dag_enter of descendants */
+
 	char			*primary_conninfo; /* Connection parameters of the backup
 										* in the format suitable for recovery.conf */
 	char			*external_dir_str;	/* List of external directories,
 										 * separated by ':' */
+	char			*mode_reason;	/* Why backup mode was chosen,
+									 * if it was chosen by --backup-mode=auto */
 };
 
 /* Recovery target for restore and validate subcommands */
@@ -394,6 +423,19 @@ typedef struct pgRecoveryTarget
 	const char	   *target_action;
 } pgRecoveryTarget;
 
+/* Tablespace mapping, see dir.c */
+typedef struct TablespaceList TablespaceList;
+
+/* Data directory to restore into, given by --extra-pgdata */
+typedef struct pgRestoreTarget
+{
+	char	   *pgdata;
+	/* host of the data directory, NULL means the database host */
+	char	   *host;
+	/* tablespace mapping of this data directory, used instead of -T */
+	TablespaceList *tablespace_map;
+} pgRestoreTarget;
+
 /* Options needed for restore and validate commands */
 typedef struct pgRestoreParams
 {
@@ -408,8 +450,14 @@ typedef struct pgRestoreParams
 	/* options for partial restore */
 	PartialRestoreType partial_restore_type;
 	parray *partial_db_list;
+
+	/* more data directories to restore into, besides PGDATA, pgRestoreTarget */
+	parray *extra_pgdata_list;
 } pgRestoreParams;
 
+/* Writers of fan-out restore into several data directories */
+typedef struct restore_fanout restore_fanout;
+
 /* Options needed for set-backup command */
 typedef struct pgSetBackupParams
 {
@@ -438,6 +486,9 @@ typedef struct
 	ConnectionArgs conn_arg;
 	int			thread_num;
 
+	/* Standby to read data files from, NULL to read from the source */
+	const char *standby_host;
+
 	/*
 	 * Return value from the thread.
 	 * 0 means there is no error, 1 - there is an error.
@@ -512,6 +563,36 @@ typedef struct BackupPageHeader
 #define PageIsTruncated -2
 #define SkipCurrentPage -3
 #define PageIsCorrupted -4 /* used by checkdb */
+#define PageIsDeferred -5 /* page is not valid yet, reread it later */
+
+/* Number of attempts to read a valid page before giving up */
+#define PAGE_READ_ATTEMPTS 100
+
+/*
+ * Pages, which are read after a deferred page, wait for it in the queue,
+ * because pages of a file are backed up in order. The oldest deferred page
+ * is reread once per DEFERRED_PAGE_RETRY_INTERVAL pages read.
+ */
+#define DEFERRED_PAGES_MAX	1024
+#define DEFERRED_PAGE_RETRY_INTERVAL	(DEFERRED_PAGES_MAX / PAGE_READ_ATTEMPTS)
+
+typedef struct DeferredPage
+{
+	BlockNumber	blknum;
+	bool		deferred;		/* page is not reread yet */
+	int32		page_state;		/* state of the page after it is read */
+	int			attempts;		/* read attempts left for a deferred page */
+	size_t		size;			/* size of data to write */
+	char		data[BLCKSZ + sizeof(BackupPageHeader)];
+} DeferredPage;
+
+typedef struct DeferredPageQueue
+{
+	DeferredPage *pages;		/* allocated on the first deferred page */
+	int			first;			/* the first page not written yet */
+	int			npages;
+	int			nread;			/* pages read since the last retry */
+} DeferredPageQueue;
 
 
 /*
@@ -542,6 +623,8 @@ typedef struct BackupPageHeader
 	XLogSegNoOffsetToRecPtr(segno, offset, wal_segsz_bytes, dest)
 #define GetXLogFileName(fname, tli, logSegNo, wal_segsz_bytes) \
 	XLogFileName(fname, tli, logSegNo, wal_segsz_bytes)
+#define GetXLogFromFileName(fname, tli, logSegNo, wal_segsz_bytes) \
+	XLogFromFileName(fname, tli, logSegNo, wal_segsz_bytes)
 #define IsInXLogSeg(xlrp, logSegNo, wal_segsz_bytes) \
 	XLByteInSeg(xlrp, logSegNo, wal_segsz_bytes)
 #define GetXLogSegName(fname, logSegNo, wal_segsz_bytes)	\
@@ -558,6 +641,8 @@ typedef struct BackupPageHeader
 	XLogSegNoOffsetToRecPtr(segno, offset, dest)
 #define GetXLogFileName(fname, tli, logSegNo, wal_segsz_bytes) \
 	XLogFileName(fname, tli, logSegNo)
+#define GetXLogFromFileName(fname, tli, logSegNo, wal_segsz_bytes) \
+	XLogFromFileName(fname, tli, logSegNo)
 #define IsInXLogSeg(xlrp, logSegNo, wal_segsz_bytes) \
 	XLByteInSeg(xlrp, logSegNo)
 #define GetXLogSegName(fname, logSegNo, wal_segsz_bytes) \
@@ -588,6 +673,11 @@ extern bool 	temp_slot;
 
 /* backup options */
 extern bool		smooth_checkpoint;
+extern bool		paranoid_crc;
+extern bool		backup_mode_auto;
+extern char	   *standby_hosts;
+extern bool		inline_validate;
+extern bool		read_back;
 
 /* remote probackup options */
 extern char* remote_agent;
@@ -669,9 +759,22 @@ extern int do_add_instance(InstanceConfig *instance);
 /* in archive.c */
 extern int do_archive_push(InstanceConfig *instance, char *wal_file_path,
 						   char *wal_file_name, bool overwrite);
+extern int do_archive_push_via_daemon(InstanceConfig *instance,
+									  char *wal_file_path, char *wal_file_name,
+									  bool overwrite, const char *daemon_socket);
+extern int do_archive_daemon(InstanceConfig *instance,
+							 const char *daemon_socket);
+extern int do_archive_receive(InstanceConfig *instance);
 extern int do_archive_get(InstanceConfig *instance, char *wal_file_path,
 						  char *wal_file_name);
 
+/* in backup_all.c */
+extern int do_backup_all(const char *schedule_path, const char *default_mode,
+						 parray *backup_args);
+
+/* in catalog_sync.c */
+extern int do_catalog_sync(const char *dst_backup_path, const char *dst_cmd);
+
 /* in configure.c */
 extern void do_show_config(void);
 extern void do_set_config(bool missing_ok);
@@ -701,7 +804,7 @@ extern void help_command(char *command);
 
 /* in validate.c */
 extern void pgBackupValidate(pgBackup* backup, pgRestoreParams *params);
-extern int do_validate_all(void);
+extern int do_validate_all(bool wal_only);
 
 /* in catalog.c */
 extern pgBackup *read_backup(const char *instance_name, time_t timestamp);
@@ -744,37 +847,52 @@ extern int pgBackupCompareId(const void *f1, const void *f2);
 extern int pgBackupCompareIdDesc(const void *f1, const void *f2);
 extern int pgBackupCompareIdEqual(const void *l, const void *r);
 
+extern void catalog_build_backup_graph(parray *backups);
 extern pgBackup* find_parent_full_backup(pgBackup *current_backup);
 extern int scan_parent_chain(pgBackup *current_backup, pgBackup **result_backup);
 extern bool is_parent(time_t parent_backup_time, pgBackup *child_backup, bool inclusive);
+extern bool is_ancestor(pgBackup *ancestor, pgBackup *descendant, bool inclusive);
 extern bool is_prolific(parray *backup_list, pgBackup *target_backup);
 extern bool in_backup_list(parray *backup_list, pgBackup *target_backup);
 extern int get_backup_index_number(parray *backup_list, pgBackup *backup);
 extern bool launch_agent(void);
+extern void set_agent_host(char const* host);
 extern void launch_ssh(char* argv[]);
 extern void wait_ssh(void);
 
 #define COMPRESS_ALG_DEFAULT NOT_DEFINED_COMPRESS
 #define COMPRESS_LEVEL_DEFAULT 1
+#define COMPRESS_LOCATION_DEFAULT COMPRESS_LOCATION_SOURCE
 
 extern CompressAlg parse_compress_alg(const char *arg);
 extern const char* deparse_compress_alg(int alg);
+extern CompressLocation parse_compress_location(const char *arg);
+extern const char* deparse_compress_location(CompressLocation location);
 
 /* in dir.c */
 extern void dir_list_file(parray *files, const char *root, bool exclude,
 						  bool follow_symlink, bool add_root,
 						  int external_dir_num, fio_location location);
+extern void dir_list_file_parallel(parray *files, const char *root,
+								   bool exclude, bool follow_symlink,
+								   bool add_root, int external_dir_num,
+								   fio_location location);
 
 extern void create_data_directories(parray *dest_files,
 										const char *data_dir,
 										const char *backup_dir,
 										bool extract_tablespaces,
+										TablespaceList *tablespace_map,
 										fio_location location);
 
 extern void read_tablespace_map(parray *files, const char *backup_dir);
 extern void opt_tablespace_map(ConfigOption *opt, const char *arg);
 extern void opt_externaldir_map(ConfigOption *opt, const char *arg);
-extern void check_tablespace_mapping(pgBackup *backup);
+extern pgRestoreTarget *parse_restore_target(const char *arg);
+extern const char *get_tablespace_mapping(TablespaceList *tablespace_map,
+										  const char *dir);
+extern void check_tablespace_mapping(pgBackup *backup,
+									 TablespaceList *tablespace_map);
 extern void check_external_dir_mapping(pgBackup *backup);
 extern char *get_external_remap(char *current_dir);
 
@@ -789,6 +907,7 @@ extern parray *dir_read_file_list(const char *root, const char *external_prefix,
 								  const char *file_txt, fio_location location);
 extern parray *make_external_directory_list(const char *colon_separated_dirs,
 											bool remap);
+extern parray *make_stripe_path_list(const char *colon_separated_paths);
 extern void free_dir_list(parray *list);
 extern void makeExternalDirPathByNum(char *ret_path, const char *pattern_path,
 									 const int dir_num);
@@ -805,6 +924,9 @@ extern pgFile *pgFileNew(const char *path, const char *rel_path,
 						 fio_location location);
 extern pgFile *pgFileInit(const char *path, const char *rel_path);
 extern void pgFileDelete(pgFile *file);
+extern void pgBackupFileDelete(pgFile *file, const char *backup_root,
+							   parray *stripe_roots);
+extern bool get_stripe_target(const char *path, char *target);
 extern void pgFileFree(void *file);
 extern pg_crc32 pgFileGetCRC(const char *file_path, bool use_crc32c,
 							 bool raise_on_deleted, size_t *bytes_read, fio_location location);
@@ -834,14 +956,34 @@ extern bool backup_data_file(backup_files_arg* arguments,
 extern void restore_data_file(const char *to_path,
 							  pgFile *file, bool allow_truncate,
 							  bool write_header,
-							  uint32 backup_version);
+							  uint32 backup_version, bool clone_pages);
+extern void restore_decompress_pool_start(int nworkers);
+extern void restore_decompress_pool_stop(void);
+extern restore_fanout *restore_fanout_start(parray *target_list);
+extern void restore_fanout_wait(restore_fanout *fanout);
+extern void restore_fanout_stop(restore_fanout *fanout);
+extern void restore_data_file_fanout(restore_fanout *fanout, pgFile *file,
+									 bool allow_truncate,
+									 uint32 backup_version);
+extern void restore_file_fanout(restore_fanout *fanout, pgFile *file,
+								const char *from_root, bool create_empty);
 extern bool copy_file(fio_location from_location, const char *to_root,
 					  fio_location to_location, pgFile *file, bool missing_ok);
 extern bool create_empty_file(fio_location from_location, const char *to_root,
 							  fio_location to_location, pgFile *file);
+extern bool clone_file(const char *to_root, pgFile *file);
 
 extern bool check_file_pages(pgFile *file, XLogRecPtr stop_lsn,
 							 uint32 checksum_version, uint32 backup_version);
+extern void check_written_page(pgFile *file, const char *write_buffer,
+							   uint32 checksum_version);
+extern void read_back_file(const char *path, pgFile *file);
+extern bool deferred_page_queue_full(DeferredPageQueue *queue);
+extern DeferredPage *deferred_page_queue_add(DeferredPageQueue *queue,
+											 BlockNumber blknum);
+extern DeferredPage *deferred_page_queue_pop(DeferredPageQueue *queue);
+extern DeferredPage *deferred_page_queue_retry(DeferredPageQueue *queue);
+extern void deferred_page_queue_free(DeferredPageQueue *queue);
 /* parsexlog.c */
 extern void extractPageMap(const char *archivedir,
 						   TimeLineID tli, uint32 seg_size,
@@ -850,6 +992,10 @@ extern void validate_wal(pgBackup *backup, const char *archivedir,
 						 time_t target_time, TransactionId target_xid,
 						 XLogRecPtr target_lsn, TimeLineID tli,
 						 uint32 seg_size);
+extern void forget_validated_wal(void);
+extern bool validate_wal_segment(const char *archivedir, TimeLineID tli,
+								 XLogSegNo segno, uint32 seg_size,
+								 int thread_num, bool *complete);
 extern bool read_recovery_info(const char *archivedir, TimeLineID tli,
 							   uint32 seg_size,
 							   XLogRecPtr start_lsn, XLogRecPtr stop_lsn,
@@ -911,5 +1057,6 @@ extern char *pg_ptrack_get_and_clear(Oid tablespace_oid,
 									 PGconn *backup_conn);
 extern XLogRecPtr get_last_ptrack_lsn(PGconn *backup_conn, PGNodeInfo *nodeInfo);
 extern parray * pg_ptrack_get_pagemapset(PGconn *backup_conn, const char *ptrack_schema, XLogRecPtr lsn);
+extern int64 pg_ptrack_count_changed_blocks(PGconn *backup_conn, const char *ptrack_schema, XLogRecPtr lsn);
 
 #endif /* PG_PROBACKUP_H */
@@ -21,6 +21,45 @@
 #define PTRACK_BITS_PER_HEAPBLOCK 1
 #define HEAPBLOCKS_PER_BYTE (BITS_PER_BYTE / PTRACK_BITS_PER_HEAPBLOCK)
 
+/*
+ * Count blocks changed since lsn according to ptrack 2.x maps.
+ * Used to estimate the size of incremental backup without reading any file.
+ */
+int64
+pg_ptrack_count_changed_blocks(PGconn *backup_conn, const char *ptrack_schema,
+							   XLogRecPtr lsn)
+{
+	parray	   *filemaps;
+	int64		n_blocks = 0;
+	int			i;
+
+	filemaps = pg_ptrack_get_pagemapset(backup_conn, ptrack_schema, lsn);
+	if (filemaps == NULL)
+		return 0;
+
+	for (i = 0; i < parray_num(filemaps); i++)
+	{
+		page_map_entry *map = (page_map_entry *) parray_get(filemaps, i);
+		size_t		j;
+
+		for (j = 0; j < map->pagemapsize; j++)
+		{
+			unsigned char byte = (unsigned char) map->pagemap[j];
+
+			/* count set bits */
+			for (; byte != 0; byte &= byte - 1)
+				n_blocks++;
+		}
+
+		PQfreemem(map->pagemap);
+		pg_free((void *) map->path);
+		pg_free(map);
+	}
+	parray_free(filemaps);
+
+	return n_blocks;
+}
+
 /*
  * Given a list of files in the instance to backup, build a pagemap for each
  * data file that has ptrack. Result is saved in the pagemap field of pgFile.
@@ -67,6 +106,13 @@ make_pagemap_from_ptrack_1(parray *files, PGconn *backup_conn)
 
 		if (file->is_datafile)
 		{
+			/* ptrack 1.x tracks only the main fork */
+			if (IsNotMainFork(file))
+			{
+				file->pagemap_isabsent = true;
+				continue;
+			}
+
 			if (file->tblspcOid == tblspcOid_with_ptrack_init &&
 				file->dbOid == dbOid_with_ptrack_init)
 			{
@@ -111,20 +157,17 @@ make_pagemap_from_ptrack_1(parray *files, PGconn *backup_conn)
 				}
 				else
 				{
+					int			bitmapsize;
 
 					if (start_addr + RELSEG_SIZE/HEAPBLOCKS_PER_BYTE > ptrack_nonparsed_size)
-					{
-						file->pagemap.bitmapsize = ptrack_nonparsed_size - start_addr;
-						elog(VERBOSE, "pagemap size: %i", file->pagemap.bitmapsize);
-					}
+						bitmapsize = ptrack_nonparsed_size - start_addr;
 					else
-					{
-						file->pagemap.bitmapsize = RELSEG_SIZE/HEAPBLOCKS_PER_BYTE;
-						elog(VERBOSE, "pagemap size: %i", file->pagemap.bitmapsize);
-					}
+						bitmapsize = RELSEG_SIZE/HEAPBLOCKS_PER_BYTE;
+
+					elog(VERBOSE, "pagemap size: %i", bitmapsize);
 
-					file->pagemap.bitmap = pg_malloc(file->pagemap.bitmapsize);
-					memcpy(file->pagemap.bitmap, ptrack_nonparsed+start_addr, file->pagemap.bitmapsize);
+					pagemap_add_bitmap(&file->pagemap, ptrack_nonparsed + start_addr,
+									   bitmapsize);
 				}
 			}
 			else
@@ -671,9 +714,9 @@ make_pagemap_from_ptrack_2(parray *files,
 		page_map_entry *map = NULL;
 
 		/*
-		 * For now nondata files are not entitled to have pagemap
-		 * TODO It's possible to use ptrack for incremental backup of
-		 * relation forks. Not implemented yet.
+		 * Nondata files are not entitled to have pagemap. ptrack 2.x tracks
+		 * writes of all relation forks, so free space map and visibility map
+		 * get their pagemaps as the main fork does.
 		 */
 		if (!file->is_datafile || file->is_cfs)
 			continue;
@@ -693,10 +736,20 @@ make_pagemap_from_ptrack_2(parray *files,
 		if (map)
 		{
 			elog(VERBOSE, "Using ptrack pagemap for file \"%s\"", file->rel_path);
-			file->pagemap.bitmapsize = map->pagemapsize;
-			file->pagemap.bitmap = map->pagemap;
+			pagemap_add_bitmap(&file->pagemap, map->pagemap, map->pagemapsize);
 		}
 	}
 
 	free(dummy_map);
+
+	/* Raw ptrack maps are not needed anymore, pagemaps keep their copies */
+	for (file_i = 0; file_i < parray_num(filemaps); file_i++)
+	{
+		page_map_entry *map = (page_map_entry *) parray_get(filemaps, file_i);
+
+		PQfreemem(map->pagemap);
+		pg_free((void *) map->path);
+		pg_free(map);
+	}
+	parray_free(filemaps);
 }
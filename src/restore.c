@@ -27,6 +27,8 @@ typedef struct
 	parray	   *dest_files;
 	parray	   *dbOid_exclude_list;
 	bool		skip_external_dirs;
+	restore_fanout *fanout;
+	bool		clone_files;
 
 	/*
 	 * Return value from the thread.
@@ -37,14 +39,22 @@ typedef struct
 
 static void restore_backup(pgBackup *backup, parray *dest_external_dirs,
 						   parray *dest_files, parray *dbOid_exclude_list,
-						   pgRestoreParams *params);
-static void create_recovery_conf(time_t backup_id,
+						   restore_fanout *fanout, pgRestoreParams *params);
+static void check_restore_targets(parray *target_list);
+static void check_extra_pgdata(pgBackup *backup, parray *target_list,
+							   pgRestoreParams *params);
+static bool restore_targets_share_host(pgRestoreTarget *target1,
+									   pgRestoreTarget *target2);
+static void set_restore_host(const char *host);
+static bool restore_can_clone(const char *database_path);
+static void create_recovery_conf(const char *pgdata, time_t backup_id,
 								 pgRecoveryTarget *rt,
 								 pgBackup *backup,
 								 pgRestoreParams *params);
 static void *restore_files(void *arg);
 static void set_orphan_status(parray *backups, pgBackup *parent_backup);
-static void pg12_recovery_config(pgBackup *backup, bool add_include);
+static void pg12_recovery_config(const char *pgdata, pgBackup *backup,
+								 bool add_include);
 
 
 /*
@@ -66,7 +76,7 @@ set_orphan_status(parray *backups, pgBackup *parent_backup)
 
 		pgBackup *backup = (pgBackup *) parray_get(backups, j);
 
-		if (is_parent(parent_backup->start_time, backup, false))
+		if (is_ancestor(parent_backup, backup, false))
 		{
 			if (backup->status == BACKUP_STATUS_OK ||
 				backup->status == BACKUP_STATUS_DONE)
@@ -108,16 +118,27 @@ do_restore_or_validate(time_t target_backup_id, pgRecoveryTarget *rt,
 	char	   *action = params->is_restore ? "Restore":"Validate";
 	parray	   *parent_chain = NULL;
 	parray	   *dbOid_exclude_list = NULL;
+	/* Data directories to restore into, PGDATA goes first */
+	parray	   *target_list = NULL;
+	pgRestoreTarget pgdata_target;
 
 	if (params->is_restore)
 	{
 		if (instance_config.pgdata == NULL)
 			elog(ERROR,
 				"required parameter not specified: PGDATA (-D, --pgdata)");
-		/* Check if restore destination empty */
-		if (!dir_is_empty(instance_config.pgdata, FIO_DB_HOST))
-			elog(ERROR, "restore destination is not empty: \"%s\"",
-				 instance_config.pgdata);
+
+		pgdata_target.pgdata = instance_config.pgdata;
+		pgdata_target.host = NULL;
+		pgdata_target.tablespace_map = NULL;
+
+		target_list = parray_new();
+		parray_append(target_list, &pgdata_target);
+		if (params->extra_pgdata_list)
+			parray_concat(target_list, params->extra_pgdata_list);
+
+		/* Check if restore destinations are empty */
+		check_restore_targets(target_list);
 	}
 
 	if (instance_name == NULL)
@@ -321,11 +342,23 @@ do_restore_or_validate(time_t target_backup_id, pgRecoveryTarget *rt,
 	 */
 	if (params->is_restore)
 	{
-		check_tablespace_mapping(dest_backup);
+		for (i = 0; i < parray_num(target_list); i++)
+		{
+			pgRestoreTarget *target = parray_get(target_list, i);
+
+			if (target->host)
+				set_restore_host(target->host);
+			check_tablespace_mapping(dest_backup, target->tablespace_map);
+			if (target->host)
+				set_restore_host(NULL);
+		}
 
 		/* no point in checking external directories if their restore is not requested */
 		if (!params->skip_external_dirs)
 			check_external_dir_mapping(dest_backup);
+
+		if (params->extra_pgdata_list)
+			check_extra_pgdata(dest_backup, target_list, params);
 	}
 
 	/* At this point we are sure that parent chain is whole
@@ -447,6 +480,7 @@ do_restore_or_validate(time_t target_backup_id, pgRecoveryTarget *rt,
 	{
 		parray	   *dest_external_dirs = NULL;
 		parray	   *dest_files;
+		restore_fanout *fanout = NULL;
 		char		control_file[MAXPGPATH],
 					dest_backup_path[MAXPGPATH];
 		int			i;
@@ -480,8 +514,18 @@ do_restore_or_validate(time_t target_backup_id, pgRecoveryTarget *rt,
 		 */
 		pgBackupGetPath(dest_backup, dest_backup_path,
 						lengthof(dest_backup_path), NULL);
-		create_data_directories(dest_files, instance_config.pgdata, dest_backup_path, true,
-								FIO_DB_HOST);
+		for (i = 0; i < parray_num(target_list); i++)
+		{
+			pgRestoreTarget *target = parray_get(target_list, i);
+
+			if (target->host)
+				set_restore_host(target->host);
+			create_data_directories(dest_files, target->pgdata,
+									dest_backup_path, true,
+									target->tablespace_map, FIO_DB_HOST);
+			if (target->host)
+				set_restore_host(NULL);
+		}
 
 		/*
 		 * Restore dest_backup external directories.
@@ -499,6 +543,13 @@ do_restore_or_validate(time_t target_backup_id, pgRecoveryTarget *rt,
 						  DIR_PERMISSION, FIO_DB_HOST);
 		}
 
+		/*
+		 * Data files are read and decompressed once for all data
+		 * directories, writers write them into each data directory.
+		 */
+		if (parray_num(target_list) > 1)
+			fanout = restore_fanout_start(target_list);
+
 		/*
 		 * Restore backups files starting from the parent backup.
 		 */
@@ -519,9 +570,13 @@ do_restore_or_validate(time_t target_backup_id, pgRecoveryTarget *rt,
 			if (params->no_validate && !lock_backup(backup))
 				elog(ERROR, "Cannot lock backup directory");
 
-			restore_backup(backup, dest_external_dirs, dest_files, dbOid_exclude_list, params);
+			restore_backup(backup, dest_external_dirs, dest_files, dbOid_exclude_list,
+						   fanout, params);
 		}
 
+		if (fanout)
+			restore_fanout_stop(fanout);
+
 		if (dest_external_dirs != NULL)
 			free_dir_list(dest_external_dirs);
 
@@ -529,26 +584,176 @@ do_restore_or_validate(time_t target_backup_id, pgRecoveryTarget *rt,
 		parray_free(dest_files);
 
 		/* Create recovery.conf with given recovery target parameters */
-		create_recovery_conf(target_backup_id, rt, dest_backup, params);
+		for (i = 0; i < parray_num(target_list); i++)
+		{
+			pgRestoreTarget *target = parray_get(target_list, i);
+
+			if (target->host)
+				set_restore_host(target->host);
+			create_recovery_conf(target->pgdata, target_backup_id,
+								 rt, dest_backup, params);
+			if (target->host)
+				set_restore_host(NULL);
+		}
 	}
 
 	/* cleanup */
 	parray_walk(backups, pgBackupFree);
 	parray_free(backups);
 	parray_free(parent_chain);
+	if (target_list)
+		parray_free(target_list);
 
 	elog(INFO, "%s of backup %s completed.",
 		 action, base36enc(dest_backup->start_time));
 	return 0;
 }
 
+/*
+ * Check that data directories to restore into are empty and are not given
+ * twice. The same directory can be restored into at different hosts.
+ */
+static void
+check_restore_targets(parray *target_list)
+{
+	int			i,
+				j;
+
+	for (i = 0; i < parray_num(target_list); i++)
+	{
+		pgRestoreTarget *target = parray_get(target_list, i);
+
+		if (target->host && !IsSshProtocol())
+			elog(ERROR, "Host of --extra-pgdata can be specified in remote mode only: \"%s\"",
+				 target->host);
+
+		for (j = 0; j < i; j++)
+		{
+			pgRestoreTarget *prev = parray_get(target_list, j);
+
+			if (strcmp(target->pgdata, prev->pgdata) != 0 ||
+				!restore_targets_share_host(target, prev))
+				continue;
+
+			if (j == 0)
+				elog(ERROR, "--extra-pgdata must differ from PGDATA: \"%s\"",
+					 target->pgdata);
+			else
+				elog(ERROR, "--extra-pgdata is specified twice: \"%s\"",
+					 target->pgdata);
+		}
+
+		if (target->host)
+			set_restore_host(target->host);
+		if (!dir_is_empty(target->pgdata, FIO_DB_HOST))
+			elog(ERROR, "restore destination is not empty: \"%s\"",
+				 target->pgdata);
+		if (target->host)
+			set_restore_host(NULL);
+	}
+}
+
+/*
+ * Ensure that the backup can be restored into several data directories.
+ * Tablespaces of data directories at the same host must be relocated to
+ * different directories by tablespace mapping of --extra-pgdata. External
+ * directories are restored at absolute paths, so they cannot be restored
+ * more than once.
+ */
+static void
+check_extra_pgdata(pgBackup *backup, parray *target_list,
+				   pgRestoreParams *params)
+{
+	char		backup_path[MAXPGPATH];
+	parray	   *links = parray_new();
+	int			i,
+				j,
+				k,
+				l;
+
+	pgBackupGetPath(backup, backup_path, lengthof(backup_path), NULL);
+	read_tablespace_map(links, backup_path);
+
+	for (i = 0; i < parray_num(target_list); i++)
+	{
+		pgRestoreTarget *target = parray_get(target_list, i);
+
+		for (j = 0; j < i; j++)
+		{
+			pgRestoreTarget *prev = parray_get(target_list, j);
+
+			if (!restore_targets_share_host(target, prev))
+				continue;
+
+			for (k = 0; k < parray_num(links); k++)
+			{
+				const char *linked = ((pgFile *) parray_get(links, k))->linked;
+				const char *path = get_tablespace_mapping(target->tablespace_map,
+														  linked);
+
+				for (l = 0; l < parray_num(links); l++)
+				{
+					const char *prev_linked = ((pgFile *) parray_get(links, l))->linked;
+
+					if (strcmp(path, get_tablespace_mapping(prev->tablespace_map,
+															prev_linked)) == 0)
+						elog(ERROR, "Tablespace directory \"%s\" is restored into \"%s\" "
+							 "and \"%s\", relocate it by --extra-pgdata=%s,OLDDIR=NEWDIR",
+							 path, prev->pgdata, target->pgdata, target->pgdata);
+				}
+			}
+		}
+	}
+
+	parray_walk(links, pgFileFree);
+	parray_free(links);
+
+	if (backup->external_dir_str && !params->skip_external_dirs)
+		elog(ERROR, "Backup %s contains external directories, use \"--skip-external-dirs\" "
+			 "to restore it with \"--extra-pgdata\"",
+			 base36enc(backup->start_time));
+}
+
+/*
+ * Return true if data directories are at the same host. Host of PGDATA
+ * and of --extra-pgdata without a host is the database host.
+ */
+static bool
+restore_targets_share_host(pgRestoreTarget *target1, pgRestoreTarget *target2)
+{
+	const char *host1 = target1->host;
+	const char *host2 = target2->host;
+
+	if (!IsSshProtocol())
+		return true;
+
+	if (host1 == NULL)
+		host1 = instance_config.remote.host;
+	if (host2 == NULL)
+		host2 = instance_config.remote.host;
+
+	return strcmp(host1, host2) == 0;
+}
+
+/*
+ * Connect agent of the main thread to the host of --extra-pgdata, or back
+ * to the database host, if host is NULL. The connection is established
+ * at the first remote call.
+ */
+static void
+set_restore_host(const char *host)
+{
+	fio_disconnect();
+	set_agent_host(host);
+}
+
 /*
  * Restore one backup.
  */
 void
 restore_backup(pgBackup *backup, parray *dest_external_dirs,
 				parray *dest_files, parray *dbOid_exclude_list,
-				pgRestoreParams *params)
+				restore_fanout *fanout, pgRestoreParams *params)
 {
 	char		timestamp[100];
 	char		database_path[MAXPGPATH];
@@ -561,6 +766,7 @@ restore_backup(pgBackup *backup, parray *dest_external_dirs,
 	pthread_t  *threads;
 	restore_files_arg *threads_args;
 	bool		restore_isok = true;
+	bool		clone_files;
 
 	if (backup->status != BACKUP_STATUS_OK &&
 		backup->status != BACKUP_STATUS_DONE)
@@ -649,6 +855,20 @@ restore_backup(pgBackup *backup, parray *dest_external_dirs,
 	threads_args = (restore_files_arg *) palloc(sizeof(restore_files_arg) *
 												num_threads);
 
+	/*
+	 * Decompression of pages is CPU bound, let workers share it with restore
+	 * threads, so a large relation doesn't keep a single core busy.
+	 */
+	if (backup->compress_alg == PGLZ_COMPRESS ||
+		backup->compress_alg == ZLIB_COMPRESS)
+		restore_decompress_pool_start(num_threads);
+
+	/* Fan-out restore writes pages of data files by its own writers */
+	clone_files = fanout == NULL && restore_can_clone(database_path);
+	if (clone_files)
+		elog(LOG, "Backup catalog and data directory are on the same file system, "
+			 "files of backup %s are cloned", base36enc(backup->start_time));
+
 	/* Restore files into target directory */
 	thread_interrupted = false;
 	for (i = 0; i < num_threads; i++)
@@ -663,6 +883,8 @@ restore_backup(pgBackup *backup, parray *dest_external_dirs,
 		arg->dest_files = dest_files;
 		arg->dbOid_exclude_list = dbOid_exclude_list;
 		arg->skip_external_dirs = params->skip_external_dirs;
+		arg->fanout = fanout;
+		arg->clone_files = clone_files;
 		/* By default there are some error */
 		threads_args[i].ret = 1;
 
@@ -679,9 +901,15 @@ restore_backup(pgBackup *backup, parray *dest_external_dirs,
 		if (threads_args[i].ret == 1)
 			restore_isok = false;
 	}
+	restore_decompress_pool_stop();
+
 	if (!restore_isok)
 		elog(ERROR, "Data files restoring failed");
 
+	/* Writers must be done with the files before they are freed */
+	if (fanout)
+		restore_fanout_wait(fanout);
+
 	pfree(threads);
 	pfree(threads_args);
 
@@ -695,6 +923,32 @@ restore_backup(pgBackup *backup, parray *dest_external_dirs,
 	elog(LOG, "Restore %s backup completed", base36enc(backup->start_time));
 }
 
+/*
+ * Check if files of the backup can be cloned into the data directory
+ * instead of being copied through user space, that is if the backup catalog
+ * and the data directory are on the same local file system. Uncompressed
+ * pages of data files and non-data files are cloned then.
+ */
+static bool
+restore_can_clone(const char *database_path)
+{
+#ifdef __linux__
+	struct stat	backup_st;
+	struct stat	pgdata_st;
+
+	if (IsSshProtocol())
+		return false;
+
+	if (stat(database_path, &backup_st) == -1 ||
+		stat(instance_config.pgdata, &pgdata_st) == -1)
+		return false;
+
+	return backup_st.st_dev == pgdata_st.st_dev;
+#else
+	return false;
+#endif
+}
+
 /*
  * Restore files into $PGDATA.
  */
@@ -739,8 +993,11 @@ restore_files(void *arg)
 				 * We cannot simply skip the file, because it may lead to
 				 * failure during WAL redo; hence, create empty file. 
 				 */
-				create_empty_file(FIO_BACKUP_HOST,
-					  instance_config.pgdata, FIO_DB_HOST, file);
+				if (arguments->fanout)
+					restore_file_fanout(arguments->fanout, file, from_root, true);
+				else
+					create_empty_file(FIO_BACKUP_HOST,
+						  instance_config.pgdata, FIO_DB_HOST, file);
 
 				elog(VERBOSE, "Exclude file due to partial restore: \"%s\"",
 					 file->rel_path);
@@ -801,7 +1058,11 @@ restore_files(void *arg)
 		elog(VERBOSE, "Restoring file \"%s\", is_datafile %i, is_cfs %i",
 			 file->path, file->is_datafile?1:0, file->is_cfs?1:0);
 
-		if (file->is_datafile && !file->is_cfs)
+		if (file->is_datafile && !file->is_cfs && arguments->fanout)
+			restore_data_file_fanout(arguments->fanout, file,
+									 arguments->backup->backup_mode == BACKUP_MODE_DIFF_DELTA,
+									 parse_program_version(arguments->backup->program_version));
+		else if (file->is_datafile && !file->is_cfs)
 		{
 			char		to_path[MAXPGPATH];
 
@@ -810,24 +1071,30 @@ restore_files(void *arg)
 			restore_data_file(to_path, file,
 							  arguments->backup->backup_mode == BACKUP_MODE_DIFF_DELTA,
 							  false,
-							  parse_program_version(arguments->backup->program_version));
+							  parse_program_version(arguments->backup->program_version),
+							  arguments->clone_files);
 		}
 		else if (file->external_dir_num)
 		{
 			char	   *external_path = parray_get(arguments->external_dirs,
 												   file->external_dir_num - 1);
 			if (backup_contains_external(external_path,
-										 arguments->dest_external_dirs))
+										 arguments->dest_external_dirs) &&
+				!(arguments->clone_files && clone_file(external_path, file)))
 				copy_file(FIO_BACKUP_HOST,
 						  external_path, FIO_DB_HOST, file, false);
 		}
+		else if (arguments->fanout)
+		{
+			/* Other files are read again by every writer */
+			restore_file_fanout(arguments->fanout, file, from_root, false);
+		}
 		else if (strcmp(file->name, "pg_control") == 0)
 			copy_pgcontrol_file(from_root, FIO_BACKUP_HOST,
-								instance_config.pgdata, FIO_DB_HOST,
-								file);
-		else
-			copy_file(FIO_BACKUP_HOST,
-					  instance_config.pgdata, FIO_DB_HOST,
+								instance_config.pgdata, FIO_DB_HOST, file);
+		else if (!(arguments->clone_files &&
+				   clone_file(instance_config.pgdata, file)))
+			copy_file(FIO_BACKUP_HOST, instance_config.pgdata, FIO_DB_HOST,
 					  file, false);
 
 		/* print size of restored file */
@@ -847,7 +1114,7 @@ restore_files(void *arg)
  * with given recovery target parameters
  */
 static void
-create_recovery_conf(time_t backup_id,
+create_recovery_conf(const char *pgdata, time_t backup_id,
 					 pgRecoveryTarget *rt,
 					 pgBackup *backup,
 					 pgRestoreParams *params)
@@ -907,18 +1174,18 @@ create_recovery_conf(time_t backup_id,
 		 * directive pointing to "probackup_recovery.conf".
 		 * If don`t do that, recovery will fail.
 		 */
-		pg12_recovery_config(backup, false);
+		pg12_recovery_config(pgdata, backup, false);
 		return;
 	}
 
 	elog(LOG, "----------------------------------------");
 #if PG_VERSION_NUM >= 120000
 	elog(LOG, "creating probackup_recovery.conf");
-	pg12_recovery_config(backup, true);
-	snprintf(path, lengthof(path), "%s/probackup_recovery.conf", instance_config.pgdata);
+	pg12_recovery_config(pgdata, backup, true);
+	snprintf(path, lengthof(path), "%s/probackup_recovery.conf", pgdata);
 #else
 	elog(LOG, "creating recovery.conf");
-	snprintf(path, lengthof(path), "%s/recovery.conf", instance_config.pgdata);
+	snprintf(path, lengthof(path), "%s/recovery.conf", pgdata);
 #endif
 
 	fp = fio_fopen(path, "w", FIO_DB_HOST);
@@ -1048,7 +1315,7 @@ create_recovery_conf(time_t backup_id,
 	if (pitr_requested)
 	{
 		elog(LOG, "creating recovery.signal file");
-		snprintf(path, lengthof(path), "%s/recovery.signal", instance_config.pgdata);
+		snprintf(path, lengthof(path), "%s/recovery.signal", pgdata);
 
 		fp = fio_fopen(path, "w", FIO_DB_HOST);
 		if (fp == NULL)
@@ -1064,7 +1331,7 @@ create_recovery_conf(time_t backup_id,
 	if (params->restore_as_replica)
 	{
 		elog(LOG, "creating standby.signal file");
-		snprintf(path, lengthof(path), "%s/standby.signal", instance_config.pgdata);
+		snprintf(path, lengthof(path), "%s/standby.signal", pgdata);
 
 		fp = fio_fopen(path, "w", FIO_DB_HOST);
 		if (fp == NULL)
@@ -1092,7 +1359,7 @@ create_recovery_conf(time_t backup_id,
  * we must always create empty probackup_recovery.conf file.
  */
 static void
-pg12_recovery_config(pgBackup *backup, bool add_include)
+pg12_recovery_config(const char *pgdata, pgBackup *backup, bool add_include)
 {
 #if PG_VERSION_NUM >= 120000
 	char		probackup_recovery_path[MAXPGPATH];
@@ -1106,7 +1373,7 @@ pg12_recovery_config(pgBackup *backup, bool add_include)
 		time2iso(current_time_str, lengthof(current_time_str), current_time);
 
 		snprintf(postgres_auto_path, lengthof(postgres_auto_path),
-					"%s/postgresql.auto.conf", instance_config.pgdata);
+					"%s/postgresql.auto.conf", pgdata);
 
 		fp = fio_fopen(postgres_auto_path, "a", FIO_DB_HOST);
 		if (fp == NULL)
@@ -1125,7 +1392,7 @@ pg12_recovery_config(pgBackup *backup, bool add_include)
 
 	/* Create empty probackup_recovery.conf */
 	snprintf(probackup_recovery_path, lengthof(probackup_recovery_path),
-		"%s/probackup_recovery.conf", instance_config.pgdata);
+		"%s/probackup_recovery.conf", pgdata);
 	fp = fio_fopen(probackup_recovery_path, "w", FIO_DB_HOST);
 	if (fp == NULL)
 		elog(ERROR, "cannot open file \"%s\": %s", probackup_recovery_path,
@@ -413,6 +413,10 @@ print_backup_json_object(PQExpBuffer buf, pgBackup *backup)
 		json_add_value(buf, "external-dirs", backup->external_dir_str,
 						json_level, true);
 
+	if (backup->mode_reason)
+		json_add_value(buf, "backup-mode-reason", backup->mode_reason,
+						json_level, true);
+
 	json_add_value(buf, "status", status2str(backup->status), json_level,
 					true);
 
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 
 #ifdef WIN32
@@ -10,11 +11,19 @@
 
 #include "pg_probackup.h"
 #include "file.h"
+#include "portability/instr_time.h"
 #include "storage/checksum.h"
 
 #define PRINTF_BUF_SIZE  1024
 #define FILE_PERMISSIONS 0600
-#define PAGE_READ_ATTEMPTS 100
+
+/*
+ * With --compress-location=auto, speeds are measured again after this number
+ * of segments compressed by the agent, and only on segments of at least
+ * COMPRESS_SPEED_MIN_BYTES.
+ */
+#define COMPRESS_LOCATION_PROBE_INTERVAL	16
+#define COMPRESS_SPEED_MIN_BYTES			(1024 * 1024)
 
 static __thread unsigned long fio_fdset = 0;
 static __thread void* fio_stdin_buffer;
@@ -22,6 +31,12 @@ static __thread int fio_stdout = 0;
 static __thread int fio_stdin = 0;
 static __thread int fio_stderr = 0;
 
+/* Speeds of the thread in bytes per second, measured for compress-location */
+static __thread double fio_recv_speed = 0;		/* receiving raw pages */
+static __thread double fio_compress_speed = 0;	/* compressing them here */
+static __thread int fio_source_segments = 0;	/* compressed by the agent
+												 * since the last measurement */
+
 fio_location MyLocation;
 
 typedef struct
@@ -32,9 +47,12 @@ typedef struct
 	uint32      checksumVersion;
 	int         calg;
 	int         clevel;
+	bool        copyInvalid; /* send invalid pages as is, see prepare_page() */
 } fio_send_request;
 
 
+static size_t fio_compress_page(fio_send_request* req, BlockNumber blknum, int rc, char* page, XLogRecPtr page_lsn, char* write_buffer);
+
 /* Convert FIO pseudo handle to index in file descriptor array */
 #define fio_fileno(f) (((size_t)f - 1) | FIO_PIPE_MARKER)
 
@@ -461,6 +479,26 @@ int fio_fflush(FILE* f)
 	return rc;
 }
 
+/*
+ * Flush stream data and start writing it to the disk without waiting for
+ * completion (does nothing for remote file). The file is not durable until
+ * it is synced by fio_sync() or fio_sync_tree().
+ */
+int fio_fflush_async(FILE* f)
+{
+	int rc = 0;
+	if (!fio_is_remote_file(f))
+	{
+		rc = fflush(f);
+#if defined(__linux__) && defined(SYNC_FILE_RANGE_WRITE)
+		/* It is only a hint, so ignore errors */
+		if (rc == 0)
+			(void) sync_file_range(fileno(f), 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+	}
+	return rc;
+}
+
 /* Sync file to the disk (does nothing for remote file) */
 int fio_flush(int fd)
 {
@@ -723,6 +761,32 @@ int fio_stat(char const* path, struct stat* st, bool follow_symlink, fio_locatio
 	}
 }
 
+/* Calculate CRC of the file at the side, where it is located */
+pg_crc32 fio_get_crc32(char const* path, bool use_crc32c, fio_location location)
+{
+	if (fio_is_remote(location))
+	{
+		fio_header hdr;
+		size_t path_len = strlen(path) + 1;
+		pg_crc32 crc = 0;
+
+		hdr.cop = FIO_GET_CRC32;
+		hdr.handle = -1;
+		hdr.arg = use_crc32c;
+		hdr.size = path_len;
+
+		IO_CHECK(fio_write_all(fio_stdout, &hdr, sizeof(hdr)), sizeof(hdr));
+		IO_CHECK(fio_write_all(fio_stdout, path, path_len), path_len);
+		IO_CHECK(fio_read_all(fio_stdin, &crc, sizeof(crc)), sizeof(crc));
+
+		return crc;
+	}
+	else
+	{
+		return pgFileGetCRC(path, use_crc32c, false, NULL, location);
+	}
+}
+
 /* Check presence of the file */
 int fio_access(char const* path, int mode, fio_location location)
 {
@@ -754,6 +818,202 @@ int fio_access(char const* path, int mode, fio_location location)
 	}
 }
 
+/*
+ * Sync regular file or directory to the disk.
+ */
+static int fio_sync_path(char const* path, bool is_dir)
+{
+	int fd;
+	int rc;
+	int errno_tmp;
+
+#ifdef WIN32
+	/* Directories cannot be synced on Windows */
+	if (is_dir)
+		return 0;
+#endif
+
+	fd = open(path, (is_dir ? O_RDONLY : O_RDWR) | PG_BINARY, 0);
+	if (fd < 0)
+		return -1;
+
+#ifdef HAVE_FDATASYNC
+	rc = is_dir ? fsync(fd) : fdatasync(fd);
+#else
+	rc = fsync(fd);
+#endif
+	errno_tmp = errno;
+	close(fd);
+	errno = errno_tmp;
+	return rc;
+}
+
+/*
+ * Sync all files and directories of the tree, directories are synced
+ * after their content.
+ */
+static int fio_sync_tree_walk(char const* path)
+{
+	DIR* dir;
+	struct dirent* entry;
+	char child[MAXPGPATH];
+	struct stat st;
+	int errno_tmp;
+
+	dir = opendir(path);
+	if (dir == NULL)
+		return -1;
+
+	while ((entry = readdir(dir)) != NULL)
+	{
+		int rc = 0;
+
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			continue;
+
+		join_path_components(child, path, entry->d_name);
+		if (lstat(child, &st) < 0)
+		{
+			/* File could have been removed concurrently */
+			if (errno == ENOENT)
+				continue;
+			rc = -1;
+		}
+		else if (S_ISDIR(st.st_mode))
+			rc = fio_sync_tree_walk(child);
+		else if (S_ISREG(st.st_mode))
+			rc = fio_sync_path(child, false);
+
+		if (rc < 0)
+		{
+			errno_tmp = errno;
+			closedir(dir);
+			errno = errno_tmp;
+			return -1;
+		}
+	}
+	closedir(dir);
+
+	return fio_sync_path(path, true);
+}
+
+static int fio_sync_impl(char const* path, bool tree)
+{
+	struct stat st;
+
+	if (tree)
+	{
+#if defined(__linux__)
+		/*
+		 * Sync the whole file system at once. It is much faster than syncing
+		 * files one by one, if there are a lot of them.
+		 */
+		int fd = open(path, O_RDONLY | PG_BINARY, 0);
+		int rc;
+		int errno_tmp;
+
+		if (fd < 0)
+			return -1;
+		rc = syncfs(fd);
+		errno_tmp = errno;
+		close(fd);
+		errno = errno_tmp;
+
+		if (rc == 0 || errno != ENOSYS)
+			return rc;
+#endif
+		return fio_sync_tree_walk(path);
+	}
+
+	if (stat(path, &st) < 0)
+		return -1;
+	return fio_sync_path(path, S_ISDIR(st.st_mode));
+}
+
+/* Sync file or directory to the disk */
+int fio_sync(char const* path, fio_location location)
+{
+	if (fio_is_remote(location))
+	{
+		fio_header hdr;
+		size_t path_len = strlen(path) + 1;
+		hdr.cop = FIO_SYNC;
+		hdr.handle = -1;
+		hdr.size = path_len;
+		hdr.arg = 0;
+
+		IO_CHECK(fio_write_all(fio_stdout, &hdr, sizeof(hdr)), sizeof(hdr));
+		IO_CHECK(fio_write_all(fio_stdout, path, path_len), path_len);
+
+		IO_CHECK(fio_read_all(fio_stdin, &hdr, sizeof(hdr)), sizeof(hdr));
+		Assert(hdr.cop == FIO_SYNC);
+
+		if (hdr.arg != 0)
+		{
+			errno = hdr.arg;
+			return -1;
+		}
+		return 0;
+	}
+	else
+	{
+		return fio_sync_impl(path, false);
+	}
+}
+
+/*
+ * Sync directory with all its content to the disk. Files written with
+ * fio_fflush_async() are made durable at once this way.
+ */
+int fio_sync_tree(char const* path, fio_location location)
+{
+	if (fio_is_remote(location))
+	{
+		fio_header hdr;
+		size_t path_len = strlen(path) + 1;
+		hdr.cop = FIO_SYNC;
+		hdr.handle = -1;
+		hdr.size = path_len;
+		hdr.arg = 1;
+
+		IO_CHECK(fio_write_all(fio_stdout, &hdr, sizeof(hdr)), sizeof(hdr));
+		IO_CHECK(fio_write_all(fio_stdout, path, path_len), path_len);
+
+		IO_CHECK(fio_read_all(fio_stdin, &hdr, sizeof(hdr)), sizeof(hdr));
+		Assert(hdr.cop == FIO_SYNC);
+
+		if (hdr.arg != 0)
+		{
+			errno = hdr.arg;
+			return -1;
+		}
+		return 0;
+	}
+	else
+	{
+		return fio_sync_impl(path, true);
+	}
+}
+
+/*
+ * Rename file so that after crash either old or new file is found with
+ * complete content: sync the file, rename it and sync the directory.
+ */
+int fio_durable_rename(char const* old_path, char const* new_path, fio_location location)
+{
+	char		dir[MAXPGPATH];
+
+	if (fio_sync(old_path, location) < 0)
+		return -1;
+
+	if (fio_rename(old_path, new_path, location) < 0)
+		return -1;
+
+	strlcpy(dir, new_path, sizeof(dir));
+	get_parent_directory(dir);
+	return fio_sync(dir, location);
+}
+
 /* Create symbolic link */
 int fio_symlink(char const* target, char const* link_path, fio_location location)
 {
@@ -1174,6 +1434,64 @@ static void fio_send_file(int out, char const* path)
 	}
 }
 
+/*
+ * Decide whether pages of the segment are compressed by the agent or on the
+ * backup host. In auto mode pages are compressed on the backup host while the
+ * agent delivers raw pages at least as fast as they are compressed here.
+ * Otherwise the network is the bottleneck, and the agent compresses pages to
+ * send less, but every COMPRESS_LOCATION_PROBE_INTERVAL segments raw pages are
+ * requested again to see if the network got faster.
+ */
+static bool fio_compress_on_target(int calg)
+{
+	if (calg != PGLZ_COMPRESS && calg != ZLIB_COMPRESS)
+		return false;
+
+	switch (instance_config.compress_location)
+	{
+		case COMPRESS_LOCATION_SOURCE:
+			return false;
+		case COMPRESS_LOCATION_TARGET:
+			return true;
+		case COMPRESS_LOCATION_AUTO:
+			break;
+	}
+
+	if (fio_compress_speed == 0 || fio_recv_speed >= fio_compress_speed ||
+		fio_source_segments >= COMPRESS_LOCATION_PROBE_INTERVAL)
+		return true;
+
+	fio_source_segments++;
+	return false;
+}
+
+/* Account speeds measured on the segment, compressed on the backup host */
+static void fio_update_compress_speed(uint64 recv_bytes, instr_time recv_time,
+									  uint64 compress_bytes, instr_time compress_time)
+{
+	double recv_secs = INSTR_TIME_GET_DOUBLE(recv_time);
+	double compress_secs = INSTR_TIME_GET_DOUBLE(compress_time);
+
+	if (compress_bytes < COMPRESS_SPEED_MIN_BYTES || recv_secs <= 0 || compress_secs <= 0)
+		return;
+
+	/* Smooth out the difference between segments */
+	if (fio_compress_speed == 0)
+	{
+		fio_recv_speed = recv_bytes / recv_secs;
+		fio_compress_speed = compress_bytes / compress_secs;
+	}
+	else
+	{
+		fio_recv_speed = (fio_recv_speed + recv_bytes / recv_secs) / 2;
+		fio_compress_speed = (fio_compress_speed + compress_bytes / compress_secs) / 2;
+	}
+	fio_source_segments = 0;
+
+	elog(VERBOSE, "Pages are received at %.0f kB/s and compressed at %.0f kB/s",
+		 fio_recv_speed / 1024, fio_compress_speed / 1024);
+}
+
 int fio_send_pages(FILE* in, FILE* out, pgFile *file,
 				   XLogRecPtr horizonLsn, BlockNumber* nBlocksSkipped, int calg, int clevel)
 {
@@ -1183,6 +1501,10 @@ int fio_send_pages(FILE* in, FILE* out, pgFile *file,
 	} req;
 	BlockNumber	n_blocks_read = 0;
 	BlockNumber blknum = 0;
+	bool compress_on_target = fio_compress_on_target(calg);
+	fio_send_request compress_req;
+	instr_time start_time, end_time, recv_time, compress_time;
+	uint64 recv_bytes = 0, compress_bytes = 0;
 
 	Assert(fio_is_remote_file(in));
 
@@ -1196,16 +1518,38 @@ int fio_send_pages(FILE* in, FILE* out, pgFile *file,
 	req.arg.checksumVersion = current.checksum_version;
 	req.arg.calg = calg;
 	req.arg.clevel = clevel;
+	req.arg.copyInvalid = IsNotMainFork(file);
+
+	/* Agent sends raw pages, which are compressed here as it would do */
+	compress_req = req.arg;
+	if (compress_on_target)
+		req.arg.calg = NONE_COMPRESS;
 
 	file->compress_alg = calg;
 
+	INSTR_TIME_SET_ZERO(recv_time);
+	INSTR_TIME_SET_ZERO(compress_time);
+
 	IO_CHECK(fio_write_all(fio_stdout, &req, sizeof(req)), sizeof(req));
 
 	while (true)
 	{
 		fio_header hdr;
 		char buf[BLCKSZ + sizeof(BackupPageHeader)];
+		char compressed_buf[BLCKSZ + sizeof(BackupPageHeader)];
+		char* write_buf = buf;
+		size_t write_size;
+
+		INSTR_TIME_SET_CURRENT(start_time);
 		IO_CHECK(fio_read_all(fio_stdin, &hdr, sizeof(hdr)), sizeof(hdr));
+
+		/* Invalid page is reported before it is sent as is */
+		if (hdr.cop == FIO_CHECK_PAGES)
+		{
+			elog(WARNING, "Invalid page in file \"%s\", block %u, it is copied as is",
+				 file->path, hdr.arg);
+			continue;
+		}
 		Assert(hdr.cop == FIO_PAGE);
 
 		if ((int)hdr.arg < 0) /* read error */
@@ -1219,17 +1563,38 @@ int fio_send_pages(FILE* in, FILE* out, pgFile *file,
 
 		Assert(hdr.size <= sizeof(buf));
 		IO_CHECK(fio_read_all(fio_stdin, buf, hdr.size), hdr.size);
+		write_size = hdr.size;
 
-		COMP_FILE_CRC32(true, file->crc, buf, hdr.size);
+		if (compress_on_target &&
+			((BackupPageHeader*)buf)->compressed_size == BLCKSZ)
+		{
+			INSTR_TIME_SET_CURRENT(end_time);
+			INSTR_TIME_ACCUM_DIFF(recv_time, end_time, start_time);
+			recv_bytes += hdr.size;
+
+			write_size = fio_compress_page(&compress_req, ((BackupPageHeader*)buf)->block, 1,
+										   buf + sizeof(BackupPageHeader), InvalidXLogRecPtr,
+										   compressed_buf);
+			write_buf = compressed_buf;
+
+			INSTR_TIME_SET_CURRENT(start_time);
+			INSTR_TIME_ACCUM_DIFF(compress_time, start_time, end_time);
+			compress_bytes += BLCKSZ;
+		}
+
+		if (inline_validate)
+			check_written_page(file, write_buf, current.checksum_version);
 
-		if (fio_fwrite(out, buf, hdr.size) != hdr.size)
+		COMP_FILE_CRC32(true, file->crc, write_buf, write_size);
+
+		if (fio_fwrite(out, write_buf, write_size) != write_size)
 		{
 			int	errno_tmp = errno;
 			fio_fclose(out);
 			elog(ERROR, "File: %s, cannot write backup at block %u: %s",
 				 file->path, blknum, strerror(errno_tmp));
 		}
-		file->write_size += hdr.size;
+		file->write_size += write_size;
 		n_blocks_read++;
 
 		if (((BackupPageHeader*)buf)->compressed_size == PageIsTruncated)
@@ -1238,102 +1603,355 @@ int fio_send_pages(FILE* in, FILE* out, pgFile *file,
 			break;
 		}
 	}
+
+	if (compress_on_target &&
+		instance_config.compress_location == COMPRESS_LOCATION_AUTO)
+		fio_update_compress_speed(recv_bytes, recv_time, compress_bytes, compress_time);
+
 	*nBlocksSkipped = blknum - n_blocks_read;
 	return blknum;
 }
 
+/*
+ * Check pages of the remote data file without transferring them.
+ * Corrupted blocks are reported by the agent one by one.
+ * Return number of corrupted blocks or -errno on read error.
+ */
+int fio_check_pages(FILE* in, pgFile *file, uint32 checksumVersion)
+{
+	struct {
+		fio_header hdr;
+		fio_send_request arg;
+	} req;
+	int n_corrupted = 0;
+
+	Assert(fio_is_remote_file(in));
+
+	elog(VERBOSE, "Pages of file \"%s\" are checked by remote agent", file->path);
+
+	memset(&req, 0, sizeof(req));
+	req.hdr.cop = FIO_CHECK_PAGES;
+	req.hdr.size = sizeof(fio_send_request);
+	req.hdr.handle = fio_fileno(in) & ~FIO_PIPE_MARKER;
+
+	req.arg.nblocks = file->size/BLCKSZ;
+	req.arg.segBlockNum = file->segno * RELSEG_SIZE;
+	req.arg.horizonLsn = InvalidXLogRecPtr;
+	req.arg.checksumVersion = checksumVersion;
+	req.arg.calg = NONE_COMPRESS;
+
+	IO_CHECK(fio_write_all(fio_stdout, &req, sizeof(req)), sizeof(req));
+
+	while (true)
+	{
+		fio_header hdr;
+		IO_CHECK(fio_read_all(fio_stdin, &hdr, sizeof(hdr)), sizeof(hdr));
+		Assert(hdr.size == 0);
+
+		if (hdr.cop == FIO_CHECK_PAGES)
+		{
+			if ((int)hdr.arg < 0) /* read error */
+				return (int)hdr.arg;
+			break;
+		}
+
+		Assert(hdr.cop == FIO_PAGE);
+		elog(WARNING, "Corruption detected in file \"%s\", block %u",
+			 file->path, hdr.arg);
+		n_corrupted++;
+	}
+	return n_corrupted;
+}
+
+/*
+ * Read a page of the file, sent by fio_send_pages_impl().
+ * Return 1 if the page is valid, 0 if the file is truncated,
+ * PAGE_CHECKSUM_MISMATCH if the page is not valid and -errno on read error.
+ */
+static int fio_read_page(int fd, fio_send_request* req, BlockNumber blknum, char* page, XLogRecPtr* page_lsn)
+{
+	ssize_t rc = pread(fd, page, BLCKSZ, blknum*BLCKSZ);
+
+	if (rc < 0)
+		return -errno;
+	if (rc == 0)
+		return 0;
+
+	if (rc == BLCKSZ)
+	{
+		if (!parse_page((Page)page, page_lsn))
+		{
+			int i;
+			for (i = 0; i < BLCKSZ && page[i] == 0; i++);
+
+			/* Page is zeroed. No need to check header and checksum. */
+			if (i == BLCKSZ)
+				return 1;
+		}
+		else if (!req->checksumVersion
+				 || pg_checksum_page(page, req->segBlockNum + blknum) == ((PageHeader)page)->pd_checksum)
+		{
+			return 1;
+		}
+	}
+	return PAGE_CHECKSUM_MISMATCH;
+}
+
+/*
+ * Put the page read by fio_read_page() with result rc into write_buffer,
+ * which must have room for BLCKSZ bytes and page header.
+ * Return size of data to send, 0 if the page is not changed since horizonLsn.
+ */
+static size_t fio_compress_page(fio_send_request* req, BlockNumber blknum, int rc, char* page, XLogRecPtr page_lsn, char* write_buffer)
+{
+	BackupPageHeader* bph = (BackupPageHeader*)write_buffer;
+	char compressed_page[BLCKSZ*2];
+	const char *errormsg = NULL;
+
+	bph->block = blknum;
+
+	if (rc == 0)
+	{
+		bph->compressed_size = PageIsTruncated;
+		return sizeof(BackupPageHeader);
+	}
+
+	/* horizonLsn is not 0 for delta backup. As far as unsigned number are always greater or equal than zero, there is no sense to add more checks */
+	if (page_lsn < req->horizonLsn && page_lsn != InvalidXLogRecPtr)
+		return 0;
+
+	bph->compressed_size = do_compress(compressed_page, sizeof(compressed_page),
+									   page, BLCKSZ, req->calg, req->clevel,
+									   &errormsg);
+	if (bph->compressed_size <= 0 || bph->compressed_size >= BLCKSZ)
+	{
+		/* Do not compress page */
+		memcpy(write_buffer + sizeof(BackupPageHeader), page, BLCKSZ);
+		bph->compressed_size = BLCKSZ;
+	}
+	else
+		memcpy(write_buffer + sizeof(BackupPageHeader), compressed_page, bph->compressed_size);
+
+	return sizeof(BackupPageHeader) + MAXALIGN(bph->compressed_size);
+}
+
+static void fio_send_page(int out, BlockNumber blknum, char* write_buffer, size_t size)
+{
+	fio_header hdr;
+
+	if (size == 0)
+		return;
+
+	hdr.cop = FIO_PAGE;
+	hdr.arg = blknum;
+	hdr.size = size;
+	IO_CHECK(fio_write_all(out, &hdr, sizeof(hdr)), sizeof(hdr));
+	IO_CHECK(fio_write_all(out, write_buffer, size), size);
+}
+
+/*
+ * Pages, which are not valid on the first read, are deferred the same way
+ * as backup_data_file() does, so that the agent goes on sending the following
+ * pages while PostgreSQL completes writing the page.
+ */
+
+/*
+ * Send pages from the beginning of the queue up to the first deferred one.
+ * Return false if the truncated page is sent and nothing else must be sent.
+ */
+static bool fio_send_deferred_pages(int out, DeferredPageQueue* deferred)
+{
+	DeferredPage* dpage;
+
+	while ((dpage = deferred_page_queue_pop(deferred)) != NULL)
+	{
+		fio_send_page(out, dpage->blknum, dpage->data, dpage->size);
+
+		if (dpage->size != 0 && ((BackupPageHeader*)dpage->data)->compressed_size == PageIsTruncated)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Reread the oldest deferred page. If force is true, reread it for all
+ * remaining attempts. Return false if transfer of the file is over, because
+ * the file is truncated or an error is sent.
+ */
+static bool fio_reread_deferred_page(int fd, int out, fio_send_request* req, DeferredPageQueue* deferred, bool force)
+{
+	DeferredPage* dpage = &deferred->pages[deferred->first];
+	char read_buffer[BLCKSZ];
+	XLogRecPtr page_lsn = InvalidXLogRecPtr;
+	int rc;
+
+	Assert(dpage->deferred);
+
+	do
+	{
+		rc = fio_read_page(fd, req, dpage->blknum, read_buffer, &page_lsn);
+		if (rc == PAGE_CHECKSUM_MISMATCH)
+			dpage->attempts--;
+	} while (rc == PAGE_CHECKSUM_MISMATCH && force && dpage->attempts > 0);
+
+	if (rc == PAGE_CHECKSUM_MISMATCH && dpage->attempts <= 0 && req->copyInvalid)
+	{
+		fio_header hdr;
+
+		hdr.cop = FIO_CHECK_PAGES;
+		hdr.arg = dpage->blknum;
+		hdr.size = 0;
+		IO_CHECK(fio_write_all(out, &hdr, sizeof(hdr)), sizeof(hdr));
+
+		/* LSN of invalid page is not trusted, so it is never skipped */
+		rc = 1;
+		page_lsn = InvalidXLogRecPtr;
+	}
+
+	if (rc < 0 && (rc != PAGE_CHECKSUM_MISMATCH || dpage->attempts <= 0))
+	{
+		fio_header hdr;
+
+		hdr.cop = FIO_PAGE;
+		hdr.arg = rc;
+		hdr.size = 0;
+		Assert((int)hdr.arg < 0);
+		IO_CHECK(fio_write_all(out, &hdr, sizeof(hdr)), sizeof(hdr));
+		return false;
+	}
+	if (rc == PAGE_CHECKSUM_MISMATCH)
+		return true;
+
+	dpage->deferred = false;
+	dpage->size = fio_compress_page(req, dpage->blknum, rc, read_buffer, page_lsn, dpage->data);
+	return fio_send_deferred_pages(out, deferred);
+}
+
 static void fio_send_pages_impl(int fd, int out, fio_send_request* req)
 {
 	BlockNumber blknum;
-	char read_buffer[BLCKSZ+1];
+	char read_buffer[BLCKSZ];
 	fio_header hdr;
+	DeferredPageQueue deferred;
 
-	hdr.cop = FIO_PAGE;
-	read_buffer[BLCKSZ] = 1; /* barrier */
+	memset(&deferred, 0, sizeof(deferred));
 
 	for (blknum = 0; blknum < req->nblocks; blknum++)
 	{
-		int retry_attempts = PAGE_READ_ATTEMPTS;
 		XLogRecPtr page_lsn = InvalidXLogRecPtr;
+		DeferredPage* dpage;
+		int rc = fio_read_page(fd, req, blknum, read_buffer, &page_lsn);
 
-		while (true)
+		if (rc < 0 && rc != PAGE_CHECKSUM_MISMATCH)
 		{
-			ssize_t rc = pread(fd, read_buffer, BLCKSZ, blknum*BLCKSZ);
-
-			if (rc <= 0)
-			{
-				if (rc < 0)
-				{
-					hdr.arg = -errno;
-					hdr.size = 0;
-					Assert((int)hdr.arg < 0);
-					IO_CHECK(fio_write_all(out, &hdr, sizeof(hdr)), sizeof(hdr));
-				}
-				else
-				{
-					BackupPageHeader bph;
-					bph.block = blknum;
-					bph.compressed_size = PageIsTruncated;
-					hdr.arg = blknum;
-					hdr.size = sizeof(bph);
-					IO_CHECK(fio_write_all(out, &hdr, sizeof(hdr)), sizeof(hdr));
-					IO_CHECK(fio_write_all(out, &bph, sizeof(bph)), sizeof(bph));
-				}
-				return;
-			}
-			else if (rc == BLCKSZ)
-			{
-				if (!parse_page((Page)read_buffer, &page_lsn))
-				{
-					int i;
-					for (i = 0; read_buffer[i] == 0; i++);
+			hdr.cop = FIO_PAGE;
+			hdr.arg = rc;
+			hdr.size = 0;
+			Assert((int)hdr.arg < 0);
+			IO_CHECK(fio_write_all(out, &hdr, sizeof(hdr)), sizeof(hdr));
+			goto Cleanup;
+		}
 
-					/* Page is zeroed. No need to check header and checksum. */
-					if (i == BLCKSZ)
-						break;
-				}
-				else if (!req->checksumVersion
-						 || pg_checksum_page(read_buffer, req->segBlockNum + blknum) == ((PageHeader)read_buffer)->pd_checksum)
-				{
-					break;
-				}
-			}
+		/* Nothing is deferred, so send the page right away */
+		if (rc != PAGE_CHECKSUM_MISMATCH && deferred.npages == 0)
+		{
+			char write_buffer[BLCKSZ + sizeof(BackupPageHeader)];
+			size_t size = fio_compress_page(req, blknum, rc, read_buffer, page_lsn, write_buffer);
 
-			if (--retry_attempts == 0)
-			{
-				hdr.size = 0;
-				hdr.arg = PAGE_CHECKSUM_MISMATCH;
-				IO_CHECK(fio_write_all(out, &hdr, sizeof(hdr)), sizeof(hdr));
-				return;
-			}
+			fio_send_page(out, blknum, write_buffer, size);
+			if (rc == 0) /* truncated */
+				goto Cleanup;
+			continue;
 		}
-		/* horizonLsn is not 0 for delta backup. As far as unsigned number are always greater or equal than zero, there is no sense to add more checks */
-		if (page_lsn >= req->horizonLsn || page_lsn == InvalidXLogRecPtr)
+
+		/* Make room for the page */
+		while (deferred_page_queue_full(&deferred))
 		{
-			char write_buffer[BLCKSZ*2];
-			BackupPageHeader* bph = (BackupPageHeader*)write_buffer;
-			const char *errormsg = NULL;
+			if (!fio_reread_deferred_page(fd, out, req, &deferred, true))
+				goto Cleanup;
+		}
 
-			hdr.arg = bph->block = blknum;
-			hdr.size = sizeof(BackupPageHeader);
+		dpage = deferred_page_queue_add(&deferred, blknum);
+		dpage->deferred = (rc == PAGE_CHECKSUM_MISMATCH);
+		if (!dpage->deferred)
+			dpage->size = fio_compress_page(req, blknum, rc, read_buffer, page_lsn, dpage->data);
 
-			bph->compressed_size = do_compress(write_buffer + sizeof(BackupPageHeader), sizeof(write_buffer) - sizeof(BackupPageHeader),
-											   read_buffer, BLCKSZ, req->calg, req->clevel,
-											   &errormsg);
-			if (bph->compressed_size <= 0 || bph->compressed_size >= BLCKSZ)
-			{
-				/* Do not compress page */
-				memcpy(write_buffer + sizeof(BackupPageHeader), read_buffer, BLCKSZ);
-				bph->compressed_size = BLCKSZ;
-			}
-			hdr.size += MAXALIGN(bph->compressed_size);
+		/* Deferred pages could have been sent to make room */
+		if (!fio_send_deferred_pages(out, &deferred))
+			goto Cleanup;
+
+		dpage = deferred_page_queue_retry(&deferred);
+		if (dpage != NULL &&
+			!fio_reread_deferred_page(fd, out, req, &deferred, dpage->attempts <= 1))
+			goto Cleanup;
 
+		if (rc == 0) /* truncated */
+			break;
+	}
+
+	/* Reread the remaining deferred pages */
+	while (deferred.npages > 0)
+	{
+		if (!fio_reread_deferred_page(fd, out, req, &deferred, true))
+			goto Cleanup;
+	}
+
+	hdr.cop = FIO_PAGE;
+	hdr.size = 0;
+	hdr.arg = blknum;
+	IO_CHECK(fio_write_all(out, &hdr, sizeof(hdr)), sizeof(hdr));
+
+  Cleanup:
+	deferred_page_queue_free(&deferred);
+}
+
+/*
+ * Check pages of the data file at the agent side, so that only numbers of
+ * corrupted blocks are sent back instead of the pages themselves.
+ * An invalid page is reread PAGE_READ_ATTEMPTS times before it is reported,
+ * as prepare_page() does, because it could be concurrently written by PostgreSQL.
+ */
+static void fio_check_pages_impl(int fd, int out, fio_send_request* req)
+{
+	BlockNumber blknum;
+	char read_buffer[BLCKSZ];
+	fio_header hdr;
+
+	for (blknum = 0; blknum < req->nblocks; blknum++)
+	{
+		XLogRecPtr page_lsn = InvalidXLogRecPtr;
+		int attempts = PAGE_READ_ATTEMPTS;
+		int rc;
+
+		do
+		{
+			rc = fio_read_page(fd, req, blknum, read_buffer, &page_lsn);
+		} while (rc == PAGE_CHECKSUM_MISMATCH && --attempts > 0);
+
+		if (rc == 0) /* truncated */
+			break;
+
+		if (rc == PAGE_CHECKSUM_MISMATCH)
+		{
+			hdr.cop = FIO_PAGE;
+			hdr.arg = blknum;
+			hdr.size = 0;
 			IO_CHECK(fio_write_all(out, &hdr, sizeof(hdr)), sizeof(hdr));
-			IO_CHECK(fio_write_all(out, write_buffer, hdr.size), hdr.size);
+		}
+		else if (rc < 0)
+		{
+			hdr.cop = FIO_CHECK_PAGES;
+			hdr.arg = rc;
+			hdr.size = 0;
+			Assert((int)hdr.arg < 0);
+			IO_CHECK(fio_write_all(out, &hdr, sizeof(hdr)), sizeof(hdr));
+			return;
 		}
 	}
-	hdr.size = 0;
+
+	hdr.cop = FIO_CHECK_PAGES;
 	hdr.arg = blknum;
+	hdr.size = 0;
 	IO_CHECK(fio_write_all(out, &hdr, sizeof(hdr)), sizeof(hdr));
 }
 
@@ -1352,6 +1970,7 @@ void fio_communicate(int in, int out)
 	char* buf = (char*)pgut_malloc(buf_size);
 	fio_header hdr;
 	struct stat st;
+	pg_crc32 crc;
 	int rc;
 
 #ifdef WIN32
@@ -1443,6 +2062,12 @@ void fio_communicate(int in, int out)
 			IO_CHECK(fio_write_all(out, &hdr, sizeof(hdr)), sizeof(hdr));
 			IO_CHECK(fio_write_all(out, &st, sizeof(st)), sizeof(st));
 			break;
+		  case FIO_SYNC: /* Sync file or directory tree to the disk */
+			rc = fio_sync_impl(buf, hdr.arg != 0);
+			hdr.arg = rc < 0 ? errno : 0;
+			hdr.size = 0;
+			IO_CHECK(fio_write_all(out, &hdr, sizeof(hdr)), sizeof(hdr));
+			break;
 		  case FIO_ACCESS: /* Check presence of file with specified name */
 			hdr.size = 0;
 			hdr.arg = access(buf, hdr.arg) < 0 ? errno  : 0;
@@ -1475,6 +2100,14 @@ void fio_communicate(int in, int out)
 			Assert(hdr.size == sizeof(fio_send_request));
 			fio_send_pages_impl(fd[hdr.handle], out, (fio_send_request*)buf);
 			break;
+		  case FIO_CHECK_PAGES:
+			Assert(hdr.size == sizeof(fio_send_request));
+			fio_check_pages_impl(fd[hdr.handle], out, (fio_send_request*)buf);
+			break;
+		  case FIO_GET_CRC32: /* Calculate CRC of the file */
+			crc = pgFileGetCRC(buf, hdr.arg, false, NULL, FIO_LOCAL_HOST);
+			IO_CHECK(fio_write_all(out, &crc, sizeof(crc)), sizeof(crc));
+			break;
 		  default:
 			Assert(false);
 		}
@@ -33,7 +33,10 @@ typedef enum
 	FIO_READDIR,
 	FIO_CLOSEDIR,
 	FIO_SEND_PAGES,
-	FIO_PAGE
+	FIO_PAGE,
+	FIO_GET_CRC32,
+	FIO_CHECK_PAGES,
+	FIO_SYNC
 } fio_operations;
 
 typedef enum
@@ -73,6 +76,7 @@ extern ssize_t fio_fread(FILE* f, void* buf, size_t size);
 extern int     fio_pread(FILE* f, void* buf, off_t offs);
 extern int     fio_fprintf(FILE* f, char const* arg, ...) pg_attribute_printf(2, 3);
 extern int     fio_fflush(FILE* f);
+extern int     fio_fflush_async(FILE* f);
 extern int     fio_fseek(FILE* f, off_t offs);
 extern int     fio_ftruncate(FILE* f, off_t size);
 extern int     fio_fclose(FILE* f);
@@ -82,6 +86,7 @@ extern void    fio_error(int rc, int size, char const* file, int line);
 struct pgFile;
 extern  int    fio_send_pages(FILE* in, FILE* out, struct pgFile *file, XLogRecPtr horizonLsn, 
 							  BlockNumber* nBlocksSkipped, int calg, int clevel);
+extern  int    fio_check_pages(FILE* in, struct pgFile *file, uint32 checksumVersion);
 
 extern int     fio_open(char const* name, int mode, fio_location location);
 extern ssize_t fio_write(int fd, void const* buf, size_t size);
@@ -94,6 +99,9 @@ extern int     fio_close(int fd);
 extern void    fio_disconnect(void);
 
 extern int     fio_rename(char const* old_path, char const* new_path, fio_location location);
+extern int     fio_durable_rename(char const* old_path, char const* new_path, fio_location location);
+extern int     fio_sync(char const* path, fio_location location);
+extern int     fio_sync_tree(char const* path, fio_location location);
 extern int     fio_symlink(char const* target, char const* link_path, fio_location location);
 extern int     fio_unlink(char const* path, fio_location location);
 extern int     fio_mkdir(char const* path, int mode, fio_location location);
@@ -103,6 +111,7 @@ extern int     fio_stat(char const* path, struct stat* st, bool follow_symlinks,
 extern DIR*    fio_opendir(char const* path, fio_location location);
 extern struct dirent * fio_readdir(DIR *dirp);
 extern int     fio_closedir(DIR *dirp);
+extern pg_crc32 fio_get_crc32(char const* path, bool use_crc32c, fio_location location);
 extern FILE*   fio_open_stream(char const* name, fio_location location);
 extern int     fio_close_stream(FILE* f);
 
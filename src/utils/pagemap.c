@@ -0,0 +1,356 @@
+/*-------------------------------------------------------------------------
+ *
+ * pagemap.c: compact set of block numbers of a relation segment.
+ *
+ * Copyright (c) 2019, Postgres Professional
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres_fe.h"
+
+#include "pagemap.h"
+#include "pgut.h"
+
+#define PAGEMAP_INITIAL_RUNS	16
+
+/* Size of a plain bitmap in bytes, needed to keep blocks up to blkno */
+#define BITMAP_SIZE(blkno)		((int) ((blkno) / 8 + 1))
+
+struct pagemap_iterator_t
+{
+	const pagemap_t *map;
+	int			run;		/* current run, not used for plain bitmap */
+	BlockNumber	nextblkno;	/* next block number to check */
+};
+
+static void pagemap_to_bitmap(pagemap_t *map);
+static void pagemap_bitmap_extend(pagemap_t *map, BlockNumber blkno);
+static void pagemap_bitmap_set_range(pagemap_t *map, BlockNumber start,
+									 BlockNumber len);
+static void pagemap_runs_add(pagemap_t *map, BlockNumber start,
+							 BlockNumber len);
+
+/*
+ * Add a block to the map.
+ */
+void
+pagemap_add(pagemap_t *map, BlockNumber blkno)
+{
+	pagemap_add_range(map, blkno, 1);
+}
+
+/*
+ * Add blocks [start, start + len) to the map.
+ */
+void
+pagemap_add_range(pagemap_t *map, BlockNumber start, BlockNumber len)
+{
+	if (len == 0)
+		return;
+
+	if (map->bitmap)
+		pagemap_bitmap_set_range(map, start, len);
+	else
+		pagemap_runs_add(map, start, len);
+}
+
+/*
+ * Merge a plain bitmap, i.e. ptrack map of a segment, into the map.
+ */
+void
+pagemap_add_bitmap(pagemap_t *map, const char *bitmap, int size)
+{
+	int			offset = 0;
+	BlockNumber	run_start = InvalidBlockNumber;
+	BlockNumber	blkno;
+
+	/* Bitmap to bitmap is just bitwise OR */
+	if (map->bitmap)
+	{
+		int			i;
+
+		/* Ignore trailing zero bytes, no need to extend the map for them */
+		while (size > 0 && bitmap[size - 1] == 0)
+			size--;
+
+		if (size == 0)
+			return;
+
+		pagemap_bitmap_extend(map, (BlockNumber) size * 8 - 1);
+		for (i = 0; i < size; i++)
+			map->bitmap[i] |= bitmap[i];
+		return;
+	}
+
+	while (offset < size)
+	{
+		unsigned char byte = (unsigned char) bitmap[offset];
+		int			bitno;
+
+		/* Fast path for empty and full bytes */
+		if (byte == 0 || byte == 0xFF)
+		{
+			blkno = (BlockNumber) offset * 8;
+
+			if (byte == 0 && run_start != InvalidBlockNumber)
+			{
+				pagemap_add_range(map, run_start, blkno - run_start);
+				run_start = InvalidBlockNumber;
+			}
+			else if (byte == 0xFF && run_start == InvalidBlockNumber)
+				run_start = blkno;
+
+			offset++;
+			continue;
+		}
+
+		for (bitno = 0; bitno < 8; bitno++)
+		{
+			blkno = (BlockNumber) offset * 8 + bitno;
+
+			if (byte & (1 << bitno))
+			{
+				if (run_start == InvalidBlockNumber)
+					run_start = blkno;
+			}
+			else if (run_start != InvalidBlockNumber)
+			{
+				pagemap_add_range(map, run_start, blkno - run_start);
+				run_start = InvalidBlockNumber;
+			}
+		}
+		offset++;
+	}
+
+	if (run_start != InvalidBlockNumber)
+		pagemap_add_range(map, run_start, (BlockNumber) size * 8 - run_start);
+}
+
+/*
+ * Add all blocks of another map to the map.
+ */
+void
+pagemap_union(pagemap_t *map, const pagemap_t *other)
+{
+	int			i;
+
+	if (other->bitmap)
+	{
+		pagemap_add_bitmap(map, other->bitmap, other->bitmapsize);
+		return;
+	}
+
+	for (i = 0; i < other->nruns; i++)
+		pagemap_add_range(map, other->runs[i].start, other->runs[i].len);
+}
+
+/*
+ * Return true if there are no blocks in the map.
+ */
+bool
+pagemap_is_empty(const pagemap_t *map)
+{
+	return map->bitmap == NULL && map->nruns == 0;
+}
+
+/*
+ * Release memory used by the map. The map is empty afterwards.
+ */
+void
+pagemap_free(pagemap_t *map)
+{
+	pg_free(map->runs);
+	pg_free(map->bitmap);
+	memset(map, 0, sizeof(pagemap_t));
+}
+
+/*
+ * Start iterating over blocks of the map in ascending order.
+ * Caller must free the iterator with pg_free().
+ */
+pagemap_iterator_t *
+pagemap_iterate(const pagemap_t *map)
+{
+	pagemap_iterator_t *iter = pgut_new(pagemap_iterator_t);
+
+	iter->map = map;
+	iter->run = 0;
+	iter->nextblkno = 0;
+
+	return iter;
+}
+
+/*
+ * Get next block number. Return false if there are no more blocks.
+ */
+bool
+pagemap_next(pagemap_iterator_t *iter, BlockNumber *blkno)
+{
+	const pagemap_t *map = iter->map;
+
+	if (map->bitmap)
+	{
+		BlockNumber	nblocks = (BlockNumber) map->bitmapsize * 8;
+
+		while (iter->nextblkno < nblocks)
+		{
+			BlockNumber	cur = iter->nextblkno;
+			unsigned char byte = (unsigned char) map->bitmap[cur / 8];
+
+			/* Skip empty bytes at once */
+			if (byte == 0 && cur % 8 == 0)
+			{
+				iter->nextblkno += 8;
+				continue;
+			}
+
+			iter->nextblkno++;
+			if (byte & (1 << (cur % 8)))
+			{
+				*blkno = cur;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	while (iter->run < map->nruns)
+	{
+		const pagemap_run *run = &map->runs[iter->run];
+
+		if (iter->nextblkno < run->start)
+			iter->nextblkno = run->start;
+
+		if (iter->nextblkno < run->start + run->len)
+		{
+			*blkno = iter->nextblkno++;
+			return true;
+		}
+		iter->run++;
+	}
+	return false;
+}
+
+/*
+ * Extend the bitmap to keep blocks up to blkno.
+ */
+static void
+pagemap_bitmap_extend(pagemap_t *map, BlockNumber blkno)
+{
+	int			newsize = BITMAP_SIZE(blkno);
+
+	if (newsize <= map->bitmapsize)
+		return;
+
+	/* Round up to multiple of 8 bytes, as datapagemap does */
+	newsize = (newsize + 7) & ~7;
+
+	map->bitmap = pgut_realloc(map->bitmap, newsize);
+	memset(map->bitmap + map->bitmapsize, 0, newsize - map->bitmapsize);
+	map->bitmapsize = newsize;
+}
+
+/*
+ * Set bits for blocks [start, start + len), extending the bitmap if needed.
+ */
+static void
+pagemap_bitmap_set_range(pagemap_t *map, BlockNumber start, BlockNumber len)
+{
+	BlockNumber	blkno;
+
+	pagemap_bitmap_extend(map, start + len - 1);
+
+	for (blkno = start; blkno < start + len; blkno++)
+		map->bitmap[blkno / 8] |= 1 << (blkno % 8);
+}
+
+/*
+ * Insert blocks [start, start + len) into the sorted array of runs, merging
+ * it with overlapping and adjacent runs. Switch to a plain bitmap if runs
+ * take more memory than the bitmap would.
+ */
+static void
+pagemap_runs_add(pagemap_t *map, BlockNumber start, BlockNumber len)
+{
+	BlockNumber	end = start + len;
+	int			lo = 0,
+				hi = map->nruns,
+				i;
+	pagemap_run *last;
+
+	/* Find the first run, which ends at or after the start of new one */
+	while (lo < hi)
+	{
+		int			mid = (lo + hi) / 2;
+
+		if (map->runs[mid].start + map->runs[mid].len < start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* Absorb all runs, which overlap or adjoin the new one */
+	for (i = lo; i < map->nruns && map->runs[i].start <= end; i++)
+	{
+		start = Min(start, map->runs[i].start);
+		end = Max(end, map->runs[i].start + map->runs[i].len);
+	}
+
+	if (i == lo)
+	{
+		/* Nothing to merge with, insert a new run */
+		if (map->nruns == map->maxruns)
+		{
+			map->maxruns = map->maxruns ? map->maxruns * 2 : PAGEMAP_INITIAL_RUNS;
+			map->runs = pgut_realloc(map->runs,
+									 map->maxruns * sizeof(pagemap_run));
+		}
+		memmove(&map->runs[lo + 1], &map->runs[lo],
+				(map->nruns - lo) * sizeof(pagemap_run));
+		map->nruns++;
+	}
+	else if (i - lo > 1)
+	{
+		/* Several runs are merged into one, close the gap */
+		memmove(&map->runs[lo + 1], &map->runs[i],
+				(map->nruns - i) * sizeof(pagemap_run));
+		map->nruns -= i - lo - 1;
+	}
+
+	map->runs[lo].start = start;
+	map->runs[lo].len = end - start;
+
+	/*
+	 * Few runs are always kept as is, otherwise a change of the first block
+	 * would turn the map into bitmap, which can grow large afterwards.
+	 */
+	last = &map->runs[map->nruns - 1];
+	if (map->nruns > PAGEMAP_INITIAL_RUNS &&
+		(Size) map->nruns * sizeof(pagemap_run) >
+		(Size) BITMAP_SIZE(last->start + last->len - 1))
+		pagemap_to_bitmap(map);
+}
+
+/*
+ * Convert array of runs to a plain bitmap.
+ */
+static void
+pagemap_to_bitmap(pagemap_t *map)
+{
+	pagemap_run *runs = map->runs;
+	int			nruns = map->nruns;
+	int			i;
+
+	map->runs = NULL;
+	map->nruns = 0;
+	map->maxruns = 0;
+
+	/* Runs are sorted, so the last one defines the size of bitmap */
+	pagemap_bitmap_extend(map, runs[nruns - 1].start + runs[nruns - 1].len - 1);
+
+	for (i = 0; i < nruns; i++)
+		pagemap_bitmap_set_range(map, runs[i].start, runs[i].len);
+
+	pg_free(runs);
+}
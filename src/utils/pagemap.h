@@ -0,0 +1,48 @@
+/*-------------------------------------------------------------------------
+ *
+ * pagemap.h: compact set of block numbers of a relation segment.
+ *
+ * Copyright (c) 2019, Postgres Professional
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PAGEMAP_H
+#define PAGEMAP_H
+
+#include "storage/block.h"
+
+/*
+ * Blocks are kept as a sorted array of runs while it takes less memory
+ * than a plain bitmap, which is the case for scattered changes as well as
+ * for long sequential ones. If runs become too fragmented, the map is
+ * converted to a plain bitmap with one bit per block.
+ */
+typedef struct pagemap_run
+{
+	BlockNumber	start;		/* first block of the run */
+	BlockNumber	len;		/* number of blocks in the run */
+} pagemap_run;
+
+typedef struct pagemap_t
+{
+	pagemap_run *runs;		/* sorted, non-overlapping and non-adjacent runs */
+	int			nruns;		/* number of runs in use */
+	int			maxruns;	/* number of runs allocated */
+	char	   *bitmap;		/* plain bitmap, NULL if runs are used */
+	int			bitmapsize;	/* size of bitmap in bytes */
+} pagemap_t;
+
+typedef struct pagemap_iterator_t pagemap_iterator_t;
+
+extern void pagemap_add(pagemap_t *map, BlockNumber blkno);
+extern void pagemap_add_range(pagemap_t *map, BlockNumber start, BlockNumber len);
+extern void pagemap_add_bitmap(pagemap_t *map, const char *bitmap, int size);
+extern void pagemap_union(pagemap_t *map, const pagemap_t *other);
+extern bool pagemap_is_empty(const pagemap_t *map);
+extern void pagemap_free(pagemap_t *map);
+
+extern pagemap_iterator_t *pagemap_iterate(const pagemap_t *map);
+extern bool pagemap_next(pagemap_iterator_t *iter, BlockNumber *blkno);
+
+#endif /* PAGEMAP_H */
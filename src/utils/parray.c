@@ -11,6 +11,10 @@
 
 #include "parray.h"
 #include "pgut.h"
+#include "thread.h"
+
+/* Arrays smaller than this are not worth to be sorted by several threads */
+#define PARALLEL_SORT_MIN_ITEMS	(64 * 1024)
 
 /* members of struct parray are hidden from client. */
 struct parray
@@ -184,6 +188,144 @@ parray_qsort(parray *array, int(*compare)(const void *, const void *))
 	qsort(array->data, array->used, sizeof(void *), compare);
 }
 
+typedef struct
+{
+	void	  **src;
+	void	  **dst;
+	size_t		start;		/* first item of the left run */
+	size_t		middle;		/* first item of the right run */
+	size_t		end;		/* item after the right run */
+	int			(*compare)(const void *, const void *);
+} parray_sort_arg;
+
+static void *
+parray_sort_worker(void *arg)
+{
+	parray_sort_arg *sarg = (parray_sort_arg *) arg;
+
+	qsort(sarg->src + sarg->start, sarg->end - sarg->start, sizeof(void *),
+		  sarg->compare);
+
+	return NULL;
+}
+
+/* Merge two sorted runs of src into dst */
+static void *
+parray_merge_worker(void *arg)
+{
+	parray_sort_arg *sarg = (parray_sort_arg *) arg;
+	size_t		l = sarg->start,
+				r = sarg->middle,
+				i = sarg->start;
+
+	while (l < sarg->middle && r < sarg->end)
+	{
+		/* Take the left item on equality to keep the merge stable */
+		if (sarg->compare(&sarg->src[r], &sarg->src[l]) < 0)
+			sarg->dst[i++] = sarg->src[r++];
+		else
+			sarg->dst[i++] = sarg->src[l++];
+	}
+	while (l < sarg->middle)
+		sarg->dst[i++] = sarg->src[l++];
+	while (r < sarg->end)
+		sarg->dst[i++] = sarg->src[r++];
+
+	return NULL;
+}
+
+/*
+ * Sort the array using up to nthreads threads: runs of the array are sorted
+ * by qsort() in parallel and then merged pairwise, pairs are merged in
+ * parallel too.
+ */
+void
+parray_qsort_parallel(parray *array, int(*compare)(const void *, const void *),
+					  int nthreads)
+{
+	pthread_t  *threads;
+	parray_sort_arg *args;
+	size_t	   *bounds;
+	void	  **src = array->data;
+	void	  **dst;
+	int			nruns = nthreads;
+	int			i;
+
+	if (nthreads <= 1 || array->used < PARALLEL_SORT_MIN_ITEMS)
+	{
+		parray_qsort(array, compare);
+		return;
+	}
+
+	threads = pgut_malloc(sizeof(pthread_t) * nruns);
+	args = pgut_malloc(sizeof(parray_sort_arg) * nruns);
+	bounds = pgut_malloc(sizeof(size_t) * (nruns + 1));
+	dst = pgut_malloc(sizeof(void *) * array->used);
+
+	for (i = 0; i <= nruns; i++)
+		bounds[i] = array->used * i / nruns;
+
+	/* Sort runs */
+	for (i = 0; i < nruns; i++)
+	{
+		args[i].src = array->data;
+		args[i].start = bounds[i];
+		args[i].end = bounds[i + 1];
+		args[i].compare = compare;
+		pthread_create(&threads[i], NULL, parray_sort_worker, &args[i]);
+	}
+	for (i = 0; i < nruns; i++)
+		pthread_join(threads[i], NULL);
+
+	/* Merge pairs of runs until the only run remains */
+	while (nruns > 1)
+	{
+		void	  **tmp;
+		int			nmerges = nruns / 2;
+
+		for (i = 0; i < nmerges; i++)
+		{
+			args[i].src = src;
+			args[i].dst = dst;
+			args[i].start = bounds[2 * i];
+			args[i].middle = bounds[2 * i + 1];
+			args[i].end = bounds[2 * i + 2];
+			args[i].compare = compare;
+			pthread_create(&threads[i], NULL, parray_merge_worker, &args[i]);
+		}
+
+		/* Odd run has no pair, just copy it */
+		if (nruns % 2 == 1)
+			memcpy(dst + bounds[nruns - 1], src + bounds[nruns - 1],
+				   sizeof(void *) * (bounds[nruns] - bounds[nruns - 1]));
+
+		for (i = 0; i < nmerges; i++)
+			pthread_join(threads[i], NULL);
+
+		for (i = 0; i < nmerges; i++)
+			bounds[i + 1] = bounds[2 * i + 2];
+		if (nruns % 2 == 1)
+			bounds[nmerges + 1] = bounds[nruns];
+		nruns = nmerges + nruns % 2;
+
+		tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+
+	/* Sorted items may be in the temporary buffer */
+	if (src != array->data)
+	{
+		memcpy(array->data, src, sizeof(void *) * array->used);
+		dst = src;
+	}
+
+	free(dst);
+	free(bounds);
+	free(args);
+	free(threads);
+}
+
 void
 parray_walk(parray *array, void (*action)(void *))
 {
@@ -28,6 +28,9 @@ extern void *parray_remove(parray *array, size_t index);
 extern bool parray_rm(parray *array, const void *key, int(*compare)(const void *, const void *));
 extern size_t parray_num(const parray *array);
 extern void parray_qsort(parray *array, int(*compare)(const void *, const void *));
+extern void parray_qsort_parallel(parray *array,
+								  int(*compare)(const void *, const void *),
+								  int nthreads);
 extern void *parray_bsearch(parray *array, const void *key, int(*compare)(const void *, const void *));
 extern void parray_walk(parray *array, void (*action)(void *));
 
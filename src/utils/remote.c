@@ -19,6 +19,9 @@
 #define ERR_BUF_SIZE        4096
 #define PIPE_SIZE           (64*1024)
 
+/* Host to launch agent of the current thread at, if not the remote host */
+static __thread char const* agent_host = NULL;
+
 static int split_options(int argc, char* argv[], int max_options, char* options)
 {
 	char* opt = options;
@@ -98,6 +101,15 @@ void launch_ssh(char* argv[])
 }
 #endif
 
+/*
+ * Connect agent of the current thread to another host, e.g. to a standby
+ * when data files are read from several standbys.
+ */
+void set_agent_host(char const* host)
+{
+	agent_host = host;
+}
+
 static bool needs_quotes(char const* path)
 {
 	return strchr(path, ' ') != NULL;
@@ -144,7 +156,7 @@ bool launch_agent(void)
 	ssh_argv[ssh_argc++] = "-o";
 	ssh_argv[ssh_argc++] = "LogLevel=error";
 
-	ssh_argv[ssh_argc++] = instance_config.remote.host;
+	ssh_argv[ssh_argc++] = agent_host ? (char*)agent_host : instance_config.remote.host;
 	ssh_argv[ssh_argc++] = cmd;
 	ssh_argv[ssh_argc] = NULL;
 
@@ -17,9 +17,15 @@
 
 static void *pgBackupValidateFiles(void *arg);
 static void do_validate_instance(void);
+static void do_validate_instance_wal(void);
+static void *validate_wal_segments(void *arg);
+static parray *read_wal_validation_cache(void);
+static void write_wal_validation_cache(parray *segments);
+static int wal_cache_entry_compare(const void *a, const void *b);
 
 static bool corrupted_backup_found = false;
 static bool skipped_due_to_lock = false;
+static bool corrupted_wal_found = false;
 
 typedef struct
 {
@@ -39,6 +45,36 @@ typedef struct
 	int			ret;
 } validate_files_arg;
 
+/* WAL segment of the archive to validate */
+typedef struct
+{
+	xlogFile   *wal_file;
+	TimeLineID	tli;
+	bool		cached;		/* validated by one of previous runs */
+	bool		valid;
+	bool		complete;	/* the last record is read from the next segment */
+} walSegment;
+
+/* WAL segment validated by one of previous runs */
+typedef struct
+{
+	char		name[MAXFNAMELEN];
+	int64		size;
+	time_t		mtime;
+} walValidationCacheEntry;
+
+typedef struct
+{
+	parray	   *segments;
+	int			thread_num;
+
+	/*
+	 * Return value from the thread.
+	 * 0 means there is no error, 1 - there is an error.
+	 */
+	int			ret;
+} validate_wal_arg;
+
 /*
  * Validate backup files.
  * TODO: partial validation.
@@ -350,10 +386,11 @@ pgBackupValidateFiles(void *arg)
  * If --instance option was provided, validate only backups of this instance.
  */
 int
-do_validate_all(void)
+do_validate_all(bool wal_only)
 {
 	corrupted_backup_found = false;
 	skipped_due_to_lock = false;
+	corrupted_wal_found = false;
 
 	if (instance_name == NULL)
 	{
@@ -405,14 +442,31 @@ do_validate_all(void)
 				continue;
 			}
 
-			do_validate_instance();
+			if (wal_only)
+				do_validate_instance_wal();
+			else
+				do_validate_instance();
 		}
 	}
+	else if (wal_only)
+		do_validate_instance_wal();
 	else
 	{
 		do_validate_instance();
 	}
 
+	if (wal_only)
+	{
+		if (corrupted_wal_found)
+		{
+			elog(WARNING, "WAL archive is not valid");
+			return 1;
+		}
+
+		elog(INFO, "WAL archive is valid");
+		return 0;
+	}
+
 	/* TODO: Probably we should have different exit code for every condition
 	 * and they combination:
 	 *  0 - all backups are valid
@@ -572,7 +626,7 @@ do_validate_instance(void)
 			{
 				pgBackup   *backup = (pgBackup *) parray_get(backups, j);
 
-				if (is_parent(current_backup->start_time, backup, false))
+				if (is_ancestor(current_backup, backup, false))
 				{
 					if (backup->status == BACKUP_STATUS_OK ||
 						backup->status == BACKUP_STATUS_DONE)
@@ -612,7 +666,7 @@ do_validate_instance(void)
 				//PAGE    OK <- we are here<-|
 				//FULL OK
 
-				if (is_parent(current_backup->start_time, backup, false))
+				if (is_ancestor(current_backup, backup, false))
 				{
 					/* Revalidation make sense only if parent chain is whole.
 					 * is_parent() do not guarantee that.
@@ -665,3 +719,275 @@ do_validate_instance(void)
 	parray_walk(backups, pgBackupFree);
 	parray_free(backups);
 }
+
+/*
+ * Validate all WAL segments in the archive of the instance. Each segment is
+ * read by one of threads. Segments validated by previous runs are skipped,
+ * if their size and modification time have not changed.
+ */
+static void
+do_validate_instance_wal(void)
+{
+	parray	   *tli_list;
+	parray	   *segments = parray_new();
+	parray	   *cache;
+	pthread_t  *threads;
+	validate_wal_arg *threads_args;
+	bool		validation_isok = true;
+	int			n_cached = 0;
+	int			n_corrupted = 0;
+	int			i,
+				j;
+
+	elog(INFO, "Validate WAL archive of instance '%s'", instance_name);
+
+	instance_config.name = instance_name;
+	tli_list = catalog_get_timelines(&instance_config);
+	cache = read_wal_validation_cache();
+
+	for (i = 0; i < parray_num(tli_list); i++)
+	{
+		timelineInfo *tlinfo = (timelineInfo *) parray_get(tli_list, i);
+		XLogSegNo	prev_segno = 0;
+
+		/* Gaps are found while the list of timelines is built */
+		for (j = 0; tlinfo->lost_segments && j < parray_num(tlinfo->lost_segments); j++)
+		{
+			xlogInterval *interval = (xlogInterval *) parray_get(tlinfo->lost_segments, j);
+			char		begin_segno[MAXFNAMELEN];
+			char		end_segno[MAXFNAMELEN];
+
+			GetXLogFileName(begin_segno, tlinfo->tli, interval->begin_segno,
+							instance_config.xlog_seg_size);
+			GetXLogFileName(end_segno, tlinfo->tli, interval->end_segno,
+							instance_config.xlog_seg_size);
+			elog(WARNING, "WAL segments between %s and %s are absent",
+				 begin_segno, end_segno);
+			corrupted_wal_found = true;
+		}
+
+		for (j = 0; j < parray_num(tlinfo->xlog_filelist); j++)
+		{
+			xlogFile   *wal_file = (xlogFile *) parray_get(tlinfo->xlog_filelist, j);
+			walSegment *segment;
+			walValidationCacheEntry key;
+			walValidationCacheEntry **entry;
+
+			/* Segment can be both compressed and not, read only one of them */
+			if (wal_file->type != SEGMENT || wal_file->segno == prev_segno)
+				continue;
+			prev_segno = wal_file->segno;
+
+			segment = pgut_new(walSegment);
+			segment->wal_file = wal_file;
+			segment->tli = tlinfo->tli;
+			segment->valid = true;
+			segment->complete = true;
+
+			strncpy(key.name, wal_file->file.name, MAXFNAMELEN);
+			entry = (walValidationCacheEntry **) parray_bsearch(cache, &key,
+																wal_cache_entry_compare);
+			segment->cached = entry != NULL &&
+				(*entry)->size == (int64) wal_file->file.size &&
+				(*entry)->mtime == wal_file->file.mtime;
+
+			if (segment->cached)
+				n_cached++;
+
+			pg_atomic_clear_flag(&wal_file->file.lock);
+			parray_append(segments, segment);
+		}
+	}
+
+	parray_walk(cache, pg_free);
+	parray_free(cache);
+
+	/* Validate segments */
+	threads = (pthread_t *) palloc(sizeof(pthread_t) * num_threads);
+	threads_args = (validate_wal_arg *) palloc(sizeof(validate_wal_arg) * num_threads);
+
+	thread_interrupted = false;
+	for (i = 0; i < num_threads; i++)
+	{
+		validate_wal_arg *arg = &(threads_args[i]);
+
+		arg->segments = segments;
+		arg->thread_num = i + 1;
+		/* By default there are some error */
+		arg->ret = 1;
+
+		pthread_create(&threads[i], NULL, validate_wal_segments, arg);
+	}
+
+	/* Wait threads */
+	for (i = 0; i < num_threads; i++)
+	{
+		pthread_join(threads[i], NULL);
+		if (threads_args[i].ret == 1)
+			validation_isok = false;
+	}
+	if (!validation_isok)
+		elog(ERROR, "WAL validation failed");
+
+	pfree(threads);
+	pfree(threads_args);
+
+	for (i = 0; i < parray_num(segments); i++)
+	{
+		walSegment *segment = (walSegment *) parray_get(segments, i);
+
+		if (!segment->valid)
+		{
+			elog(WARNING, "WAL segment \"%s\" is corrupted",
+				 segment->wal_file->file.name);
+			n_corrupted++;
+		}
+	}
+	if (n_corrupted > 0)
+		corrupted_wal_found = true;
+
+	write_wal_validation_cache(segments);
+
+	elog(INFO, "WAL segments of instance '%s' are validated: %lu total, %d skipped "
+		 "as already validated, %d corrupted", instance_name,
+		 (unsigned long) parray_num(segments), n_cached, n_corrupted);
+
+	/* cleanup */
+	parray_walk(segments, pg_free);
+	parray_free(segments);
+}
+
+/* Validate WAL segments, which are not validated by previous runs */
+static void *
+validate_wal_segments(void *arg)
+{
+	validate_wal_arg *arguments = (validate_wal_arg *) arg;
+	int			i;
+
+	for (i = 0; i < parray_num(arguments->segments); i++)
+	{
+		walSegment *segment = (walSegment *) parray_get(arguments->segments, i);
+
+		if (segment->cached)
+			continue;
+
+		if (!pg_atomic_test_set_flag(&segment->wal_file->file.lock))
+			continue;
+
+		/* check for interrupt */
+		if (interrupted || thread_interrupted)
+			elog(ERROR, "Interrupted during WAL validation");
+
+		if (progress)
+			elog(INFO, "Progress: (%d/%d). Validate WAL segment \"%s\"",
+				 i + 1, (int) parray_num(arguments->segments),
+				 segment->wal_file->file.name);
+
+		segment->valid = validate_wal_segment(arclog_path, segment->tli,
+											  segment->wal_file->segno,
+											  instance_config.xlog_seg_size,
+											  arguments->thread_num,
+											  &segment->complete);
+	}
+
+	/* WAL validation is successful */
+	arguments->ret = 0;
+
+	return NULL;
+}
+
+/*
+ * Read the list of WAL segments validated by previous runs, sorted by name.
+ */
+static parray *
+read_wal_validation_cache(void)
+{
+	parray	   *cache = parray_new();
+	char		path[MAXPGPATH];
+	char		buf[MAXPGPATH];
+	FILE	   *fp;
+
+	join_path_components(path, backup_instance_path, WAL_VALIDATION_CACHE_FILE);
+	if (!fileExists(path, FIO_BACKUP_HOST))
+		return cache;
+
+	fp = fio_open_stream(path, FIO_BACKUP_HOST);
+	if (fp == NULL)
+		elog(ERROR, "Cannot open \"%s\": %s", path, strerror(errno));
+
+	while (fgets(buf, lengthof(buf), fp))
+	{
+		walValidationCacheEntry *entry = pgut_new(walValidationCacheEntry);
+		int64		mtime;
+
+		if (sscanf(buf, "%63s " INT64_FORMAT " " INT64_FORMAT,
+				   entry->name, &entry->size, &mtime) != 3)
+		{
+			/* The cache can be simply rebuilt */
+			elog(WARNING, "Invalid line in \"%s\", ignore the file: %s", path, buf);
+			pg_free(entry);
+			parray_walk(cache, pg_free);
+			parray_free(cache);
+			fio_close_stream(fp);
+			return parray_new();
+		}
+		entry->mtime = (time_t) mtime;
+		parray_append(cache, entry);
+	}
+	fio_close_stream(fp);
+
+	parray_qsort(cache, wal_cache_entry_compare);
+
+	return cache;
+}
+
+/*
+ * Remember valid WAL segments. Segments, whose last record could not be read
+ * because the next segment is absent yet, are validated again next time.
+ */
+static void
+write_wal_validation_cache(parray *segments)
+{
+	char		path[MAXPGPATH];
+	char		path_temp[MAXPGPATH];
+	FILE	   *out;
+	int			i;
+
+	join_path_components(path, backup_instance_path, WAL_VALIDATION_CACHE_FILE);
+	snprintf(path_temp, sizeof(path_temp), "%s.tmp", path);
+
+	out = fio_fopen(path_temp, PG_BINARY_W, FIO_BACKUP_HOST);
+	if (out == NULL)
+		elog(ERROR, "Cannot open file \"%s\": %s", path_temp,
+			 strerror(errno));
+
+	for (i = 0; i < parray_num(segments); i++)
+	{
+		walSegment *segment = (walSegment *) parray_get(segments, i);
+
+		if (!segment->valid || !segment->complete)
+			continue;
+
+		fio_fprintf(out, "%s " INT64_FORMAT " " INT64_FORMAT "\n",
+					segment->wal_file->file.name,
+					(int64) segment->wal_file->file.size,
+					(int64) segment->wal_file->file.mtime);
+	}
+
+	if (fio_fflush(out) || fio_fclose(out))
+		elog(ERROR, "Cannot write file \"%s\": %s", path_temp,
+			 strerror(errno));
+
+	if (fio_durable_rename(path_temp, path, FIO_BACKUP_HOST) < 0)
+		elog(ERROR, "Cannot rename file \"%s\" to \"%s\": %s",
+			 path_temp, path, strerror(errno));
+}
+
+static int
+wal_cache_entry_compare(const void *a, const void *b)
+{
+	walValidationCacheEntry *entry_a = *(walValidationCacheEntry **) a;
+	walValidationCacheEntry *entry_b = *(walValidationCacheEntry **) b;
+
+	return strcmp(entry_a->name, entry_b->name);
+}
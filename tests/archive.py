@@ -1117,6 +1117,181 @@ class ArchiveTest(ProbackupTest, unittest.TestCase):
         pg_receivexlog.kill()
         self.del_test_dir(module_name, fname)
 
+    # @unittest.expectedFailure
+    # @unittest.skip("skip")
+    def test_archive_receive(self):
+        """Test backup with archive-receive wal delivery method"""
+        fname = self.id().split('.')[3]
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+        node = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node'),
+            set_replication=True,
+            initdb_params=['--data-checksums'],
+            pg_options={
+                'checkpoint_timeout': '30s'})
+
+        self.init_pb(backup_dir)
+        self.add_instance(backup_dir, 'node', node)
+        node.slow_start()
+        if self.get_version(node) < self.version_to_num('10.0'):
+            return unittest.skip('You need PostgreSQL >= 10 for this test')
+
+        node.safe_psql(
+            "postgres",
+            "SELECT pg_create_physical_replication_slot('slot_1')")
+
+        archive_receive = self.run_binary(
+            [
+                self.probackup_path, 'archive-receive',
+                '-B', backup_dir, '--instance=node',
+                '-S', 'slot_1', '--compress',
+                '-d', 'postgres', '-p', str(node.port)
+            ], asynchronous=True)
+
+        if archive_receive.returncode:
+            self.assertFalse(
+                True,
+                'Failed to start archive-receive: {0}'.format(
+                    archive_receive.communicate()[1]))
+
+        node.safe_psql(
+            "postgres",
+            "create table t_heap as select i as id, md5(i::text) as text, "
+            "md5(repeat(i::text,10))::tsvector as tsvector "
+            "from generate_series(0,10000) i")
+
+        self.backup_node(backup_dir, 'node', node)
+
+        # PAGE
+        node.safe_psql(
+            "postgres",
+            "insert into t_heap select i as id, md5(i::text) as text, "
+            "md5(repeat(i::text,10))::tsvector as tsvector "
+            "from generate_series(10000,20000) i")
+
+        self.backup_node(
+            backup_dir, 'node', node,
+            backup_type='page')
+
+        result = node.safe_psql("postgres", "SELECT * FROM t_heap")
+        self.validate_pb(backup_dir)
+
+        # Finished segments are compressed, current one is partial
+        wals = os.listdir(os.path.join(backup_dir, 'wal', 'node'))
+        self.assertTrue(any(wal.endswith('.gz') for wal in wals))
+        self.assertTrue(any(wal.endswith('.partial') for wal in wals))
+
+        # Check data correctness
+        node.cleanup()
+        self.restore_node(backup_dir, 'node', node)
+        node.slow_start()
+
+        self.assertEqual(
+            result, node.safe_psql("postgres", "SELECT * FROM t_heap"),
+            'data after restore not equal to original data')
+
+        # Clean after yourself
+        archive_receive.kill()
+        self.del_test_dir(module_name, fname)
+
+    # @unittest.expectedFailure
+    # @unittest.skip("skip")
+    def test_archive_daemon(self):
+        """Test backup with archive-push via archive-daemon"""
+        fname = self.id().split('.')[3]
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+        node = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node'),
+            set_replication=True,
+            initdb_params=['--data-checksums'],
+            pg_options={
+                'checkpoint_timeout': '30s'})
+
+        # Socket path is limited in length, so keep it short
+        socket_path = '/tmp/.s.pg_probackup.{0}'.format(fname)
+
+        self.init_pb(backup_dir)
+        self.add_instance(backup_dir, 'node', node)
+        self.set_archiving(backup_dir, 'node', node, compress=True)
+        self.set_auto_conf(
+            node,
+            {'archive_command': '"{0}" archive-push -B {1} --instance=node '
+                '--via-daemon --daemon-socket={2} '
+                '--wal-file-path=%p --wal-file-name=%f'.format(
+                    self.probackup_path, backup_dir, socket_path)})
+
+        archive_daemon = self.run_binary(
+            [
+                self.probackup_path, 'archive-daemon',
+                '-B', backup_dir, '--instance=node', '--compress', '-j', '2',
+                '--daemon-socket={0}'.format(socket_path)
+            ], asynchronous=True)
+
+        if archive_daemon.returncode:
+            self.assertFalse(
+                True,
+                'Failed to start archive-daemon: {0}'.format(
+                    archive_daemon.communicate()[1]))
+
+        node.slow_start()
+
+        node.safe_psql(
+            "postgres",
+            "create table t_heap as select i as id, md5(i::text) as text, "
+            "md5(repeat(i::text,10))::tsvector as tsvector "
+            "from generate_series(0,10000) i")
+
+        self.backup_node(backup_dir, 'node', node)
+
+        # PAGE
+        node.safe_psql(
+            "postgres",
+            "insert into t_heap select i as id, md5(i::text) as text, "
+            "md5(repeat(i::text,10))::tsvector as tsvector "
+            "from generate_series(10000,20000) i")
+
+        self.backup_node(
+            backup_dir, 'node', node,
+            backup_type='page')
+
+        result = node.safe_psql("postgres", "SELECT * FROM t_heap")
+        self.validate_pb(backup_dir)
+
+        # Socket of running daemon must not be stolen
+        try:
+            self.run_pb([
+                'archive-daemon', '-B', backup_dir, '--instance=node',
+                '--daemon-socket={0}'.format(socket_path)])
+            # we should die here because exception is what we expect to happen
+            self.assertEqual(
+                1, 0,
+                "Expecting Error because archive daemon is already running.\n "
+                "Output: {0} \n CMD: {1}".format(
+                    repr(self.output), self.cmd))
+        except ProbackupException as e:
+            self.assertIn(
+                'ERROR: Archive daemon is already running on socket',
+                e.message,
+                '\n Unexpected Error Message: {0}\n CMD: {1}'.format(
+                    repr(e.message), self.cmd))
+
+        # Segments are compressed by the daemon
+        wals = os.listdir(os.path.join(backup_dir, 'wal', 'node'))
+        self.assertTrue(any(wal.endswith('.gz') for wal in wals))
+
+        # Check data correctness
+        node.cleanup()
+        self.restore_node(backup_dir, 'node', node)
+        node.slow_start()
+
+        self.assertEqual(
+            result, node.safe_psql("postgres", "SELECT * FROM t_heap"),
+            'data after restore not equal to original data')
+
+        # Clean after yourself
+        archive_daemon.kill()
+        self.del_test_dir(module_name, fname)
+
     # @unittest.expectedFailure
     # @unittest.skip("skip")
     def test_archive_catalog(self):
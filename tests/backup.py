@@ -115,6 +115,57 @@ class BackupTest(ProbackupTest, unittest.TestCase):
         # Clean after yourself
         self.del_test_dir(module_name, fname)
 
+    # @unittest.skip("skip")
+    def test_backup_mode_auto(self):
+        """
+        make node with archiving, take backups with --backup-mode=auto,
+        check that FULL is taken first, then PAGE after a small change
+        and FULL again after most of data is changed
+        """
+        fname = self.id().split('.')[3]
+        node = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node'),
+            initdb_params=['--data-checksums'])
+
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+        self.init_pb(backup_dir)
+        self.add_instance(backup_dir, 'node', node)
+        self.set_archiving(backup_dir, 'node', node)
+        node.slow_start()
+
+        # there are no backups yet
+        backup_id = self.backup_node(backup_dir, 'node', node, backup_type='auto')
+        show_backup = self.show_pb(backup_dir, 'node', backup_id)
+        self.assertEqual(show_backup['backup-mode'], "FULL")
+        self.assertIn('no valid backup', show_backup['backup-mode-reason'])
+
+        # small change
+        node.safe_psql(
+            "postgres",
+            "create table t_heap as select i as id "
+            "from generate_series(0,100) i")
+
+        backup_id = self.backup_node(backup_dir, 'node', node, backup_type='auto')
+        show_backup = self.show_pb(backup_dir, 'node', backup_id)
+        self.assertEqual(show_backup['backup-mode'], "PAGE")
+        self.assertIn('estimated by WAL volume', show_backup['backup-mode-reason'])
+
+        # most of data is changed
+        node.safe_psql(
+            "postgres",
+            "insert into t_heap select i as id "
+            "from generate_series(0,2000000) i")
+
+        backup_id = self.backup_node(backup_dir, 'node', node, backup_type='auto')
+        show_backup = self.show_pb(backup_dir, 'node', backup_id)
+        self.assertEqual(show_backup['backup-mode'], "FULL")
+        self.assertIn(
+            'incremental backup would cost as much as FULL',
+            show_backup['backup-mode-reason'])
+
+        # Clean after yourself
+        self.del_test_dir(module_name, fname)
+
     # @unittest.skip("skip")
     def test_incremental_backup_without_full(self):
         """page-level backup without validated full backup"""
@@ -2400,3 +2451,294 @@ class BackupTest(ProbackupTest, unittest.TestCase):
 
         # Clean after yourself
         self.del_test_dir(module_name, fname)
+
+    # @unittest.skip("skip")
+    def test_skip_unchanged_nondata_files(self):
+        """
+        Non-data files with the same size and mtime as in the previous
+        backup must be skipped without reading, unless --paranoid is used
+        """
+        fname = self.id().split('.')[3]
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+        node = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node'),
+            set_replication=True,
+            initdb_params=['--data-checksums'])
+
+        self.init_pb(backup_dir)
+        self.add_instance(backup_dir, 'node', node)
+        node.slow_start()
+
+        external_dir = self.get_tblspace_path(node, 'external_dir')
+        os.mkdir(external_dir)
+
+        file_path = os.path.join(external_dir, 'file')
+        with open(file_path, 'w') as f:
+            f.write('A' * 8192)
+            f.flush()
+            f.close()
+
+        stat = os.stat(file_path)
+
+        sleep(1)
+
+        # FULL backup
+        self.backup_node(
+            backup_dir, 'node', node,
+            options=['--stream', '-E', external_dir])
+
+        # Change content, but keep size and mtime
+        with open(file_path, 'w') as f:
+            f.write('B' * 8192)
+            f.flush()
+            f.close()
+
+        os.utime(file_path, (stat.st_atime, stat.st_mtime))
+
+        backup_id = self.backup_node(
+            backup_dir, 'node', node, backup_type='delta',
+            options=['--stream', '-E', external_dir])
+
+        filelist = self.get_backup_filelist(backup_dir, 'node', backup_id)
+
+        self.assertEqual(filelist['file']['size'], '-1')
+        self.assertEqual(filelist['file']['mtime'], str(int(stat.st_mtime)))
+        self.assertEqual(filelist['file']['full_size'], '8192')
+
+        backup_id = self.backup_node(
+            backup_dir, 'node', node, backup_type='delta',
+            options=['--stream', '-E', external_dir, '--paranoid'])
+
+        filelist = self.get_backup_filelist(backup_dir, 'node', backup_id)
+
+        self.assertNotEqual(filelist['file']['size'], '-1')
+
+        # Clean after yourself
+        self.del_test_dir(module_name, fname)
+
+    # @unittest.skip("skip")
+    def test_backup_stripe_paths(self):
+        """
+        Data files are spread across stripe paths and linked from
+        the backup directory, restore, merge and delete handle them
+        """
+        fname = self.id().split('.')[3]
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+        stripe1 = os.path.join(self.tmp_path, module_name, fname, 'stripe1')
+        stripe2 = os.path.join(self.tmp_path, module_name, fname, 'stripe2')
+        node = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node'),
+            set_replication=True,
+            initdb_params=['--data-checksums'])
+
+        self.init_pb(backup_dir)
+        self.add_instance(backup_dir, 'node', node)
+        self.set_config(
+            backup_dir, 'node',
+            options=['--stripe-paths={0}:{1}'.format(stripe1, stripe2)])
+        node.slow_start()
+
+        node.pgbench_init(scale=2)
+
+        full_id = self.backup_node(
+            backup_dir, 'node', node, options=['--stream', '-j', '4'])
+
+        database_path = os.path.join(
+            backup_dir, 'backups', 'node', full_id, 'database')
+
+        links = []
+        for root, dirs, files in os.walk(database_path):
+            for file in files:
+                path = os.path.join(root, file)
+                if os.path.islink(path):
+                    links.append(os.readlink(path))
+
+        self.assertTrue(
+            any(link.startswith(stripe1) for link in links))
+        self.assertTrue(
+            any(link.startswith(stripe2) for link in links))
+
+        pgbench = node.pgbench(options=['-T', '5', '-c', '2', '--no-vacuum'])
+        pgbench.wait()
+
+        page_id = self.backup_node(
+            backup_dir, 'node', node, backup_type='page',
+            options=['--stream', '-j', '4'])
+
+        self.validate_pb(backup_dir, 'node')
+
+        pgdata = self.pgdata_content(node.data_dir)
+
+        self.merge_backup(backup_dir, 'node', page_id, options=['-j', '4'])
+
+        node.cleanup()
+        self.restore_node(backup_dir, 'node', node, options=['-j', '4'])
+
+        pgdata_restored = self.pgdata_content(node.data_dir)
+        self.compare_pgdata(pgdata, pgdata_restored)
+
+        # Nothing is left on stripe paths after delete
+        self.delete_pb(backup_dir, 'node', page_id)
+
+        self.assertEqual(os.listdir(os.path.join(stripe1, 'node')), [])
+        self.assertEqual(os.listdir(os.path.join(stripe2, 'node')), [])
+
+        # Clean after yourself
+        self.del_test_dir(module_name, fname)
+
+    # @unittest.skip("skip")
+    def test_backup_all(self):
+        """
+        Backups of several instances are taken by backup-all
+        in the order of the schedule, sharing threads
+        """
+        fname = self.id().split('.')[3]
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+        self.init_pb(backup_dir)
+
+        nodes = []
+        for name in ['node1', 'node2', 'node3']:
+            node = self.make_simple_node(
+                base_dir=os.path.join(module_name, fname, name),
+                set_replication=True,
+                initdb_params=['--data-checksums'])
+            self.add_instance(backup_dir, name, node)
+            self.set_config(
+                backup_dir, name,
+                options=['-p', str(node.port), '-d', 'postgres'])
+            node.slow_start()
+            nodes.append(node)
+
+        schedule = os.path.join(
+            self.tmp_path, module_name, fname, 'schedule')
+        with open(schedule, 'w') as f:
+            f.write(
+                '# comment\n'
+                'node2 FULL 2\n'
+                '\n'
+                'node1\n'
+                'node3 full\n')
+
+        output = self.run_pb([
+            'backup-all', '-B', backup_dir, '-b', 'FULL',
+            '--schedule={0}'.format(schedule), '-j', '3', '--stream'],
+            return_id=False)
+
+        self.assertIn('All backups completed', output)
+
+        for name in ['node1', 'node2', 'node3']:
+            backups = self.show_pb(backup_dir, name)
+            self.assertEqual(len(backups), 1)
+            self.assertEqual(backups[0]['status'], 'OK')
+            self.assertEqual(backups[0]['backup-mode'], 'FULL')
+
+        # All instances of the catalog are backed up without schedule,
+        # options of backup command are passed to each backup
+        output = self.run_pb([
+            'backup-all', '-B', backup_dir, '-b', 'DELTA',
+            '-j', '2', '--stream', '--compress', '--ttl=1d'],
+            return_id=False)
+
+        for name in ['node1', 'node2', 'node3']:
+            backups = self.show_pb(backup_dir, name)
+            self.assertEqual(len(backups), 2)
+            self.assertEqual(backups[1]['status'], 'OK')
+            self.assertEqual(backups[1]['backup-mode'], 'DELTA')
+            self.assertEqual(backups[1]['compress-alg'], 'zlib')
+            self.assertIn('expire-time', backups[1])
+
+        # Failed backup is reported, the others are taken anyway
+        nodes[0].stop()
+
+        try:
+            self.run_pb([
+                'backup-all', '-B', backup_dir, '-b', 'DELTA',
+                '-j', '2', '--stream'],
+                return_id=False)
+            self.assertEqual(
+                1, 0,
+                "Expecting Error because instance node1 is stopped.\n "
+                "Output: {0} \n CMD: {1}".format(
+                    repr(self.output), self.cmd))
+        except ProbackupException as e:
+            self.assertIn(
+                'ERROR: 1 backups failed', e.message,
+                '\n Unexpected Error Message: {0}\n CMD: {1}'.format(
+                    repr(e.message), self.cmd))
+
+        self.assertEqual(len(self.show_pb(backup_dir, 'node2')), 3)
+        self.assertEqual(len(self.show_pb(backup_dir, 'node3')), 3)
+
+        # Clean after yourself
+        self.del_test_dir(module_name, fname)
+
+    # @unittest.skip("skip")
+    def test_backup_inline_validate(self):
+        """
+        Backup taken with --inline-validate or --read-back gets OK status
+        without validation after backup, and can be validated and restored
+        """
+        fname = self.id().split('.')[3]
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+        node = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node'),
+            set_replication=True,
+            initdb_params=['--data-checksums'])
+
+        self.init_pb(backup_dir)
+        self.add_instance(backup_dir, 'node', node)
+        node.slow_start()
+
+        node.pgbench_init(scale=2)
+
+        output = self.backup_node(
+            backup_dir, 'node', node,
+            options=['--stream', '-j', '4', '--inline-validate',
+                     '--compress'],
+            return_id=False)
+
+        self.assertIn('data files are validated during backup', output)
+        self.assertNotIn('Validating backup', output)
+
+        pgbench = node.pgbench(options=['-T', '5', '-c', '2', '--no-vacuum'])
+        pgbench.wait()
+
+        output = self.backup_node(
+            backup_dir, 'node', node, backup_type='delta',
+            options=['--stream', '-j', '4', '--read-back'],
+            return_id=False)
+
+        self.assertIn('data files are validated during backup', output)
+        self.assertNotIn('Validating backup', output)
+
+        for backup in self.show_pb(backup_dir, 'node'):
+            self.assertEqual(backup['status'], 'OK')
+
+        self.validate_pb(backup_dir, 'node')
+
+        pgdata = self.pgdata_content(node.data_dir)
+
+        node.cleanup()
+        self.restore_node(backup_dir, 'node', node, options=['-j', '4'])
+
+        pgdata_restored = self.pgdata_content(node.data_dir)
+        self.compare_pgdata(pgdata, pgdata_restored)
+
+        try:
+            self.backup_node(
+                backup_dir, 'node', node,
+                options=['--stream', '--read-back', '--no-validate'])
+            self.assertEqual(
+                1, 0,
+                "Expecting Error because of incompatible options.\n "
+                "Output: {0} \n CMD: {1}".format(
+                    repr(self.output), self.cmd))
+        except ProbackupException as e:
+            self.assertIn(
+                'ERROR: You cannot specify --inline-validate or --read-back '
+                'together with --no-validate', e.message,
+                '\n Unexpected Error Message: {0}\n CMD: {1}'.format(
+                    repr(e.message), self.cmd))
+
+        # Clean after yourself
+        self.del_test_dir(module_name, fname)
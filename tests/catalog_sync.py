@@ -0,0 +1,202 @@
+import unittest
+import os
+from .helpers.ptrack_helpers import ProbackupTest, ProbackupException
+
+
+module_name = 'catalog_sync'
+
+
+class CatalogSyncTest(ProbackupTest, unittest.TestCase):
+
+    # @unittest.expectedFailure
+    # @unittest.skip("skip")
+    def test_catalog_sync(self):
+        """
+        make FULL and PAGE backups, sync catalog, make another PAGE,
+        sync again, restore from the destination catalog
+        """
+        fname = self.id().split('.')[3]
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+        dst_backup_dir = os.path.join(
+            self.tmp_path, module_name, fname, 'dst_backup')
+        node = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node'),
+            set_replication=True,
+            initdb_params=['--data-checksums'])
+
+        self.init_pb(backup_dir)
+        self.add_instance(backup_dir, 'node', node)
+        self.set_archiving(backup_dir, 'node', node)
+        node.slow_start()
+
+        node.pgbench_init(scale=5)
+
+        self.backup_node(backup_dir, 'node', node)
+
+        pgbench = node.pgbench(options=['-T', '10', '-c', '2', '--no-vacuum'])
+        pgbench.wait()
+
+        self.backup_node(backup_dir, 'node', node, backup_type='page')
+
+        self.init_pb(dst_backup_dir)
+        self.run_pb([
+            'catalog-sync', '-B', backup_dir, '--instance=node',
+            '--dst-backup-path={0}'.format(dst_backup_dir), '-j', '4'])
+
+        self.assertEqual(
+            len(self.show_pb(dst_backup_dir, 'node')), 2)
+
+        pgbench = node.pgbench(options=['-T', '10', '-c', '2', '--no-vacuum'])
+        pgbench.wait()
+
+        self.backup_node(backup_dir, 'node', node, backup_type='page')
+
+        pgdata = self.pgdata_content(node.data_dir)
+
+        # Only the new backup is transferred
+        output = self.run_pb([
+            'catalog-sync', '-B', backup_dir, '--instance=node',
+            '--dst-backup-path={0}'.format(dst_backup_dir), '-j', '4'])
+
+        self.assertEqual(output.count('Syncing backup'), 1)
+
+        self.assertEqual(
+            len(self.show_pb(dst_backup_dir, 'node')), 3)
+
+        # Synced backups are valid
+        self.validate_pb(dst_backup_dir, 'node')
+
+        node.cleanup()
+        self.restore_node(dst_backup_dir, 'node', node)
+
+        pgdata_restored = self.pgdata_content(node.data_dir)
+        self.compare_pgdata(pgdata, pgdata_restored)
+
+        # Clean after yourself
+        self.del_test_dir(module_name, fname)
+
+    # @unittest.expectedFailure
+    # @unittest.skip("skip")
+    def test_catalog_sync_resend_corrupted(self):
+        """
+        corrupt file in the destination catalog and remove backup.control,
+        as if sync was interrupted, and check that only this file is sent
+        """
+        fname = self.id().split('.')[3]
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+        dst_backup_dir = os.path.join(
+            self.tmp_path, module_name, fname, 'dst_backup')
+        node = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node'),
+            set_replication=True,
+            initdb_params=['--data-checksums'])
+
+        self.init_pb(backup_dir)
+        self.add_instance(backup_dir, 'node', node)
+        node.slow_start()
+
+        node.pgbench_init(scale=1)
+
+        backup_id = self.backup_node(
+            backup_dir, 'node', node, options=['--stream'])
+
+        self.init_pb(dst_backup_dir)
+        self.run_pb([
+            'catalog-sync', '-B', backup_dir, '--instance=node',
+            '--dst-backup-path={0}'.format(dst_backup_dir)])
+
+        dst_backup_path = os.path.join(
+            dst_backup_dir, 'backups', 'node', backup_id)
+
+        os.remove(os.path.join(dst_backup_path, 'backup.control'))
+
+        file = os.path.join(dst_backup_path, 'database', 'postgresql.conf')
+        with open(file, "r+b", 0) as f:
+            f.seek(42)
+            f.write(b"blah")
+            f.flush()
+            f.close
+
+        output = self.run_pb([
+            'catalog-sync', '-B', backup_dir, '--instance=node',
+            '--dst-backup-path={0}'.format(dst_backup_dir),
+            '--log-level-console=verbose'])
+
+        self.assertIn('Syncing file', output)
+        self.assertEqual(output.count('is already synced'),
+            output.count('Syncing file') - 1)
+
+        self.validate_pb(dst_backup_dir, 'node')
+
+        # Clean after yourself
+        self.del_test_dir(module_name, fname)
+
+    # @unittest.expectedFailure
+    # @unittest.skip("skip")
+    def test_catalog_sync_dst_command(self):
+        """
+        upload backups and WAL with --dst-command, which stands in for
+        object storage, and restore from the uploaded files
+        """
+        fname = self.id().split('.')[3]
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+        bucket_dir = os.path.join(
+            self.tmp_path, module_name, fname, 'bucket')
+        node = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node'),
+            set_replication=True,
+            initdb_params=['--data-checksums'])
+
+        self.init_pb(backup_dir)
+        self.add_instance(backup_dir, 'node', node)
+        self.set_archiving(backup_dir, 'node', node)
+        node.slow_start()
+
+        node.pgbench_init(scale=1)
+
+        self.backup_node(backup_dir, 'node', node)
+
+        pgbench = node.pgbench(options=['-T', '5', '-c', '2', '--no-vacuum'])
+        pgbench.wait()
+
+        self.backup_node(backup_dir, 'node', node, backup_type='page')
+
+        pgdata = self.pgdata_content(node.data_dir)
+
+        dst_command = (
+            'mkdir -p "$(dirname "{0}/%f")" && '
+            'cp "%p" "{0}/%f"'.format(bucket_dir))
+
+        self.run_pb([
+            'catalog-sync', '-B', backup_dir, '--instance=node',
+            '--dst-command={0}'.format(dst_command), '-j', '4'])
+
+        self.assertTrue(os.path.isfile(os.path.join(
+            bucket_dir, 'backups', 'node', 'catalog_sync.manifest')))
+
+        # Nothing is uploaded again, the bucket is not listed
+        output = self.run_pb([
+            'catalog-sync', '-B', backup_dir, '--instance=node',
+            '--dst-command={0}'.format(dst_command)])
+
+        self.assertNotIn('Syncing backup', output)
+        self.assertIn('WAL files synced: 0', output)
+
+        # Uploaded files form a valid catalog
+        self.assertEqual(
+            len(self.show_pb(bucket_dir, 'node')), 2)
+        self.validate_pb(bucket_dir, 'node')
+
+        node.cleanup()
+        self.restore_node(bucket_dir, 'node', node)
+
+        pgdata_restored = self.pgdata_content(node.data_dir)
+        self.compare_pgdata(pgdata, pgdata_restored)
+
+        # Manifest does not prevent instance from being deleted
+        self.del_instance(backup_dir, 'node')
+        self.assertFalse(os.path.exists(
+            os.path.join(backup_dir, 'backups', 'node')))
+
+        # Clean after yourself
+        self.del_test_dir(module_name, fname)
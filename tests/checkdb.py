@@ -446,6 +446,92 @@ class CheckdbTest(ProbackupTest, unittest.TestCase):
         # Clean after yourself
         self.del_test_dir(module_name, fname)
 
+    # @unittest.skip("skip")
+    def test_checkdb_remote_block_validation(self):
+        """
+        make node, corrupt some pages, check that checkdb
+        running in remote mode reports corrupted blocks
+        """
+        if not self.remote:
+            return unittest.skip(
+                'Skipped because remote mode is disabled')
+
+        fname = self.id().split('.')[3]
+        node = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node'),
+            set_replication=True,
+            initdb_params=['--data-checksums'])
+
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+
+        self.init_pb(backup_dir)
+        self.add_instance(backup_dir, 'node', node)
+        node.slow_start()
+
+        node.safe_psql(
+            "postgres",
+            "create table t_heap as select 1 as id, md5(i::text) as text, "
+            "md5(repeat(i::text,10))::tsvector as tsvector "
+            "from generate_series(0,1000) i")
+        node.safe_psql(
+            "postgres",
+            "CHECKPOINT;")
+
+        heap_path = node.safe_psql(
+            "postgres",
+            "select pg_relation_filepath('t_heap')").rstrip()
+
+        remote_options = [
+            '-d', 'postgres', '-p', str(node.port),
+            '--remote-proto=ssh', '--remote-host=localhost',
+            '--log-level-console=verbose']
+
+        output = self.checkdb_node(
+            backup_dir, 'node', options=remote_options)
+
+        heap_full_path = os.path.join(node.data_dir, heap_path)
+
+        # pages must be checked by the agent, not read by checkdb itself
+        self.assertIn(
+            'Pages of file "{0}" are checked by remote agent'.format(
+                os.path.normpath(heap_full_path)),
+            output)
+
+        with open(heap_full_path, "rb+", 0) as f:
+                f.seek(9000)
+                f.write(b"bla")
+                f.flush()
+                f.close
+
+        try:
+            self.checkdb_node(
+                backup_dir, 'node', options=remote_options)
+            # we should die here because exception is what we expect to happen
+            self.assertEqual(
+                1, 0,
+                "Expecting Error because of data corruption\n"
+                " Output: {0} \n CMD: {1}".format(
+                    repr(self.output), self.cmd))
+        except ProbackupException as e:
+            self.assertIn(
+                "ERROR: Checkdb failed",
+                e.message,
+                "\n Unexpected Error Message: {0}\n CMD: {1}".format(
+                    repr(e.message), self.cmd))
+
+            self.assertIn(
+                'WARNING: Corruption detected in file "{0}", block 1'.format(
+                    os.path.normpath(heap_full_path)),
+                e.message)
+
+            self.assertIn(
+                'Pages of file "{0}" are checked by remote agent'.format(
+                    os.path.normpath(heap_full_path)),
+                e.message)
+
+        # Clean after yourself
+        self.del_test_dir(module_name, fname)
+
     # @unittest.skip("skip")
     def test_checkdb_sigint_handling(self):
         """"""
@@ -521,3 +521,73 @@ class CompressionTest(ProbackupTest, unittest.TestCase):
 
         # Clean after yourself
         self.del_test_dir(module_name, fname)
+
+    # @unittest.skip("skip")
+    def test_compress_location(self):
+        """
+        make full backup compressed on backup host and delta backup
+        with compress location chosen automatically,
+        check data correctness in restored instance
+        """
+        fname = self.id().split('.')[3]
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+        node = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node'),
+            set_replication=True,
+            initdb_params=['--data-checksums'])
+
+        self.init_pb(backup_dir)
+        self.add_instance(backup_dir, 'node', node)
+        node.slow_start()
+
+        node.pgbench_init(scale=3)
+
+        self.backup_node(
+            backup_dir, 'node', node,
+            options=[
+                '--stream', '-j', '2',
+                '--compress-algorithm=zlib',
+                '--compress-location=target'])
+
+        self.set_config(
+            backup_dir, 'node', options=['--compress-location=auto'])
+        self.assertEqual(
+            self.show_config(backup_dir, 'node')['compress-location'], 'auto')
+
+        pgbench = node.pgbench(options=['-T', '10', '-c', '2'])
+        pgbench.wait()
+
+        self.backup_node(
+            backup_dir, 'node', node, backup_type='delta',
+            options=['--stream', '-j', '2', '--compress-algorithm=zlib'])
+
+        pgdata = self.pgdata_content(node.data_dir)
+
+        node.cleanup()
+
+        self.restore_node(backup_dir, 'node', node)
+
+        pgdata_restored = self.pgdata_content(node.data_dir)
+        self.compare_pgdata(pgdata, pgdata_restored)
+
+        node.slow_start()
+
+        try:
+            self.backup_node(
+                backup_dir, 'node', node, backup_type='delta',
+                options=['--stream', '--compress-location=bla-blah'])
+            # we should die here because exception is what we expect to happen
+            self.assertEqual(
+                1, 0,
+                "Expecting Error because compress-location is invalid.\n "
+                "Output: {0} \n CMD: {1}".format(
+                    repr(self.output), self.cmd))
+        except ProbackupException as e:
+            self.assertEqual(
+                e.message,
+                'ERROR: invalid compress location value "bla-blah"\n',
+                '\n Unexpected Error Message: {0}\n CMD: {1}'.format(
+                    repr(e.message), self.cmd))
+
+        # Clean after yourself
+        self.del_test_dir(module_name, fname)
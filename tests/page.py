@@ -1112,6 +1112,136 @@ class PageTest(ProbackupTest, unittest.TestCase):
         # Clean after yourself
         self.del_test_dir(module_name, fname)
 
+    # @unittest.skip("skip")
+    def test_page_vm_fsm_forks(self):
+        """
+        Make node, take full backup, delete rows and vacuum the table,
+        take page backup, check that visibility map and free space map
+        are backed up block by block and restored correctly
+        """
+        fname = self.id().split('.')[3]
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+        node = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node'),
+            set_replication=True,
+            initdb_params=['--data-checksums'],
+            pg_options={'autovacuum': 'off'})
+
+        self.init_pb(backup_dir)
+        self.add_instance(backup_dir, 'node', node)
+        self.set_archiving(backup_dir, 'node', node)
+        node.slow_start()
+
+        node.safe_psql(
+            "postgres",
+            "create table t_heap as select i as id, md5(i::text) as text "
+            "from generate_series(0,100000) i")
+        node.safe_psql("postgres", "vacuum t_heap")
+
+        # FULL BACKUP
+        self.backup_node(backup_dir, 'node', node)
+
+        node.safe_psql("postgres", "delete from t_heap where id < 5000")
+        node.safe_psql("postgres", "vacuum t_heap")
+
+        # PAGE BACKUP
+        backup_id = self.backup_node(
+            backup_dir, 'node', node, backup_type='page')
+
+        if self.paranoia:
+            pgdata = self.pgdata_content(node.data_dir)
+
+        relpath = node.safe_psql(
+            "postgres",
+            "select pg_relation_filepath('t_heap')").rstrip()
+
+        filelist = self.get_backup_filelist(backup_dir, 'node', backup_id)
+        for fork in ['_vm', '_fsm']:
+            self.assertEqual(
+                filelist[relpath + fork]['is_datafile'], '1',
+                'File {0} is expected to be backed up as data file'.format(
+                    relpath + fork))
+
+        result = node.safe_psql("postgres", "select * from t_heap")
+
+        # RESTORE
+        node_restored = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node_restored'))
+        node_restored.cleanup()
+
+        self.restore_node(backup_dir, 'node', node_restored)
+
+        # COMPARE PHYSICAL CONTENT
+        if self.paranoia:
+            pgdata_restored = self.pgdata_content(node_restored.data_dir)
+            self.compare_pgdata(pgdata, pgdata_restored)
+
+        self.set_auto_conf(node_restored, {'port': node_restored.port})
+        node_restored.slow_start()
+
+        self.assertEqual(
+            result,
+            node_restored.safe_psql("postgres", "select * from t_heap"))
+
+        # Clean after yourself
+        self.del_test_dir(module_name, fname)
+
+    # @unittest.skip("skip")
+    def test_page_fsm_fork_corruption(self):
+        """
+        Make node, corrupt a page of free space map, check that backup
+        reports it with WARNING, copies it as is and is valid
+        """
+        fname = self.id().split('.')[3]
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+        node = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node'),
+            set_replication=True,
+            initdb_params=['--data-checksums'],
+            pg_options={'autovacuum': 'off'})
+
+        self.init_pb(backup_dir)
+        self.add_instance(backup_dir, 'node', node)
+        node.slow_start()
+
+        node.safe_psql(
+            "postgres",
+            "create table t_heap as select i as id, md5(i::text) as text "
+            "from generate_series(0,100000) i")
+        node.safe_psql("postgres", "vacuum t_heap")
+        node.safe_psql("postgres", "checkpoint")
+
+        relpath = node.safe_psql(
+            "postgres",
+            "select pg_relation_filepath('t_heap')").rstrip()
+
+        node.stop()
+
+        with open(os.path.join(node.data_dir, relpath + '_fsm'), "rb+", 0) as f:
+            f.seek(9000)
+            f.write(b"bla")
+            f.flush()
+            f.close
+
+        node.slow_start()
+
+        output = self.backup_node(
+            backup_dir, 'node', node,
+            options=['--stream'], return_id=False)
+
+        self.assertIn(
+            'WARNING: Invalid page in file "{0}", block 1, '
+            'it is copied as is'.format(
+                os.path.join(node.data_dir, relpath + '_fsm')),
+            output)
+
+        self.validate_pb(backup_dir, 'node')
+        self.assertEqual(
+            'OK', self.show_pb(backup_dir, 'node')[0]['status'])
+
+        # Clean after yourself
+        self.del_test_dir(module_name, fname)
+
     @unittest.skip("skip")
     # @unittest.expectedFailure
     def test_page_pg_resetxlog(self):
@@ -1091,6 +1091,50 @@ class ReplicaTest(ProbackupTest, unittest.TestCase):
         self.del_test_dir(module_name, fname)
 
 
+    # @unittest.skip("skip")
+    def test_backup_standby_hosts_checks(self):
+        """
+        Data files can be read only from standbys of the backed up
+        cluster and only in remote mode
+        """
+        fname = self.id().split('.')[3]
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+        master = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'master'),
+            set_replication=True,
+            initdb_params=['--data-checksums'])
+
+        self.init_pb(backup_dir)
+        self.add_instance(backup_dir, 'master', master)
+        master.slow_start()
+
+        if self.remote:
+            message = 'ERROR: Host "localhost" is not a standby'
+        else:
+            message = 'ERROR: --standby-hosts can be used only in remote mode'
+
+        try:
+            self.backup_node(
+                backup_dir, 'master', master,
+                options=[
+                    '--stream',
+                    '--standby-hosts=localhost:{0}'.format(master.port)])
+            # we should die here because exception is what we expect to happen
+            self.assertEqual(
+                1, 0,
+                "Expecting Error because master is not a standby.\n "
+                "Output: {0} \n CMD: {1}".format(
+                    repr(self.output), self.cmd))
+        except ProbackupException as e:
+            self.assertIn(
+                message, e.message,
+                '\n Unexpected Error Message: {0}\n CMD: {1}'.format(
+                    repr(e.message), self.cmd))
+
+        # Clean after yourself
+        self.del_test_dir(module_name, fname)
+
+
 # TODO:
 # null offset STOP LSN and latest record in previous segment is conrecord (manual only)
 # archiving from promoted delayed replica
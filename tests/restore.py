@@ -3376,4 +3376,224 @@ class RestoreTest(ProbackupTest, unittest.TestCase):
         self.assertEqual('2', timeline_id)
 
         # Clean after yourself
-        self.del_test_dir(module_name, fname)
\ No newline at end of file
+        self.del_test_dir(module_name, fname)
+    # @unittest.skip("skip")
+    def test_restore_extra_pgdata(self):
+        """
+        restore FULL and DELTA backups into two data directories
+        at once and check that both are equal to the original one
+        """
+        fname = self.id().split('.')[3]
+        node = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node'),
+            set_replication=True,
+            initdb_params=['--data-checksums'])
+
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+        self.init_pb(backup_dir)
+        self.add_instance(backup_dir, 'node', node)
+        node.slow_start()
+
+        node.pgbench_init(scale=5)
+
+        self.backup_node(
+            backup_dir, 'node', node,
+            options=['--stream', '--compress'])
+
+        pgbench = node.pgbench(options=['-T', '10', '-c', '2'])
+        pgbench.wait()
+
+        node.safe_psql(
+            'postgres',
+            'delete from pgbench_accounts where aid < 1000; '
+            'vacuum pgbench_accounts')
+
+        self.backup_node(
+            backup_dir, 'node', node, backup_type='delta',
+            options=['--stream', '--compress'])
+
+        pgdata = self.pgdata_content(node.data_dir)
+
+        node_restored = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node_restored'))
+        node_restored.cleanup()
+
+        node_extra = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node_extra'))
+        node_extra.cleanup()
+
+        self.restore_node(
+            backup_dir, 'node', node_restored,
+            options=[
+                '-j', '4',
+                '--extra-pgdata={0}'.format(node_extra.data_dir)])
+
+        pgdata_restored = self.pgdata_content(node_restored.data_dir)
+        self.compare_pgdata(pgdata, pgdata_restored)
+
+        pgdata_extra = self.pgdata_content(node_extra.data_dir)
+        self.compare_pgdata(pgdata, pgdata_extra)
+
+        self.set_auto_conf(node_extra, {'port': node_extra.port})
+        node_extra.slow_start()
+
+        node_extra.safe_psql(
+            'postgres',
+            'select count(*) from pgbench_accounts')
+
+        # Clean after yourself
+        self.del_test_dir(module_name, fname)
+
+    # @unittest.skip("skip")
+    @unittest.skipUnless(sys.platform.startswith('linux'), 'skip')
+    def test_restore_clone_files(self):
+        """
+        restore uncompressed FULL and DELTA backups into data directory
+        on the same file system as backup catalog, files must be cloned
+        """
+        fname = self.id().split('.')[3]
+        node = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node'),
+            set_replication=True,
+            initdb_params=['--data-checksums'])
+
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+        self.init_pb(backup_dir)
+        self.add_instance(backup_dir, 'node', node)
+        node.slow_start()
+
+        node.pgbench_init(scale=5)
+
+        self.backup_node(backup_dir, 'node', node, options=['--stream'])
+
+        pgbench = node.pgbench(options=['-T', '10', '-c', '2'])
+        pgbench.wait()
+
+        node.safe_psql(
+            'postgres',
+            'delete from pgbench_accounts where aid < 1000; '
+            'vacuum pgbench_accounts')
+
+        backup_id = self.backup_node(
+            backup_dir, 'node', node, backup_type='delta',
+            options=['--stream'])
+
+        pgdata = self.pgdata_content(node.data_dir)
+
+        node_restored = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node_restored'))
+        node_restored.cleanup()
+
+        self.restore_node(
+            backup_dir, 'node', node_restored,
+            options=['-j', '4', '--log-level-file=LOG'])
+
+        with open(os.path.join(backup_dir, 'log', 'pg_probackup.log')) as f:
+            log_content = f.read()
+            self.assertIn(
+                'files of backup {0} are cloned'.format(backup_id),
+                log_content)
+
+        pgdata_restored = self.pgdata_content(node_restored.data_dir)
+        self.compare_pgdata(pgdata, pgdata_restored)
+
+        self.set_auto_conf(node_restored, {'port': node_restored.port})
+        node_restored.slow_start()
+
+        node_restored.safe_psql(
+            'postgres',
+            'select count(*) from pgbench_accounts')
+
+        # Clean after yourself
+        self.del_test_dir(module_name, fname)
+
+    # @unittest.skip("skip")
+    def test_restore_extra_pgdata_tablespace(self):
+        """
+        restore backup with tablespace into two data directories
+        at once, relocating tablespace of each of them separately
+        """
+        fname = self.id().split('.')[3]
+        node = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node'),
+            set_replication=True,
+            initdb_params=['--data-checksums'])
+
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+        self.init_pb(backup_dir)
+        self.add_instance(backup_dir, 'node', node)
+        node.slow_start()
+
+        self.create_tblspace_in_node(node, 'tblspc')
+        tblspc_path = self.get_tblspace_path(node, 'tblspc')
+
+        node.safe_psql(
+            'postgres',
+            'create table t_heap tablespace tblspc as select i as id, '
+            'md5(i::text) as text from generate_series(0,10000) i')
+
+        self.backup_node(
+            backup_dir, 'node', node, options=['--stream'])
+
+        pgdata = self.pgdata_content(node.data_dir)
+
+        node_restored = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node_restored'))
+        node_restored.cleanup()
+
+        node_extra = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node_extra'))
+        node_extra.cleanup()
+
+        tblspc_restored = os.path.join(node_restored.base_dir, 'tblspc')
+        tblspc_extra = os.path.join(node_extra.base_dir, 'tblspc')
+
+        # tablespace of both data directories cannot be the same
+        try:
+            self.restore_node(
+                backup_dir, 'node', node_restored,
+                options=[
+                    '-T', '{0}={1}'.format(tblspc_path, tblspc_restored),
+                    '--extra-pgdata={0},{1}={2}'.format(
+                        node_extra.data_dir, tblspc_path, tblspc_restored)])
+            # we should die here because exception is what we expect to happen
+            self.assertEqual(
+                1, 0,
+                "Expecting Error because tablespace is restored twice "
+                "into the same directory.\n Output: {0} \n CMD: {1}".format(
+                    repr(self.output), self.cmd))
+        except ProbackupException as e:
+            self.assertIn(
+                'ERROR: Tablespace directory "{0}" is restored into'.format(
+                    tblspc_restored),
+                e.message,
+                '\n Unexpected Error Message: {0}\n CMD: {1}'.format(
+                    repr(e.message), self.cmd))
+
+        self.restore_node(
+            backup_dir, 'node', node_restored,
+            options=[
+                '-j', '4',
+                '-T', '{0}={1}'.format(tblspc_path, tblspc_restored),
+                '--extra-pgdata={0},{1}={2}'.format(
+                    node_extra.data_dir, tblspc_path, tblspc_extra)])
+
+        pgdata_restored = self.pgdata_content(node_restored.data_dir)
+        self.compare_pgdata(pgdata, pgdata_restored)
+
+        pgdata_extra = self.pgdata_content(node_extra.data_dir)
+        self.compare_pgdata(pgdata, pgdata_extra)
+
+        self.assertTrue(os.listdir(tblspc_restored))
+        self.assertTrue(os.listdir(tblspc_extra))
+
+        self.set_auto_conf(node_extra, {'port': node_extra.port})
+        node_extra.slow_start()
+
+        result = node_extra.safe_psql(
+            'postgres',
+            'select count(*) from t_heap').rstrip()
+        self.assertEqual(result, b'10001')
+
+        # Clean after yourself
+        self.del_test_dir(module_name, fname)
@@ -3539,6 +3539,98 @@ class ValidateTest(ProbackupTest, unittest.TestCase):
         # Clean after yourself
         self.del_test_dir(module_name, fname)
 
+    # @unittest.skip("skip")
+    def test_validate_wal_archive(self):
+        """
+        Check that validate --wal reads every segment of WAL archive,
+        skips already validated segments and detects corrupted ones
+        """
+        fname = self.id().split('.')[3]
+        backup_dir = os.path.join(self.tmp_path, module_name, fname, 'backup')
+        node = self.make_simple_node(
+            base_dir=os.path.join(module_name, fname, 'node'),
+            set_replication=True,
+            initdb_params=['--data-checksums'])
+
+        self.init_pb(backup_dir)
+        self.add_instance(backup_dir, 'node', node)
+        self.set_archiving(backup_dir, 'node', node)
+        node.slow_start()
+
+        for i in range(3):
+            node.pgbench_init(scale=2)
+            self.switch_wal_segment(node)
+
+        output = self.validate_pb(backup_dir, 'node', options=['--wal', '-j2'])
+        self.assertIn('WAL archive is valid', output)
+        self.assertIn(' 0 skipped as already validated, 0 corrupted', output)
+
+        self.assertTrue(os.path.isfile(os.path.join(
+            backup_dir, 'backups', 'node', 'wal_validation.cache')))
+
+        # Nothing is read again
+        output = self.validate_pb(backup_dir, 'node', options=['--wal'])
+        self.assertIn('WAL archive is valid', output)
+        self.assertNotIn(' 0 skipped as already validated', output)
+
+        # Corrupt a segment in the middle of the archive
+        wals_dir = os.path.join(backup_dir, 'wal', 'node')
+        wals = sorted(
+            f for f in os.listdir(wals_dir)
+            if os.path.isfile(os.path.join(wals_dir, f)) and
+            not f.endswith('.backup') and not f.endswith('.partial') and
+            not f.endswith('.history'))
+        wal_name = wals[len(wals) // 2]
+        wal_file = os.path.join(wals_dir, wal_name)
+
+        with open(wal_file, 'r+b', 0) as f:
+            f.seek(8192 * 10)
+            f.write(b"blablablaadssaaaaaaaaaaaaaaa")
+            f.flush()
+
+        try:
+            self.validate_pb(backup_dir, 'node', options=['--wal'])
+            self.assertEqual(
+                1, 0,
+                "Expecting Error because of WAL corruption.\n "
+                "Output: {0} \n CMD: {1}".format(
+                    repr(self.output), self.cmd))
+        except ProbackupException as e:
+            self.assertIn(
+                'WARNING: WAL segment "{0}" is corrupted'.format(wal_name),
+                e.message,
+                '\n Unexpected Error Message: {0}\n CMD: {1}'.format(
+                    repr(e.message), self.cmd))
+            self.assertIn(
+                'WARNING: WAL archive is not valid', e.message,
+                '\n Unexpected Error Message: {0}\n CMD: {1}'.format(
+                    repr(e.message), self.cmd))
+
+        # --wal cannot be used with backup ID
+        try:
+            self.validate_pb(
+                backup_dir, 'node', backup_id='QWERTY', options=['--wal'])
+            self.assertEqual(
+                1, 0,
+                "Expecting Error because of incompatible options.\n "
+                "Output: {0} \n CMD: {1}".format(
+                    repr(self.output), self.cmd))
+        except ProbackupException as e:
+            self.assertIn(
+                'ERROR: You cannot specify --wal with backup ID '
+                'or recovery target', e.message,
+                '\n Unexpected Error Message: {0}\n CMD: {1}'.format(
+                    repr(e.message), self.cmd))
+
+        # Cache does not prevent instance from being deleted
+        node.stop()
+        self.del_instance(backup_dir, 'node')
+        self.assertFalse(os.path.exists(
+            os.path.join(backup_dir, 'backups', 'node')))
+
+        # Clean after yourself
+        self.del_test_dir(module_name, fname)
+
     # @unittest.expectedFailure
     # @unittest.skip("skip")
     def test_recovery_target_time_backup_victim(self):